@@ -0,0 +1,352 @@
+#include "ActionMap.h"
+#include "InputMgr.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include <cctype>
+#include <cstring>
+#include <string>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	struct KeyName
+	{
+		const char *name;
+		eKeyCodes key;
+	};
+
+	// eKeyCodes without KEY_
+	static const KeyName s_keyNames[] =
+	{
+		{ "LBUTTON", eKeyCodes::KEY_LBUTTON },
+		{ "RBUTTON", eKeyCodes::KEY_RBUTTON },
+		{ "CANCEL", eKeyCodes::KEY_CANCEL },
+		{ "MBUTTON", eKeyCodes::KEY_MBUTTON },
+		{ "XBUTTON1", eKeyCodes::KEY_XBUTTON1 },
+		{ "XBUTTON2", eKeyCodes::KEY_XBUTTON2 },
+		{ "BACK", eKeyCodes::KEY_BACK },
+		{ "TAB", eKeyCodes::KEY_TAB },
+		{ "CLEAR", eKeyCodes::KEY_CLEAR },
+		{ "RETURN", eKeyCodes::KEY_RETURN },
+		{ "SHIFT", eKeyCodes::KEY_SHIFT },
+		{ "CONTROL", eKeyCodes::KEY_CONTROL },
+		{ "ALT", eKeyCodes::KEY_ALT },
+		{ "PAUSE", eKeyCodes::KEY_PAUSE },
+		{ "CAPITAL", eKeyCodes::KEY_CAPITAL },
+		{ "KANA", eKeyCodes::KEY_KANA },
+		{ "HANGUEL", eKeyCodes::KEY_HANGUEL },
+		{ "HANGUL", eKeyCodes::KEY_HANGUL },
+		{ "JUNJA", eKeyCodes::KEY_JUNJA },
+		{ "FINAL", eKeyCodes::KEY_FINAL },
+		{ "HANJA", eKeyCodes::KEY_HANJA },
+		{ "KANJI", eKeyCodes::KEY_KANJI },
+		{ "ESCAPE", eKeyCodes::KEY_ESCAPE },
+		{ "SPACE", eKeyCodes::KEY_SPACE },
+		{ "PAGEUP", eKeyCodes::KEY_PAGEUP },
+		{ "PAGEDOWN", eKeyCodes::KEY_PAGEDOWN },
+		{ "END", eKeyCodes::KEY_END },
+		{ "HOME", eKeyCodes::KEY_HOME },
+		{ "LEFT", eKeyCodes::KEY_LEFT },
+		{ "UP", eKeyCodes::KEY_UP },
+		{ "RIGHT", eKeyCodes::KEY_RIGHT },
+		{ "DOWN", eKeyCodes::KEY_DOWN },
+		{ "SELECT", eKeyCodes::KEY_SELECT },
+		{ "EXE", eKeyCodes::KEY_EXE },
+		{ "SNAPSHOT", eKeyCodes::KEY_SNAPSHOT },
+		{ "INSERT", eKeyCodes::KEY_INSERT },
+		{ "DELETE", eKeyCodes::KEY_DELETE },
+		{ "HELP", eKeyCodes::KEY_HELP },
+		{ "0", eKeyCodes::KEY_0 },
+		{ "1", eKeyCodes::KEY_1 },
+		{ "2", eKeyCodes::KEY_2 },
+		{ "3", eKeyCodes::KEY_3 },
+		{ "4", eKeyCodes::KEY_4 },
+		{ "5", eKeyCodes::KEY_5 },
+		{ "6", eKeyCodes::KEY_6 },
+		{ "7", eKeyCodes::KEY_7 },
+		{ "8", eKeyCodes::KEY_8 },
+		{ "9", eKeyCodes::KEY_9 },
+		{ "A", eKeyCodes::KEY_A },
+		{ "B", eKeyCodes::KEY_B },
+		{ "C", eKeyCodes::KEY_C },
+		{ "D", eKeyCodes::KEY_D },
+		{ "E", eKeyCodes::KEY_E },
+		{ "F", eKeyCodes::KEY_F },
+		{ "G", eKeyCodes::KEY_G },
+		{ "H", eKeyCodes::KEY_H },
+		{ "I", eKeyCodes::KEY_I },
+		{ "J", eKeyCodes::KEY_J },
+		{ "K", eKeyCodes::KEY_K },
+		{ "L", eKeyCodes::KEY_L },
+		{ "M", eKeyCodes::KEY_M },
+		{ "N", eKeyCodes::KEY_N },
+		{ "O", eKeyCodes::KEY_O },
+		{ "P", eKeyCodes::KEY_P },
+		{ "Q", eKeyCodes::KEY_Q },
+		{ "R", eKeyCodes::KEY_R },
+		{ "S", eKeyCodes::KEY_S },
+		{ "T", eKeyCodes::KEY_T },
+		{ "U", eKeyCodes::KEY_U },
+		{ "V", eKeyCodes::KEY_V },
+		{ "W", eKeyCodes::KEY_W },
+		{ "X", eKeyCodes::KEY_X },
+		{ "Y", eKeyCodes::KEY_Y },
+		{ "Z", eKeyCodes::KEY_Z },
+		{ "WINLEFT", eKeyCodes::KEY_WINLEFT },
+		{ "WINRIGHT", eKeyCodes::KEY_WINRIGHT },
+		{ "APPS", eKeyCodes::KEY_APPS },
+		{ "NUMPAD0", eKeyCodes::KEY_NUMPAD0 },
+		{ "NUMPAD1", eKeyCodes::KEY_NUMPAD1 },
+		{ "NUMPAD2", eKeyCodes::KEY_NUMPAD2 },
+		{ "NUMPAD3", eKeyCodes::KEY_NUMPAD3 },
+		{ "NUMPAD4", eKeyCodes::KEY_NUMPAD4 },
+		{ "NUMPAD5", eKeyCodes::KEY_NUMPAD5 },
+		{ "NUMPAD6", eKeyCodes::KEY_NUMPAD6 },
+		{ "NUMPAD7", eKeyCodes::KEY_NUMPAD7 },
+		{ "NUMPAD8", eKeyCodes::KEY_NUMPAD8 },
+		{ "NUMPAD9", eKeyCodes::KEY_NUMPAD9 },
+		{ "MULTIPLY", eKeyCodes::KEY_MULTIPLY },
+		{ "ADD", eKeyCodes::KEY_ADD },
+		{ "SEPARATOR", eKeyCodes::KEY_SEPARATOR },
+		{ "SUBTRACT", eKeyCodes::KEY_SUBTRACT },
+		{ "DECIMAL", eKeyCodes::KEY_DECIMAL },
+		{ "DIVIDE", eKeyCodes::KEY_DIVIDE },
+		{ "F1", eKeyCodes::KEY_F1 },
+		{ "F2", eKeyCodes::KEY_F2 },
+		{ "F3", eKeyCodes::KEY_F3 },
+		{ "F4", eKeyCodes::KEY_F4 },
+		{ "F5", eKeyCodes::KEY_F5 },
+		{ "F6", eKeyCodes::KEY_F6 },
+		{ "F7", eKeyCodes::KEY_F7 },
+		{ "F8", eKeyCodes::KEY_F8 },
+		{ "F9", eKeyCodes::KEY_F9 },
+		{ "F10", eKeyCodes::KEY_F10 },
+		{ "F11", eKeyCodes::KEY_F11 },
+		{ "F12", eKeyCodes::KEY_F12 },
+		{ "F13", eKeyCodes::KEY_F13 },
+		{ "F14", eKeyCodes::KEY_F14 },
+		{ "F15", eKeyCodes::KEY_F15 },
+		{ "F16", eKeyCodes::KEY_F16 },
+		{ "F17", eKeyCodes::KEY_F17 },
+		{ "F18", eKeyCodes::KEY_F18 },
+		{ "F19", eKeyCodes::KEY_F19 },
+		{ "F20", eKeyCodes::KEY_F20 },
+		{ "F21", eKeyCodes::KEY_F21 },
+		{ "F22", eKeyCodes::KEY_F22 },
+		{ "F23", eKeyCodes::KEY_F23 },
+		{ "F24", eKeyCodes::KEY_F24 },
+		{ "NUMLOCK", eKeyCodes::KEY_NUMLOCK },
+		{ "SCROLL", eKeyCodes::KEY_SCROLL },
+		{ "LSHIFT", eKeyCodes::KEY_LSHIFT },
+		{ "RSHIFT", eKeyCodes::KEY_RSHIFT },
+		{ "LCONTROL", eKeyCodes::KEY_LCONTROL },
+		{ "RCONTROL", eKeyCodes::KEY_RCONTROL },
+		{ "LALT", eKeyCodes::KEY_LALT },
+		{ "RALT", eKeyCodes::KEY_RALT },
+		{ "PLUS", eKeyCodes::KEY_PLUS },
+		{ "COMMA", eKeyCodes::KEY_COMMA },
+		{ "MINUS", eKeyCodes::KEY_MINUS },
+		{ "PERIOD", eKeyCodes::KEY_PERIOD },
+		{ "EXPONENT", eKeyCodes::KEY_EXPONENT },
+		{ "ATTN", eKeyCodes::KEY_ATTN },
+		{ "CRSEL", eKeyCodes::KEY_CRSEL },
+		{ "EXSEL", eKeyCodes::KEY_EXSEL },
+		{ "EREOF", eKeyCodes::KEY_EREOF },
+		{ "PLAY", eKeyCodes::KEY_PLAY },
+		{ "ZOOM", eKeyCodes::KEY_ZOOM },
+		{ "NONAME", eKeyCodes::KEY_NONAME },
+		{ "PA1", eKeyCodes::KEY_PA1 },
+		{ "OEMCLEAR", eKeyCodes::KEY_OEMCLEAR },
+	};
+
+	static const char *const s_buttonNames[MOUSE_MAX] = { "MOUSE_LEFT", "MOUSE_MIDDLE", "MOUSE_RIGHT" };
+
+	static bool s_equal(const char *a, const char *b)
+	{
+		for (; *a && *b; a++, b++)
+			if (toupper(static_cast<unsigned char>(*a)) != toupper(static_cast<unsigned char>(*b)))
+				return false;
+		return *a == *b;
+	}
+
+	static bool s_startsWith(const char *text, const char *prefix)
+	{
+		for (; *prefix; text++, prefix++)
+			if (toupper(static_cast<unsigned char>(*text)) != *prefix)
+				return false;
+		return true;
+	}
+
+	// Bit of a key or button name, -1 if it is none
+	static int s_inputBit(const char *name)
+	{
+		// KEY_Z as well as Z
+		if (s_startsWith(name, "KEY_"))
+			name += 4;
+		for (size_t i = 0; i < sizeof(s_keyNames) / sizeof(s_keyNames[0]); i++)
+			if (s_equal(name, s_keyNames[i].name))
+				return static_cast<int>(s_keyNames[i].key) & 0xFF;
+		for (int b = 0; b < MOUSE_MAX; b++)
+			if (s_equal(name, s_buttonNames[b]))
+				return 256 + b;
+		return -1;
+	}
+
+//------------------------------------------------------------------
+
+	ActionMap::ActionMap(const char *const *names, unsigned count) : m_names(names), m_count(count < MaxActions ? count : MaxActions)
+	{
+		Clear();
+	}
+
+	void ActionMap::Clear()
+	{
+		memset(m_table, 0, sizeof(m_table));
+		m_bound.clear();
+	}
+
+	void ActionMap::m_bind(unsigned action, unsigned bit)
+	{
+		if (!m_table[bit])
+		{
+			// keep m_bound in table order
+			size_t at = 0;
+			while (at < m_bound.size() && m_bound[at] < bit)
+				at++;
+			m_bound.insert(m_bound.begin() + at, static_cast<unsigned short>(bit));
+		}
+		m_table[bit] |= 1u << action;
+	}
+
+	bool ActionMap::Bind(unsigned action, eKeyCodes key)
+	{
+		if (action >= m_count)
+			return false;
+		m_bind(action, static_cast<unsigned>(key) & 0xFF);
+		return true;
+	}
+
+	bool ActionMap::Bind(unsigned action, eMouseKeyCodes button)
+	{
+		if (action >= m_count || button >= MOUSE_MAX)
+			return false;
+		m_bind(action, KeyBits + button);
+		return true;
+	}
+
+	int ActionMap::Find(const char *name) const
+	{
+		for (unsigned i = 0; i < m_count; i++)
+			if (s_equal(name, m_names[i]))
+				return static_cast<int>(i);
+		return -1;
+	}
+
+//------------------------------------------------------------------
+
+	unsigned ActionMap::Parse(const char *text)
+	{
+		unsigned errors = 0;
+		int lineNumber = 0;
+		while (*text)
+		{
+			const char *end = strchr(text, '\n');
+			if (!end)
+				end = text + strlen(text);
+			std::string line(text, end);
+			text = *end ? end + 1 : end;
+			lineNumber++;
+
+			const size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.erase(comment);
+			// words, with the = as one of its own
+			std::vector<std::string> words;
+			for (size_t i = 0; i < line.size(); )
+			{
+				const char c = line[i];
+				if (isspace(static_cast<unsigned char>(c)) || c == ',')
+					i++;
+				else if (c == '=')
+				{
+					words.push_back("=");
+					i++;
+				}
+				else
+				{
+					const size_t start = i;
+					while (i < line.size() && !isspace(static_cast<unsigned char>(line[i])) && line[i] != '=' && line[i] != ',')
+						i++;
+					words.push_back(line.substr(start, i - start));
+				}
+			}
+			if (words.empty())
+				continue;
+
+			const int action = words.size() >= 3 && words[1] == "=" ? Find(words[0].c_str()) : -1;
+			bool bad = action < 0;
+			for (size_t w = 2; action >= 0 && w < words.size(); w++)
+			{
+				const int bit = s_inputBit(words[w].c_str());
+				if (bit < 0)
+				{
+					if (Log::Get())
+						Log::Get()->Err("Bindings line %d: no key or button %s", lineNumber, words[w].c_str());
+					bad = true;
+				}
+				else
+					m_bind(static_cast<unsigned>(action), static_cast<unsigned>(bit));
+			}
+			if (action < 0 && Log::Get())
+				Log::Get()->Err("Bindings line %d: expected \"action = keys\" with a known action", lineNumber);
+			if (bad)
+				errors++;
+		}
+		return errors;
+	}
+
+	bool ActionMap::Load(const char *path)
+	{
+		std::vector<unsigned char> data;
+		if (!LoadFile(path, data))
+		{
+			if (Log::Get())
+				Log::Get()->Err("Bindings %s cannot be read", path);
+			return false;
+		}
+		const std::string text(data.begin(), data.end());
+		const unsigned errors = Parse(text.c_str());
+		if (errors > 0 && Log::Get())
+			Log::Get()->Err("Bindings %s: %u bad lines", path, errors);
+		return errors == 0;
+	}
+
+//------------------------------------------------------------------
+
+	unsigned ActionMap::Held(const InputMgr &input) const
+	{
+		unsigned held = 0;
+		for (size_t i = 0; i < m_bound.size(); i++)
+		{
+			const unsigned bit = m_bound[i];
+			if (bit < KeyBits ? input.IsDown(static_cast<eKeyCodes>(bit)) : input.IsDown(static_cast<eMouseKeyCodes>(bit - KeyBits)))
+				held |= m_table[bit];
+		}
+		return held;
+	}
+
+	unsigned ActionMap::Pressed(const InputMgr &input) const
+	{
+		unsigned pressed = 0;
+		for (size_t i = 0; i < m_bound.size(); i++)
+		{
+			const unsigned bit = m_bound[i];
+			if (bit < KeyBits ? input.WasPressedThisFrame(static_cast<eKeyCodes>(bit)) : input.WasPressedThisFrame(static_cast<eMouseKeyCodes>(bit - KeyBits)))
+				pressed |= m_table[bit];
+		}
+		return pressed;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "InputCodes.h"
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class InputMgr;
+
+	// Binds keys and mouse buttons to the actions of an application, read
+	// from lines like
+	//
+	//     # action = keys and buttons
+	//     scale_up = Z ADD
+	//     recenter = SPACE MOUSE_MIDDLE
+	//
+	// Key names are those of eKeyCodes without KEY_, buttons those of
+	// eMouseKeyCodes. The bindings are compiled to a table of the actions
+	// of every key and button, so a frame finds the actions held with a bit
+	// test for each bound key instead of following the key events.
+	class ActionMap
+	{
+	public:
+		// Actions are bits of an unsigned
+		static const unsigned MaxActions = 32;
+
+		// names[i] is how the bindings call action i. The names must live
+		// as long as the map.
+		ActionMap(const char *const *names, unsigned count);
+
+		void Clear();
+		bool Bind(unsigned action, eKeyCodes key);
+		bool Bind(unsigned action, eMouseKeyCodes button);
+
+		// Adds the bindings of text. Lines it cannot read are logged and
+		// skipped; returns how many there were.
+		unsigned Parse(const char *text);
+		// Parse of a file, false if it cannot be read or has lines Parse
+		// cannot read; the lines it can read are bound either way
+		bool Load(const char *path);
+
+		// Bit i set if action i is held, i.e. any of its keys is down
+		unsigned Held(const InputMgr &input) const;
+		// Bit i set if one of the keys of action i went down this frame
+		unsigned Pressed(const InputMgr &input) const;
+
+		// The compiled table: actions of a key or button
+		unsigned Actions(eKeyCodes key) const { return m_table[static_cast<unsigned>(key) & 0xFF]; }
+		unsigned Actions(eMouseKeyCodes button) const { return m_table[KeyBits + button]; }
+
+		// Action of a name, -1 if there is none
+		int Find(const char *name) const;
+
+	private:
+		static const unsigned KeyBits = 256;
+
+		void m_bind(unsigned action, unsigned bit);
+
+		const char *const *m_names;
+		unsigned m_count;
+		unsigned m_table[KeyBits + MOUSE_MAX];
+		// keys and buttons with any action, in the order of the table
+		std::vector<unsigned short> m_bound;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,3796 @@
+#include "Benchmark.h"
+#include "Clock.h"
+#include "Simd.h"
+#include "ColorConvert.h"
+#include "Undistort.h"
+#include "ThreadPool.h"
+#include "CameraThread.h"
+#include "Capture.h"
+#include "HmdDevice.h"
+#include "RenderDevice.h"
+#include "FrameLoop.h"
+#include "SoftwareRenderDevice.h"
+#include "Hash.h"
+#include "TransformBatch.h"
+#include "SceneBvh.h"
+#include "PoseHistory.h"
+#include "CameraReprojection.h"
+#include "Log.h"
+#include "InputMgr.h"
+#include "InputListener.h"
+#include "InputRecorder.h"
+#include "ImageDecode.h"
+#include "ImageEncode.h"
+#include "MipChain.h"
+#include "TextureStreamer.h"
+#include "BlockCompress.h"
+#include "TextureCache.h"
+#include "TextureAtlas.h"
+#include "ShaderCache.h"
+#include "StartupGraph.h"
+#include "MappedFile.h"
+#include "MyInput.h"
+#include <OVR.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <list>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Arguments after the benchmark name
+	static int s_argc = 0;
+	static char **s_argv = nullptr;
+
+	static bool s_writeFile(const char *path, const std::vector<unsigned char> &data)
+	{
+		FILE *file = fopen(path, "wb");
+		if (!file)
+			return false;
+		const bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+		return fclose(file) == 0 && ok;
+	}
+
+	// Camera stand-in of the camera benchmark: a given number of frames at
+	// a fixed rate, or as fast as possible. Every byte of an eye image is
+	// derived from the frame's sequence number, so a reader can tell a
+	// frame that was written to while it read it.
+	class PacedCameraSource : public CameraSource
+	{
+	public:
+		PacedCameraSource(int width, int height, double fps, unsigned long long frames) :
+			m_width(width), m_height(height), m_period(fps > 0.0 ? 1.0 / fps : 0.0), m_frames(frames), m_next(0.0), m_sequence(0) {}
+
+		bool Grab(CameraFrame &frame)
+		{
+			if (m_sequence >= m_frames)
+				return false;
+			if (m_period > 0.0)
+			{
+				const double now = Clock::Now();
+				if (m_next == 0.0)
+					m_next = now;
+				Clock::Sleep(m_next - now);
+				m_next += m_period;
+			}
+			frame.Allocate(m_width, m_height, PIXEL_RGBA32);
+			frame.sequence = ++m_sequence;
+			for (int e = 0; e < 2; e++)
+				memset(&frame.eye[e][0], Value(frame.sequence, e), frame.eye[e].size());
+			frame.captureTime = Clock::Now();
+			return true;
+		}
+
+		static unsigned char Value(unsigned long long sequence, int eye) { return static_cast<unsigned char>(sequence * 37 + eye * 101); }
+
+	private:
+		int m_width;
+		int m_height;
+		double m_period;
+		unsigned long long m_frames;
+		double m_next;
+		unsigned long long m_sequence;
+	};
+
+	// What the render side of the camera benchmark saw
+	struct CameraReadout
+	{
+		unsigned long long delivered;
+		unsigned long long skipped;
+		unsigned long long torn;
+		unsigned long long outOfOrder;
+		double latencySum;
+		double latencyMax;
+	};
+
+	// Takes the newest frame if there is one and checks it whole
+	static void s_readCamera(CameraThread &camera, unsigned long long &last, CameraReadout &out)
+	{
+		bool isNew = false;
+		const CameraFrame *frame = camera.Latest(&isNew);
+		if (!frame || !isNew)
+			return;
+		const double latency = Clock::Now() - frame->captureTime;
+		out.delivered++;
+		out.latencySum += latency;
+		out.latencyMax = std::max(out.latencyMax, latency);
+		if (frame->sequence <= last)
+			out.outOfOrder++;
+		else
+			out.skipped += frame->sequence - last - 1;
+		last = frame->sequence;
+		for (int e = 0; e < 2; e++)
+		{
+			const unsigned char value = PacedCameraSource::Value(frame->sequence, e);
+			const std::vector<unsigned char> &image = frame->eye[e];
+			size_t i = 0;
+			while (i < image.size() && image[i] == value)
+				i++;
+			if (i < image.size())
+			{
+				out.torn++;
+				break;
+			}
+		}
+	}
+
+	// The capture thread and its triple buffer with a VGA camera stand-in:
+	// at 60 fps read by a render loop at 75 Hz and at 30 Hz, then frames as
+	// fast as they can be made read as fast as possible. Every frame the
+	// capture thread published has to be either delivered or counted as
+	// dropped, in order and never torn. Reports the frame rates and the
+	// latency from capture to the render side picking a frame up. Last, a
+	// source that runs out and the thread started again on a second one.
+	// Arguments: [seconds per run]
+	static bool s_camera()
+	{
+		const double seconds = s_argc > 0 ? atof(s_argv[0]) : 2.0;
+		const int width = 640;
+		const int height = 480;
+		bool ok = true;
+		if (seconds <= 0.0)
+		{
+			printf("camera: seconds must be positive\n");
+			return false;
+		}
+
+		printf("camera: capture thread and triple buffer, %dx%d RGBA both eyes\n", width, height);
+		// readerHz 0 reads as fast as possible
+		auto run = [&](const char *name, double fps, double readerHz) {
+			const unsigned long long frames = fps > 0.0 ? static_cast<unsigned long long>(seconds * fps) : ~0ULL;
+			PacedCameraSource source(width, height, fps, frames);
+			CameraThread camera;
+			CameraReadout readout = {};
+			unsigned long long last = 0;
+			const double start = Clock::Now();
+			camera.Start(&source);
+			double next = start;
+			while (fps > 0.0 ? camera.Captured() < frames : Clock::Now() - start < seconds)
+			{
+				s_readCamera(camera, last, readout);
+				if (readerHz > 0.0)
+				{
+					next += 1.0 / readerHz;
+					Clock::Sleep(next - Clock::Now());
+				}
+				else
+					std::this_thread::yield();
+			}
+			camera.Stop();
+			const double elapsed = Clock::Now() - start;
+			// the last frame published may still be waiting
+			s_readCamera(camera, last, readout);
+
+			const unsigned long long captured = camera.Captured();
+			const unsigned long long dropped = camera.Dropped();
+			const double meanLatency = readout.delivered > 0 ? readout.latencySum / readout.delivered : 0.0;
+			// picked up within the reader's period, with room for the scheduler
+			const double latencyBound = readerHz > 0.0 ? 2.0 / readerHz : 0.05;
+			const bool match = captured > 0 && readout.delivered + dropped == captured && readout.skipped == dropped &&
+				readout.torn == 0 && readout.outOfOrder == 0 && meanLatency < latencyBound;
+			ok = ok && match;
+			printf("  %-26s %7.1f fps captured, %7.1f delivered, %6llu dropped, %llu torn, latency mean %6.2f ms max %6.2f ms%s\n",
+				name, captured / elapsed, readout.delivered / elapsed, dropped, readout.torn, meanLatency * 1e3, readout.latencyMax * 1e3,
+				match ? "" : "  MISMATCH");
+		};
+
+		run("60 fps, reader at 75 Hz", 60.0, 75.0);
+		run("60 fps, reader at 30 Hz", 60.0, 30.0);
+		run("unpaced, reader unpaced", 0.0, 0.0);
+
+		// the thread ends on its own when the source does
+		{
+			PacedCameraSource first(width, height, 0.0, 3), second(width, height, 0.0, 3);
+			CameraThread camera;
+			bool restarted = camera.Start(&first);
+			const double start = Clock::Now();
+			while (restarted && !camera.Start(&second) && Clock::Now() - start < 5.0)
+				std::this_thread::yield();
+			while (camera.Captured() < 6 && Clock::Now() - start < 5.0)
+				std::this_thread::yield();
+			camera.Stop();
+			restarted = restarted && camera.Captured() == 6;
+			ok = ok && restarted;
+			printf("  %-26s %llu frames from two sources%s\n", "restart after source ended", camera.Captured(), restarted ? "" : "  MISMATCH");
+		}
+		return ok;
+	}
+
+	// Converts YUYV black, mid grey and white (Y 16, 126 and 235) with every
+	// SIMD level, which have to come out as 0, 128 and 255
+	static bool s_colorReference(const std::vector<eSimdLevel> &levels)
+	{
+		const int width = 64;
+		const unsigned char luma[] = { 16, 126, 235 };
+		const unsigned char expected[] = { 0, 128, 255 };
+		const int height = sizeof(luma);
+
+		std::vector<unsigned char> src(width * 2 * height);
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+			{
+				src[y * width * 2 + x * 2] = luma[y];
+				src[y * width * 2 + x * 2 + 1] = 128;
+			}
+
+		bool ok = true;
+		std::vector<unsigned char> out(width * 4 * height);
+		for (size_t l = 0; l < levels.size(); l++)
+		{
+			Simd::Force(levels[l]);
+			ColorConvert::ToRGBA(&src[0], width * 2, PIXEL_YUYV, width, height, &out[0], width * 4);
+			int worst = 0;
+			for (int y = 0; y < height; y++)
+				for (int i = 0; i < width * 4; i++)
+					worst = std::max(worst, abs(out[y * width * 4 + i] - ((i & 3) == 3 ? 255 : expected[y])));
+			ok = ok && worst == 0;
+			printf("  YUYV black/grey/white %-7s %3d %3d %3d, largest difference %d%s\n", Simd::Name(levels[l]),
+				out[0], out[width * 4], out[width * 8], worst, worst == 0 ? "" : "  MISMATCH");
+		}
+		Simd::Reset();
+		return ok;
+	}
+
+	// Converts stereo frames at VGA and 720p with every available SIMD level
+	// and reports Mpixel/s for both eyes together, after checking the YUYV
+	// levels of black and white.
+	static bool s_color()
+	{
+		const int sizes[][2] = { { 640, 480 }, { 1280, 720 } };
+		const ePixelFormat formats[] = { PIXEL_BAYER_GRBG, PIXEL_YUYV, PIXEL_RGB24 };
+		const char *formatNames[] = { "Bayer", "YUYV", "RGB24" };
+
+		std::vector<eSimdLevel> levels;
+		levels.push_back(SIMD_SCALAR);
+		if (Simd::Level() == SIMD_AVX2)
+			levels.push_back(SIMD_SSE2);
+		if (Simd::Level() != SIMD_SCALAR)
+			levels.push_back(Simd::Level());
+
+		printf("color conversion to RGBA, both eyes\n");
+		bool ok = s_colorReference(levels);
+		for (int s = 0; s < 2; s++)
+		{
+			const int width = sizes[s][0];
+			const int height = sizes[s][1];
+			for (int f = 0; f < 3; f++)
+			{
+				CameraFrame frame;
+				frame.Allocate(width, height, formats[f]);
+				srand(1);
+				for (int e = 0; e < 2; e++)
+					for (size_t i = 0; i < frame.eye[e].size(); i++)
+						frame.eye[e][i] = static_cast<unsigned char>(rand());
+
+				const int dstPitch = width * 4;
+				std::vector<unsigned char> reference(dstPitch * height);
+				std::vector<unsigned char> out[2];
+				out[0].resize(dstPitch * height);
+				out[1].resize(dstPitch * height);
+				ColorConvert::ToRGBAReference(&frame.eye[0][0], frame.pitch, formats[f], width, height, &reference[0], dstPitch);
+
+				for (size_t l = 0; l < levels.size(); l++)
+				{
+					Simd::Force(levels[l]);
+					const int iterations = 50;
+					double start = Clock::Now();
+					for (int i = 0; i < iterations; i++)
+						for (int e = 0; e < 2; e++)
+							ColorConvert::ToRGBA(&frame.eye[e][0], frame.pitch, formats[f], width, height, &out[e][0], dstPitch);
+					double elapsed = Clock::Now() - start;
+
+					const bool match = out[0] == reference;
+					ok = ok && match;
+					const double mpix = 2.0 * width * height * iterations / elapsed / 1e6;
+					printf("  %4dx%-4d %-6s %-7s %8.1f Mpixel/s %7.3f ms/frame%s\n", width, height, formatNames[f],
+						Simd::Name(levels[l]), mpix, elapsed * 1e3 / iterations, match ? "" : "  MISMATCH");
+				}
+				Simd::Reset();
+			}
+		}
+		return ok;
+	}
+
+	// Builds the stereo undistortion tables (cold and from the cache) and
+	// resamples both VGA eyes, single threaded and on the thread pool, and
+	// once more while the pool is busy with long tasks, which must not
+	// hold the resampling up.
+	static bool s_undistort()
+	{
+		const int width = 640;
+		const int height = 480;
+		CameraCalibration calibration[2];
+
+		UndistortMap map;
+		double start = Clock::Now();
+		map.Init(width, height, calibration, 0.0f, 0.9f, nullptr);
+		const double build = Clock::Now() - start;
+
+		// the first Init makes sure the cache file exists
+		UndistortMap cached;
+		cached.Init(width, height, calibration, 0.0f, 0.9f);
+		start = Clock::Now();
+		cached.Init(width, height, calibration, 0.0f, 0.9f);
+		const double load = Clock::Now() - start;
+
+		printf("undistortion %dx%d, both eyes\n", width, height);
+		printf("  table build %.2f ms, cache load %.2f ms%s\n", build * 1e3, load * 1e3, cached.FromCache() ? "" : " (cache not written)");
+
+		std::vector<unsigned char> src(width * height * 4);
+		srand(1);
+		for (size_t i = 0; i < src.size(); i++)
+			src[i] = static_cast<unsigned char>(rand());
+		std::vector<unsigned char> reference(src.size()), out[2];
+		out[0].resize(src.size());
+		out[1].resize(src.size());
+		map.ApplyReference(0, &src[0], width * 4, &reference[0], width * 4);
+
+		ThreadPool pool;
+		std::vector<eSimdLevel> levels;
+		levels.push_back(SIMD_SCALAR);
+		if (Simd::Level() == SIMD_AVX2)
+			levels.push_back(SIMD_SSE2);
+		if (Simd::Level() != SIMD_SCALAR)
+			levels.push_back(Simd::Level());
+
+		bool ok = true;
+		for (size_t l = 0; l < levels.size(); l++)
+		{
+			Simd::Force(levels[l]);
+			for (int threaded = 0; threaded < 2; threaded++)
+			{
+				const int iterations = 100;
+				start = Clock::Now();
+				for (int i = 0; i < iterations; i++)
+					for (int e = 0; e < 2; e++)
+						map.Apply(e, &src[0], width * 4, &out[e][0], width * 4, threaded ? &pool : nullptr);
+				const double elapsed = Clock::Now() - start;
+
+				const bool match = out[0] == reference;
+				ok = ok && match;
+				printf("  %-7s %-12s %7.3f ms/frame%s\n", Simd::Name(levels[l]), threaded ? "threads" : "one thread",
+					elapsed * 1e3 / iterations, match ? "" : "  MISMATCH");
+			}
+		}
+		Simd::Reset();
+		printf("  thread pool: %d workers + caller\n", pool.Size());
+
+		// with every worker busy, e.g. decoding textures, the caller does
+		// all rows itself and must not wait for the workers
+		std::atomic<int> busy(0);
+		for (int i = 0; i < pool.Size() * 2; i++)
+			pool.Submit([&busy]() {
+				std::this_thread::sleep_for(std::chrono::milliseconds(300));
+				busy++;
+			});
+		start = Clock::Now();
+		map.Apply(0, &src[0], width * 4, &out[0][0], width * 4, &pool);
+		const double blocked = Clock::Now() - start;
+		const bool waited = blocked > 0.1 || out[0] != reference;
+		ok = ok && !waited;
+		printf("  pool busy with 300 ms tasks: %7.3f ms/eye%s\n", blocked * 1e3, waited ? "  MISMATCH" : "");
+		while (busy.load() < pool.Size() * 2)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return ok;
+	}
+
+	// Writes a recording of VGA RGB frames from the camera thread, poses
+	// and timings from this thread and input from a third one, like the
+	// application does, and reads it back: every record has to come back
+	// byte for byte, in order. Then the same file cut off in the middle of
+	// a frame, which has to give exactly the records before the cut, and
+	// with broken index entries or a broken trailer, which have to be
+	// ignored. Reports the write rate, how long input writes took while
+	// frames were written, and the open times.
+	// Arguments: [frames]
+	static bool s_capture()
+	{
+		const int frames = s_argc > 0 ? atoi(s_argv[0]) : 120;
+		const char *path = "bench_capture.oarc";
+		const char *cutPath = "bench_capture_cut.oarc";
+		bool ok = true;
+		if (frames <= 0)
+		{
+			printf("capture: frame count must be positive\n");
+			return false;
+		}
+
+		// what goes in
+		std::vector<CameraFrame> written(frames);
+		std::vector<PoseRecord> poses;
+		std::vector<InputRecord> inputs;
+		std::vector<TimingRecord> timings;
+		SyntheticCameraSource synthetic(640, 480, 0.0);
+		for (int i = 0; i < frames; i++)
+			synthetic.Grab(written[i]);
+
+		CaptureWriter writer;
+		if (!writer.Open(path))
+		{
+			printf("capture: cannot create %s\n", path);
+			return false;
+		}
+		std::atomic<bool> writing(true);
+		std::atomic<int> frameIndex(0);
+		std::thread camera([&]() {
+			for (int i = 0; i < frames; i++)
+			{
+				writer.WriteFrame(written[i]);
+				frameIndex = i + 1;
+			}
+			writing = false;
+		});
+		double inputMax = 0.0, inputSum = 0.0;
+		std::thread window([&]() {
+			for (int i = 0; writing || i < 100; i++)
+			{
+				const InputRecord record = { Clock::Now(), 0x200u + i % 16, static_cast<unsigned long long>(i), -static_cast<long long>(i) };
+				inputs.push_back(record);
+				const double start = Clock::Now();
+				writer.WriteInput(record);
+				const double elapsed = Clock::Now() - start;
+				inputMax = std::max(inputMax, elapsed);
+				inputSum += elapsed;
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+			}
+		});
+		const double start = Clock::Now();
+		for (int i = 0; frameIndex < frames || i < 100; i++)
+		{
+			PoseRecord pose = {};
+			pose.time = Clock::Now();
+			pose.statusFlags = i;
+			pose.head.orientation[3] = 1.0f;
+			pose.head.position[0] = i * 0.001f;
+			poses.push_back(pose);
+			writer.WritePose(pose);
+			const TimingRecord timing = { pose.time, Clock::Now(), static_cast<unsigned long long>(i) };
+			timings.push_back(timing);
+			writer.WriteTiming(timing);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		camera.join();
+		window.join();
+		writer.Close();
+		const double elapsed = Clock::Now() - start;
+
+		std::vector<unsigned char> file;
+		ok = LoadFile(path, file) && ok;
+		printf("capture: %d frames, %u poses, %u inputs, %u timings, %.1f MB\n", frames, static_cast<unsigned>(poses.size()),
+			static_cast<unsigned>(inputs.size()), static_cast<unsigned>(timings.size()), file.size() / 1048576.0);
+		printf("  written at %.1f MB/s, input writes mean %.3f ms max %.3f ms\n", file.size() / 1048576.0 / elapsed,
+			inputSum * 1e3 / std::max<size_t>(inputs.size(), 1), inputMax * 1e3);
+
+		// the first frames, poses, inputs and timings as written, and nothing else
+		auto check = [&](const char *name, const char *filePath, size_t frameCount, size_t poseCount, size_t inputCount, size_t timingCount) {
+			CaptureReader reader;
+			const double openStart = Clock::Now();
+			bool match = reader.Open(filePath);
+			const double open = Clock::Now() - openStart;
+			match = match && reader.FrameCount() == frameCount && reader.PoseCount() == poseCount &&
+				reader.InputCount() == inputCount && reader.TimingCount() == timingCount;
+			for (size_t i = 0; match && i < frameCount; i++)
+			{
+				const CaptureFrameView view = reader.Frame(i);
+				const CameraFrame &frame = written[i];
+				match = view.sequence == frame.sequence && view.captureTime == frame.captureTime && view.width == frame.width &&
+					view.height == frame.height && view.pitch == frame.pitch && view.format == frame.format &&
+					memcmp(view.eye[0], &frame.eye[0][0], frame.eye[0].size()) == 0 && memcmp(view.eye[1], &frame.eye[1][0], frame.eye[1].size()) == 0 &&
+					reinterpret_cast<size_t>(view.eye[0]) % 64 == 0 && reinterpret_cast<size_t>(view.eye[1]) % 64 == 0;
+			}
+			for (size_t i = 0; match && i < poseCount; i++)
+				match = memcmp(&reader.Pose(i), &poses[i], sizeof(PoseRecord)) == 0;
+			for (size_t i = 0; match && i < inputCount; i++)
+				match = memcmp(&reader.Input(i), &inputs[i], sizeof(InputRecord)) == 0;
+			for (size_t i = 0; match && i < timingCount; i++)
+				match = memcmp(&reader.Timing(i), &timings[i], sizeof(TimingRecord)) == 0;
+			ok = ok && match;
+			printf("  %-30s %4u frames, %5u poses, %5u inputs, %5u timings, opened in %7.3f ms%s\n", name,
+				static_cast<unsigned>(reader.FrameCount()), static_cast<unsigned>(reader.PoseCount()), static_cast<unsigned>(reader.InputCount()),
+				static_cast<unsigned>(reader.TimingCount()), open * 1e3, match ? "" : "  MISMATCH");
+		};
+		check("round trip", path, frames, poses.size(), inputs.size(), timings.size());
+
+		// cut in the middle of the image of the frame in the middle; counts
+		// what lies before it by walking the chunks as written
+		size_t cut = 0;
+		size_t before[4] = { 0, 0, 0, 0 };
+		CaptureFileTrailer trailer;
+		memcpy(&trailer, &file[file.size() - sizeof(CaptureFileTrailer)], sizeof(trailer));
+		{
+			unsigned long long offset = sizeof(CaptureFileHeader);
+			size_t seenFrames = 0;
+			while (offset < trailer.indexOffset)
+			{
+				const CaptureChunk *chunk = reinterpret_cast<const CaptureChunk*>(&file[static_cast<size_t>(offset)]);
+				if (chunk->type == CHUNK_FRAME && seenFrames++ == static_cast<size_t>(frames / 2))
+				{
+					cut = static_cast<size_t>(offset + sizeof(CaptureChunk) + chunk->size / 2);
+					break;
+				}
+				if (chunk->type >= CHUNK_FRAME && chunk->type <= CHUNK_TIMING)
+					before[chunk->type - CHUNK_FRAME]++;
+				offset = (offset + sizeof(CaptureChunk) + chunk->size + 7) & ~7ULL;
+			}
+		}
+		ok = cut > 0 && s_writeFile(cutPath, std::vector<unsigned char>(file.begin(), file.begin() + cut)) && ok;
+		check("cut off in a frame", cutPath, before[0], before[1], before[2], before[3]);
+
+		// index entries that are misaligned, out of the file, of the wrong type
+		// or out of order, and a trailer whose index offset is misaligned,
+		// wraps around or points at the header: the reader has to walk the
+		// chunks instead
+		const size_t indexOffset = static_cast<size_t>(trailer.indexOffset);
+		const char *damage[7] = { "misaligned index entry", "index entry past the end", "index entry of the wrong type", "index entries out of order",
+			"misaligned index", "index offset wrapping around", "index offset in the header" };
+		for (int d = 0; d < 7; d++)
+		{
+			std::vector<unsigned char> broken(file);
+			CaptureIndexEntry *entry = reinterpret_cast<CaptureIndexEntry*>(&broken[indexOffset + sizeof(CaptureChunk)]) + 5;
+			CaptureFileTrailer damaged = trailer;
+			if (d == 0)
+				entry->offset += 4;
+			else if (d == 1)
+				entry->offset = ~0ULL - 4;
+			else if (d == 2)
+				entry->type = entry->type == CHUNK_POSE ? CHUNK_TIMING : CHUNK_POSE;
+			else if (d == 3)
+				std::swap(entry[0], entry[1]);
+			else if (d == 4)
+				damaged.indexOffset += 4;
+			else if (d == 5)
+				damaged.indexOffset = ~0ULL - 8;
+			else
+				damaged.indexOffset = 0;
+			memcpy(&broken[broken.size() - sizeof(CaptureFileTrailer)], &damaged, sizeof(damaged));
+			ok = s_writeFile(cutPath, broken) && ok;
+			check(damage[d], cutPath, frames, poses.size(), inputs.size(), timings.size());
+		}
+
+		remove(path);
+		remove(cutPath);
+		return ok;
+	}
+
+	// Runs the application frame on the null HMD and renderer with the
+	// camera pipeline on, and reports the CPU time of every stage.
+	// Arguments: [frames] [recording], the recording supplies the poses
+	// and camera frames instead of the stand-ins.
+	static bool s_frameloop()
+	{
+		const int frames = s_argc > 0 ? atoi(s_argv[0]) : 2000;
+		const char *recording = s_argc > 1 ? s_argv[1] : nullptr;
+		if (frames <= 0)
+		{
+			printf("frameloop: frame count must be positive\n");
+			return false;
+		}
+
+		CaptureReader reader;
+		if (recording && !reader.Open(recording))
+		{
+			printf("frameloop: cannot open recording '%s'\n", recording);
+			return false;
+		}
+
+		const int width = recording && reader.FrameCount() > 0 ? reader.Frame(0).width : 640;
+		const int height = recording && reader.FrameCount() > 0 ? reader.Frame(0).height : 480;
+
+		NullHmdDevice nullHmd;
+		ReplayHmdDevice replayHmd(&nullHmd, &reader, false);
+		HmdDevice *hmd = recording ? static_cast<HmdDevice*>(&replayHmd) : &nullHmd;
+		NullRenderDevice render(width, height);
+
+		// Camera frames as fast as they come, so most frames have a new one
+		SyntheticCameraSource synthetic(width, height, 0.0);
+		ReplayCameraSource replay(&reader, false, true);
+		CameraThread camera;
+		camera.Start(recording && reader.FrameCount() > 0 ? static_cast<CameraSource*>(&replay) : &synthetic);
+
+		CameraCalibration calibration[2];
+		UndistortMap undistort;
+		undistort.Init(width, height, calibration, 0.0f, 0.9f, nullptr);
+		ThreadPool pool;
+
+		FrameLoop loop(hmd, &render);
+		loop.SetCamera(&camera, &undistort, &pool);
+		loop.SetShowCamera(true);
+
+		// Every frame gets a new camera image, like a render loop running at
+		// the camera rate. The wait is not part of the frame.
+		unsigned long long captured = 0;
+		auto nextFrame = [&]() {
+			const double timeout = Clock::Now() + 1.0;
+			while (camera.Captured() == captured && Clock::Now() < timeout)
+				std::this_thread::yield();
+			captured = camera.Captured();
+			loop.RunFrame();
+		};
+
+		// warm up caches, the pool and the camera thread
+		for (int i = 0; i < 50; i++)
+			nextFrame();
+		loop.Stats().Clear();
+		render.ResetCounters();
+
+		for (int i = 0; i < frames; i++)
+			nextFrame();
+		camera.Stop();
+
+		const FrameStats &stats = loop.Stats();
+		printf("frame loop, %d frames, camera %dx%d%s\n", frames, width, height, recording ? " from recording" : "");
+		printf("  %-10s %9s %9s %9s\n", "stage", "p50 us", "p99 us", "mean us");
+		for (int s = 0; s < STAGE_COUNT; s++)
+		{
+			const eFrameStage stage = static_cast<eFrameStage>(s);
+			printf("  %-10s %9.2f %9.2f %9.2f\n", FrameStats::StageName(stage),
+				stats.Percentile(stage, 50.0), stats.Percentile(stage, 99.0), stats.Mean(stage));
+		}
+		const RenderCounters &counters = render.Counters();
+		printf("  %llu draws, %llu instances, %llu constant writes, %.2f constant maps and %.2f instance maps per frame, %llu camera uploads\n",
+			counters.draws, counters.instances, counters.constantWrites, static_cast<double>(counters.constantMaps) / frames,
+			static_cast<double>(counters.instanceMaps) / frames, counters.cameraUploads);
+		// per eye the camera quad and one instanced draw of both overlays
+		const unsigned long long n = static_cast<unsigned long long>(frames);
+		return counters.draws == n * 4 && counters.instances == n * 4 && counters.constantMaps == n && counters.instanceMaps == n;
+	}
+
+	// Renders the application frame with the software rasterizer at the DK2
+	// eye buffer size, scalar and SIMD, on one thread and on the pool. All
+	// of them must produce the same image; its hash is the golden value.
+	// Arguments: [frames] [image.ppm], the file gets the first frame.
+	static bool s_raster()
+	{
+		const int frames = s_argc > 0 ? atoi(s_argv[0]) : 30;
+		const char *imagePath = s_argc > 1 ? s_argv[1] : nullptr;
+		if (frames <= 0)
+		{
+			printf("raster: frame count must be positive\n");
+			return false;
+		}
+
+		// checkerboard and noise for the overlays, gradients for the camera
+		std::vector<unsigned char> checker(256 * 256 * 4), noise(512 * 512 * 4);
+		for (int y = 0; y < 256; y++)
+			for (int x = 0; x < 256; x++)
+			{
+				const unsigned char c = ((x >> 5) ^ (y >> 5)) & 1 ? 230 : 30;
+				unsigned char *p = &checker[(y * 256 + x) * 4];
+				p[0] = c;
+				p[1] = c;
+				p[2] = static_cast<unsigned char>(x);
+				p[3] = 255;
+			}
+		srand(1);
+		for (size_t i = 0; i < noise.size(); i++)
+			noise[i] = static_cast<unsigned char>(rand());
+
+		NullHmdDevice hmd;
+		const ovrRecti right = hmd.EyeViewport(1);
+		const int width = right.Pos.x + right.Size.w;
+		const int height = right.Size.h;
+		const int cameraWidth = 640;
+		const int cameraHeight = 480;
+		ThreadPool pool;
+
+		struct Config
+		{
+			eSimdLevel level;
+			bool threaded;
+		};
+		const Config configs[] = {
+			{ SIMD_SCALAR, false }, { SIMD_SCALAR, true }, { Simd::Level(), false }, { Simd::Level(), true }
+		};
+		const int configCount = Simd::Level() == SIMD_SCALAR ? 2 : 4;
+
+		printf("software rasterizer %dx%d, %d frames\n", width, height, frames);
+		std::vector<unsigned char> reference;
+		bool ok = true;
+		for (int c = 0; c < configCount; c++)
+		{
+			Simd::Force(configs[c].level);
+			NullHmdDevice configHmd;
+			SoftwareRenderDevice render(width, height, cameraWidth, cameraHeight, configs[c].threaded ? &pool : nullptr);
+			render.SetTextureImage(TEXTURE_OVERLAY_OUT, &checker[0], 256, 256, 256 * 4);
+			render.SetTextureImage(TEXTURE_OVERLAY_IN, &noise[0], 512, 512, 512 * 4);
+			for (int eye = 0; eye < 2; eye++)
+			{
+				int pitch = 0;
+				unsigned char *camera = render.MapCameraTexture(eye, &pitch);
+				for (int y = 0; y < cameraHeight; y++)
+					for (int x = 0; x < cameraWidth; x++)
+					{
+						unsigned char *p = camera + y * pitch + x * 4;
+						p[0] = static_cast<unsigned char>(x * 255 / cameraWidth);
+						p[1] = static_cast<unsigned char>(y * 255 / cameraHeight);
+						p[2] = static_cast<unsigned char>(eye * 255);
+						p[3] = 255;
+					}
+			}
+
+			FrameLoop loop(&configHmd, &render);
+			loop.SetShowCamera(true);
+			ovrVector3f translate = { 0.2f, 0.0f, -3.0f };
+			loop.SetOverlay(0.5f, translate);
+
+			// the first frame is the golden image
+			loop.RunFrame();
+			std::vector<unsigned char> first(render.Image(), render.Image() + render.Pitch() * height);
+			if (c == 0)
+			{
+				reference = first;
+				if (imagePath)
+				{
+					FILE *file = fopen(imagePath, "wb");
+					if (file)
+					{
+						fprintf(file, "P6\n%d %d\n255\n", width, height);
+						for (int y = 0; y < height; y++)
+							for (int x = 0; x < width; x++)
+								fwrite(&reference[y * render.Pitch() + x * 4], 1, 3, file);
+						fclose(file);
+					}
+					else
+					{
+						printf("  cannot write '%s'\n", imagePath);
+						ok = false;
+					}
+				}
+			}
+
+			const double start = Clock::Now();
+			for (int i = 0; i < frames; i++)
+				loop.RunFrame();
+			const double elapsed = Clock::Now() - start;
+
+			const bool match = first == reference;
+			ok = ok && match;
+			printf("  %-7s %-12s %8.3f ms/frame%s\n", Simd::Name(configs[c].level), configs[c].threaded ? "threads" : "one thread",
+				elapsed * 1e3 / frames, match ? "" : "  MISMATCH");
+		}
+		Simd::Reset();
+		printf("  first frame hash %016llx\n", HashBytes(&reference[0], reference.size()));
+		return ok;
+	}
+
+	// Checks the frame constant ring: aligned, non-overlapping allocations,
+	// full rings refusing, and one upload per frame however many draws a
+	// frame has, also past the capacity of the ring.
+	static bool s_constants()
+	{
+		bool ok = true;
+		const unsigned alignments[] = { 16, 64, 256 };
+		srand(1);
+		for (int a = 0; a < 3; a++)
+		{
+			ConstantRing ring(4096, alignments[a]);
+			unsigned end = 0;
+			int allocations = 0;
+			for (;;)
+			{
+				const unsigned size = 1 + rand() % 200;
+				const int offset = ring.Allocate(size);
+				if (offset < 0)
+				{
+					// refused only when it really does not fit
+					const unsigned aligned = (end + alignments[a] - 1) & ~(alignments[a] - 1);
+					ok = ok && aligned + size > ring.Capacity();
+					break;
+				}
+				ok = ok && offset % alignments[a] == 0 && static_cast<unsigned>(offset) >= end && offset + size <= ring.Capacity();
+				end = offset + size;
+				allocations++;
+			}
+			printf("constant ring, alignment %3u: %d allocations in %u bytes%s\n", alignments[a], allocations, ring.Capacity(), ok ? "" : "  FAILED");
+		}
+
+		const unsigned draws[] = { 6, 64, RenderDevice::MaxDraws, RenderDevice::MaxDraws + 1, 4 * RenderDevice::MaxDraws };
+		float mvp[16] = { 1.0f };
+		for (int d = 0; d < 5; d++)
+		{
+			NullRenderDevice render(0, 0);
+			const int frames = 100;
+			const double start = Clock::Now();
+			for (int f = 0; f < frames; f++)
+			{
+				render.BeginFrame();
+				for (unsigned i = 0; i < draws[d]; i++)
+				{
+					render.WriteConstants(mvp, sizeof(mvp));
+					render.DrawQuad();
+				}
+				render.EndFrame();
+			}
+			const double elapsed = Clock::Now() - start;
+			const unsigned expected = (draws[d] + RenderDevice::MaxDraws - 1) / RenderDevice::MaxDraws;
+			const double maps = static_cast<double>(render.Counters().constantMaps) / frames;
+			const bool match = render.Counters().constantMaps == static_cast<unsigned long long>(expected) * frames;
+			ok = ok && match;
+			printf("  %4u draws: %.2f maps per frame, %.2f us per frame%s\n", draws[d], maps, elapsed * 1e6 / frames, match ? "" : "  MISMATCH");
+		}
+		return ok;
+	}
+
+	// Transforms of both eyes for a growing number of objects: the old
+	// per-object OVR::Matrix4f path, projection rebuilt every eye, against
+	// the structure-of-arrays batch at every SIMD level. Argument: [frames]
+	static bool s_transform()
+	{
+		const int frames = s_argc > 0 ? atoi(s_argv[0]) : 2000;
+		NullHmdDevice hmd;
+		const int counts[] = { 2, 64, 512 };
+		bool ok = true;
+		srand(1);
+		for (int c = 0; c < 3; c++)
+		{
+			const int objects = counts[c];
+			std::vector<OVR::Matrix4f> models(objects);
+			TransformBatch batch;
+			for (int o = 0; o < objects; o++)
+			{
+				const float x = (rand() % 2001 - 1000) / 100.0f;
+				const float z = (rand() % 2001 - 1000) / 100.0f;
+				models[o] = OVR::Matrix4f::Translation(x, 0.0f, z) * OVR::Matrix4f::Scaling(1.0f + (rand() % 100) / 50.0f) * OVR::Matrix4f::RotationY((rand() % 628) / 100.0f);
+				batch.Add(&models[o].M[0][0], o % 4 == 0);
+			}
+			const OVR::Matrix4f view[2] = {
+				OVR::Matrix4f::LookAtRH(OVR::Vector3f(-0.032f, 1.7f, 0.0f), OVR::Vector3f(-0.032f, 1.7f, -1.0f), OVR::Vector3f(0.0f, 1.0f, 0.0f)),
+				OVR::Matrix4f::LookAtRH(OVR::Vector3f(0.032f, 1.7f, 0.0f), OVR::Vector3f(0.032f, 1.7f, -1.0f), OVR::Vector3f(0.0f, 1.0f, 0.0f)) };
+			std::vector<float> reference(2 * objects * 16), out(2 * objects * 16);
+
+			printf("transforms, %d objects, both eyes\n", objects);
+			double start = Clock::Now();
+			for (int f = 0; f < frames; f++)
+			{
+				for (int eye = 0; eye < 2; eye++)
+				{
+					OVR::Matrix4f projection = ovrMatrix4f_Projection(hmd.EyeFov(eye), 0.01f, 10000.0f, true);
+					for (int o = 0; o < objects; o++)
+					{
+						ovrMatrix4f transposed = (o % 4 == 0 ? projection * models[o] : projection * view[eye] * models[o]).Transposed();
+						memcpy(&reference[(eye * objects + o) * 16], transposed.M, sizeof(transposed.M));
+					}
+				}
+			}
+			double elapsed = Clock::Now() - start;
+			printf("  per object        %9.3f us/frame\n", elapsed * 1e6 / frames);
+
+			for (int eye = 0; eye < 2; eye++)
+				batch.SetView(eye, &view[eye].M[0][0]);
+			std::vector<eSimdLevel> levels;
+			levels.push_back(SIMD_SCALAR);
+			if (Simd::Level() == SIMD_AVX2)
+				levels.push_back(SIMD_SSE2);
+			if (Simd::Level() != SIMD_SCALAR)
+				levels.push_back(Simd::Level());
+			for (size_t l = 0; l < levels.size(); l++)
+			{
+				Simd::Force(levels[l]);
+				start = Clock::Now();
+				for (int f = 0; f < frames; f++)
+				{
+					for (int eye = 0; eye < 2; eye++)
+						batch.SetProjection(eye, hmd.EyeFov(eye), 0.01f, 10000.0f);
+					batch.Run(&out[0]);
+				}
+				elapsed = Clock::Now() - start;
+				const bool match = out == reference;
+				ok = ok && match;
+				printf("  batch %-7s     %9.3f us/frame%s\n", Simd::Name(levels[l]), elapsed * 1e6 / frames, match ? "" : "  MISMATCH");
+			}
+			Simd::Reset();
+			batch.RunReference(&out[0]);
+			ok = ok && out == reference && batch.ProjectionBuilds() == 2;
+			printf("  projections built %u\n", batch.ProjectionBuilds());
+		}
+		return ok;
+	}
+
+	// Packs overlay instances for both eyes, 10000 by default, checks
+	// them against the matrices and rectangles they came from and reports
+	// the size and build time. A full instance upload must not lose the
+	// constants allocated before it. Argument: [instances]
+	static bool s_instances()
+	{
+		const int instances = s_argc > 0 ? atoi(s_argv[0]) : 10000;
+		const int quads = instances / 2;
+		if (quads <= 0)
+		{
+			printf("instances: need at least 2\n");
+			return false;
+		}
+
+		NullHmdDevice hmd;
+		TransformBatch transforms;
+		OverlayInstanceBuilder builder;
+		srand(1);
+		for (int q = 0; q < quads; q++)
+		{
+			const OVR::Matrix4f model = OVR::Matrix4f::Translation((rand() % 2001 - 1000) / 100.0f, 0.0f, (rand() % 2001 - 1000) / 100.0f);
+			transforms.Add(&model.M[0][0], q % 8 == 0);
+			// a grid of 4x4 tiles over the texture, like an atlas
+			const float u = (q % 4) / 4.0f, v = (q / 4 % 4) / 4.0f;
+			builder.Add(q % RenderDevice::OverlaySlices, u, v, u + 0.25f, v + 0.25f);
+		}
+		for (int eye = 0; eye < 2; eye++)
+			transforms.SetProjection(eye, hmd.EyeFov(eye), 0.01f, 10000.0f);
+		std::vector<float> mvps(2 * quads * 16);
+		std::vector<OverlayInstance> out(2 * quads);
+
+		const int iterations = 200;
+		double transformTime = 0.0, buildTime = 0.0;
+		for (int i = 0; i < iterations; i++)
+		{
+			double start = Clock::Now();
+			transforms.Run(&mvps[0]);
+			transformTime += Clock::Now() - start;
+			start = Clock::Now();
+			builder.Build(&mvps[0], &out[0]);
+			buildTime += Clock::Now() - start;
+		}
+
+		bool ok = true;
+		for (int i = 0; i < 2 * quads && ok; i++)
+		{
+			const int q = i % quads;
+			const float u = (q % 4) / 4.0f, v = (q / 4 % 4) / 4.0f;
+			const float rect[4] = { u, v, u + 0.25f, v + 0.25f };
+			ok = memcmp(out[i].mvp, &mvps[i * 16], sizeof(out[i].mvp)) == 0 && out[i].slice == static_cast<unsigned>(q % RenderDevice::OverlaySlices);
+			for (int c = 0; c < 4; c++)
+				ok = ok && fabsf(OverlayInstanceBuilder::Unpack(out[i].uvRect[c]) - rect[c]) <= 0.5f / 65535.0f;
+		}
+		// the full rectangle must come back exactly, the default quads rely on it
+		builder.Clear();
+		builder.Add(0);
+		builder.Build(&mvps[0], &out[0]);
+		for (int c = 0; c < 4; c++)
+			ok = ok && OverlayInstanceBuilder::Unpack(out[0].uvRect[c]) == (c < 2 ? 0.0f : 1.0f);
+
+		// running out of instances submits, but constants allocated before
+		// and not drawn yet have to keep their slot and their data
+		NullRenderDevice device(64, 64);
+		device.BeginFrame();
+		void *constants = nullptr;
+		const int slot = device.AllocateConstants(1, &constants);
+		memset(constants, 0x5A, RenderDevice::DrawConstants);
+		OverlayInstance *packed = nullptr;
+		for (unsigned i = 0; i <= RenderDevice::MaxInstances / 256; i++)
+			device.AllocateInstances(256, &packed);
+		const unsigned char *kept = static_cast<const unsigned char*>(device.Ring().Data()) + slot * RenderDevice::DrawConstants;
+		bool slotKept = device.Counters().instanceMaps == 1 && device.Ring().Used() == RenderDevice::DrawConstants;
+		for (unsigned i = 0; i < RenderDevice::DrawConstants; i++)
+			slotKept = slotKept && kept[i] == 0x5A;
+		device.EndFrame();
+		ok = ok && slotKept;
+
+		printf("overlay instances, %d quads for both eyes, %d instances\n", quads, 2 * quads);
+		printf("  %u bytes per instance, %.1f KB per frame\n", static_cast<unsigned>(sizeof(OverlayInstance)), 2.0 * quads * sizeof(OverlayInstance) / 1024.0);
+		printf("  transforms %.1f us, build %.1f us per frame%s\n", transformTime * 1e6 / iterations, buildTime * 1e6 / iterations, ok ? "" : "  MISMATCH");
+		printf("  constants across a full instance upload %s\n", slotKept ? "kept" : "LOST");
+		return ok;
+	}
+
+	// Frustum culling of 1k to 100k boxes scattered around the viewer, who
+	// turns a little every frame: build and refit time of the hierarchy,
+	// cull time at every SIMD level and the visible sets, checked against
+	// testing every box. Below SceneBvh::LinearCount objects there is no
+	// tree and the cull is a plain scan. Argument: [frames]
+	static bool s_cull()
+	{
+		const int frames = s_argc > 0 ? atoi(s_argv[0]) : 100;
+		NullHmdDevice hmd;
+		const ovrFovPort fov[2] = { hmd.EyeFov(0), hmd.EyeFov(1) };
+		const int counts[] = { 1000, 10000, 100000 };
+		bool ok = true;
+
+		for (int c = 0; c < 3; c++)
+		{
+			const int objects = counts[c];
+			srand(1);
+			std::vector<Aabb> boxes(objects);
+			for (int o = 0; o < objects; o++)
+			{
+				for (int i = 0; i < 3; i++)
+				{
+					const float center = (rand() % 20001 - 10000) / 100.0f;
+					const float half = 0.1f + (rand() % 100) / 100.0f;
+					boxes[o].min[i] = center - half;
+					boxes[o].max[i] = center + half;
+				}
+			}
+
+			SceneBvh scene;
+			for (int o = 0; o < objects; o++)
+				scene.Add(boxes[o]);
+			double start = Clock::Now();
+			scene.Build();
+			const double build = Clock::Now() - start;
+
+			// a tenth of the objects drift a little
+			for (int o = 0; o < objects; o += 10)
+			{
+				Aabb moved = boxes[o];
+				for (int i = 0; i < 3; i++)
+				{
+					moved.min[i] += 0.05f;
+					moved.max[i] += 0.05f;
+				}
+				scene.SetBounds(o, moved);
+			}
+			start = Clock::Now();
+			scene.Refit();
+			const double refit = Clock::Now() - start;
+			printf("culling, %d objects%s\n", objects, scene.Linear() ? ", no tree" : "");
+			printf("  build %.3f ms, refit of %d moved %.3f ms\n", build * 1e3, (objects + 9) / 10, refit * 1e3);
+
+			std::vector<eSimdLevel> levels;
+			levels.push_back(SIMD_SCALAR);
+			if (Simd::Level() == SIMD_AVX2)
+				levels.push_back(SIMD_SSE2);
+			if (Simd::Level() != SIMD_SCALAR)
+				levels.push_back(Simd::Level());
+
+			std::vector<int> visible[2], reference[2];
+			for (size_t l = 0; l < levels.size(); l++)
+			{
+				Simd::Force(levels[l]);
+				double elapsed = 0.0;
+				unsigned long long candidates = 0, seen = 0;
+				bool match = true;
+				for (int f = 0; f < frames; f++)
+				{
+					// both eyes share the head orientation, 64 mm apart
+					const OVR::Quatf head(OVR::Vector3f(0.0f, 1.0f, 0.0f), f * 0.0628f);
+					ovrPosef eyePose[2];
+					Frustum eye[2];
+					for (int e = 0; e < 2; e++)
+					{
+						const OVR::Vector3f position = head.Rotate(OVR::Vector3f(e == 0 ? -0.032f : 0.032f, 0.0f, 0.0f));
+						eyePose[e] = OVR::Posef(head, position);
+						const OVR::Matrix4f view = OVR::Matrix4f::LookAtRH(position, position + head.Rotate(OVR::Vector3f(0.0f, 0.0f, -1.0f)),
+							head.Rotate(OVR::Vector3f(0.0f, 1.0f, 0.0f)));
+						const OVR::Matrix4f clip = OVR::Matrix4f(ovrMatrix4f_Projection(fov[e], 0.01f, 10000.0f, true)) * view;
+						eye[e].FromMatrix(&clip.M[0][0]);
+					}
+					Frustum stereo;
+					stereo.FromStereo(fov, eyePose, 0.01f, 10000.0f);
+
+					start = Clock::Now();
+					scene.Cull(stereo, eye, visible);
+					elapsed += Clock::Now() - start;
+					candidates += scene.Stats().candidates;
+					seen += visible[0].size() + visible[1].size();
+
+					scene.CullReference(eye, reference);
+					match = match && visible[0] == reference[0] && visible[1] == reference[1];
+				}
+				ok = ok && match;
+				printf("  %-7s %9.3f us/frame, %7.0f candidates, %7.0f visible per eye%s\n", Simd::Name(levels[l]), elapsed * 1e6 / frames,
+					static_cast<double>(candidates) / frames, seen / 2.0 / frames, match ? "" : "  MISMATCH");
+			}
+			Simd::Reset();
+
+			// the brute force test for comparison
+			std::vector<int> all[2];
+			Frustum eye[2];
+			for (int e = 0; e < 2; e++)
+			{
+				const OVR::Matrix4f clip = OVR::Matrix4f(ovrMatrix4f_Projection(fov[e], 0.01f, 10000.0f, true));
+				eye[e].FromMatrix(&clip.M[0][0]);
+			}
+			start = Clock::Now();
+			for (int f = 0; f < frames; f++)
+				scene.CullReference(eye, all);
+			printf("  every box, scalar %9.3f us/frame\n", (Clock::Now() - start) * 1e6 / frames);
+		}
+		return ok;
+	}
+
+	// Angle between two orientations in degrees, from the vector part of
+	// conj(a) * b; acos of their dot product loses small angles to rounding
+	static double s_angleDegrees(const ovrQuatf &a, const ovrQuatf &b)
+	{
+		const double ax = a.x, ay = a.y, az = a.z, aw = a.w;
+		const double x = aw * b.x - ax * b.w - ay * b.z + az * b.y;
+		const double y = aw * b.y + ax * b.z - ay * b.w - az * b.x;
+		const double z = aw * b.z - ax * b.y + ay * b.x - az * b.w;
+		const double w = aw * b.w + ax * b.x + ay * b.y + az * b.z;
+		return 2.0 * std::atan2(std::sqrt(x * x + y * y + z * z), std::fabs(w)) * 180.0 / 3.14159265358979;
+	}
+
+	static double s_distanceMm(const ovrVector3f &a, const ovrVector3f &b)
+	{
+		const double x = a.x - b.x, y = a.y - b.y, z = a.z - b.z;
+		return std::sqrt(x * x + y * y + z * z) * 1e3;
+	}
+
+	// Fills a history with the NullHmdDevice head motion at 1 kHz, once with
+	// the exact derivatives and once with estimated ones, and reports the
+	// error of interpolated and predicted poses against the true motion,
+	// then has a PoseSampler write while this thread reads and checks that
+	// no read is torn.
+	static bool s_pose()
+	{
+		const double rate = 1000.0;
+		const int samples = PoseHistory::Capacity;
+		const int queries = s_argc > 0 ? atoi(s_argv[0]) : 100000;
+		bool ok = true;
+
+		for (int source = 0; source < 2; source++)
+		{
+			PoseHistory history;
+			for (int i = 0; i < samples; i++)
+			{
+				ovrPoseStatef state;
+				NullHmdDevice::HeadStateAt(10.0 + i / rate, &state);
+				if (source == 0)
+					history.Push(state);
+				else
+					history.PushPose(state.TimeInSeconds, state.ThePose);
+			}
+			ovrPoseStatef newest;
+			history.Latest(&newest);
+			printf("pose history, %s derivatives\n", source == 0 ? "tracker" : "estimated");
+
+			// between the samples of the last half second
+			srand(1);
+			double maxAngle = 0.0, maxDistance = 0.0;
+			double start = Clock::Now();
+			for (int q = 0; q < queries; q++)
+			{
+				const double t = newest.TimeInSeconds - 0.5 * (rand() % 10000) / 10000.0;
+				ovrPoseStatef sampled, truth;
+				history.Sample(t, &sampled);
+				NullHmdDevice::HeadStateAt(t, &truth);
+				const double angle = s_angleDegrees(sampled.ThePose.Orientation, truth.ThePose.Orientation);
+				const double distance = s_distanceMm(sampled.ThePose.Position, truth.ThePose.Position);
+				maxAngle = angle > maxAngle ? angle : maxAngle;
+				maxDistance = distance > maxDistance ? distance : maxDistance;
+			}
+			const double elapsed = Clock::Now() - start;
+			printf("  interpolated   max %.5f deg %.5f mm, %.0f ns/query\n", maxAngle, maxDistance, elapsed * 1e9 / queries);
+			ok = ok && maxAngle < 0.01 && maxDistance < 0.01;
+
+			// past the newest sample
+			const double horizons[] = { 0.010, 0.020, 0.040 };
+			const ePrediction predictions[] = { PREDICT_HOLD, PREDICT_VELOCITY, PREDICT_ACCELERATION };
+			const char *predictionNames[] = { "hold", "velocity", "acceleration" };
+			for (int h = 0; h < 3; h++)
+			{
+				ovrPoseStatef truth;
+				NullHmdDevice::HeadStateAt(newest.TimeInSeconds + horizons[h], &truth);
+				printf("  %2.0f ms ahead  ", horizons[h] * 1e3);
+				for (int p = 0; p < 3; p++)
+				{
+					ovrPoseStatef predicted;
+					history.Sample(newest.TimeInSeconds + horizons[h], &predicted, predictions[p]);
+					printf(" %s %.3f deg %.3f mm", predictionNames[p], s_angleDegrees(predicted.ThePose.Orientation, truth.ThePose.Orientation),
+						s_distanceMm(predicted.ThePose.Position, truth.ThePose.Position));
+				}
+				printf("\n");
+			}
+		}
+
+		// A sampler thread writes, this one reads: every sample read has to
+		// be exactly what was written for its time
+		NullHmdDevice hmd;
+		PoseHistory history;
+		PoseSampler sampler;
+		sampler.Start(&hmd, &history, 20000.0);
+		unsigned long long reads = 0, torn = 0;
+		const double end = Clock::Now() + 0.5;
+		while (Clock::Now() < end)
+		{
+			ovrPoseStatef latest, truth;
+			if (!history.Latest(&latest))
+				continue;
+			NullHmdDevice::HeadStateAt(latest.TimeInSeconds, &truth);
+			if (memcmp(&latest, &truth, sizeof(truth)) != 0)
+				torn++;
+			ovrPoseStatef sampled;
+			history.Sample(latest.TimeInSeconds - 0.01, &sampled);
+			reads++;
+		}
+		sampler.Stop();
+		printf("concurrent: %llu samples written, %llu read, %llu torn\n", sampler.Samples(), reads, torn);
+		ok = ok && torn == 0 && sampler.Samples() > 0;
+		return ok;
+	}
+
+	// Checks the camera reprojection three ways: the quad transform against
+	// the point mapping, the software rasterizer drawing a marker where the
+	// point mapping puts it, and a frame loop at 75 Hz showing a 30 Hz
+	// camera, which reports the frames reused and the latency hidden.
+	static bool s_reproject()
+	{
+		const double seconds = s_argc > 0 ? atof(s_argv[0]) : 2.0;
+		NullHmdDevice hmd;
+		const ovrRecti viewport = hmd.EyeViewport(0);
+		const ovrFovPort fov = hmd.EyeFov(0);
+		const ovrQuatf identity = { 0.0f, 0.0f, 0.0f, 1.0f };
+		bool ok = true;
+
+		// transform against MapPoint for head turns up to 10 degrees, in pixels
+		srand(1);
+		double maxError = 0.0;
+		for (int i = 0; i < 1000; i++)
+		{
+			const OVR::Vector3f axis((rand() % 2001 - 1000) / 1000.0f, (rand() % 2001 - 1000) / 1000.0f, (rand() % 2001 - 1000) / 1000.0f + 0.001f);
+			const ovrQuatf display = OVR::Quatf(axis, (rand() % 1001) / 1000.0f * 10.0f * 3.14159265f / 180.0f);
+			float transform[16];
+			CameraReprojection::Transform(fov, identity, display, transform);
+			for (int p = 0; p < 16; p++)
+			{
+				const float x = (rand() % 2001 - 1000) / 1000.0f;
+				const float y = (rand() % 2001 - 1000) / 1000.0f;
+				float mx, my;
+				if (!CameraReprojection::MapPoint(fov, identity, display, x, y, &mx, &my))
+					continue;
+				const float w = transform[12] * x + transform[13] * y - transform[14] + transform[15];
+				const float tx = (transform[0] * x + transform[1] * y - transform[2] + transform[3]) / w;
+				const float ty = (transform[4] * x + transform[5] * y - transform[6] + transform[7]) / w;
+				const double error = std::max(std::fabs(tx - mx) * viewport.Size.w, std::fabs(ty - my) * viewport.Size.h) * 0.5;
+				maxError = std::max(maxError, error);
+			}
+		}
+		printf("camera reprojection\n");
+		printf("  transform against point mapping: max %.4f px\n", maxError);
+		ok = ok && maxError < 0.01;
+
+		// a white square on black, drawn turned by the software rasterizer
+		const int cameraWidth = 640, cameraHeight = 480;
+		const int markerX = 400, markerY = 180, markerSize = 16;
+		SoftwareRenderDevice render(viewport.Size.w, viewport.Size.h, cameraWidth, cameraHeight);
+		int pitch = 0;
+		unsigned char *camera = render.MapCameraTexture(0, &pitch);
+		for (int y = 0; y < cameraHeight; y++)
+			for (int x = 0; x < cameraWidth; x++)
+			{
+				const bool marker = x >= markerX && x < markerX + markerSize && y >= markerY && y < markerY + markerSize;
+				unsigned char *p = camera + y * pitch + x * 4;
+				p[0] = p[1] = p[2] = marker ? 255 : 0;
+				p[3] = 255;
+			}
+		render.UnmapCameraTexture(0);
+
+		const float turns[][2] = { { 0.0f, 0.0f }, { 3.0f, 0.0f }, { -2.0f, 4.0f }, { 8.0f, -5.0f } };
+		for (int t = 0; t < 4; t++)
+		{
+			const float yaw = turns[t][0] * 3.14159265f / 180.0f;
+			const float pitchAngle = turns[t][1] * 3.14159265f / 180.0f;
+			const ovrQuatf display = OVR::Quatf(OVR::Vector3f(0.0f, 1.0f, 0.0f), yaw) * OVR::Quatf(OVR::Vector3f(1.0f, 0.0f, 0.0f), pitchAngle);
+			OVR::Matrix4f transform;
+			CameraReprojection::Transform(fov, identity, display, &transform.M[0][0]);
+			const ovrMatrix4f transposed = transform.Transposed();
+
+			render.BeginFrame();
+			render.SetViewport(viewport);
+			render.WriteConstants(transposed.M, sizeof(transposed.M));
+			render.SetTexture(TEXTURE_CAMERA_LEFT);
+			render.DrawQuad();
+			render.EndFrame();
+
+			// centroid of the bright pixels against the mapped marker center;
+			// the clear colour shows where the image turned away
+			double sumX = 0.0, sumY = 0.0, weight = 0.0;
+			for (int y = 0; y < render.Height(); y++)
+				for (int x = 0; x < render.Width(); x++)
+				{
+					const unsigned char green = render.Image()[y * render.Pitch() + x * 4 + 1];
+					const double value = green > 128 ? green : 0.0;
+					sumX += value * (x + 0.5);
+					sumY += value * (y + 0.5);
+					weight += value;
+				}
+			// texture u, v to viewport NDC: the scene quad has v = 0 at the top
+			const float u = (markerX + markerSize * 0.5f) / cameraWidth;
+			const float v = (markerY + markerSize * 0.5f) / cameraHeight;
+			float mx = 0.0f, my = 0.0f;
+			const bool mapped = CameraReprojection::MapPoint(fov, identity, display, u * 2.0f - 1.0f, 1.0f - v * 2.0f, &mx, &my);
+			const double expectedX = (mx + 1.0) * 0.5 * viewport.Size.w;
+			const double expectedY = (1.0 - my) * 0.5 * viewport.Size.h;
+			const double error = weight > 0.0 ? std::sqrt((sumX / weight - expectedX) * (sumX / weight - expectedX) + (sumY / weight - expectedY) * (sumY / weight - expectedY)) : 1e9;
+			printf("  software rasterizer, yaw %4.1f pitch %4.1f deg: marker at %7.1f %7.1f, expected %7.1f %7.1f\n",
+				turns[t][0], turns[t][1], sumX / weight, sumY / weight, expectedX, expectedY);
+			ok = ok && mapped && error < 1.0;
+		}
+
+		// the whole loop, headless: 30 Hz camera, 75 Hz display
+		NullRenderDevice nullRender(cameraWidth, cameraHeight);
+		SyntheticCameraSource synthetic(cameraWidth, cameraHeight, 30.0);
+		CameraThread cameraThread;
+		CameraCalibration calibration[2];
+		UndistortMap undistort;
+		undistort.Init(cameraWidth, cameraHeight, calibration, 0.0f, 0.9f, nullptr);
+		PoseHistory history;
+		PoseSampler sampler;
+		sampler.Start(&hmd, &history);
+		// a camera frame captured before the first pose cannot be reprojected
+		const double poseTimeout = Clock::Now() + 1.0;
+		while (history.Count() == 0 && Clock::Now() < poseTimeout)
+			Clock::Sleep(0.001);
+		cameraThread.Start(&synthetic);
+
+		FrameLoop loop(&hmd, &nullRender);
+		loop.SetCamera(&cameraThread, &undistort, nullptr);
+		loop.SetPoseHistory(&history);
+		loop.SetShowCamera(true);
+		loop.SetReprojectCamera(true);
+
+		// until the first camera frame is there and reprojected
+		const double timeout = Clock::Now() + 1.0;
+		while (loop.Reprojection().reprojected == 0 && Clock::Now() < timeout)
+		{
+			loop.RunFrame();
+			Clock::Sleep(1.0 / 75.0);
+		}
+		loop.Reprojection().Clear();
+		nullRender.ResetCounters();
+
+		const int frames = static_cast<int>(seconds * 75.0);
+		double next = Clock::Now();
+		for (int i = 0; i < frames; i++)
+		{
+			loop.RunFrame();
+			next += 1.0 / 75.0;
+			const double wait = next - Clock::Now();
+			if (wait > 0.0)
+				Clock::Sleep(wait);
+		}
+		sampler.Stop();
+		cameraThread.Stop();
+
+		const ReprojectionStats &stats = loop.Reprojection();
+		const double reprojected = stats.reprojected > 0 ? static_cast<double>(stats.reprojected) : 1.0;
+		printf("  frame loop, %d frames: %llu with camera, %llu reused, %llu reprojected\n", frames, stats.frames, stats.reused, stats.reprojected);
+		printf("  latency hidden mean %.1f ms max %.1f ms, rotation corrected mean %.2f deg max %.2f deg\n",
+			stats.latencySum * 1e3 / reprojected, stats.latencyMax * 1e3, stats.rotationSum / reprojected, stats.rotationMax);
+		const RenderCounters &counters = nullRender.Counters();
+		// per eye the camera quad and one instanced draw; both warps in the frame's one upload
+		const unsigned long long n = static_cast<unsigned long long>(frames);
+		ok = ok && stats.frames == n && stats.reprojected == n && stats.reused > 0 && counters.draws == n * 4 && counters.constantMaps == n;
+		return ok;
+	}
+
+	// ns per log call from 1 to 8 threads logging at once, against
+	// formatting and writing on the calling thread like Log did before.
+	// The threads log in bursts the ring can hold, then all of them flood
+	// it without pause to see the drop policy. Every message must end up in
+	// the file whole or be counted as dropped.
+	// Arguments: [messages per thread] [file]
+	static bool s_log()
+	{
+		const int messages = s_argc > 0 ? atoi(s_argv[0]) : 20000;
+		const char *path = s_argc > 1 ? s_argv[1] : "bench_log.txt";
+		const int burst = 256;
+		bool ok = true;
+
+		// the old way: format, print and flush on the calling thread
+		FILE *file = fopen(path, "w");
+		if (!file)
+		{
+			printf("log: cannot write '%s'\n", path);
+			return false;
+		}
+		double start = Clock::Now();
+		for (int i = 0; i < messages; i++)
+		{
+			char text[Log::MaxMessage];
+			snprintf(text, sizeof(text), "thread %d message %d value %.3f", 0, i, i * 0.5);
+			fprintf(file, "%s\n", text);
+			fflush(file);
+		}
+		const double direct = Clock::Now() - start;
+		fclose(file);
+		printf("logging, %d messages per thread\n", messages);
+		printf("  write and flush per call  %9.1f ns/call\n", direct * 1e9 / messages);
+
+		const int threadCounts[] = { 1, 2, 4, 8, 8 };
+		for (int c = 0; c < 5; c++)
+		{
+			const int threads = threadCounts[c];
+			const bool flood = c == 4;
+			unsigned long long written = 0, dropped = 0;
+			std::vector<double> elapsed(threads);
+			{
+				Log log(path, false);
+				std::vector<std::thread> workers;
+				for (int t = 0; t < threads; t++)
+					workers.push_back(std::thread([&, t]() {
+						double busy = 0.0;
+						for (int i = 0; i < messages; i += burst)
+						{
+							const int end = std::min(i + burst, messages);
+							const double begin = Clock::Now();
+							for (int m = i; m < end; m++)
+								log.Print("thread %d message %d value %.3f", t, m, m * 0.5);
+							busy += Clock::Now() - begin;
+							if (!flood)
+								Clock::Sleep(0.002);
+						}
+						elapsed[t] = busy;
+					}));
+				for (int t = 0; t < threads; t++)
+					workers[t].join();
+				log.Flush();
+				written = log.Written();
+				dropped = log.Dropped();
+			}
+
+			// every message line has to be one of those logged, in one piece
+			unsigned long long lines = 0, broken = 0;
+			file = fopen(path, "r");
+			char line[512];
+			while (file && fgets(line, sizeof(line), file))
+			{
+				const char *text = strstr(line, "thread ");
+				if (!text)
+					continue;
+				int t = -1, i = -1;
+				double value = 0.0;
+				if (sscanf(text, "thread %d message %d value %lf", &t, &i, &value) != 3 || t < 0 || t >= threads ||
+					i < 0 || i >= messages || std::fabs(value - i * 0.5) > 1e-3)
+					broken++;
+				lines++;
+			}
+			if (file)
+				fclose(file);
+
+			double mean = 0.0, worst = 0.0;
+			for (int t = 0; t < threads; t++)
+			{
+				mean += elapsed[t] / threads;
+				worst = std::max(worst, elapsed[t]);
+			}
+			const unsigned long long total = static_cast<unsigned long long>(threads) * messages;
+			const bool match = written + dropped == total && lines == written && broken == 0;
+			ok = ok && match;
+			printf("  %-6s %d thread%s %9.1f ns/call mean %9.1f worst, %llu written %llu dropped%s\n", flood ? "flood" : "bursts",
+				threads, threads == 1 ? " " : "s", mean * 1e9 / messages, worst * 1e9 / messages, written, dropped, match ? "" : "  MISMATCH");
+		}
+		remove(path);
+		return ok;
+	}
+
+	// Reads the message part of the lines of a text log that contain key
+	static std::vector<std::string> s_logMessages(const char *path, const char *key)
+	{
+		std::vector<std::string> messages;
+		FILE *file = fopen(path, "r");
+		char line[2048];
+		while (file && fgets(line, sizeof(line), file))
+		{
+			// after the "%10.6f: " time
+			const char *text = strstr(line, ": ");
+			if (text && strstr(text, key))
+				messages.push_back(text + 2);
+		}
+		if (file)
+			fclose(file);
+		return messages;
+	}
+
+	// Logs a message through Print and keeps what snprintf makes of it
+	template<typename... Args>
+	static void s_printBoth(std::vector<std::string> &expected, const char *format, const Args&... args)
+	{
+		char text[Log::MaxMessage];
+		snprintf(text, sizeof(text), format, args...);
+		expected.push_back(std::string(text) + "\n");
+		Log::Get()->Print(format, args...);
+	}
+
+	// Per-frame telemetry logged as text, with deferred formatting and as
+	// binary records: ns per call, and the decoded binary log has to read
+	// exactly like the text one. Debug calls below LOG_MIN_LEVEL must cost
+	// nothing. Arguments: [messages] [file prefix]
+	static bool s_logbinary()
+	{
+		const int messages = s_argc > 0 ? atoi(s_argv[0]) : 20000;
+		const std::string prefix = s_argc > 1 ? s_argv[1] : "bench_log";
+		const std::string textPath = prefix + ".txt", deferredPath = prefix + "_deferred.txt";
+		const std::string binaryPath = prefix + ".bin", decodedPath = prefix + "_decoded.txt";
+		// a frame's worth of telemetry; the ring is emptied between bursts,
+		// so with a burst below Log::Capacity nothing can be dropped
+		const int burst = 256;
+		bool ok = true;
+
+		// every argument type once, and the telemetry line
+		auto check = [](int mode) {
+			if (mode == 0)
+				Log::Get()->Print("check %d %u %lld %llu %5.2f %s %c %x %% %-6s|", -5, 7u, -1234567890123LL, 18446744073709551615ULL, 3.14159, "text", 'A', 255, "pad");
+			else
+				LOG_PRINT("check %d %u %lld %llu %5.2f %s %c %x %% %-6s|", -5, 7u, -1234567890123LL, 18446744073709551615ULL, 3.14159, "text", 'A', 255, "pad");
+		};
+		auto telemetry = [](int mode, int i) {
+			const float q[4] = { 0.01f * (i % 100), 0.7071f, -0.25f, 0.5f + i * 1e-5f };
+			if (mode == 0)
+				Log::Get()->Print("frame %u pose %.4f %.4f %.4f %.4f dt %.3f ms camera %s", static_cast<unsigned>(i), q[0], q[1], q[2], q[3], 13.3 + (i % 7) * 0.1, i % 3 ? "reused" : "new");
+			else
+				LOG_PRINT("frame %u pose %.4f %.4f %.4f %.4f dt %.3f ms camera %s", static_cast<unsigned>(i), q[0], q[1], q[2], q[3], 13.3 + (i % 7) * 0.1, i % 3 ? "reused" : "new");
+		};
+
+		printf("structured logging, %d messages\n", messages);
+		const char *modeNames[] = { "text, Print", "text, deferred", "binary" };
+		const std::string paths[] = { textPath, deferredPath, binaryPath };
+		for (int mode = 0; mode < 3; mode++)
+		{
+			double busy = 0.0;
+			{
+				Log log(paths[mode].c_str(), false, mode == 2);
+				check(mode == 0 ? 0 : 1);
+				for (int i = 0; i < messages; i += burst)
+				{
+					const int end = std::min(i + burst, messages);
+					const double begin = Clock::Now();
+					for (int m = i; m < end; m++)
+						telemetry(mode == 0 ? 0 : 1, m);
+					busy += Clock::Now() - begin;
+					log.Flush();
+				}
+				ok = ok && log.Dropped() == 0;
+			}
+			printf("  %-15s %7.1f ns/call\n", modeNames[mode], busy * 1e9 / messages);
+		}
+
+		// the decoded binary log reads like the text ones
+		const bool decoded = Log::Decode(binaryPath.c_str(), decodedPath.c_str());
+		const std::vector<std::string> text = s_logMessages(textPath.c_str(), "frame ");
+		const std::vector<std::string> deferred = s_logMessages(deferredPath.c_str(), "frame ");
+		const std::vector<std::string> fromBinary = s_logMessages(decodedPath.c_str(), "frame ");
+		const std::vector<std::string> checkText = s_logMessages(textPath.c_str(), "check ");
+		const std::vector<std::string> checkBinary = s_logMessages(decodedPath.c_str(), "check ");
+		const bool match = decoded && text.size() == static_cast<size_t>(messages) && text == deferred && text == fromBinary && checkText == checkBinary;
+		FILE *file = fopen(binaryPath.c_str(), "rb");
+		long binarySize = 0, textSize = 0;
+		if (file)
+		{
+			fseek(file, 0, SEEK_END);
+			binarySize = ftell(file);
+			fclose(file);
+		}
+		file = fopen(textPath.c_str(), "rb");
+		if (file)
+		{
+			fseek(file, 0, SEEK_END);
+			textSize = ftell(file);
+			fclose(file);
+		}
+		printf("  decoded binary log %s the text log, %ld bytes binary, %ld bytes text\n", match ? "matches" : "DIFFERS FROM", binarySize, textSize);
+		if (!checkText.empty() && !checkBinary.empty())
+			printf("  text:    %s  decoded: %s", checkText[0].c_str(), checkBinary[0].c_str());
+		ok = ok && match;
+
+		// below the compiled-in level nothing is left of the call
+		{
+			Log log(textPath.c_str(), false);
+			const double begin = Clock::Now();
+			for (int i = 0; i < messages; i++)
+				LOG_DEBUG("frame %d debug %f", i, i * 0.5);
+			const double elapsed = Clock::Now() - begin;
+			log.Flush();
+			const bool compiledOut = !LogGate<LOG_LEVEL_DEBUG>::Enabled;
+			printf("  LOG_DEBUG %s %7.1f ns/call, %llu written\n", compiledOut ? "compiled out" : "compiled in", elapsed * 1e9 / messages, log.Written());
+			ok = ok && (!compiledOut || log.Written() == 0);
+		}
+
+		// Print leaves to the writer what LogArgs prints the same and
+		// formats the rest itself; either way the line is snprintf's
+		std::vector<std::string> expected;
+		{
+			Log log(textPath.c_str(), false);
+			const std::string longText(300, 'x');
+			s_printBoth(expected, "printf %d %5u %-4ld|%lld %llx %zu %c %s %.2e %g %%", -3, 9u, -7L, -9000000000LL, 0xABCDEFULL, static_cast<size_t>(42), 'z', "str", 12345.678, 0.1);
+			s_printBoth(expected, "printf %0200d %0100d", 1, 2);
+			s_printBoth(expected, "printf %*d|%hd", 6, 42, static_cast<short>(-2));
+			s_printBoth(expected, "printf %p", static_cast<void*>(&expected));
+			s_printBoth(expected, "printf %s", longText.c_str());
+			log.Flush();
+		}
+		const bool printed = s_logMessages(textPath.c_str(), "printf ") == expected;
+		printf("  Print on the writer and the caller %s\n", printed ? "reads like snprintf" : "DIFFERS FROM snprintf");
+		ok = ok && printed;
+
+		// a spec too long to print still takes its argument
+		unsigned char argsBuffer[64];
+		LogArgs packed(argsBuffer, sizeof(argsBuffer));
+		packed.AddAll(1, 2);
+		char formatted[64];
+		LogArgs::Format("%0000000000000000000000000000000000000000000000001d %d", argsBuffer, packed.Size(), formatted, sizeof(formatted));
+		const bool skipped = strcmp(formatted, "? 2") == 0;
+		printf("  overlong spec: \"%s\"%s\n", formatted, skipped ? "" : "  MISMATCH");
+		ok = ok && skipped;
+
+		remove(textPath.c_str());
+		remove(deferredPath.c_str());
+		remove(binaryPath.c_str());
+		remove(decodedPath.c_str());
+		return ok;
+	}
+
+	// Writes down what a listener of the input benchmark gets: the type of
+	// every event and the sequence number the benchmark put into it
+	class InputTrace : public InputListener
+	{
+	public:
+		explicit InputTrace(bool consumeKeys) : frameTime(0.0), wrongTime(0), m_consumeKeys(consumeKeys) {}
+
+		bool MousePressed(const MouseEventClick &arg) { m_add(INPUT_MOUSE_PRESS, arg.x, arg.time); return false; }
+		bool MouseReleased(const MouseEventClick &arg) { m_add(INPUT_MOUSE_RELEASE, arg.x, arg.time); return false; }
+		bool MouseWheel(const MouseEventWheel &arg) { m_add(INPUT_MOUSE_WHEEL, arg.x, arg.time); return false; }
+		bool MouseMove(const MouseEvent &arg) { m_add(INPUT_MOUSE_MOVE, arg.x, arg.time); return false; }
+		bool KeyPressed(const KeyEvent &arg) { m_add(INPUT_KEY_PRESS, arg.scan, arg.time); return m_consumeKeys; }
+		bool KeyReleased(const KeyEvent &arg) { m_add(INPUT_KEY_RELEASE, arg.scan, arg.time); return m_consumeKeys; }
+
+		static unsigned Entry(int type, int sequence) { return static_cast<unsigned>(type) << 24 | (sequence & 0x7FFF); }
+
+		std::vector<unsigned> events;
+		double frameTime;
+		unsigned long long wrongTime;
+
+	private:
+		void m_add(int type, int sequence, double time)
+		{
+			events.push_back(Entry(type, sequence));
+			if (time != frameTime)
+				wrongTime++;
+		}
+
+		bool m_consumeKeys;
+	};
+
+	// Synthetic input event i: mostly mouse moves, some buttons, wheel and
+	// keys. Mouse events carry i as x, keys as their scan code.
+	static InputEvent s_inputEvent(int i, double time)
+	{
+		InputEvent event = {};
+		event.time = time;
+		const int r = rand() % 10;
+		event.type = static_cast<unsigned char>(r < 7 ? INPUT_MOUSE_MOVE : r == 7 ? INPUT_MOUSE_WHEEL :
+			r == 8 ? (i & 1 ? INPUT_MOUSE_RELEASE : INPUT_MOUSE_PRESS) : (i & 1 ? INPUT_KEY_RELEASE : INPUT_KEY_PRESS));
+		event.button = static_cast<unsigned char>(i % MOUSE_MAX);
+		event.key = eKeyCodes::KEY_SPACE;
+		event.scan = static_cast<unsigned short>(i & 0x7FFF);
+		event.x = i;
+		event.y = -i;
+		event.dx = 1;
+		event.dy = -1;
+		event.wheel = InputMgr::WheelUnits;
+		return event;
+	}
+
+	// Streams of synthetic input events through the input queue, with no
+	// window behind it. Every frame the queued events go to two listeners,
+	// the first one consuming keys: both have to get them in order, with the
+	// frame time, each run of mouse moves and wheel turns as one move and one
+	// wheel event, and the second one no keys. Reports ns per event queued and handed on, then runs the
+	// queue with the events coming from another thread.
+	// Arguments: [events] [events per frame]
+	static bool s_input()
+	{
+		const int events = s_argc > 0 ? atoi(s_argv[0]) : 200000;
+		const int perFrame = s_argc > 1 ? std::max(1, atoi(s_argv[1])) : 133;
+		bool ok = true;
+
+		InputMgr *input = new InputMgr();
+		InputTrace first(true), second(false);
+		input->AddListener(&first);
+		input->AddListener(&second);
+		std::vector<unsigned> expectFirst, expectSecond;
+		unsigned long long expectCoalesced = 0, dispatched = 0;
+		double pushTime = 0.0, dispatchTime = 0.0;
+		std::vector<InputEvent> frame;
+		srand(1);
+		for (int i = 0, f = 0; i < events; f++)
+		{
+			const double frameTime = f / 75.0;
+			frame.clear();
+			for (; i < events && static_cast<int>(frame.size()) < perFrame; i++)
+				frame.push_back(s_inputEvent(i, frameTime - 0.001));
+			auto expect = [&](int type, int sequence) {
+				expectFirst.push_back(InputTrace::Entry(type, sequence));
+				if (type != INPUT_KEY_PRESS && type != INPUT_KEY_RELEASE)
+					expectSecond.push_back(InputTrace::Entry(type, sequence));
+			};
+			unsigned moves = 0, wheels = 0;
+			int runX = 0;
+			for (size_t e = 0; e <= frame.size(); e++)
+			{
+				const int type = e < frame.size() ? frame[e].type : -1;
+				if (type == INPUT_MOUSE_MOVE || type == INPUT_MOUSE_WHEEL)
+				{
+					(type == INPUT_MOUSE_MOVE ? moves : wheels)++;
+					runX = frame[e].x;
+					continue;
+				}
+				if (moves > 0)
+					expect(INPUT_MOUSE_MOVE, runX);
+				if (wheels > 0)
+					expect(INPUT_MOUSE_WHEEL, runX);
+				expectCoalesced += moves + wheels - (moves > 0) - (wheels > 0);
+				moves = wheels = 0;
+				if (type >= 0)
+					expect(type, type == INPUT_KEY_PRESS || type == INPUT_KEY_RELEASE ? frame[e].scan : frame[e].x);
+			}
+
+			const double pushStart = Clock::Now();
+			for (size_t e = 0; e < frame.size(); e++)
+				ok = input->Push(frame[e]) && ok;
+			const double dispatchStart = Clock::Now();
+			first.frameTime = second.frameTime = frameTime;
+			dispatched += input->Dispatch(frameTime);
+			dispatchTime += Clock::Now() - dispatchStart;
+			pushTime += dispatchStart - pushStart;
+		}
+		const bool match = first.events == expectFirst && second.events == expectSecond && input->Coalesced() == expectCoalesced &&
+			dispatched == expectFirst.size() && first.wrongTime == 0 && second.wrongTime == 0 && input->Dropped() == 0;
+		ok = ok && match;
+		printf("input queue, %d events, %d per frame, 2 listeners\n", events, perFrame);
+		printf("  queue    %7.1f ns/event\n", pushTime * 1e9 / events);
+		printf("  dispatch %7.1f ns/event handed on, %llu handed on, %llu mouse events merged%s\n",
+			dispatchTime * 1e9 / std::max(1ULL, dispatched), dispatched, input->Coalesced(), match ? "" : "  MISMATCH");
+		delete input;
+
+		// message thread and frame thread: nothing may get lost or out of order
+		const int threadedEvents = std::min(events, 16000);
+		input = new InputMgr();
+		InputTrace trace(false);
+		input->AddListener(&trace);
+		std::atomic<bool> done(false);
+		unsigned long long expectOther = 0;
+		std::thread producer([&]() {
+			srand(2);
+			for (int i = 0; i < threadedEvents; i++)
+			{
+				const InputEvent event = s_inputEvent(i, 0.0);
+				if (event.type != INPUT_MOUSE_MOVE && event.type != INPUT_MOUSE_WHEEL)
+					expectOther++;
+				while (!input->Push(event))
+					std::this_thread::yield();
+				// a 8 kHz mouse
+				if (i % 64 == 63)
+					Clock::Sleep(0.008);
+			}
+			done = true;
+		});
+		unsigned long long frames = 0;
+		while (true)
+		{
+			const bool last = done;
+			trace.frameTime = Clock::Now();
+			input->Dispatch(trace.frameTime);
+			frames++;
+			if (last && input->Dispatch(trace.frameTime) == 0)
+				break;
+			Clock::Sleep(1.0 / 75.0);
+		}
+		producer.join();
+		// sequence numbers never go back, merged mouse events skip some
+		unsigned long long other = 0, unordered = 0;
+		for (size_t e = 0; e < trace.events.size(); e++)
+		{
+			const unsigned type = trace.events[e] >> 24;
+			if (type != INPUT_MOUSE_MOVE && type != INPUT_MOUSE_WHEEL)
+				other++;
+			if (e > 0 && (((trace.events[e] & 0x7FFF) - (trace.events[e - 1] & 0x7FFF)) & 0x7FFF) >= 0x4000)
+				unordered++;
+		}
+		const bool complete = !trace.events.empty() && (trace.events.back() & 0x7FFF) == ((threadedEvents - 1) & 0x7FFF);
+		const bool threadedMatch = other == expectOther && unordered == 0 && complete && trace.wrongTime == 0;
+		ok = ok && threadedMatch;
+		printf("  threaded %d events, %llu frames, %llu handed on, %llu pushes found the queue full%s\n", threadedEvents, frames,
+			static_cast<unsigned long long>(trace.events.size()), input->Dropped(), threadedMatch ? "" : "  MISMATCH");
+		delete input;
+		return ok;
+	}
+
+	// Key listener of the keys benchmark, asking for the character or not
+	class KeyCounter : public InputListener
+	{
+	public:
+		explicit KeyCounter(bool text) : keys(0), characters(0), m_text(text) {}
+
+		bool KeyPressed(const KeyEvent &arg) { return m_key(arg); }
+		bool KeyReleased(const KeyEvent &arg) { return m_key(arg); }
+
+		unsigned long long keys;
+		unsigned long long characters;
+
+	private:
+		bool m_key(const KeyEvent &arg)
+		{
+			keys++;
+			if (m_text && arg.Char() != 0)
+				characters++;
+			return false;
+		}
+
+		bool m_text;
+	};
+
+	// Key and mouse button state InputMgr keeps from a synthetic stream of
+	// presses, repeats, releases and focus losses: after every frame
+	// IsDown and WasPressedThisFrame have to agree with a plain reference.
+	// Reports ns per query, ns per key event with and without the
+	// character, and checks the character follows shift and caps lock.
+	// Arguments: [frames] [events per frame]
+	static bool s_keys()
+	{
+		const int frames = s_argc > 0 ? atoi(s_argv[0]) : 20000;
+		const int perFrame = s_argc > 1 ? std::max(1, atoi(s_argv[1])) : 8;
+		const unsigned bits = 256 + MOUSE_MAX;
+		bool ok = true;
+
+		InputMgr *input = new InputMgr();
+		KeyCounter counter(false);
+		input->AddListener(&counter);
+		std::vector<unsigned char> down(bits, 0), pressed(bits, 0);
+		unsigned long long mismatches = 0, events = 0;
+		double queryTime = 0.0;
+		unsigned long long queries = 0, held = 0;
+		srand(1);
+		for (int f = 0; f < frames; f++)
+		{
+			std::fill(pressed.begin(), pressed.end(), 0);
+			for (int e = 0; e < perFrame; e++, events++)
+			{
+				InputEvent event = {};
+				const int r = rand() % 100;
+				// a few keys and buttons, so they get held, repeated and released
+				const unsigned key = static_cast<unsigned>("\x10\x11\x20\x25\x26\x27\x28\x41\x44\x53\x57\x5A"[rand() % 12]);
+				const unsigned button = static_cast<unsigned>(rand() % MOUSE_MAX);
+				if (r == 0)
+				{
+					event.type = INPUT_FOCUS_LOST;
+					std::fill(down.begin(), down.end(), 0);
+				}
+				else
+				{
+					const bool mouse = r < 20;
+					const bool press = r % 2 == 0;
+					const unsigned bit = mouse ? 256 + button : key;
+					event.type = static_cast<unsigned char>(mouse ? (press ? INPUT_MOUSE_PRESS : INPUT_MOUSE_RELEASE) : (press ? INPUT_KEY_PRESS : INPUT_KEY_RELEASE));
+					event.button = static_cast<unsigned char>(button);
+					event.key = static_cast<eKeyCodes>(key);
+					if (press && !down[bit])
+						pressed[bit] = 1;
+					down[bit] = press;
+				}
+				ok = input->Push(event) && ok;
+			}
+			input->Dispatch(f / 75.0);
+
+			const double start = Clock::Now();
+			for (unsigned k = 0; k < 256; k++)
+			{
+				const bool isDown = input->IsDown(static_cast<eKeyCodes>(k));
+				const bool wasPressed = input->WasPressedThisFrame(static_cast<eKeyCodes>(k));
+				held += isDown;
+				if (isDown != (down[k] != 0) || wasPressed != (pressed[k] != 0))
+					mismatches++;
+			}
+			for (unsigned b = 0; b < MOUSE_MAX; b++)
+			{
+				const bool isDown = input->IsDown(static_cast<eMouseKeyCodes>(b));
+				const bool wasPressed = input->WasPressedThisFrame(static_cast<eMouseKeyCodes>(b));
+				if (isDown != (down[256 + b] != 0) || wasPressed != (pressed[256 + b] != 0))
+					mismatches++;
+			}
+			queryTime += Clock::Now() - start;
+			queries += 2 * bits;
+		}
+		ok = ok && mismatches == 0;
+		printf("key state, %d frames, %d events per frame\n", frames, perFrame);
+		printf("  IsDown and WasPressedThisFrame %5.2f ns/query, %.2f keys held on average, %llu mismatches%s\n",
+			queryTime * 1e9 / queries, static_cast<double>(held) / frames, mismatches, mismatches ? "  MISMATCH" : "");
+		delete input;
+
+		// the same key events to a listener that wants the text and one that does not
+		for (int text = 0; text < 2; text++)
+		{
+			input = new InputMgr();
+			KeyCounter keys(text != 0);
+			input->AddListener(&keys);
+			srand(2);
+			double elapsed = 0.0;
+			for (int f = 0; f < frames; f++)
+			{
+				for (int e = 0; e < perFrame; e++)
+				{
+					InputEvent event = {};
+					event.type = static_cast<unsigned char>(e % 2 ? INPUT_KEY_RELEASE : INPUT_KEY_PRESS);
+					event.key = static_cast<eKeyCodes>('A' + rand() % 26);
+					input->Push(event);
+				}
+				const double start = Clock::Now();
+				input->Dispatch(f / 75.0);
+				elapsed += Clock::Now() - start;
+			}
+			printf("  key events %-14s %6.1f ns/event, %llu characters\n", text ? "with Char()" : "without Char()",
+				elapsed * 1e9 / std::max(1ULL, keys.keys), keys.characters);
+			delete input;
+		}
+
+		// the character follows the shift the event stream holds and caps lock
+		input = new InputMgr();
+		struct CharListener : public InputListener
+		{
+			CharListener() : last(0) {}
+			bool KeyPressed(const KeyEvent &arg) { last = arg.Char(); return false; }
+			wchar_t last;
+		} chars;
+		input->AddListener(&chars);
+		auto type = [&](eKeyCodes key, bool press, unsigned char flags) -> wchar_t {
+			InputEvent event = {};
+			event.type = static_cast<unsigned char>(press ? INPUT_KEY_PRESS : INPUT_KEY_RELEASE);
+			event.key = key;
+			event.flags = flags;
+			chars.last = 0;
+			input->Push(event);
+			input->Dispatch(0.0);
+			return chars.last;
+		};
+		const wchar_t lower = type(eKeyCodes::KEY_A, true, 0);
+		type(eKeyCodes::KEY_A, false, 0);
+		type(eKeyCodes::KEY_SHIFT, true, 0);
+		const wchar_t upper = type(eKeyCodes::KEY_A, true, 0);
+		type(eKeyCodes::KEY_A, false, 0);
+		type(eKeyCodes::KEY_SHIFT, false, 0);
+		const wchar_t caps = type(eKeyCodes::KEY_A, true, INPUT_FLAG_CAPS_LOCK);
+		const bool charsMatch = lower != 0 && upper != lower && upper == static_cast<wchar_t>(towupper(lower)) && caps == upper;
+		ok = ok && charsMatch;
+		printf("  characters a %04x, shift+a %04x, caps lock a %04x%s\n", static_cast<unsigned>(lower), static_cast<unsigned>(upper),
+			static_cast<unsigned>(caps), charsMatch ? "" : "  MISMATCH");
+		delete input;
+		return ok;
+	}
+
+	// Mouse listener of the mouse benchmark, adds up what it gets
+	class MouseTotals : public InputListener
+	{
+	public:
+		MouseTotals() : calls(0), moves(0), wheels(0), dx(0), dy(0), notches(0) {}
+
+		bool MouseMove(const MouseEvent &arg) { calls++; moves += arg.count; dx += arg.dx; dy += arg.dy; return false; }
+		bool MouseWheel(const MouseEventWheel &arg) { calls++; wheels += arg.count; notches += arg.wheel; return false; }
+
+		unsigned long long calls;
+		unsigned long long moves;
+		unsigned long long wheels;
+		long long dx;
+		long long dy;
+		long long notches;
+	};
+
+	// A synthetic high rate mouse with a fine wheel, a quarter notch a step,
+	// at 75 Hz frames: once handed on event by event like the window
+	// messages used to be, once merged by Dispatch. The listeners have to
+	// get the same motion and notches either way, and merged at most a move
+	// and a wheel event a frame. Reports the cost per frame and per mouse
+	// event. Arguments: [seconds] [mouse rate]
+	static bool s_mouse()
+	{
+		const int seconds = s_argc > 0 ? std::max(1, atoi(s_argv[0])) : 20;
+		const int rate = s_argc > 1 ? std::max(75, atoi(s_argv[1])) : 8000;
+		const int frames = seconds * 75;
+		bool ok = true;
+
+		printf("mouse at %d Hz, %d frames at 75 Hz\n", rate, frames);
+		long long expectDx = 0, expectDy = 0, expectUnits = 0;
+		unsigned long long expectMoves = 0, expectWheels = 0;
+		for (int merged = 0; merged < 2; merged++)
+		{
+			InputMgr *input = new InputMgr();
+			MouseTotals totals;
+			input->AddListener(&totals);
+			srand(1);
+			int x = 0, y = 0;
+			long long sent = 0;
+			double elapsed = 0.0;
+			unsigned long long maxCalls = 0;
+			std::vector<InputEvent> batch;
+			for (int f = 0; f < frames; f++)
+			{
+				// the events of the polls that fell into this frame
+				const long long due = static_cast<long long>(f + 1) * rate / 75;
+				batch.clear();
+				for (; sent < due; sent++)
+				{
+					InputEvent event = {};
+					event.type = INPUT_MOUSE_MOVE;
+					event.dx = rand() % 7 - 3;
+					event.dy = rand() % 7 - 3;
+					x += event.dx;
+					y += event.dy;
+					event.x = x;
+					event.y = y;
+					batch.push_back(event);
+					if (sent % 16 == 0)
+					{
+						event.type = INPUT_MOUSE_WHEEL;
+						event.wheel = InputMgr::WheelUnits / 4;
+						batch.push_back(event);
+					}
+				}
+				if (merged == 0)
+					for (size_t e = 0; e < batch.size(); e++)
+					{
+						if (batch[e].type == INPUT_MOUSE_MOVE)
+						{
+							expectDx += batch[e].dx;
+							expectDy += batch[e].dy;
+							expectMoves++;
+						}
+						else
+						{
+							expectUnits += batch[e].wheel;
+							expectWheels++;
+						}
+					}
+
+				const unsigned long long callsBefore = totals.calls;
+				const double start = Clock::Now();
+				for (size_t e = 0; e < batch.size(); e++)
+				{
+					input->Push(batch[e]);
+					if (merged == 0)
+						input->Dispatch(f / 75.0);
+				}
+				if (merged == 1)
+					input->Dispatch(f / 75.0);
+				elapsed += Clock::Now() - start;
+				maxCalls = std::max(maxCalls, totals.calls - callsBefore);
+			}
+
+			// wheel units short of a whole notch stay behind
+			const bool match = totals.dx == expectDx && totals.dy == expectDy && totals.notches == expectUnits / InputMgr::WheelUnits &&
+				totals.moves == expectMoves && (merged == 0 || maxCalls <= 2);
+			ok = ok && match && input->Dropped() == 0;
+			printf("  %-13s %8.1f ns/frame %6.1f ns/mouse event, %6.2f listener calls/frame, motion %lld %lld, %lld notches%s\n",
+				merged ? "merged" : "event by event", elapsed * 1e9 / frames, elapsed * 1e9 / (expectMoves + expectWheels),
+				static_cast<double>(totals.calls) / frames, totals.dx, totals.dy, totals.notches, match ? "" : "  MISMATCH");
+			delete input;
+		}
+		return ok;
+	}
+
+	// Listener of the listeners benchmark: counts its calls and writes its
+	// id into order, if there is one. On a key it can take itself out, or
+	// take out and delete another listener.
+	class OrderListener : public InputListener
+	{
+	public:
+		OrderListener(int id, std::vector<int> *order) : calls(0), removeFrom(nullptr), deletes(nullptr), m_id(id), m_order(order) {}
+		// InputListener has none, and one is deleted through its own type
+		virtual ~OrderListener() {}
+
+		bool KeyPressed(const KeyEvent &)
+		{
+			m_call();
+			if (removeFrom && deletes)
+			{
+				removeFrom->RemoveListener(deletes);
+				delete deletes;
+				deletes = nullptr;
+			}
+			else if (removeFrom)
+				removeFrom->RemoveListener(this);
+			return false;
+		}
+		bool MouseMove(const MouseEvent &) { m_call(); return false; }
+
+		unsigned long long calls;
+		InputMgr *removeFrom;
+		OrderListener *deletes;
+
+	private:
+		void m_call()
+		{
+			calls++;
+			if (m_order)
+				m_order->push_back(m_id);
+		}
+
+		int m_id;
+		std::vector<int> *m_order;
+	};
+
+	// Hands keys on the way InputMgr used to: to every listener of a
+	// std::list, null checked and called
+	class ListWalk : public InputListener
+	{
+	public:
+		bool KeyPressed(const KeyEvent &arg)
+		{
+			for (auto it = listeners.begin(); it != listeners.end(); ++it)
+			{
+				if (!(*it))
+					continue;
+				else if ((*it)->KeyPressed(arg))
+					return true;
+			}
+			return false;
+		}
+
+		std::list<InputListener*> listeners;
+	};
+
+	// Listener priorities, kinds and removal, then ns per key event through
+	// Dispatch with 1, 10 and 100 listeners: walking a list as before,
+	// through the per-kind table when one listener handles keys and the rest
+	// only mouse moves, and through the table when all of them handle keys.
+	// Arguments: [key events]
+	static bool s_listeners()
+	{
+		const int events = s_argc > 0 ? atoi(s_argv[0]) : 100000;
+		bool ok = true;
+
+		auto key = [](InputMgr *input) {
+			InputEvent event = {};
+			event.type = INPUT_KEY_PRESS;
+			event.key = eKeyCodes::KEY_A;
+			input->Push(event);
+		};
+
+		// priority order, equal priorities in the order added; mouse only
+		// listeners get no keys; a listener removed from inside gets nothing
+		// more, not even the rest of the events of that Dispatch
+		{
+			InputMgr input;
+			std::vector<int> order;
+			OrderListener l0(0, &order), l1(1, &order), l2(2, &order), l3(3, &order), l4(4, &order), mouse(5, &order);
+			input.AddListener(&l0, 0);
+			input.AddListener(&l1, 5);
+			input.AddListener(&l2, -1);
+			input.AddListener(&l3, 5);
+			input.AddListener(&l4, 0);
+			input.AddListener(&mouse, 10, LISTEN_MOUSE_MOVE);
+			key(&input);
+			input.Dispatch(0.0);
+			const int expect1[] = { 1, 3, 0, 4, 2 };
+			bool match = order == std::vector<int>(expect1, expect1 + 5);
+
+			order.clear();
+			input.RemoveListener(&l3);
+			l0.removeFrom = &input;
+			key(&input);
+			key(&input);
+			input.Dispatch(0.0);
+			key(&input);
+			input.Dispatch(0.0);
+			const int expect2[] = { 1, 0, 4, 2, 1, 4, 2, 1, 4, 2 };
+			match = match && order == std::vector<int>(expect2, expect2 + 10) && mouse.calls == 0;
+
+			// one taken out and deleted by another mid Dispatch, which a
+			// sanitizer would catch being called afterwards
+			order.clear();
+			OrderListener *doomed = new OrderListener(6, &order);
+			input.AddListener(doomed, -5);
+			l1.removeFrom = &input;
+			l1.deletes = doomed;
+			key(&input);
+			key(&input);
+			input.Dispatch(0.0);
+			const int expect3[] = { 1, 4, 2, 1, 4, 2 };
+			match = match && order == std::vector<int>(expect3, expect3 + 6);
+			ok = ok && match;
+			printf("listeners: priority order, kinds and removal %s\n", match ? "ok" : "MISMATCH");
+		}
+
+		printf("  %-9s %12s %22s %22s\n", "listeners", "list walk", "table, 1 handles keys", "table, all handle keys");
+		const int counts[] = { 1, 10, 100 };
+		for (int c = 0; c < 3; c++)
+		{
+			const int count = counts[c];
+			std::vector<OrderListener> listeners;
+			for (int i = 0; i < count; i++)
+				listeners.push_back(OrderListener(i, nullptr));
+
+			// 0: the list, 1: the table with one key listener, 2: the table with all
+			double elapsed[3];
+			for (int mode = 0; mode < 3; mode++)
+			{
+				InputMgr *input = new InputMgr();
+				ListWalk walk;
+				if (mode == 0)
+				{
+					for (int i = 0; i < count; i++)
+						walk.listeners.push_back(&listeners[i]);
+					input->AddListener(&walk);
+				}
+				else
+					for (int i = 0; i < count; i++)
+						input->AddListener(&listeners[i], 0, mode == 2 || i == count - 1 ? LISTEN_KEY : LISTEN_MOUSE_MOVE);
+				elapsed[mode] = 0.0;
+				for (int e = 0; e < events; e += 64)
+				{
+					for (int k = e; k < e + 64 && k < events; k++)
+						key(input);
+					const double start = Clock::Now();
+					input->Dispatch(0.0);
+					elapsed[mode] += Clock::Now() - start;
+				}
+				delete input;
+			}
+			// the list called everyone, the table only the one with keys, then everyone
+			const bool match = listeners[0].calls == (count == 1 ? 3ULL : 2ULL) * events && listeners[count - 1].calls == 3ULL * events;
+			ok = ok && match;
+			printf("  %-9d %9.1f ns %19.1f ns %19.1f ns%s\n", count, elapsed[0] * 1e9 / events, elapsed[1] * 1e9 / events,
+				elapsed[2] * 1e9 / events, match ? "" : "  MISMATCH");
+		}
+		return ok;
+	}
+
+	// Key bindings read from text, then MyInput moving the overlay through a
+	// scripted key session at 60, 75 and 90 Hz frames, each once more with
+	// the key repeat of the system on top. The motion has to be the same
+	// every time and match the times the keys were held. Reports ns per
+	// frame update. Arguments: [updates]
+	static bool s_actions()
+	{
+		const int updates = s_argc > 0 ? atoi(s_argv[0]) : 1000000;
+		bool ok = true;
+
+		{
+			MyInput input;
+			const unsigned errors = input.actions.Parse("# comment\n  move_left = A, KEY_J mouse_left  # more\nnonsense = Q\nmove_left = NOKEY\ngarbage\n\n");
+			const unsigned left = 1u << MyInput::ACTION_MOVE_LEFT;
+			const bool match = errors == 3 && input.actions.Actions(eKeyCodes::KEY_A) == left && input.actions.Actions(eKeyCodes::KEY_J) == left &&
+				input.actions.Actions(MOUSE_LEFT) == left && input.actions.Actions(eKeyCodes::KEY_LEFT) == left &&
+				input.actions.Actions(eKeyCodes::KEY_X) == 1u << MyInput::ACTION_SCALE_DOWN && input.actions.Actions(eKeyCodes::KEY_Q) == 0;
+			ok = ok && match;
+			printf("actions: bindings %s, %u bad lines\n", match ? "ok" : "MISMATCH", errors);
+		}
+
+		// a bindings file with a bad line does not load, the old bindings stay
+		{
+			MyInput input;
+			const char *path = "bench_bindings.txt";
+			const std::string good = "move_left = J\n", bad = good + "move_left = NOKEY\n";
+			const unsigned left = 1u << MyInput::ACTION_MOVE_LEFT;
+			const unsigned before = input.actions.Actions(eKeyCodes::KEY_J);
+			s_writeFile(path, std::vector<unsigned char>(bad.begin(), bad.end()));
+			const bool badRejected = !input.LoadBindings(path) && input.actions.Actions(eKeyCodes::KEY_J) == before;
+			s_writeFile(path, std::vector<unsigned char>(good.begin(), good.end()));
+			const bool goodLoaded = input.LoadBindings(path) && input.actions.Actions(eKeyCodes::KEY_J) == left;
+			remove(path);
+			const bool missingRejected = !input.LoadBindings(path);
+			const bool match = badRejected && goodLoaded && missingRejected;
+			ok = ok && match;
+			printf("actions: bindings file %s\n", match ? "ok" : "MISMATCH");
+		}
+
+		struct Step
+		{
+			double time;
+			eKeyCodes key;
+			bool down;
+		};
+		const Step session[] =
+		{
+			{ 0.0, eKeyCodes::KEY_UP, true }, { 1.0, eKeyCodes::KEY_UP, false },
+			{ 1.0, eKeyCodes::KEY_Z, true }, { 2.0, eKeyCodes::KEY_Z, false },
+			{ 2.0, eKeyCodes::KEY_LEFT, true }, { 2.0, eKeyCodes::KEY_SHIFT, true },
+			{ 3.0, eKeyCodes::KEY_LEFT, false }, { 3.0, eKeyCodes::KEY_SHIFT, false },
+			{ 3.0, eKeyCodes::KEY_X, true }, { 5.0, eKeyCodes::KEY_X, false },
+			{ 5.0, eKeyCodes::KEY_SPACE, true }, { 6.0, eKeyCodes::KEY_SPACE, false }
+		};
+		const int steps = sizeof(session) / sizeof(session[0]);
+		const double length = 6.0;
+
+		// up 1 s, left and up 1 s; the scale doubles for 1 s and halves for 2 s
+		MyInput reference;
+		const OVR::Vector3f expectTranslate = reference.translate + OVR::Vector3f(-reference.translateSpeed, reference.translateSpeed, -reference.translateSpeed);
+		const float expectScale = reference.scaleAmount / reference.scaleSpeed;
+
+		const int rates[] = { 60, 75, 90 };
+		for (int r = 0; r < 3; r++)
+		{
+			for (int repeat = 0; repeat < 2; repeat++)
+			{
+				const int rate = rates[r];
+				InputMgr *manager = new InputMgr();
+				MyInput input;
+				int next = 0;
+				std::vector<eKeyCodes> held;
+				for (int f = 0; f < length * rate; f++)
+				{
+					const double time = static_cast<double>(f) / rate;
+					for (; next < steps && session[next].time <= time + 1e-9; next++)
+					{
+						InputEvent event = {};
+						event.type = static_cast<unsigned char>(session[next].down ? INPUT_KEY_PRESS : INPUT_KEY_RELEASE);
+						event.key = session[next].key;
+						manager->Push(event);
+						if (session[next].down)
+							held.push_back(session[next].key);
+						else
+							held.erase(std::find(held.begin(), held.end(), session[next].key));
+					}
+					// a press of every held key each frame, like a fast key repeat
+					for (size_t k = 0; repeat && k < held.size(); k++)
+					{
+						InputEvent event = {};
+						event.type = INPUT_KEY_PRESS;
+						event.key = held[k];
+						manager->Push(event);
+					}
+					manager->Dispatch(time);
+					input.Update(*manager, 1.0 / rate);
+				}
+				const float error = std::max(std::max(std::fabs(input.translate.x - expectTranslate.x), std::fabs(input.translate.y - expectTranslate.y)),
+					std::max(std::fabs(input.translate.z - expectTranslate.z), std::fabs(input.scaleAmount - expectScale)));
+				const bool match = error < 1e-4f && input.recenter;
+				ok = ok && match;
+				printf("  %d Hz%s translate %8.5f %8.5f %8.5f scale %.5f recenter %d%s\n", rate, repeat ? ", key repeat" : "             ",
+					input.translate.x, input.translate.y, input.translate.z, input.scaleAmount, input.recenter ? 1 : 0, match ? "" : "  MISMATCH");
+				delete manager;
+			}
+		}
+
+		// the cost of a frame: a bit test for every bound key
+		InputMgr *manager = new InputMgr();
+		MyInput input;
+		InputEvent event = {};
+		event.type = INPUT_KEY_PRESS;
+		event.key = eKeyCodes::KEY_UP;
+		manager->Push(event);
+		manager->Dispatch(0.0);
+		const double start = Clock::Now();
+		for (int i = 0; i < updates; i++)
+			input.Update(*manager, 1e-6);
+		const double elapsed = Clock::Now() - start;
+		printf("  Update %.1f ns/frame with %d actions bound, translate z %.3f\n", elapsed * 1e9 / updates, static_cast<int>(MyInput::ACTION_MAX), input.translate.z);
+		delete manager;
+		return ok;
+	}
+
+	// Hashes what the listeners get, with the frame time to the nanosecond
+	class InputDigest : public InputListener
+	{
+	public:
+		InputDigest() : hash(HashBytes(nullptr, 0)), events(0) {}
+
+		bool MousePressed(const MouseEventClick &arg) { m_add(INPUT_MOUSE_PRESS, arg.btn, arg.x, arg.y, 0, arg.time); return false; }
+		bool MouseReleased(const MouseEventClick &arg) { m_add(INPUT_MOUSE_RELEASE, arg.btn, arg.x, arg.y, 0, arg.time); return false; }
+		bool MouseWheel(const MouseEventWheel &arg) { m_add(INPUT_MOUSE_WHEEL, arg.wheel, arg.x, arg.y, arg.count, arg.time); return false; }
+		bool MouseMove(const MouseEvent &arg) { m_add(INPUT_MOUSE_MOVE, arg.dx, arg.dy, arg.x + arg.y * 65536, arg.count, arg.time); return false; }
+		bool KeyPressed(const KeyEvent &arg) { m_add(INPUT_KEY_PRESS, static_cast<int>(arg.code), arg.scan, 0, 0, arg.time); return false; }
+		bool KeyReleased(const KeyEvent &arg) { m_add(INPUT_KEY_RELEASE, static_cast<int>(arg.code), arg.scan, 0, 0, arg.time); return false; }
+
+		unsigned long long hash;
+		unsigned long long events;
+
+	private:
+		void m_add(int type, int a, int b, int c, unsigned d, double time)
+		{
+			const long long values[6] = { type, a, b, c, d, static_cast<long long>(std::floor(time * 1e9 + 0.5)) };
+			hash = HashBytes(values, sizeof(values), hash);
+			events++;
+		}
+	};
+
+	// Frames of input out of a recording, the way the frame loop takes
+	// them: Dispatch at the recorded frame time, then MyInput moves by the
+	// time since the previous frame
+	struct ReplayRun
+	{
+		InputDigest digest;
+		MyInput input;
+		unsigned frames;
+		unsigned dispatched;
+		double seconds;
+	};
+
+	static void s_replayFrames(InputReplay &replay, ReplayRun &run, unsigned maxFrames)
+	{
+		InputMgr *manager = new InputMgr();
+		manager->AddListener(&run.digest);
+		run.frames = run.dispatched = 0;
+		double previous = 0.0, frameTime = 0.0;
+		const double start = Clock::Now();
+		while (run.frames < maxFrames && replay.NextFrame(*manager, frameTime))
+		{
+			run.dispatched += manager->Dispatch(frameTime);
+			run.input.Update(*manager, previous > 0.0 ? std::min(frameTime - previous, 0.1) : 0.0);
+			previous = frameTime;
+			run.frames++;
+		}
+		run.seconds = Clock::Now() - start;
+		delete manager;
+	}
+
+	// Records a synthetic session of mouse, wheel, clicks and held keys
+	// through InputMgr, then replays the file headless: as fast as possible
+	// the listeners have to get exactly the same events in the same frames
+	// and the overlay has to end up in the same place, paced the first
+	// frames have to take as long as recorded. Reports bytes per event and
+	// the replay speed. Given a file, only replays that one.
+	// Arguments: [frames] [recording]
+	static bool s_replay()
+	{
+		const int frames = s_argc > 0 ? atoi(s_argv[0]) : 5400;
+		const char *recording = s_argc > 1 ? s_argv[1] : nullptr;
+		bool ok = true;
+
+		if (recording != nullptr)
+		{
+			InputReplay replay;
+			if (!replay.Open(recording))
+			{
+				printf("replay: cannot read %s\n", recording);
+				return false;
+			}
+			ReplayRun run;
+			s_replayFrames(replay, run, ~0u);
+			printf("replay: %s, %u frames %.2f s recorded, %u events handed on in %.3f ms, translate %.4f %.4f %.4f scale %.4f\n", recording,
+				run.frames, replay.EndTime() - replay.StartTime(), run.dispatched, run.seconds * 1e3,
+				run.input.translate.x, run.input.translate.y, run.input.translate.z, run.input.scaleAmount);
+			return true;
+		}
+
+		const char *path = "bench_input.bin";
+		const eKeyCodes keys[] = { eKeyCodes::KEY_UP, eKeyCodes::KEY_DOWN, eKeyCodes::KEY_LEFT, eKeyCodes::KEY_RIGHT,
+			eKeyCodes::KEY_SHIFT, eKeyCodes::KEY_CONTROL, eKeyCodes::KEY_Z, eKeyCodes::KEY_X, eKeyCodes::KEY_SPACE };
+		const int keyCount = sizeof(keys) / sizeof(keys[0]);
+		bool held[keyCount] = {};
+
+		// live: times on whole nanoseconds like a recording keeps them
+		ReplayRun live;
+		InputRecorder recorder;
+		if (!recorder.Open(path))
+		{
+			printf("replay: cannot write %s\n", path);
+			return false;
+		}
+		{
+			InputMgr *manager = new InputMgr();
+			manager->AddListener(&live.digest);
+			manager->RecordTo(&recorder);
+			srand(20);
+			const long long start = 1000000000000LL, frame = 11111111;
+			int x = 400, y = 300;
+			unsigned events = 0;
+			double previous = 0.0;
+			for (int f = 0; f < frames; f++)
+			{
+				const long long frameNs = start + f * frame;
+				const int count = rand() % 12;
+				for (int e = 0; e < count; e++)
+				{
+					InputEvent event = {};
+					event.time = static_cast<double>(frameNs - frame + (e + 1) * frame / (count + 1)) * 1e-9;
+					const int r = rand() % 40;
+					if (r < 30)
+					{
+						event.type = INPUT_MOUSE_MOVE;
+						event.dx = rand() % 9 - 4;
+						event.dy = rand() % 9 - 4;
+						x += event.dx;
+						y += event.dy;
+					}
+					else if (r < 33)
+					{
+						event.type = INPUT_MOUSE_WHEEL;
+						event.wheel = rand() % 2 ? InputMgr::WheelUnits : -InputMgr::WheelUnits / 3;
+					}
+					else if (r < 35)
+					{
+						event.type = static_cast<unsigned char>(rand() % 2 ? INPUT_MOUSE_PRESS : INPUT_MOUSE_RELEASE);
+						event.button = static_cast<unsigned char>(rand() % MOUSE_MAX);
+					}
+					else if (r == 35 && rand() % 20 == 0)
+					{
+						event.type = INPUT_FOCUS_LOST;
+						std::fill(held, held + keyCount, false);
+					}
+					else
+					{
+						const int k = rand() % keyCount;
+						// mostly releases of held keys, so they stay down for a while
+						if (held[k] && rand() % 3 != 0)
+							continue;
+						held[k] = !held[k];
+						event.type = static_cast<unsigned char>(held[k] ? INPUT_KEY_PRESS : INPUT_KEY_RELEASE);
+						event.key = keys[k];
+						event.scan = static_cast<unsigned short>(k + 1);
+						event.flags = static_cast<unsigned char>(rand() % 8 == 0 ? INPUT_FLAG_CAPS_LOCK : 0);
+					}
+					event.x = x;
+					event.y = y;
+					manager->Push(event);
+					events++;
+				}
+				const double frameTime = static_cast<double>(frameNs) * 1e-9;
+				live.dispatched += manager->Dispatch(frameTime);
+				live.input.Update(*manager, previous > 0.0 ? std::min(frameTime - previous, 0.1) : 0.0);
+				previous = frameTime;
+			}
+			live.frames = frames;
+			recorder.Close();
+			delete manager;
+			printf("replay: %d frames, %u events recorded in %llu bytes, %.2f bytes/event\n", frames, events, recorder.Bytes(),
+				static_cast<double>(recorder.Bytes()) / std::max(events, 1u));
+		}
+
+		// as fast as it goes, twice
+		for (int pass = 0; pass < 2; pass++)
+		{
+			InputReplay replay;
+			ReplayRun run;
+			const bool opened = replay.Open(path);
+			if (opened)
+				s_replayFrames(replay, run, ~0u);
+			const bool match = opened && run.frames == live.frames && run.dispatched == live.dispatched && run.digest.hash == live.digest.hash &&
+				run.input.translate.x == live.input.translate.x && run.input.translate.y == live.input.translate.y && run.input.translate.z == live.input.translate.z &&
+				run.input.scaleAmount == live.input.scaleAmount && run.input.recenter == live.input.recenter;
+			ok = ok && match;
+			printf("  fast     %u frames, %u events handed on, %7.1f ns/event, digest %016llx, translate %.4f %.4f %.4f scale %.4f%s\n",
+				run.frames, run.dispatched, run.seconds * 1e9 / std::max(replay.EventCount(), static_cast<size_t>(1)), run.digest.hash,
+				run.input.translate.x, run.input.translate.y, run.input.translate.z, run.input.scaleAmount, match ? "" : "  MISMATCH");
+		}
+
+		// paced, the first half second
+		{
+			InputReplay replay(true);
+			ReplayRun run;
+			const unsigned paced = std::min(45u, static_cast<unsigned>(frames));
+			const bool opened = replay.Open(path);
+			if (opened)
+				s_replayFrames(replay, run, paced);
+			const double recorded = opened && paced > 0 ? (paced - 1) * 0.011111111 : 0.0;
+			const bool match = opened && run.frames == paced && run.seconds >= recorded - 0.002;
+			ok = ok && match;
+			printf("  realtime %u frames in %.1f ms, recorded %.1f ms%s\n", run.frames, run.seconds * 1e3, recorded * 1e3, match ? "" : "  MISMATCH");
+		}
+
+		// cut off in the middle: the frames before it still read
+		{
+			std::vector<char> bytes;
+			FILE *file = fopen(path, "rb");
+			if (file)
+			{
+				char buffer[4096];
+				size_t read;
+				while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+					bytes.insert(bytes.end(), buffer, buffer + read);
+				fclose(file);
+			}
+			file = fopen(path, "wb");
+			if (file)
+			{
+				fwrite(bytes.data(), 1, bytes.size() / 2 + 3, file);
+				fclose(file);
+			}
+			InputReplay replay;
+			const bool match = !bytes.empty() && replay.Open(path) && replay.FrameCount() > 0 && replay.FrameCount() < static_cast<size_t>(frames);
+			ok = ok && match;
+			printf("  cut off  %u of %d frames left%s\n", static_cast<unsigned>(replay.FrameCount()), frames, match ? "" : "  MISMATCH");
+		}
+		remove(path);
+		return ok;
+	}
+
+	// Synthetic scene texture: gradients, rings and a little noise, so it
+	// compresses roughly like a photo does
+	static void s_textureImage(ImageRgba &image, int width, int height)
+	{
+		image.Allocate(width, height);
+		srand(21);
+		for (int y = 0; y < height; y++)
+		{
+			unsigned char *row = image.Row(y);
+			for (int x = 0; x < width; x++)
+			{
+				const float dx = x - width * 0.4f, dy = y - height * 0.6f;
+				const float ring = 0.5f + 0.5f * sinf(sqrtf(dx * dx + dy * dy) * 0.04f);
+				const int noise = rand() % 7 - 3;
+				const int values[4] = { static_cast<int>(255.0f * x / width * ring) + noise, 255 * y / height + noise,
+					static_cast<int>(60.0f + 150.0f * ring) + noise, ((x >> 7) + (y >> 7)) % 3 ? 255 : 160 };
+				for (int c = 0; c < 4; c++)
+					row[x * 4 + c] = static_cast<unsigned char>(std::min(std::max(values[c], 0), 255));
+			}
+		}
+	}
+
+	// Bits of a JPEG file, the first one in the highest bit, a 0 stuffed
+	// after each 0xFF
+	struct BitWriter
+	{
+		explicit BitWriter(std::vector<unsigned char> &out) : out(out), bits(0), count(0) {}
+
+		void Msb(unsigned value, int n)
+		{
+			bits = (bits << n) | (value & ((1u << n) - 1));
+			count += n;
+			for (; count >= 8; count -= 8)
+			{
+				const unsigned char byte = static_cast<unsigned char>(bits >> (count - 8));
+				out.push_back(byte);
+				if (byte == 0xFF)
+					out.push_back(0);
+			}
+		}
+		void FlushMsb() { if (count > 0) Msb(0x7F, 8 - count); }
+
+		std::vector<unsigned char> &out;
+		unsigned long long bits;
+		int count;
+	};
+
+	// Canonical Huffman codes from a JPEG DHT table
+	static void s_jpegCodes(const unsigned char *bits, const unsigned char *values, unsigned short *codes, unsigned char *sizes)
+	{
+		unsigned code = 0;
+		int k = 0;
+		for (int length = 1; length <= 16; length++, code <<= 1)
+			for (int i = 0; i < bits[length - 1]; i++, k++, code++)
+			{
+				codes[values[k]] = static_cast<unsigned short>(code);
+				sizes[values[k]] = static_cast<unsigned char>(length);
+			}
+	}
+
+	// Huffman code of a size category, then the value's bits
+	static void s_jpegValue(BitWriter &writer, int value, const unsigned short *codes, const unsigned char *sizes, int run)
+	{
+		int size = 0;
+		while ((abs(value) >> size) != 0)
+			size++;
+		writer.Msb(codes[run | size], sizes[run | size]);
+		if (size > 0)
+			writer.Msb(static_cast<unsigned>(value < 0 ? value + (1 << size) - 1 : value), size);
+	}
+
+	// Baseline 4:2:0 JPEG at quality 90 with the example tables of the
+	// standard, a float DCT
+	static void s_writeJpeg(const ImageRgba &image, std::vector<unsigned char> &out)
+	{
+		static const unsigned char zigzag[64] = { 0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+			35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+		static const unsigned char baseQuant[2][64] = {
+			{ 16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+			  18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99 },
+			{ 17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+			  99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99 } };
+		static const unsigned char dcBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+		static const unsigned char dcValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+		static const unsigned char acBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D };
+		static const unsigned char acValues[162] = {
+			0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08,
+			0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+			0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+			0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+			0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
+			0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+			0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA };
+
+		unsigned char quant[2][64];
+		for (int t = 0; t < 2; t++)
+			for (int i = 0; i < 64; i++)
+				quant[t][i] = static_cast<unsigned char>(std::max((baseQuant[t][i] * 20 + 50) / 100, 1));
+		unsigned short dcCodes[256], acCodes[256];
+		unsigned char dcSizes[256], acSizes[256];
+		s_jpegCodes(dcBits, dcValues, dcCodes, dcSizes);
+		s_jpegCodes(acBits, acValues, acCodes, acSizes);
+		float basis[8][8];
+		for (int x = 0; x < 8; x++)
+			for (int u = 0; u < 8; u++)
+				basis[x][u] = 0.5f * cosf((2 * x + 1) * u * 3.14159265f / 16.0f) * (u == 0 ? 0.70710678f : 1.0f);
+
+		out.clear();
+		const unsigned char start[] = { 0xFF, 0xD8, 0xFF, 0xDB, 0, 132 };
+		out.insert(out.end(), start, start + 6);
+		for (int t = 0; t < 2; t++)
+		{
+			out.push_back(static_cast<unsigned char>(t));
+			for (int k = 0; k < 64; k++)
+				out.push_back(quant[t][zigzag[k]]);
+		}
+		const unsigned char frame[] = { 0xFF, 0xC0, 0, 17, 8 };
+		out.insert(out.end(), frame, frame + 5);
+		const unsigned char size[4] = { static_cast<unsigned char>(image.height >> 8), static_cast<unsigned char>(image.height),
+			static_cast<unsigned char>(image.width >> 8), static_cast<unsigned char>(image.width) };
+		out.insert(out.end(), size, size + 4);
+		const unsigned char components[] = { 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1, 0xFF, 0xC4, 0, 210, 0x00 };
+		out.insert(out.end(), components, components + 15);
+		out.insert(out.end(), dcBits, dcBits + 16);
+		out.insert(out.end(), dcValues, dcValues + 12);
+		out.push_back(0x10);
+		out.insert(out.end(), acBits, acBits + 16);
+		out.insert(out.end(), acValues, acValues + 162);
+		const unsigned char scan[] = { 0xFF, 0xDA, 0, 12, 3, 1, 0x00, 2, 0x00, 3, 0x00, 0, 63, 0 };
+		out.insert(out.end(), scan, scan + 14);
+
+		BitWriter writer(out);
+		int predictions[3] = {};
+		float planes[3][16][16];
+		for (int my = 0; my < image.height; my += 16)
+			for (int mx = 0; mx < image.width; mx += 16)
+			{
+				for (int y = 0; y < 16; y++)
+				{
+					const unsigned char *row = image.Row(std::min(my + y, image.height - 1));
+					for (int x = 0; x < 16; x++)
+					{
+						const unsigned char *p = row + std::min(mx + x, image.width - 1) * 4;
+						planes[0][y][x] = 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] - 128.0f;
+						planes[1][y][x] = -0.168736f * p[0] - 0.331264f * p[1] + 0.5f * p[2];
+						planes[2][y][x] = 0.5f * p[0] - 0.418688f * p[1] - 0.081312f * p[2];
+					}
+				}
+
+				for (int b = 0; b < 6; b++)
+				{
+					const int component = b < 4 ? 0 : b - 3;
+					float samples[8][8];
+					for (int y = 0; y < 8; y++)
+						for (int x = 0; x < 8; x++)
+						{
+							if (component == 0)
+								samples[y][x] = planes[0][(b >> 1) * 8 + y][(b & 1) * 8 + x];
+							else
+							{
+								const float (*plane)[16] = planes[component];
+								samples[y][x] = 0.25f * (plane[y * 2][x * 2] + plane[y * 2][x * 2 + 1] + plane[y * 2 + 1][x * 2] + plane[y * 2 + 1][x * 2 + 1]);
+							}
+						}
+
+					float rows[8][8];
+					for (int y = 0; y < 8; y++)
+						for (int u = 0; u < 8; u++)
+						{
+							float sum = 0.0f;
+							for (int x = 0; x < 8; x++)
+								sum += samples[y][x] * basis[x][u];
+							rows[y][u] = sum;
+						}
+					int coefficients[64];
+					const unsigned char *q = quant[component == 0 ? 0 : 1];
+					for (int k = 0; k < 64; k++)
+					{
+						const int v = zigzag[k] >> 3, u = zigzag[k] & 7;
+						float sum = 0.0f;
+						for (int y = 0; y < 8; y++)
+							sum += rows[y][u] * basis[y][v];
+						coefficients[k] = static_cast<int>(floorf(sum / q[zigzag[k]] + 0.5f));
+					}
+
+					const int diff = coefficients[0] - predictions[component];
+					predictions[component] = coefficients[0];
+					s_jpegValue(writer, diff, dcCodes, dcSizes, 0);
+					int run = 0;
+					for (int k = 1; k < 64; k++)
+					{
+						if (coefficients[k] == 0)
+						{
+							run++;
+							continue;
+						}
+						for (; run >= 16; run -= 16)
+							writer.Msb(acCodes[0xF0], acSizes[0xF0]);
+						s_jpegValue(writer, coefficients[k], acCodes, acSizes, run << 4);
+						run = 0;
+					}
+					if (run > 0)
+						writer.Msb(acCodes[0], acSizes[0]);
+				}
+			}
+		writer.FlushMsb();
+		out.push_back(0xFF);
+		out.push_back(0xD9);
+	}
+
+
+	// Largest difference of two images of the same size, or 256 if not
+	static int s_imageDifference(const ImageRgba &a, const ImageRgba &b)
+	{
+		if (a.width != b.width || a.height != b.height || a.pixels.size() != b.pixels.size())
+			return 256;
+		int worst = 0;
+		for (size_t i = 0; i < a.pixels.size(); i++)
+			worst = std::max(worst, abs(a.pixels[i] - b.pixels[i]));
+		return worst;
+	}
+
+	// Decodes a PNG and a JPEG of a synthetic 2048x2048 texture, or the
+	// given files: the PNG has to come back exactly, the JPEG within 30 dB.
+	// Then builds their mip chains with the box and Kaiser filters, scalar
+	// and SIMD, and streams them through a TextureStreamer with a 4 MB
+	// budget to a NullRenderDevice with a 1024x1024 overlay array; every
+	// byte of every level has to arrive and no frame may go over the
+	// budget, so the 16 MB top levels go up over several frames. A missing
+	// file has to fail without holding up the others. Reports Mpixel/s decoded, ms per chain and frames to stream.
+	// Arguments: [image files...]
+	static bool s_textures()
+	{
+		const int size = 2048;
+		const size_t budget = 4 << 20;
+		const int overlaySize = 1024;
+		bool ok = true;
+
+		// the files, and the synthetic image they were written from
+		std::vector<std::string> paths;
+		std::vector<std::string> written;
+		ImageRgba source;
+		if (s_argc > 0)
+			for (int i = 0; i < s_argc; i++)
+				paths.push_back(s_argv[i]);
+		else
+		{
+			s_textureImage(source, size, size);
+			std::vector<unsigned char> data;
+			ImageEncode::Png(source, PNG_FILTERED, data);
+			written.push_back("bench_texture.png");
+			ok = s_writeFile(written.back().c_str(), data) && ok;
+			s_writeJpeg(source, data);
+			written.push_back("bench_texture.jpg");
+			ok = s_writeFile(written.back().c_str(), data) && ok;
+			paths = written;
+		}
+
+		printf("textures: decode, mip chains and streaming\n");
+		std::vector<ImageRgba> images(paths.size());
+		for (size_t f = 0; f < paths.size(); f++)
+		{
+			std::vector<unsigned char> data;
+			if (!LoadFile(paths[f].c_str(), data) || !ImageDecode::Decode(data.data(), data.size(), images[f]))
+			{
+				printf("  %s: cannot decode  MISMATCH\n", paths[f].c_str());
+				ok = false;
+				continue;
+			}
+			int iterations = 0;
+			const double start = Clock::Now();
+			double elapsed = 0.0;
+			ImageRgba image;
+			do
+			{
+				ImageDecode::Decode(data.data(), data.size(), image);
+				iterations++;
+				elapsed = Clock::Now() - start;
+			} while (iterations < 3 || elapsed < 0.5);
+
+			const ImageRgba &decoded = images[f];
+			char check[64] = "";
+			bool match = true;
+			if (!written.empty() && f == 0)
+			{
+				match = s_imageDifference(decoded, source) == 0;
+				sprintf(check, ", exact");
+			}
+			else if (!written.empty())
+			{
+				double error = 0.0;
+				for (size_t i = 0; i < source.pixels.size(); i++)
+					if ((i & 3) != 3)
+						error += (decoded.pixels[i] - source.pixels[i]) * (decoded.pixels[i] - source.pixels[i]);
+				const double psnr = 10.0 * log10(255.0 * 255.0 / std::max(error / (source.pixels.size() / 4 * 3), 1e-9));
+				match = decoded.width == source.width && decoded.height == source.height && psnr > 30.0;
+				sprintf(check, ", %.1f dB", psnr);
+			}
+			ok = ok && match;
+			printf("  %-24s %dx%d, %7u KB, %7.1f Mpixel/s, %6.2f ms%s%s\n", paths[f].c_str(), decoded.width, decoded.height, static_cast<unsigned>(data.size() >> 10),
+				decoded.width * static_cast<double>(decoded.height) * iterations / elapsed * 1e-6, elapsed * 1e3 / iterations, check, match ? "" : "  MISMATCH");
+		}
+
+		// the chains, the SIMD ones against the reference
+		const eMipFilter filters[] = { MIP_BOX, MIP_KAISER };
+		const char *filterNames[] = { "box", "Kaiser" };
+		for (size_t f = 0; f < images.size(); f++)
+		{
+			if (images[f].pixels.empty())
+				continue;
+			for (int m = 0; m < 2; m++)
+			{
+				std::vector<ImageRgba> reference(1), levels(1);
+				reference[0] = images[f];
+				levels[0] = images[f];
+				double start = Clock::Now();
+				for (int l = 1; l < MipChain::LevelCount(images[f].width, images[f].height); l++)
+				{
+					reference.push_back(ImageRgba());
+					MipChain::DownsampleReference(reference[l - 1], reference[l], filters[m]);
+				}
+				const double scalar = Clock::Now() - start;
+				start = Clock::Now();
+				MipChain::Build(levels, filters[m]);
+				const double simd = Clock::Now() - start;
+
+				int worst = levels.size() == reference.size() ? 0 : 256;
+				for (size_t l = 0; l < levels.size() && l < reference.size(); l++)
+					worst = std::max(worst, s_imageDifference(levels[l], reference[l]));
+				// rounding of the float sums may differ by one with fused multiply-adds
+				const bool match = worst <= (filters[m] == MIP_BOX ? 0 : 1);
+				ok = ok && match;
+				printf("  %-24s %-6s %2u levels, scalar %7.2f ms, %-6s %7.2f ms, %.2fx, max difference %d%s\n", paths[f].c_str(), filterNames[m],
+					static_cast<unsigned>(levels.size()), scalar * 1e3, Simd::Name(Simd::Level()), simd * 1e3, scalar / std::max(simd, 1e-9), worst, match ? "" : "  MISMATCH");
+			}
+		}
+
+		// the Kaiser weights add up to one: a flat odd sized image stays flat
+		{
+			std::vector<ImageRgba> levels(1);
+			levels[0].Allocate(37, 23);
+			for (size_t i = 0; i < levels[0].pixels.size(); i++)
+				levels[0].pixels[i] = static_cast<unsigned char>(i % 4 == 0 ? 10 : i % 4 == 1 ? 200 : i % 4 == 2 ? 77 : 255);
+			MipChain::Build(levels, MIP_KAISER);
+			ImageRgba scaled;
+			scaled.Allocate(64, 64);
+			MipChain::Resample(levels[0], scaled);
+			levels.push_back(scaled);
+			bool match = static_cast<int>(levels.size()) == MipChain::LevelCount(37, 23) + 1;
+			for (size_t l = 1; l < levels.size(); l++)
+				for (size_t i = 0; i < levels[l].pixels.size(); i++)
+					match = match && levels[l].pixels[i] == levels[0].pixels[i % 4];
+			ok = ok && match;
+			printf("  flat 37x23 chain and 64x64 resample stay flat%s\n", match ? "" : "  MISMATCH");
+		}
+
+		// streaming, with a file that is not there
+		{
+			Log log("bench_textures.txt", false);
+			ThreadPool pool;
+			NullRenderDevice render(640, 480);
+			render.SetOverlaySize(overlaySize);
+			TextureStreamer streamer(&pool);
+			std::vector<int> ids;
+			unsigned long long expected = 0;
+			// RGBA8 bytes of a chain down to 1x1
+			auto chainBytes = [](int width, int height) {
+				unsigned long long bytes = 0;
+				for (int l = 0; l < MipChain::LevelCount(width, height); l++)
+					bytes += 4ULL * std::max(width >> l, 1) * std::max(height >> l, 1);
+				return bytes;
+			};
+			const size_t streamed = std::min<size_t>(paths.size(), RenderDevice::OverlaySlices);
+			const double start = Clock::Now();
+			for (size_t f = 0; f < streamed; f++)
+			{
+				ids.push_back(streamer.Request(paths[f].c_str(), static_cast<eSceneTexture>(f), overlaySize));
+				if (!images[f].pixels.empty())
+					expected += chainBytes(images[f].width, images[f].height) + chainBytes(overlaySize, overlaySize);
+			}
+			const int missing = streamer.Request("bench_missing.png", TEXTURE_CAMERA_LEFT, overlaySize);
+
+			int frames = 0, busyFrames = 0;
+			size_t total = 0, most = 0;
+			bool withinBudget = true;
+			while (!streamer.Idle() && Clock::Now() - start < 30.0)
+			{
+				const size_t bytes = streamer.Update(render, budget);
+				withinBudget = withinBudget && bytes <= budget;
+				frames++;
+				busyFrames += bytes > 0 ? 1 : 0;
+				total += bytes;
+				most = std::max(most, bytes);
+				if (bytes == 0)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+
+			bool match = withinBudget && streamer.Idle() && render.Counters().textureBytes == expected && total == expected && streamer.State(missing) == TEXTURE_FAILED;
+			for (size_t f = 0; f < ids.size(); f++)
+				match = match && streamer.State(ids[f]) == (images[f].pixels.empty() ? TEXTURE_FAILED : TEXTURE_READY);
+			ok = ok && match;
+			printf("  streamed %u uploads, %.1f MB in %d frames uploading (%d polled), most %.2f MB a frame, budget %.2f MB%s\n",
+				static_cast<unsigned>(render.Counters().textureUploads), total / 1048576.0, busyFrames, frames, most / 1048576.0, budget / 1048576.0, match ? "" : "  MISMATCH");
+			for (size_t f = 0; f < ids.size(); f++)
+				printf("  %-24s decoded after %7.2f ms, ready after %7.2f ms\n", paths[f].c_str(), streamer.DecodeTime(ids[f]) * 1e3, streamer.ReadyTime(ids[f]) * 1e3);
+		}
+		remove("bench_textures.txt");
+		for (size_t i = 0; i < written.size(); i++)
+			remove(written[i].c_str());
+		return ok;
+	}
+
+	// Offset of the first segment with marker in a JPEG, or 0
+	static size_t s_jpegSegment(const std::vector<unsigned char> &data, unsigned char marker)
+	{
+		for (size_t i = 2; i + 4 <= data.size() && data[i] == 0xFF; i += 2 + (data[i + 2] << 8 | data[i + 3]))
+			if (data[i + 1] == marker)
+				return i;
+		return 0;
+	}
+
+	// Feeds the decoders broken files: a 64x64 PNG and JPEG with random
+	// bytes changed, runs of 0xFF written over them or cut short, plus
+	// hand made ones: a DHT with more codes of a length than fit, a PNG
+	// header over the size limit and a deflate stream with an oversubscribed
+	// code. The hand made ones have to be refused and the untouched files
+	// still decode. Run under a sanitizer, any bad read or write shows up.
+	// Argument: [mutations]
+	static bool s_malformed()
+	{
+		const int mutations = s_argc > 0 ? atoi(s_argv[0]) : 20000;
+		ImageRgba source, image;
+		s_textureImage(source, 64, 64);
+		std::vector<unsigned char> files[2];
+		ImageEncode::Png(source, PNG_FILTERED, files[0]);
+		s_writeJpeg(source, files[1]);
+		const char *names[2] = { "PNG", "JPEG" };
+		bool ok = true;
+
+		printf("malformed images, %d mutations each\n", mutations);
+		srand(5);
+		for (int f = 0; f < 2; f++)
+		{
+			const bool intact = ImageDecode::Decode(files[f].data(), files[f].size(), image) && image.width == 64 && image.height == 64;
+			int decoded = 0;
+			const double start = Clock::Now();
+			for (int m = 0; m < mutations; m++)
+			{
+				std::vector<unsigned char> data = files[f];
+				const int kind = rand() % 3;
+				if (kind == 0)
+				{
+					for (int i = 1 + rand() % 8; i > 0; i--)
+						data[rand() % data.size()] = static_cast<unsigned char>(rand());
+				}
+				else if (kind == 1)
+				{
+					const size_t at = rand() % data.size();
+					for (size_t i = at; i < data.size() && i < at + 1 + rand() % 32; i++)
+						data[i] = 0xFF;
+				}
+				else
+					data.resize(rand() % data.size());
+				decoded += ImageDecode::Decode(data.data(), data.size(), image) ? 1 : 0;
+			}
+			const double elapsed = Clock::Now() - start;
+			ok = ok && intact;
+			printf("  %-4s %5d decoded, %5d refused, %6.1f us each%s\n", names[f], decoded, mutations - decoded, elapsed * 1e6 / std::max(mutations, 1),
+				intact ? "" : "  MISMATCH");
+		}
+
+		// three codes of length 1: the third would fill past the fast table
+		std::vector<unsigned char> jpeg = files[1];
+		const size_t dht = s_jpegSegment(jpeg, 0xC4);
+		bool refused = dht != 0;
+		if (dht)
+		{
+			unsigned char *counts = &jpeg[dht + 5];
+			memset(counts, 0, 16);
+			counts[0] = 3;
+			counts[1] = 9;
+			refused = !ImageDecode::Decode(jpeg.data(), jpeg.size(), image);
+		}
+		printf("  JPEG with an overfull Huffman table %s\n", refused ? "refused" : "decoded  MISMATCH");
+		ok = ok && refused;
+
+		// width past MaxSize, the IHDR checksum is not checked
+		std::vector<unsigned char> png = files[0];
+		png[16] = 0x7F;
+		refused = !ImageDecode::Decode(png.data(), png.size(), image);
+		printf("  PNG wider than %d %s\n", ImageDecode::MaxSize, refused ? "refused" : "decoded  MISMATCH");
+		ok = ok && refused;
+
+		// a dynamic block whose code length code has three codes of length 1
+		png = files[0];
+		const size_t idat = 8 + 25;
+		const unsigned char dynamic[] = { 0x78, 0x01, 0x05, 0x00, 0x92, 0x00 };
+		memcpy(&png[idat + 8], dynamic, sizeof(dynamic));
+		refused = !ImageDecode::Decode(png.data(), png.size(), image);
+		printf("  PNG with an oversubscribed deflate code %s\n", refused ? "refused" : "decoded  MISMATCH");
+		ok = ok && refused;
+		return ok;
+	}
+
+	// Peak signal to noise ratio of the colour and of the alpha of b
+	// against a, 99 dB when they are the same
+	static void s_psnr(const ImageRgba &a, const ImageRgba &b, double &rgb, double &alpha)
+	{
+		double errors[2] = { 0.0, 0.0 };
+		for (size_t i = 0; i < a.pixels.size() && i < b.pixels.size(); i++)
+		{
+			const double difference = a.pixels[i] - b.pixels[i];
+			errors[(i & 3) == 3 ? 1 : 0] += difference * difference;
+		}
+		const double texels = static_cast<double>(a.pixels.size() / 4);
+		rgb = errors[0] > 0.0 ? std::min(10.0 * log10(255.0 * 255.0 * texels * 3 / errors[0]), 99.0) : 99.0;
+		alpha = errors[1] > 0.0 ? std::min(10.0 * log10(255.0 * 255.0 * texels / errors[1]), 99.0) : 99.0;
+	}
+
+	// Encodes a synthetic 1024x1024 texture, or the given files, to BC1,
+	// BC3 and BC7 at each quality: scalar, SIMD and spread over the pool.
+	// The SIMD and pool blocks have to be the same bytes as the scalar ones
+	// and the synthetic texture has to decode to better than 30 dB. Then
+	// streams a PNG of it twice with a texture cache: the first time it is
+	// encoded, the second it has to come out of the cache, sooner and with
+	// the same levels and bytes as the first. A third time from the cache
+	// with a 64 KB budget has to split the levels into block rows and
+	// still deliver the same bytes. Reports Mpixel/s, dB and the
+	// size against RGBA8.
+	// Arguments: [image files...]
+	static bool s_compress()
+	{
+		const int size = 1024;
+		bool ok = true;
+
+		std::vector<std::string> paths;
+		std::vector<ImageRgba> images;
+		if (s_argc > 0)
+			for (int i = 0; i < s_argc; i++)
+			{
+				std::vector<unsigned char> data;
+				ImageRgba image;
+				if (!LoadFile(s_argv[i], data) || !ImageDecode::Decode(data.data(), data.size(), image))
+				{
+					printf("  %s: cannot decode  MISMATCH\n", s_argv[i]);
+					ok = false;
+					continue;
+				}
+				paths.push_back(s_argv[i]);
+				images.push_back(image);
+			}
+		else
+		{
+			images.resize(1);
+			s_textureImage(images[0], size, size);
+			paths.push_back("synthetic");
+		}
+
+		printf("compress: block compression and the texture cache\n");
+		const eTextureFormat formats[] = { FORMAT_BC1, FORMAT_BC3, FORMAT_BC7 };
+		const char *formatNames[] = { "BC1", "BC3", "BC7" };
+		const eCompressQuality qualities[] = { COMPRESS_FAST, COMPRESS_NORMAL, COMPRESS_HIGH };
+		const char *qualityNames[] = { "fast", "normal", "high" };
+		ThreadPool pool;
+		for (size_t f = 0; f < images.size(); f++)
+		{
+			const ImageRgba &image = images[f];
+			const double mpixels = image.width * static_cast<double>(image.height) * 1e-6;
+			for (int i = 0; i < 3; i++)
+				for (int q = 0; q < 3; q++)
+				{
+					std::vector<unsigned char> reference, simd, pooled;
+					double start = Clock::Now();
+					BlockCompress::EncodeReference(image, formats[i], qualities[q], reference);
+					const double scalar = Clock::Now() - start;
+					start = Clock::Now();
+					BlockCompress::Encode(image, formats[i], qualities[q], simd);
+					const double single = Clock::Now() - start;
+					start = Clock::Now();
+					BlockCompress::Encode(image, formats[i], qualities[q], pooled, &pool);
+					const double spread = Clock::Now() - start;
+
+					ImageRgba decoded;
+					BlockCompress::Decode(simd.data(), formats[i], image.width, image.height, decoded);
+					double rgb, alpha;
+					s_psnr(image, decoded, rgb, alpha);
+					// BC1 only knows opaque and transparent
+					const bool match = simd == reference && pooled == reference &&
+						(s_argc > 0 || (rgb > 30.0 && (formats[i] == FORMAT_BC1 || alpha > 30.0)));
+					ok = ok && match;
+					char alphaText[32] = "";
+					if (formats[i] != FORMAT_BC1)
+						sprintf(alphaText, ", alpha %5.1f dB", alpha);
+					printf("  %-12s %s %-6s scalar %7.1f, %-6s %7.1f, pool %7.1f Mpixel/s, %5.1f dB%s, %5.1f%% of RGBA8%s\n", paths[f].c_str(),
+						formatNames[i], qualityNames[q], mpixels / std::max(scalar, 1e-9), Simd::Name(Simd::Level()), mpixels / std::max(single, 1e-9),
+						mpixels / std::max(spread, 1e-9), rgb, alphaText, 100.0 * simd.size() / image.pixels.size(), match ? "" : "  MISMATCH");
+				}
+		}
+
+		// a flat colour comes back flat and within the precision of the endpoints
+		{
+			ImageRgba flat;
+			flat.Allocate(8, 8);
+			for (size_t i = 0; i < flat.pixels.size(); i++)
+				flat.pixels[i] = static_cast<unsigned char>(i % 4 == 0 ? 96 : i % 4 == 1 ? 96 : i % 4 == 2 ? 96 : 255);
+			bool match = true;
+			for (int i = 0; i < 3; i++)
+			{
+				std::vector<unsigned char> blocks;
+				ImageRgba decoded;
+				BlockCompress::Encode(flat, formats[i], COMPRESS_NORMAL, blocks);
+				BlockCompress::Decode(blocks.data(), formats[i], flat.width, flat.height, decoded);
+				// 5:6:5 endpoints a third apart, and 7 bit ones with a parity bit shared with alpha
+				match = match && s_imageDifference(flat, decoded) <= (formats[i] == FORMAT_BC7 ? 1 : 3);
+				for (size_t t = 4; t < decoded.pixels.size(); t++)
+					match = match && decoded.pixels[t] == decoded.pixels[t % 4];
+			}
+			ok = ok && match;
+			printf("  flat grey comes back within the endpoint precision%s\n", match ? "" : "  MISMATCH");
+		}
+
+		// the same PNG streamed twice through the cache, which is the current directory
+		{
+			ImageRgba source;
+			s_textureImage(source, size, size);
+			std::vector<unsigned char> data;
+			ImageEncode::Png(source, PNG_FILTERED, data);
+			const char *path = "bench_compress.png";
+			ok = s_writeFile(path, data) && ok;
+			const int overlaySize = 1024;
+			TextureCache cache(".");
+			const unsigned long long key = TextureCache::Key(data.data(), data.size(), FORMAT_BC7, COMPRESS_NORMAL, MIP_KAISER, overlaySize);
+			remove(cache.Path(key).c_str());
+
+			Log log("bench_compress.txt", false);
+			double times[3] = { 0.0, 0.0, 0.0 };
+			bool cached[3] = { true, false, false };
+			unsigned long long uploads[3] = { 0, 0, 0 }, bytes[3] = { 0, 0, 0 };
+			const size_t budgets[3] = { 64 << 20, 64 << 20, 64 << 10 };
+			int smallFrames = 0;
+			bool withinBudget = true;
+			for (int run = 0; run < 3; run++)
+			{
+				NullRenderDevice render(640, 480);
+				render.SetOverlaySize(overlaySize);
+				TextureStreamer streamer(&pool);
+				streamer.SetCompression(FORMAT_BC7, COMPRESS_NORMAL, ".");
+				const double start = Clock::Now();
+				const int id = streamer.Request(path, TEXTURE_OVERLAY_OUT, overlaySize);
+				while (!streamer.Idle() && Clock::Now() - start < 30.0)
+				{
+					const size_t uploaded = streamer.Update(render, budgets[run]);
+					withinBudget = withinBudget && uploaded <= budgets[run];
+					smallFrames += run == 2 && uploaded > 0 ? 1 : 0;
+					if (uploaded == 0)
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				times[run] = streamer.ReadyTime(id);
+				cached[run] = streamer.Cached(id) && streamer.State(id) == TEXTURE_READY;
+				uploads[run] = render.Counters().textureUploads;
+				bytes[run] = render.Counters().textureBytes;
+			}
+
+			// the full size level in the entry is the image encoded directly
+			MappedFile entry;
+			std::vector<TextureChain> chains;
+			std::vector<unsigned char> expected;
+			BlockCompress::Encode(source, FORMAT_BC7, COMPRESS_NORMAL, expected, &pool);
+			bool same = cache.Load(key, entry, chains) && chains.size() == 2 && !chains[0].levels.empty() && chains[0].format == FORMAT_BC7 &&
+				chains[0].levels[0].bytes == expected.size() && memcmp(chains[0].levels[0].data, expected.data(), expected.size()) == 0;
+			entry.Close();
+
+			const unsigned long long levels = MipChain::LevelCount(size, size) + MipChain::LevelCount(overlaySize, overlaySize);
+			const bool match = same && !cached[0] && cached[1] && uploads[0] == levels && uploads[1] == uploads[0] && bytes[1] == bytes[0] && times[1] < times[0] &&
+				cached[2] && uploads[2] > uploads[0] && bytes[2] == bytes[0] && withinBudget;
+			ok = ok && match;
+			printf("  streamed %u levels, %.2f MB: encoded and stored in %7.2f ms, from the cache in %7.2f ms, %.1fx, with a 64 KB budget in %d frames%s\n",
+				static_cast<unsigned>(uploads[0]), bytes[0] / 1048576.0, times[0] * 1e3, times[1] * 1e3, times[0] / std::max(times[1], 1e-9), smallFrames, match ? "" : "  MISMATCH");
+			remove(cache.Path(key).c_str());
+			remove(path);
+			remove("bench_compress.txt");
+		}
+		return ok;
+	}
+
+	// Packs 10000 overlay images of mixed sizes, mostly small, a few long
+	// strips, onto 1024x1024 pages: no two cells may overlap, all of them
+	// have to be on their pages and start on the alignment. Then builds an
+	// atlas out of 200 PNG files onto 256x256 pages and reads it back: every
+	// image has to be found by name and be on its page where the index says,
+	// its edges extruded. Reports pack time, packing efficiency and lookups.
+	// Arguments: [images] [page size]
+	static bool s_atlas()
+	{
+		const int count = s_argc > 0 ? std::max(atoi(s_argv[0]), 1) : 10000;
+		const int pageSize = s_argc > 1 ? std::max(atoi(s_argv[1]), 64) / 4 * 4 : 1024;
+		const int padding = 2, alignment = 4;
+		bool ok = true;
+
+		printf("atlas: packing overlay images onto pages\n");
+		std::vector<AtlasItem> sizes(count);
+		srand(23);
+		size_t imageTexels = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const int kind = rand() % 20;
+			AtlasItem &item = sizes[i];
+			if (kind == 0)
+			{
+				item.width = 128 + rand() % 129;
+				item.height = 8 + rand() % 17;
+			}
+			else if (kind == 1)
+			{
+				item.width = 8 + rand() % 17;
+				item.height = 128 + rand() % 129;
+			}
+			else if (kind < 6)
+			{
+				item.width = 64 + rand() % 129;
+				item.height = 64 + rand() % 129;
+			}
+			else
+			{
+				item.width = 8 + rand() % 57;
+				item.height = 8 + rand() % 57;
+			}
+			imageTexels += static_cast<size_t>(item.width) * item.height;
+		}
+
+		std::vector<AtlasItem> items;
+		AtlasPacker packer(pageSize, padding, alignment);
+		double best = 1e9;
+		int iterations = 0;
+		const double start = Clock::Now();
+		do
+		{
+			items = sizes;
+			const double t = Clock::Now();
+			ok = packer.Pack(items) && ok;
+			best = std::min(best, Clock::Now() - t);
+			iterations++;
+		} while (iterations < 3 || (Clock::Now() - start < 1.0 && iterations < 20));
+
+		// cells on a grid of alignment, one owner per grid square
+		const int grid = pageSize / alignment;
+		std::vector<int> owner(static_cast<size_t>(packer.Pages()) * grid * grid, -1);
+		size_t cellTexels = 0;
+		bool placed = true;
+		for (int i = 0; i < count && placed; i++)
+		{
+			const AtlasItem &item = items[i];
+			const int cellX = item.x - padding, cellY = item.y - padding;
+			const int cellW = (item.width + 2 * padding + alignment - 1) / alignment * alignment;
+			const int cellH = (item.height + 2 * padding + alignment - 1) / alignment * alignment;
+			placed = item.width == sizes[i].width && item.height == sizes[i].height && item.page >= 0 && item.page < packer.Pages() &&
+				cellX >= 0 && cellY >= 0 && cellX + cellW <= pageSize && cellY + cellH <= pageSize && cellX % alignment == 0 && cellY % alignment == 0;
+			for (int y = cellY / alignment; placed && y < (cellY + cellH) / alignment; y++)
+				for (int x = cellX / alignment; placed && x < (cellX + cellW) / alignment; x++)
+				{
+					int &square = owner[(static_cast<size_t>(item.page) * grid + y) * grid + x];
+					placed = square < 0;
+					square = i;
+				}
+			cellTexels += static_cast<size_t>(cellW) * cellH;
+		}
+		ok = ok && placed;
+		const double pageTexels = static_cast<double>(packer.Pages()) * pageSize * pageSize;
+		printf("  %d images, %.1f Mtexels on %d %dx%d pages in %.2f ms: %.1f%% images, %.1f%% cells, %.1f%% below the skylines%s\n",
+			count, imageTexels * 1e-6, packer.Pages(), pageSize, pageSize, best * 1e3, 100.0 * imageTexels / pageTexels,
+			100.0 * cellTexels / pageTexels, 100.0 * packer.UsedTexels() / pageTexels, placed ? "" : "  MISMATCH");
+		printf("  instanced overlays bind %d page%s instead of %d textures\n", packer.Pages(), packer.Pages() == 1 ? "" : "s", count);
+
+		// a whole atlas from files and back
+		{
+			const int files = 200, smallPage = 256;
+			Log log("bench_atlas.txt", false);
+			ThreadPool pool;
+			std::vector<std::string> paths(files);
+			std::vector<ImageRgba> images(files);
+			std::vector<unsigned char> data;
+			for (int i = 0; i < files; i++)
+			{
+				char name[32];
+				sprintf(name, "bench_atlas_%03d.png", i);
+				paths[i] = name;
+				ImageRgba &image = images[i];
+				image.Allocate(6 + rand() % 43, 6 + rand() % 43);
+				for (int y = 0; y < image.height; y++)
+					for (int x = 0; x < image.width; x++)
+					{
+						unsigned char *texel = image.Row(y) + x * 4;
+						texel[0] = static_cast<unsigned char>(i);
+						texel[1] = static_cast<unsigned char>(x * 5);
+						texel[2] = static_cast<unsigned char>(y * 5);
+						texel[3] = static_cast<unsigned char>(255 - i % 7);
+					}
+				ImageEncode::Png(image, PNG_FILTERED, data);
+				ok = s_writeFile(name, data) && ok;
+			}
+
+			double t = Clock::Now();
+			bool match = AtlasPacker::Build("bench_atlas", paths, smallPage, &pool);
+			const double build = Clock::Now() - t;
+			TextureAtlas atlas;
+			match = atlas.Open("bench_atlas") && match;
+			std::vector<ImageRgba> pages(atlas.Pages());
+			for (unsigned p = 0; p < atlas.Pages(); p++)
+				match = ImageDecode::Load(atlas.PagePath(p).c_str(), pages[p]) && pages[p].width == smallPage && match;
+
+			for (int i = 0; i < files && match; i++)
+			{
+				AtlasRect rect;
+				char name[32];
+				sprintf(name, "bench_atlas_%03d", i);
+				const ImageRgba &image = images[i];
+				match = atlas.Find(name, rect) && rect.page < pages.size();
+				const int x0 = static_cast<int>(rect.u0 * smallPage + 0.5f), y0 = static_cast<int>(rect.v0 * smallPage + 0.5f);
+				match = match && static_cast<int>(rect.u1 * smallPage + 0.5f) - x0 == image.width && static_cast<int>(rect.v1 * smallPage + 0.5f) - y0 == image.height;
+				// the image, and its padding as the nearest edge texel
+				for (int y = -padding; match && y < image.height + padding; y++)
+					for (int x = -padding; match && x < image.width + padding; x++)
+					{
+						const int sx = std::min(std::max(x, 0), image.width - 1), sy = std::min(std::max(y, 0), image.height - 1);
+						match = memcmp(pages[rect.page].Row(y0 + y) + (x0 + x) * 4, image.Row(sy) + sx * 4, 4) == 0;
+					}
+			}
+			AtlasRect rect;
+			match = match && !atlas.Find("bench_atlas_missing", rect) && atlas.Count() == static_cast<unsigned>(files);
+
+			const int lookups = 1000000;
+			unsigned found = 0;
+			t = Clock::Now();
+			for (int i = 0; i < lookups; i++)
+			{
+				char name[32];
+				sprintf(name, "bench_atlas_%03d", i % files);
+				found += atlas.Find(name, rect) ? 1 : 0;
+			}
+			const double lookup = Clock::Now() - t;
+			match = match && found == static_cast<unsigned>(lookups);
+			ok = ok && match;
+			printf("  built %d files onto %u %dx%d pages in %.2f ms, %.0f ns a lookup by name%s\n", files, atlas.Pages(), smallPage, smallPage,
+				build * 1e3, lookup * 1e9 / lookups, match ? "" : "  MISMATCH");
+
+			const unsigned written = atlas.Pages();
+			atlas.Close();
+			for (unsigned p = 0; p < written; p++)
+				remove(TextureAtlas::PagePath("bench_atlas", p).c_str());
+			remove(TextureAtlas::IndexPath("bench_atlas").c_str());
+			for (int i = 0; i < files; i++)
+				remove(paths[i].c_str());
+		}
+		remove("bench_atlas.txt");
+		return ok;
+	}
+
+	// Stand-in for the shader compiler: takes its time, turns the source,
+	// entry point, profile and flags into a blob, fails on "#error"
+	static bool s_stubCompile(const ShaderRequest &request, const unsigned char *source, size_t size,
+		std::vector<unsigned char> &blob, std::string &errors, int delayMs, std::atomic<int> &calls)
+	{
+		calls++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+		const std::string text(reinterpret_cast<const char*>(source), size);
+		if (text.find("#error") != std::string::npos)
+		{
+			errors = request.path + ": #error";
+			return false;
+		}
+		const unsigned long long hash = ShaderCache::Key(request, source, size);
+		blob.assign(reinterpret_cast<const unsigned char*>("DXBC"), reinterpret_cast<const unsigned char*>("DXBC") + 4);
+		blob.insert(blob.end(), reinterpret_cast<const unsigned char*>(&hash), reinterpret_cast<const unsigned char*>(&hash) + sizeof(hash));
+		blob.insert(blob.end(), request.entry.begin(), request.entry.end());
+		blob.resize(blob.size() + 100 + hash % 400, static_cast<unsigned char>(hash));
+		return true;
+	}
+
+	// The shader cache with a stub compiler taking some milliseconds a
+	// shader: 4 files with 2 entry points at 2 flag sets each, compiled
+	// cold on the pool and one at a time, then loaded again as on the next
+	// launch, after editing one file, with another compiler, with a broken
+	// file and from a damaged archive. Each time exactly the shaders that
+	// changed have to be compiled, and all blobs have to be what the
+	// compiler made of the current files. Reports the load times.
+	// Arguments: [ms per compile]
+	static bool s_shaders()
+	{
+		const int delay = s_argc > 0 ? std::max(atoi(s_argv[0]), 0) : 20;
+		const int files = 4;
+		const char *archive = "bench_shaders.cache";
+		bool ok = true;
+		Log log("bench_shaders.txt", false);
+		ThreadPool pool(4);
+		std::atomic<int> calls(0);
+		const ShaderCompiler compiler = [&](const ShaderRequest &request, const unsigned char *source, size_t size, std::vector<unsigned char> &blob, std::string &errors) {
+			return s_stubCompile(request, source, size, blob, errors, delay, calls);
+		};
+
+		std::vector<ShaderRequest> requests;
+		std::vector<std::string> texts(files);
+		for (int f = 0; f < files; f++)
+		{
+			char path[32], text[128];
+			sprintf(path, "bench_shader_%d.hlsl", f);
+			sprintf(text, "float4 VS%d() : SV_POSITION { return %d; }\nfloat4 PS%d() : SV_Target { return %d; }\n", f, f, f, f);
+			texts[f] = text;
+			ok = s_writeFile(path, std::vector<unsigned char>(texts[f].begin(), texts[f].end())) && ok;
+			for (int e = 0; e < 4; e++)
+			{
+				ShaderRequest request;
+				request.path = path;
+				request.entry = (e % 2 ? "PS" : "VS") + std::to_string(f);
+				request.profile = e % 2 ? "ps_4_0" : "vs_4_0";
+				request.flags = e < 2 ? 0x800u : 0x801u;
+				requests.push_back(request);
+			}
+		}
+		remove(archive);
+
+		printf("shaders: compiled shader archive, %d shaders, %d ms a compile\n", static_cast<int>(requests.size()), delay);
+		// what the compiler makes of the files as they are now
+		auto expected = [&](size_t i, std::vector<unsigned char> &blob) {
+			std::vector<unsigned char> text;
+			std::string errors;
+			std::atomic<int> ignored(0);
+			return LoadFile(requests[i].path.c_str(), text) && s_stubCompile(requests[i], text.data(), text.size(), blob, errors, 0, ignored);
+		};
+		auto run = [&](const char *name, unsigned long long compilerId, ThreadPool *threads, bool loads, int compiles, int failures) {
+			ShaderCache cache(archive, compiler, compilerId);
+			calls = 0;
+			const double start = Clock::Now();
+			const bool loaded = cache.Load(requests, threads);
+			const double elapsed = Clock::Now() - start;
+			bool match = loaded == loads && cache.Compiled() == compiles - failures && calls == compiles &&
+				cache.Hits() == static_cast<int>(requests.size()) - compiles;
+			int empty = 0;
+			for (size_t i = 0; i < requests.size(); i++)
+			{
+				std::vector<unsigned char> blob;
+				const ShaderBlob &loadedBlob = cache.Blob(i);
+				if (loadedBlob.size == 0)
+					empty++;
+				else
+					match = match && expected(i, blob) && blob.size() == loadedBlob.size && memcmp(blob.data(), loadedBlob.data, blob.size()) == 0;
+			}
+			match = match && empty == failures;
+			ok = ok && match;
+			printf("  %-28s %2d compiled, %2d from the archive, %2d failed, %8.2f ms%s\n", name, cache.Compiled(), cache.Hits(), empty, elapsed * 1e3, match ? "" : "  MISMATCH");
+		};
+
+		const int all = static_cast<int>(requests.size());
+		run("cold, one at a time", 1, nullptr, true, all, 0);
+		remove(archive);
+		run("cold, on 4 threads", 1, &pool, true, all, 0);
+		run("next launch", 1, &pool, true, 0, 0);
+
+		texts[2] += "// edited\n";
+		ok = s_writeFile("bench_shader_2.hlsl", std::vector<unsigned char>(texts[2].begin(), texts[2].end())) && ok;
+		run("one file edited", 1, &pool, true, 4, 0);
+		run("another compiler", 2, &pool, true, all, 0);
+
+		const std::string broken = texts[3] + "#error\n";
+		ok = s_writeFile("bench_shader_3.hlsl", std::vector<unsigned char>(broken.begin(), broken.end())) && ok;
+		run("one file broken", 2, &pool, false, 4, 4);
+		run("still broken, not stored", 2, &pool, false, 4, 4);
+		ok = s_writeFile("bench_shader_3.hlsl", std::vector<unsigned char>(texts[3].begin(), texts[3].end())) && ok;
+		// nothing was stored while it was broken, so the archive still has it
+		run("fixed again", 2, &pool, true, 0, 0);
+
+		std::vector<unsigned char> data;
+		ok = LoadFile(archive, data) && ok;
+		data.resize(data.size() / 2);
+		ok = s_writeFile(archive, data) && ok;
+		run("damaged archive", 2, &pool, true, all, 0);
+		run("after the damage", 2, &pool, true, 0, 0);
+
+		remove(archive);
+		for (int f = 0; f < files; f++)
+		{
+			char path[32];
+			sprintf(path, "bench_shader_%d.hlsl", f);
+			remove(path);
+		}
+		remove("bench_shaders.txt");
+		return ok;
+	}
+
+	// The startup graph of the application up to its first frame. What
+	// needs the HMD, a window or D3D is a stand-in sleeping about as long
+	// as it takes on a DK2 machine; the shader cache (cold, with the stub
+	// compiler), the undistortion tables, the synthetic camera and the
+	// texture streamer are the real thing. Runs one task after another, as
+	// the startup used to, and then as a graph on the pool, and reports the
+	// time to the first frame and the timeline of both. Every task has to
+	// start after the tasks it depends on ended, the graph has to be the
+	// faster one, and with a failing HMD only the tasks after it may be
+	// skipped.
+	// Arguments: [ms the camera takes to open]
+	static bool s_startup()
+	{
+		const int cameraMs = s_argc > 0 ? std::max(atoi(s_argv[0]), 0) : 300;
+		const int width = 640;
+		const int height = 480;
+		const int overlaySize = 1024;
+		const char *archive = "bench_startup.cache";
+		bool ok = true;
+		Log log("bench_startup.txt", false);
+		ThreadPool workers;
+
+		ImageRgba image;
+		s_textureImage(image, overlaySize, overlaySize);
+		std::vector<unsigned char> png;
+		ImageEncode::Png(image, PNG_FILTERED, png);
+		ok = s_writeFile("bench_startup.png", png) && ok;
+		const std::string shaderText = "float4 VS() : SV_POSITION { return 0; }\nfloat4 PS() : SV_Target { return 1; }\n";
+		ok = s_writeFile("bench_startup.hlsl", std::vector<unsigned char>(shaderText.begin(), shaderText.end())) && ok;
+		std::vector<ShaderRequest> requests(4);
+		for (int i = 0; i < 4; i++)
+		{
+			requests[i].path = "bench_startup.hlsl";
+			requests[i].entry = i % 2 ? "PS" : "VS";
+			requests[i].profile = i % 2 ? "ps_4_0" : "vs_4_0";
+			requests[i].flags = i < 2 ? 0u : 1u;
+		}
+		std::atomic<int> calls(0);
+		const ShaderCompiler compiler = [&](const ShaderRequest &request, const unsigned char *source, size_t size, std::vector<unsigned char> &blob, std::string &errors) {
+			return s_stubCompile(request, source, size, blob, errors, 20, calls);
+		};
+		auto stand = [](int ms) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+			return true;
+		};
+
+		// Builds and runs the graph the way main does, then the first frame.
+		// Seconds from the start to the end of the first frame, 0 if the
+		// graph failed.
+		auto run = [&](StartupGraph &graph, ThreadPool *pool, bool hmdFails) {
+			remove(archive);
+			SyntheticCameraSource synthetic(width, height, 60.0);
+			CameraThread camera;
+			ShaderCache shaders(archive, compiler, 1);
+			CameraCalibration calibration[2];
+			UndistortMap undistort;
+			TextureStreamer streamer(&workers);
+			NullRenderDevice render(width, height);
+			render.SetOverlaySize(overlaySize);
+
+			const double start = Clock::Now();
+			const int hmd = graph.Add("hmd", [&]() { return stand(60) && !hmdFails; }, true);
+			const int window = graph.Add("window", [&]() { return stand(15); }, true);
+			graph.Add("camera", [&]() { return stand(cameraMs) && camera.Start(&synthetic); }, false, hmd);
+			const int device = graph.Add("device", [&]() { return stand(120); }, true, hmd, window);
+			const int targets = graph.Add("render targets", [&]() { return stand(5); }, false, device);
+			graph.Add("rendering", [&]() { return stand(25); }, true, targets);
+			const int shaderTask = graph.Add("shaders", [&]() { return shaders.Load(requests, &workers); }, false);
+			graph.Add("scene", [&]() { return stand(10); }, true, device, shaderTask);
+			graph.Add("camera textures", [&]() { return stand(2); }, false, device);
+			graph.Add("undistort", [&]() {
+				undistort.Init(width, height, calibration, 0.0f, 0.9f, nullptr);
+				return true;
+			}, false);
+			graph.Add("textures", [&]() {
+				streamer.Request("bench_startup.png", TEXTURE_OVERLAY_OUT, overlaySize);
+				return true;
+			}, false);
+			if (!graph.Run(pool))
+			{
+				camera.Stop();
+				return 0.0;
+			}
+
+			NullHmdDevice nullHmd;
+			FrameLoop loop(&nullHmd, &render);
+			loop.SetCamera(&camera, &undistort, &workers);
+			loop.SetTextureStreamer(&streamer, 4 << 20);
+			loop.SetShowCamera(true);
+			loop.RunFrame();
+			const double firstFrame = Clock::Now() - start;
+			camera.Stop();
+			return firstFrame;
+		};
+		auto report = [&](const char *name, const StartupGraph &graph, double firstFrame) {
+			bool ordered = true;
+			for (int i = 0; i < graph.Count(); i++)
+				for (size_t d = 0; d < graph.Dependencies(i).size(); d++)
+					ordered = ordered && (graph.State(i) != STARTUP_DONE || graph.Start(i) >= graph.End(graph.Dependencies(i)[d]));
+			char frame[64] = ", no frame";
+			if (firstFrame > 0.0)
+				sprintf(frame, ", first frame after %.1f ms", firstFrame * 1e3);
+			printf("  %s: startup %.1f ms%s%s\n", name, graph.Elapsed() * 1e3, frame, ordered ? "" : "  MISMATCH");
+			graph.Timeline([](const char *line) { printf("    %s\n", line); });
+			return ordered;
+		};
+
+		printf("startup: init tasks up to the first frame, camera opens in %d ms\n", cameraMs);
+		StartupGraph serial;
+		const double serialFrame = run(serial, nullptr, false);
+		ok = serialFrame > 0.0 && report("one after another", serial, serialFrame) && ok;
+
+		ThreadPool pool(4);
+		StartupGraph parallel;
+		const double parallelFrame = run(parallel, &pool, false);
+		ok = parallelFrame > 0.0 && report("graph on 4 threads", parallel, parallelFrame) && ok;
+		const bool faster = parallelFrame > 0.0 && parallelFrame < serialFrame;
+		printf("  first frame %.2fx sooner%s\n", parallelFrame > 0.0 ? serialFrame / parallelFrame : 0.0, faster ? "" : "  MISMATCH");
+		ok = ok && faster;
+
+		// without an HMD nothing that needs it runs, the rest still does
+		StartupGraph failing;
+		const double failedFrame = run(failing, &pool, true);
+		bool skipped = failedFrame == 0.0;
+		for (int i = 0; i < failing.Count(); i++)
+		{
+			const std::string name = failing.Name(i);
+			const bool independent = name == "window" || name == "shaders" || name == "undistort" || name == "textures";
+			const eStartupState expected = name == "hmd" ? STARTUP_FAILED : independent ? STARTUP_DONE : STARTUP_SKIPPED;
+			skipped = skipped && failing.State(i) == expected;
+		}
+		report("graph with a failing HMD", failing, 0.0);
+		printf("  %s\n", skipped ? "tasks after the failed one skipped, the others ran" : "wrong tasks skipped  MISMATCH");
+		ok = ok && skipped;
+
+		remove(archive);
+		remove("bench_startup.hlsl");
+		remove("bench_startup.png");
+		remove("bench_startup.txt");
+		return ok;
+	}
+
+	struct BenchmarkEntry
+	{
+		const char *name;
+		bool (*run)();
+	};
+
+	static const BenchmarkEntry s_benchmarks[] =
+	{
+		{ "camera", s_camera },
+		{ "color", s_color },
+		{ "undistort", s_undistort },
+		{ "capture", s_capture },
+		{ "frameloop", s_frameloop },
+		{ "raster", s_raster },
+		{ "constants", s_constants },
+		{ "transform", s_transform },
+		{ "instances", s_instances },
+		{ "cull", s_cull },
+		{ "pose", s_pose },
+		{ "reproject", s_reproject },
+		{ "log", s_log },
+		{ "logbinary", s_logbinary },
+		{ "input", s_input },
+		{ "keys", s_keys },
+		{ "mouse", s_mouse },
+		{ "listeners", s_listeners },
+		{ "actions", s_actions },
+		{ "replay", s_replay },
+		{ "textures", s_textures },
+		{ "malformed", s_malformed },
+		{ "compress", s_compress },
+		{ "atlas", s_atlas },
+		{ "shaders", s_shaders },
+		{ "startup", s_startup },
+	};
+
+	bool Benchmark::Run(const char *name, int argc, char **argv)
+	{
+		s_argc = argc;
+		s_argv = argv;
+		const bool all = strcmp(name, "all") == 0;
+		bool found = false;
+		bool ok = true;
+		for (size_t i = 0; i < sizeof(s_benchmarks) / sizeof(s_benchmarks[0]); i++)
+		{
+			if (!all && strcmp(name, s_benchmarks[i].name) != 0)
+				continue;
+			found = true;
+			ok = s_benchmarks[i].run() && ok;
+		}
+
+		if (!found)
+		{
+			printf("unknown benchmark '%s', available:", name);
+			for (size_t i = 0; i < sizeof(s_benchmarks) / sizeof(s_benchmarks[0]); i++)
+				printf(" %s", s_benchmarks[i].name);
+			printf("\n");
+		}
+		return found && ok;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Headless benchmarks, started with "OculusAR --bench [name] [args]".
+	// They need neither an HMD nor a window and print their results to stdout.
+	class Benchmark
+	{
+	public:
+		// Runs the named benchmark, or all of them for "all".
+		// argv holds the arguments after the name.
+		// Returns false for an unknown name or when a check failed.
+		static bool Run(const char *name, int argc = 0, char **argv = nullptr);
+	};
+
+//------------------------------------------------------------------
+}
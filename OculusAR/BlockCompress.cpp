@@ -0,0 +1,790 @@
+#include "BlockCompress.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if SIMD_X86
+#	include <emmintrin.h>
+#endif
+#if SIMD_ARM_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// BC7 interpolation weights of 4 bit indices, in 64ths
+	static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Nearest of count RGBA palette entries for each of the 16 texels of a
+	// block by squared distance, the first one on ties. Returns the sum of
+	// the distances.
+	typedef unsigned (*IndexFn)(const unsigned char *texels, const unsigned char *palette, int count, unsigned char *indices);
+
+	static unsigned s_indicesScalar(const unsigned char *texels, const unsigned char *palette, int count, unsigned char *indices)
+	{
+		unsigned total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			const unsigned char *t = texels + i * 4;
+			unsigned best = ~0u;
+			for (int k = 0; k < count; k++)
+			{
+				const unsigned char *p = palette + k * 4;
+				const int r = t[0] - p[0], g = t[1] - p[1], b = t[2] - p[2], a = t[3] - p[3];
+				const unsigned error = static_cast<unsigned>(r * r + g * g + b * b + a * a);
+				if (error < best)
+				{
+					best = error;
+					indices[i] = static_cast<unsigned char>(k);
+				}
+			}
+			total += best;
+		}
+		return total;
+	}
+
+#if SIMD_X86
+	// Four texels per register, the channels widened to 16 bits for madd
+	static unsigned s_indicesSSE2(const unsigned char *texels, const unsigned char *palette, int count, unsigned char *indices)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i low[4], high[4], best[4], index[4];
+		for (int g = 0; g < 4; g++)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + g * 16));
+			low[g] = _mm_unpacklo_epi8(v, zero);
+			high[g] = _mm_unpackhi_epi8(v, zero);
+			best[g] = _mm_set1_epi32(0x7FFFFFFF);
+			index[g] = zero;
+		}
+
+		for (int k = 0; k < count; k++)
+		{
+			int word;
+			memcpy(&word, palette + k * 4, 4);
+			const __m128i entry = _mm_unpacklo_epi8(_mm_set1_epi32(word), zero);
+			const __m128i number = _mm_set1_epi32(k);
+			for (int g = 0; g < 4; g++)
+			{
+				const __m128i dl = _mm_sub_epi16(low[g], entry);
+				const __m128i dh = _mm_sub_epi16(high[g], entry);
+				// r*r+g*g and b*b+a*a of each texel, then the two added
+				const __m128 sl = _mm_castsi128_ps(_mm_madd_epi16(dl, dl));
+				const __m128 sh = _mm_castsi128_ps(_mm_madd_epi16(dh, dh));
+				const __m128i error = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(sl, sh, _MM_SHUFFLE(2, 0, 2, 0))),
+					_mm_castps_si128(_mm_shuffle_ps(sl, sh, _MM_SHUFFLE(3, 1, 3, 1))));
+				const __m128i less = _mm_cmplt_epi32(error, best[g]);
+				best[g] = _mm_or_si128(_mm_and_si128(less, error), _mm_andnot_si128(less, best[g]));
+				index[g] = _mm_or_si128(_mm_and_si128(less, number), _mm_andnot_si128(less, index[g]));
+			}
+		}
+
+		unsigned errors[16], numbers[16];
+		for (int g = 0; g < 4; g++)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(errors + g * 4), best[g]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(numbers + g * 4), index[g]);
+		}
+		unsigned total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			total += errors[i];
+			indices[i] = static_cast<unsigned char>(numbers[i]);
+		}
+		return total;
+	}
+#endif
+
+#if SIMD_ARM_NEON
+	// The channels of all 16 texels deinterleaved, squares of the absolute
+	// differences widened to 32 bits
+	static unsigned s_indicesNEON(const unsigned char *texels, const unsigned char *palette, int count, unsigned char *indices)
+	{
+		const uint8x16x4_t channels = vld4q_u8(texels);
+		uint32x4_t best[4], index[4];
+		for (int g = 0; g < 4; g++)
+		{
+			best[g] = vdupq_n_u32(0xFFFFFFFFu);
+			index[g] = vdupq_n_u32(0);
+		}
+
+		for (int k = 0; k < count; k++)
+		{
+			uint16x8_t squares[4][2];
+			for (int c = 0; c < 4; c++)
+			{
+				const uint8x16_t d = vabdq_u8(channels.val[c], vdupq_n_u8(palette[k * 4 + c]));
+				squares[c][0] = vmull_u8(vget_low_u8(d), vget_low_u8(d));
+				squares[c][1] = vmull_u8(vget_high_u8(d), vget_high_u8(d));
+			}
+			const uint32x4_t number = vdupq_n_u32(static_cast<unsigned>(k));
+			for (int g = 0; g < 4; g++)
+			{
+				const int half = g >> 1;
+				uint32x4_t error;
+				if (g & 1)
+					error = vaddq_u32(vaddl_u16(vget_high_u16(squares[0][half]), vget_high_u16(squares[1][half])),
+						vaddl_u16(vget_high_u16(squares[2][half]), vget_high_u16(squares[3][half])));
+				else
+					error = vaddq_u32(vaddl_u16(vget_low_u16(squares[0][half]), vget_low_u16(squares[1][half])),
+						vaddl_u16(vget_low_u16(squares[2][half]), vget_low_u16(squares[3][half])));
+				const uint32x4_t less = vcltq_u32(error, best[g]);
+				best[g] = vbslq_u32(less, error, best[g]);
+				index[g] = vbslq_u32(less, number, index[g]);
+			}
+		}
+
+		unsigned errors[16], numbers[16];
+		for (int g = 0; g < 4; g++)
+		{
+			vst1q_u32(errors + g * 4, best[g]);
+			vst1q_u32(numbers + g * 4, index[g]);
+		}
+		unsigned total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			total += errors[i];
+			indices[i] = static_cast<unsigned char>(numbers[i]);
+		}
+		return total;
+	}
+#endif
+
+	static IndexFn s_pickIndices(eSimdLevel level)
+	{
+#if SIMD_X86
+		if (level == SIMD_AVX2 || level == SIMD_SSE2)
+			return s_indicesSSE2;
+#elif SIMD_ARM_NEON
+		if (level == SIMD_NEON)
+			return s_indicesNEON;
+#endif
+		(void)level;
+		return s_indicesScalar;
+	}
+
+//------------------------------------------------------------------
+
+	// Bits of a BC7 block, first one in the lowest bit of the first byte
+	struct BlockBits
+	{
+		explicit BlockBits(unsigned char *data) : data(data), position(0) {}
+
+		void Put(unsigned value, int count)
+		{
+			for (int i = 0; i < count; i++, position++)
+				if ((value >> i) & 1)
+					data[position >> 3] |= static_cast<unsigned char>(1 << (position & 7));
+		}
+		unsigned Get(int count)
+		{
+			unsigned value = 0;
+			for (int i = 0; i < count; i++, position++)
+				value |= static_cast<unsigned>((data[position >> 3] >> (position & 7)) & 1) << i;
+			return value;
+		}
+
+		unsigned char *data;
+		int position;
+	};
+
+	static float s_clamp255(float v)
+	{
+		return v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+	}
+
+	static int s_refits(eCompressQuality quality)
+	{
+		return quality == COMPRESS_FAST ? 0 : (quality == COMPRESS_NORMAL ? 1 : 8);
+	}
+
+	// Endpoints for the used texels: the bounding box diagonal that follows
+	// them for COMPRESS_FAST, else the ends of their principal axis
+	static void s_endpoints(const unsigned char *texels, const bool *use, int channels, eCompressQuality quality, float *e0, float *e1)
+	{
+		int count = 0;
+		float mean[4] = {}, low[4] = { 255.0f, 255.0f, 255.0f, 255.0f }, high[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!use[i])
+				continue;
+			count++;
+			for (int c = 0; c < channels; c++)
+			{
+				const float v = texels[i * 4 + c];
+				mean[c] += v;
+				low[c] = std::min(low[c], v);
+				high[c] = std::max(high[c], v);
+			}
+		}
+		for (int c = 0; c < 4; c++)
+			e0[c] = e1[c] = 0.0f;
+		if (count == 0)
+			return;
+		for (int c = 0; c < channels; c++)
+			mean[c] /= count;
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!use[i])
+				continue;
+			for (int a = 0; a < channels; a++)
+				for (int b = a; b < channels; b++)
+					covariance[a][b] += (texels[i * 4 + a] - mean[a]) * (texels[i * 4 + b] - mean[b]);
+		}
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < a; b++)
+				covariance[a][b] = covariance[b][a];
+
+		if (quality == COMPRESS_FAST)
+		{
+			// channels that fall while the widest one rises run the other way
+			int widest = 0;
+			for (int c = 1; c < channels; c++)
+				if (high[c] - low[c] > high[widest] - low[widest])
+					widest = c;
+			for (int c = 0; c < channels; c++)
+			{
+				const float inset = (high[c] - low[c]) / 16.0f;
+				const bool falling = covariance[widest][c] < 0.0f;
+				e0[c] = falling ? high[c] - inset : low[c] + inset;
+				e1[c] = falling ? low[c] + inset : high[c] - inset;
+			}
+			return;
+		}
+
+		float axis[4];
+		for (int c = 0; c < 4; c++)
+			axis[c] = c < channels ? high[c] - low[c] : 0.0f;
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {}, largest = 0.0f;
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+					next[a] += covariance[a][b] * axis[b];
+				largest = std::max(largest, fabsf(next[a]));
+			}
+			if (largest == 0.0f)
+				break;
+			for (int c = 0; c < channels; c++)
+				axis[c] = next[c] / largest;
+		}
+		float length = 0.0f;
+		for (int c = 0; c < channels; c++)
+			length += axis[c] * axis[c];
+		if (length == 0.0f)
+		{
+			for (int c = 0; c < channels; c++)
+				e0[c] = e1[c] = mean[c];
+			return;
+		}
+		length = sqrtf(length);
+		for (int c = 0; c < channels; c++)
+			axis[c] /= length;
+
+		float first = 0.0f, last = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			if (!use[i])
+				continue;
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++)
+				t += (texels[i * 4 + c] - mean[c]) * axis[c];
+			first = std::min(first, t);
+			last = std::max(last, t);
+		}
+		for (int c = 0; c < channels; c++)
+		{
+			e0[c] = s_clamp255(mean[c] + axis[c] * first);
+			e1[c] = s_clamp255(mean[c] + axis[c] * last);
+		}
+	}
+
+	// Least squares endpoints for the used texels' indices; t is where
+	// each palette entry lies from e0 (0) to e1 (1)
+	static void s_refit(const unsigned char *texels, const bool *use, const unsigned char *indices, const float *t, int channels, float *e0, float *e1)
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!use[i])
+				continue;
+			const float b = t[indices[i]], a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < channels; c++)
+			{
+				ax[c] += a * texels[i * 4 + c];
+				bx[c] += b * texels[i * 4 + c];
+			}
+		}
+		const float determinant = aa * bb - ab * ab;
+		if (determinant < 1e-4f)
+			return;
+		for (int c = 0; c < channels; c++)
+		{
+			e0[c] = s_clamp255((bb * ax[c] - ab * bx[c]) / determinant);
+			e1[c] = s_clamp255((aa * bx[c] - ab * ax[c]) / determinant);
+		}
+	}
+
+//------------------------------------------------------------------
+
+	static unsigned s_pack565(const float *rgb)
+	{
+		const unsigned r = static_cast<unsigned>(rgb[0] * (31.0f / 255.0f) + 0.5f);
+		const unsigned g = static_cast<unsigned>(rgb[1] * (63.0f / 255.0f) + 0.5f);
+		const unsigned b = static_cast<unsigned>(rgb[2] * (31.0f / 255.0f) + 0.5f);
+		return (r << 11) | (g << 5) | b;
+	}
+
+	// RGB of a BC1 colour block's palette, alpha 0 like the texels the
+	// encoder compares them with. Three colours leave black last.
+	static void s_palette565(unsigned c0, unsigned c1, bool fourColors, unsigned char *palette)
+	{
+		const unsigned ends[2] = { c0, c1 };
+		for (int e = 0; e < 2; e++)
+		{
+			const unsigned r = (ends[e] >> 11) & 31, g = (ends[e] >> 5) & 63, b = ends[e] & 31;
+			palette[e * 4 + 0] = static_cast<unsigned char>((r << 3) | (r >> 2));
+			palette[e * 4 + 1] = static_cast<unsigned char>((g << 2) | (g >> 4));
+			palette[e * 4 + 2] = static_cast<unsigned char>((b << 3) | (b >> 2));
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			const int a = palette[c], b = palette[4 + c];
+			palette[8 + c] = static_cast<unsigned char>(fourColors ? (2 * a + b) / 3 : (a + b) / 2);
+			palette[12 + c] = static_cast<unsigned char>(fourColors ? (a + 2 * b) / 3 : 0);
+		}
+		palette[3] = palette[7] = palette[11] = palette[15] = 0;
+	}
+
+	// BC1 colour block, also the second half of a BC3 block. With
+	// transparency texels below alpha 128 get the transparent entry.
+	static void s_encodeColor(const unsigned char *texels, bool transparency, eCompressQuality quality, IndexFn indexFn, unsigned char *block)
+	{
+		static const float fourSteps[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		static const float threeSteps[3] = { 0.0f, 1.0f, 0.5f };
+
+		unsigned char colors[64];
+		bool use[16];
+		bool transparent = false;
+		for (int i = 0; i < 16; i++)
+		{
+			memcpy(colors + i * 4, texels + i * 4, 3);
+			colors[i * 4 + 3] = 0;
+			use[i] = !transparency || texels[i * 4 + 3] >= 128;
+			transparent = transparent || !use[i];
+		}
+		float e0[4], e1[4];
+		s_endpoints(colors, use, 3, quality, e0, e1);
+
+		const int entries = transparent ? 3 : 4;
+		const int refits = s_refits(quality);
+		unsigned char palette[16], indices[16], bestIndices[16];
+		unsigned best = ~0u, bestC0 = 0, bestC1 = 0;
+		for (int pass = 0; ; pass++)
+		{
+			unsigned c0 = s_pack565(e0), c1 = s_pack565(e1);
+			// four colours need c0 > c1, three c0 <= c1; equal ends leave
+			// every texel on the first entry
+			if (transparent ? c0 > c1 : c0 < c1)
+			{
+				std::swap(c0, c1);
+				std::swap_ranges(e0, e0 + 3, e1);
+			}
+			s_palette565(c0, c1, !transparent, palette);
+			const unsigned error = indexFn(colors, palette, entries, indices);
+			const bool improved = error < best;
+			if (improved)
+			{
+				best = error;
+				bestC0 = c0;
+				bestC1 = c1;
+				memcpy(bestIndices, indices, 16);
+			}
+			if (pass == refits || (pass > 0 && !improved))
+				break;
+			s_refit(colors, use, indices, transparent ? threeSteps : fourSteps, 3, e0, e1);
+		}
+
+		unsigned bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= static_cast<unsigned>(use[i] ? bestIndices[i] : 3) << (i * 2);
+		block[0] = static_cast<unsigned char>(bestC0);
+		block[1] = static_cast<unsigned char>(bestC0 >> 8);
+		block[2] = static_cast<unsigned char>(bestC1);
+		block[3] = static_cast<unsigned char>(bestC1 >> 8);
+		for (int b = 0; b < 4; b++)
+			block[4 + b] = static_cast<unsigned char>(bits >> (b * 8));
+	}
+
+	// Eight alpha values: a0 > a1 interpolates six between them, else four
+	// and adds 0 and 255
+	static void s_alphaPalette(int a0, int a1, unsigned char *palette)
+	{
+		palette[0] = static_cast<unsigned char>(a0);
+		palette[1] = static_cast<unsigned char>(a1);
+		if (a0 > a1)
+		{
+			for (int k = 1; k <= 6; k++)
+				palette[k + 1] = static_cast<unsigned char>(((7 - k) * a0 + k * a1) / 7);
+			return;
+		}
+		for (int k = 1; k <= 4; k++)
+			palette[k + 1] = static_cast<unsigned char>(((5 - k) * a0 + k * a1) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	static unsigned s_alphaIndices(const unsigned char *texels, const unsigned char *palette, unsigned char *indices)
+	{
+		unsigned total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			unsigned best = ~0u;
+			for (int k = 0; k < 8; k++)
+			{
+				const int d = texels[i * 4 + 3] - palette[k];
+				if (static_cast<unsigned>(d * d) < best)
+				{
+					best = static_cast<unsigned>(d * d);
+					indices[i] = static_cast<unsigned char>(k);
+				}
+			}
+			total += best;
+		}
+		return total;
+	}
+
+	// BC3 alpha block; beyond COMPRESS_FAST also tries exact 0 and 255
+	// with the other values between their own ends
+	static void s_encodeAlpha(const unsigned char *texels, eCompressQuality quality, unsigned char *block)
+	{
+		int low = 255, high = 0, innerLow = 255, innerHigh = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			const int a = texels[i * 4 + 3];
+			low = std::min(low, a);
+			high = std::max(high, a);
+			if (a != 0 && a != 255)
+			{
+				innerLow = std::min(innerLow, a);
+				innerHigh = std::max(innerHigh, a);
+			}
+		}
+
+		int a0 = high, a1 = low;
+		unsigned char palette[8], indices[16];
+		s_alphaPalette(a0, a1, palette);
+		unsigned error = s_alphaIndices(texels, palette, indices);
+		if (quality != COMPRESS_FAST && innerLow <= innerHigh && error > 0)
+		{
+			unsigned char otherIndices[16];
+			s_alphaPalette(innerLow, innerHigh, palette);
+			if (s_alphaIndices(texels, palette, otherIndices) < error)
+			{
+				a0 = innerLow;
+				a1 = innerHigh;
+				memcpy(indices, otherIndices, 16);
+			}
+		}
+
+		unsigned long long bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= static_cast<unsigned long long>(indices[i]) << (i * 3);
+		block[0] = static_cast<unsigned char>(a0);
+		block[1] = static_cast<unsigned char>(a1);
+		for (int b = 0; b < 6; b++)
+			block[2 + b] = static_cast<unsigned char>(bits >> (b * 8));
+	}
+
+	// 7 bits per channel and the shared parity bit below them
+	static void s_quantize7(const float *e, int parity, int *q)
+	{
+		for (int c = 0; c < 4; c++)
+			q[c] = std::min(std::max(static_cast<int>(floorf((e[c] - parity) * 0.5f + 0.5f)), 0), 127);
+	}
+
+	static float s_quantizeError(const float *e, int parity)
+	{
+		int q[4];
+		s_quantize7(e, parity, q);
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			const float d = ((q[c] << 1) | parity) - e[c];
+			error += d * d;
+		}
+		return error;
+	}
+
+	static void s_bc7Palette(const int *q0, int p0, const int *q1, int p1, unsigned char *palette)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			const int v0 = (q0[c] << 1) | p0, v1 = (q1[c] << 1) | p1;
+			for (int k = 0; k < 16; k++)
+				palette[k * 4 + c] = static_cast<unsigned char>(((64 - BC7_WEIGHTS[k]) * v0 + BC7_WEIGHTS[k] * v1 + 32) >> 6);
+		}
+	}
+
+	// BC7 mode 6: RGBA endpoints of 7 bits plus a parity bit each, 4 bit
+	// indices with the first texel's top bit implied 0
+	static void s_encodeBc7(const unsigned char *texels, eCompressQuality quality, IndexFn indexFn, unsigned char *block)
+	{
+		float steps[16];
+		for (int k = 0; k < 16; k++)
+			steps[k] = BC7_WEIGHTS[k] / 64.0f;
+		bool use[16];
+		for (int i = 0; i < 16; i++)
+			use[i] = true;
+		float e0[4], e1[4];
+		s_endpoints(texels, use, 4, quality, e0, e1);
+
+		const int refits = s_refits(quality);
+		int bestQ[2][4] = {}, bestP[2] = {};
+		unsigned char palette[64], indices[16], passIndices[16], bestIndices[16] = {};
+		unsigned best = ~0u;
+		for (int pass = 0; ; pass++)
+		{
+			// the parity bits nearest the endpoints, or every pair
+			const int nearest = (s_quantizeError(e0, 1) < s_quantizeError(e0, 0) ? 1 : 0) | (s_quantizeError(e1, 1) < s_quantizeError(e1, 0) ? 2 : 0);
+			unsigned passBest = ~0u;
+			bool improved = false;
+			for (int pair = 0; pair < 4; pair++)
+			{
+				if (quality != COMPRESS_HIGH && pair != nearest)
+					continue;
+				const int p0 = pair & 1, p1 = pair >> 1;
+				int q0[4], q1[4];
+				s_quantize7(e0, p0, q0);
+				s_quantize7(e1, p1, q1);
+				s_bc7Palette(q0, p0, q1, p1, palette);
+				const unsigned error = indexFn(texels, palette, 16, indices);
+				if (error < passBest)
+				{
+					passBest = error;
+					memcpy(passIndices, indices, 16);
+				}
+				if (error < best)
+				{
+					best = error;
+					improved = true;
+					memcpy(bestQ[0], q0, sizeof(q0));
+					memcpy(bestQ[1], q1, sizeof(q1));
+					bestP[0] = p0;
+					bestP[1] = p1;
+					memcpy(bestIndices, indices, 16);
+				}
+			}
+			if (pass == refits || (pass > 0 && !improved))
+				break;
+			s_refit(texels, use, passIndices, steps, 4, e0, e1);
+		}
+
+		// the first texel's index has to be below 8: swap the ends if not
+		if (bestIndices[0] >= 8)
+		{
+			for (int c = 0; c < 4; c++)
+				std::swap(bestQ[0][c], bestQ[1][c]);
+			std::swap(bestP[0], bestP[1]);
+			for (int i = 0; i < 16; i++)
+				bestIndices[i] = static_cast<unsigned char>(15 - bestIndices[i]);
+		}
+
+		memset(block, 0, 16);
+		BlockBits bits(block);
+		bits.Put(1 << 6, 7);
+		for (int c = 0; c < 4; c++)
+		{
+			bits.Put(bestQ[0][c], 7);
+			bits.Put(bestQ[1][c], 7);
+		}
+		bits.Put(bestP[0], 1);
+		bits.Put(bestP[1], 1);
+		bits.Put(bestIndices[0], 3);
+		for (int i = 1; i < 16; i++)
+			bits.Put(bestIndices[i], 4);
+	}
+
+//------------------------------------------------------------------
+
+	// The 4x4 texels of a block, the last row and column repeated past the edges
+	static void s_gather(const ImageRgba &image, int bx, int by, unsigned char *texels)
+	{
+		for (int y = 0; y < 4; y++)
+		{
+			const unsigned char *row = image.Row(std::min(by * 4 + y, image.height - 1));
+			for (int x = 0; x < 4; x++)
+				memcpy(texels + (y * 4 + x) * 4, row + std::min(bx * 4 + x, image.width - 1) * 4, 4);
+		}
+	}
+
+	static void s_encodeRows(const ImageRgba &image, eTextureFormat format, eCompressQuality quality, int begin, int end, unsigned char *blocks, eSimdLevel level)
+	{
+		const int pitch = BlockCompress::Pitch(format, image.width);
+		if (format == FORMAT_RGBA8)
+		{
+			for (int y = begin; y < end; y++)
+				memcpy(blocks + static_cast<size_t>(y) * pitch, image.Row(y), pitch);
+			return;
+		}
+
+		const IndexFn indexFn = s_pickIndices(level);
+		const int blockBytes = BlockCompress::BlockBytes(format);
+		const int columns = (image.width + 3) / 4;
+		unsigned char texels[64];
+		for (int by = begin; by < end; by++)
+			for (int bx = 0; bx < columns; bx++)
+			{
+				s_gather(image, bx, by, texels);
+				unsigned char *block = blocks + static_cast<size_t>(by) * pitch + bx * blockBytes;
+				if (format == FORMAT_BC1)
+					s_encodeColor(texels, true, quality, indexFn, block);
+				else if (format == FORMAT_BC3)
+				{
+					s_encodeAlpha(texels, quality, block);
+					s_encodeColor(texels, false, quality, indexFn, block + 8);
+				}
+				else
+					s_encodeBc7(texels, quality, indexFn, block);
+			}
+	}
+
+	int BlockCompress::BlockBytes(eTextureFormat format)
+	{
+		return format == FORMAT_RGBA8 ? 0 : (format == FORMAT_BC1 ? 8 : 16);
+	}
+
+	int BlockCompress::Pitch(eTextureFormat format, int width)
+	{
+		return format == FORMAT_RGBA8 ? width * 4 : (width + 3) / 4 * BlockBytes(format);
+	}
+
+	int BlockCompress::Rows(eTextureFormat format, int height)
+	{
+		return format == FORMAT_RGBA8 ? height : (height + 3) / 4;
+	}
+
+	size_t BlockCompress::LevelBytes(eTextureFormat format, int width, int height)
+	{
+		return static_cast<size_t>(Pitch(format, width)) * Rows(format, height);
+	}
+
+	void BlockCompress::Encode(const ImageRgba &image, eTextureFormat format, eCompressQuality quality, std::vector<unsigned char> &blocks, ThreadPool *pool)
+	{
+		blocks.resize(LevelBytes(format, image.width, image.height));
+		const int rows = Rows(format, image.height);
+		const eSimdLevel level = Simd::Level();
+		if (blocks.empty())
+			return;
+		unsigned char *out = &blocks[0];
+		if (pool)
+			pool->ParallelFor(rows, 4, [&](int begin, int end) { s_encodeRows(image, format, quality, begin, end, out, level); });
+		else
+			s_encodeRows(image, format, quality, 0, rows, out, level);
+	}
+
+	void BlockCompress::EncodeReference(const ImageRgba &image, eTextureFormat format, eCompressQuality quality, std::vector<unsigned char> &blocks)
+	{
+		blocks.resize(LevelBytes(format, image.width, image.height));
+		if (!blocks.empty())
+			s_encodeRows(image, format, quality, 0, Rows(format, image.height), &blocks[0], SIMD_SCALAR);
+	}
+
+	void BlockCompress::EncodeRows(const ImageRgba &image, eTextureFormat format, eCompressQuality quality, int begin, int end, unsigned char *blocks)
+	{
+		s_encodeRows(image, format, quality, begin, end, blocks, Simd::Level());
+	}
+
+//------------------------------------------------------------------
+
+	static void s_decodeColor(const unsigned char *block, bool transparency, unsigned char *texels)
+	{
+		const unsigned c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+		const bool fourColors = !transparency || c0 > c1;
+		unsigned char palette[16];
+		s_palette565(c0, c1, fourColors, palette);
+		palette[3] = palette[7] = palette[11] = 255;
+		palette[15] = static_cast<unsigned char>(fourColors ? 255 : 0);
+		const unsigned bits = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<unsigned>(block[7]) << 24);
+		for (int i = 0; i < 16; i++)
+			memcpy(texels + i * 4, palette + ((bits >> (i * 2)) & 3) * 4, 4);
+	}
+
+	static void s_decodeAlpha(const unsigned char *block, unsigned char *texels)
+	{
+		unsigned char palette[8];
+		s_alphaPalette(block[0], block[1], palette);
+		unsigned long long bits = 0;
+		for (int b = 0; b < 6; b++)
+			bits |= static_cast<unsigned long long>(block[2 + b]) << (b * 8);
+		for (int i = 0; i < 16; i++)
+			texels[i * 4 + 3] = palette[(bits >> (i * 3)) & 7];
+	}
+
+	static void s_decodeBc7(const unsigned char *block, unsigned char *texels)
+	{
+		memset(texels, 0, 64);
+		if ((block[0] & 0x7F) != 0x40)
+			return;
+		unsigned char copy[16];
+		memcpy(copy, block, 16);
+		BlockBits bits(copy);
+		bits.Get(7);
+		int q[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			q[0][c] = static_cast<int>(bits.Get(7));
+			q[1][c] = static_cast<int>(bits.Get(7));
+		}
+		const int p0 = static_cast<int>(bits.Get(1)), p1 = static_cast<int>(bits.Get(1));
+		unsigned char palette[64];
+		s_bc7Palette(q[0], p0, q[1], p1, palette);
+		for (int i = 0; i < 16; i++)
+			memcpy(texels + i * 4, palette + bits.Get(i == 0 ? 3 : 4) * 4, 4);
+	}
+
+	void BlockCompress::Decode(const unsigned char *blocks, eTextureFormat format, int width, int height, ImageRgba &image)
+	{
+		image.Allocate(width, height);
+		const int pitch = Pitch(format, width);
+		if (format == FORMAT_RGBA8)
+		{
+			for (int y = 0; y < height; y++)
+				memcpy(image.Row(y), blocks + static_cast<size_t>(y) * pitch, pitch);
+			return;
+		}
+
+		const int blockBytes = BlockBytes(format);
+		unsigned char texels[64];
+		for (int by = 0; by < Rows(format, height); by++)
+			for (int bx = 0; bx < (width + 3) / 4; bx++)
+			{
+				const unsigned char *block = blocks + static_cast<size_t>(by) * pitch + bx * blockBytes;
+				if (format == FORMAT_BC1)
+					s_decodeColor(block, true, texels);
+				else if (format == FORMAT_BC3)
+				{
+					s_decodeColor(block + 8, false, texels);
+					s_decodeAlpha(block, texels);
+				}
+				else
+					s_decodeBc7(block, texels);
+
+				const int w = std::min(4, width - bx * 4), h = std::min(4, height - by * 4);
+				for (int y = 0; y < h; y++)
+					memcpy(image.Row(by * 4 + y) + bx * 16, texels + y * 16, w * 4);
+			}
+	}
+
+//------------------------------------------------------------------
+}
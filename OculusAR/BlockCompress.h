@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "ImageDecode.h"
+#include "RenderDevice.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class ThreadPool;
+
+	enum eCompressQuality
+	{
+		// bounding box endpoints, nearest indices
+		COMPRESS_FAST = 0,
+		// endpoints along the principal axis, refitted once to their indices
+		COMPRESS_NORMAL,
+		// refitted until it stops improving, and for BC7 every parity bit pair
+		COMPRESS_HIGH
+	};
+
+	// Encodes RGBA images into the block compressed formats, a quarter
+	// (BC3, BC7) or an eighth (BC1) of their RGBA8 size in memory and on
+	// the way to the GPU.
+	//
+	// BC1 uses its 3 colour mode only for blocks with transparent texels
+	// (alpha below 128). BC7 is mode 6 only, one pair of RGBA endpoints per
+	// block with 16 steps between them: a lot better than BC3 on gradients
+	// and colour, not as good as a full BC7 encoder on sharp edges between
+	// several colours.
+	//
+	// The search of the nearest palette entry for each texel, where the
+	// time goes, has SSE2 and NEON paths that pick the same entries as the
+	// scalar one, so the output is the same on every machine.
+	class BlockCompress
+	{
+	public:
+		// Changes with anything that changes the encoded bytes, so cached
+		// blocks of an older encoder are not used
+		static const unsigned Version = 1;
+
+		// Bytes of a 4x4 block, 0 for FORMAT_RGBA8
+		static int BlockBytes(eTextureFormat format);
+		// Bytes of a row of blocks, or of texels for FORMAT_RGBA8
+		static int Pitch(eTextureFormat format, int width);
+		// Rows of blocks, or of texels
+		static int Rows(eTextureFormat format, int height);
+		static size_t LevelBytes(eTextureFormat format, int width, int height);
+
+		// Encodes the whole image, blocks is resized to LevelBytes. With a
+		// pool the rows are spread over it; not for the pool's own tasks.
+		static void Encode(const ImageRgba &image, eTextureFormat format, eCompressQuality quality, std::vector<unsigned char> &blocks, ThreadPool *pool = nullptr);
+		static void EncodeReference(const ImageRgba &image, eTextureFormat format, eCompressQuality quality, std::vector<unsigned char> &blocks);
+		// Encodes the rows [begin, end) as Rows counts them into blocks,
+		// which holds the whole level
+		static void EncodeRows(const ImageRgba &image, eTextureFormat format, eCompressQuality quality, int begin, int end, unsigned char *blocks);
+
+		// Back to RGBA as the GPU samples it. BC7 blocks of other modes
+		// than the encoder's come out transparent black.
+		static void Decode(const unsigned char *blocks, eTextureFormat format, int width, int height, ImageRgba &image);
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,83 @@
+#include "CameraReprojection.h"
+#include <OVR.h>
+#include <cmath>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Depth of the background, like the plain background transform
+	static const float BACKGROUND_DEPTH = 0.9999f;
+
+	void ReprojectionStats::Clear()
+	{
+		frames = 0;
+		reused = 0;
+		reprojected = 0;
+		latencySum = 0.0;
+		latencyMax = 0.0;
+		rotationSum = 0.0;
+		rotationMax = 0.0;
+	}
+
+//------------------------------------------------------------------
+
+	// Eye projection; near and far do not matter, depth is replaced
+	static OVR::Matrix4f s_projection(const ovrFovPort &fov)
+	{
+		return OVR::Matrix4f(ovrMatrix4f_Projection(fov, 0.01f, 10000.0f, true));
+	}
+
+	// Rotation taking capture eye space directions to display eye space
+	static OVR::Quatf s_delta(const ovrQuatf &capture, const ovrQuatf &display)
+	{
+		return OVR::Quatf(display).Inverted() * OVR::Quatf(capture);
+	}
+
+	// Viewport NDC x, y of the quad at z = -1 to the eye space direction
+	// (tan x, tan y, -1) that projection shows there
+	static OVR::Matrix4f s_unproject(const OVR::Matrix4f &projection)
+	{
+		const float sx = 1.0f / projection.M[0][0];
+		const float sy = 1.0f / projection.M[1][1];
+		return OVR::Matrix4f(
+			sx, 0.0f, 0.0f, projection.M[0][2] * sx,
+			0.0f, sy, 0.0f, projection.M[1][2] * sy,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	void CameraReprojection::Transform(const ovrFovPort &fov, const ovrQuatf &capture, const ovrQuatf &display, float transform[16])
+	{
+		const OVR::Matrix4f projection = s_projection(fov);
+		OVR::Matrix4f m = projection * OVR::Matrix4f(s_delta(capture, display)) * s_unproject(projection);
+		// constant depth: z follows w
+		for (int c = 0; c < 4; c++)
+			m.M[2][c] = BACKGROUND_DEPTH * m.M[3][c];
+		for (int i = 0; i < 16; i++)
+			transform[i] = m.M[i / 4][i % 4];
+	}
+
+	bool CameraReprojection::MapPoint(const ovrFovPort &fov, const ovrQuatf &capture, const ovrQuatf &display,
+		float x, float y, float *outX, float *outY)
+	{
+		const OVR::Matrix4f projection = s_projection(fov);
+		const OVR::Matrix4f unproject = s_unproject(projection);
+		const OVR::Vector3f direction(unproject.M[0][0] * x + unproject.M[0][3], unproject.M[1][1] * y + unproject.M[1][3], -1.0f);
+		const OVR::Vector3f rotated = s_delta(capture, display).Rotate(direction);
+		if (rotated.z >= 0.0f)
+			return false;
+		*outX = (projection.M[0][0] * rotated.x + projection.M[0][2] * rotated.z) / -rotated.z;
+		*outY = (projection.M[1][1] * rotated.y + projection.M[1][2] * rotated.z) / -rotated.z;
+		return true;
+	}
+
+	double CameraReprojection::Angle(const ovrQuatf &capture, const ovrQuatf &display)
+	{
+		const OVR::Quatf delta = s_delta(capture, display);
+		const double sinHalf = std::sqrt(static_cast<double>(delta.x) * delta.x + static_cast<double>(delta.y) * delta.y + static_cast<double>(delta.z) * delta.z);
+		return 2.0 * std::atan2(sinHalf, std::fabs(static_cast<double>(delta.w))) * 180.0 / 3.14159265358979;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <OVR_CAPI.h>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// What reprojecting the camera background did since the last Clear
+	struct ReprojectionStats
+	{
+		ReprojectionStats() { Clear(); }
+		void Clear();
+
+		// Frames that showed the camera image, and those among them that had
+		// no new camera frame and showed the previous one again
+		unsigned long long frames;
+		unsigned long long reused;
+		// Frames whose image was moved to the display pose
+		unsigned long long reprojected;
+		// Capture to display time the reprojected frames made up for, seconds
+		double latencySum;
+		double latencyMax;
+		// Head rotation between capture and display, degrees
+		double rotationSum;
+		double rotationMax;
+	};
+
+	// Moves the camera image from the head orientation it was captured at
+	// to the one it will be displayed at, like timewarp does for rendered
+	// frames. Only rotation is compensated, as if everything the camera sees
+	// were far away.
+	//
+	// The camera background fills the eye viewport, so its pixels are taken
+	// as directions through the eye fov. A rotation of these directions is a
+	// homography of the image, which the 4x4 transform of the background
+	// quad can hold: the GPU and the software rasterizer warp the image
+	// with their perspective correct texture mapping, no extra pass.
+	class CameraReprojection
+	{
+	public:
+		// Row-major transform of the background quad (the scene quad at
+		// z = -1) for one eye. At capture == display it fills the viewport
+		// like the plain background transform. Depth stays at the far end.
+		static void Transform(const ovrFovPort &fov, const ovrQuatf &capture, const ovrQuatf &display, float transform[16]);
+
+		// Where the image point at viewport NDC x, y ends up, the same
+		// mapping on the CPU. False if it ends up behind the eye.
+		static bool MapPoint(const ovrFovPort &fov, const ovrQuatf &capture, const ovrQuatf &display,
+			float x, float y, float *outX, float *outY);
+
+		// Rotation from capture to display orientation in degrees
+		static double Angle(const ovrQuatf &capture, const ovrQuatf &display);
+	};
+
+//------------------------------------------------------------------
+}
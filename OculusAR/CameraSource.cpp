@@ -0,0 +1,77 @@
+#include "CameraSource.h"
+#include "Clock.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	int PixelSize(ePixelFormat format)
+	{
+		switch (format)
+		{
+		case PIXEL_RGB24:
+			return 3;
+		case PIXEL_RGBA32:
+			return 4;
+		case PIXEL_YUYV:
+			return 2;
+		case PIXEL_BAYER_GRBG:
+			return 1;
+		default:
+			return 0;
+		}
+	}
+
+	void CameraFrame::Allocate(int w, int h, ePixelFormat f)
+	{
+		width = w;
+		height = h;
+		format = f;
+		pitch = w * PixelSize(f);
+		eye[0].resize(pitch * h);
+		eye[1].resize(pitch * h);
+	}
+
+	SyntheticCameraSource::SyntheticCameraSource(int width, int height, double fps, ePixelFormat format) :
+		m_width(width), m_height(height), m_period(fps > 0.0 ? 1.0 / fps : 0.0), m_format(format),
+		m_next(0.0), m_sequence(0)
+	{
+	}
+
+	bool SyntheticCameraSource::Grab(CameraFrame &frame)
+	{
+		if (m_period > 0.0)
+		{
+			double now = Clock::Now();
+			if (m_next == 0.0)
+				m_next = now;
+			Clock::Sleep(m_next - now);
+			m_next += m_period;
+		}
+
+		frame.Allocate(m_width, m_height, m_format);
+		frame.sequence = ++m_sequence;
+		frame.captureTime = Clock::Now();
+
+		// Diagonal gradient scrolling one pixel per frame, the right eye
+		// shifted a few pixels to give some disparity.
+		const int size = PixelSize(m_format);
+		for (int e = 0; e < 2; e++)
+		{
+			const unsigned shift = static_cast<unsigned>(m_sequence) + e * 8;
+			for (int y = 0; y < m_height; y++)
+			{
+				unsigned char *row = &frame.eye[e][y * frame.pitch];
+				for (int x = 0; x < m_width; x++)
+				{
+					unsigned char v = static_cast<unsigned char>(x + y + shift);
+					for (int c = 0; c < size; c++)
+						row[x * size + c] = static_cast<unsigned char>(v ^ (c * 0x55));
+				}
+			}
+		}
+		return true;
+	}
+
+//------------------------------------------------------------------
+}
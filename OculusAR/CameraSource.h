@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	enum ePixelFormat
+	{
+		PIXEL_RGB24 = 0,
+		PIXEL_RGBA32,
+		PIXEL_YUYV,
+		PIXEL_BAYER_GRBG,
+
+		PIXEL_MAX
+	};
+
+	// Bytes per pixel (per sample for Bayer)
+	int PixelSize(ePixelFormat format);
+
+	// One stereo pair as delivered by a camera
+	struct CameraFrame
+	{
+		CameraFrame() : width(0), height(0), pitch(0), format(PIXEL_RGB24), sequence(0), captureTime(0.0) {}
+
+		// Resizes both eye images; keeps memory if the size did not change
+		void Allocate(int w, int h, ePixelFormat f);
+
+		int width;
+		int height;
+		int pitch;					// bytes per row
+		ePixelFormat format;
+		unsigned long long sequence;	// 1 for the first frame, 0 = empty
+		double captureTime;			// Clock::Now() when the image was taken
+		std::vector<unsigned char> eye[2];
+	};
+
+	// Anything that produces stereo frames: the Ovrvision, a recording, a test pattern
+	class CameraSource
+	{
+	public:
+		virtual ~CameraSource() {}
+
+		// Waits for the next frame and writes it into frame (reusing its memory).
+		// Returns false when the source has nothing more to give.
+		virtual bool Grab(CameraFrame &frame) = 0;
+	};
+
+	// Moving test pattern generated on the CPU, paced to a fixed rate.
+	// Stands in for the camera on machines without one.
+	class SyntheticCameraSource : public CameraSource
+	{
+	public:
+		// fps <= 0 produces frames as fast as possible
+		SyntheticCameraSource(int width, int height, double fps, ePixelFormat format = PIXEL_RGB24);
+
+		bool Grab(CameraFrame &frame);
+
+	private:
+		int m_width;
+		int m_height;
+		double m_period;
+		ePixelFormat m_format;
+		double m_next;
+		unsigned long long m_sequence;
+	};
+
+//------------------------------------------------------------------
+}
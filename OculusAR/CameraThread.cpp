@@ -0,0 +1,62 @@
+#include "CameraThread.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	CameraThread::CameraThread() : m_source(nullptr), m_running(false), m_captured(0)
+	{
+	}
+
+	CameraThread::~CameraThread()
+	{
+		Stop();
+	}
+
+	bool CameraThread::Start(CameraSource *source)
+	{
+		if (m_running || !source)
+			return false;
+
+		// the thread of a source that ran out has stopped but not been joined
+		if (m_thread.joinable())
+			m_thread.join();
+		m_source = source;
+		m_running = true;
+		m_thread = std::thread(&CameraThread::m_run, this);
+		return true;
+	}
+
+	void CameraThread::Stop()
+	{
+		m_running = false;
+		if (m_thread.joinable())
+			m_thread.join();
+		m_source = nullptr;
+	}
+
+	const CameraFrame *CameraThread::Latest(bool *isNew)
+	{
+		bool fresh = m_frames.Update();
+		if (isNew)
+			*isNew = fresh;
+
+		const CameraFrame &frame = m_frames.ReadSlot();
+		return frame.sequence ? &frame : nullptr;
+	}
+
+	void CameraThread::m_run()
+	{
+		while (m_running)
+		{
+			CameraFrame &frame = m_frames.WriteSlot();
+			if (!m_source->Grab(frame))
+				break;
+			m_frames.Publish();
+			m_captured.fetch_add(1, std::memory_order_relaxed);
+		}
+		m_running = false;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "CameraSource.h"
+#include "TripleBuffer.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Pulls frames from a CameraSource on its own thread so the render loop
+	// never waits on the camera. The newest complete frame is handed over
+	// through a lock-free triple buffer.
+	class CameraThread
+	{
+	public:
+		CameraThread();
+		~CameraThread();
+
+		// The source must outlive the thread (until Stop). False while the
+		// thread is running; once its source has run out it can be started
+		// again without a Stop.
+		bool Start(CameraSource *source);
+		void Stop();
+
+		// Render side. Returns the newest complete frame, or nullptr if none
+		// arrived yet. Never blocks. isNew is set to false when the returned
+		// frame was already returned by a previous call.
+		// The frame stays valid until the next call.
+		const CameraFrame *Latest(bool *isNew = nullptr);
+
+		// Frames grabbed by the capture thread
+		unsigned long long Captured() const { return m_captured.load(std::memory_order_relaxed); }
+		// Frames replaced before the render loop picked them up
+		unsigned long long Dropped() const { return m_frames.Overwritten(); }
+
+	private:
+		void m_run();
+
+		CameraSource *m_source;
+		std::thread m_thread;
+		std::atomic<bool> m_running;
+		std::atomic<unsigned long long> m_captured;
+		TripleBuffer<CameraFrame> m_frames;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,418 @@
+#include "Capture.h"
+#include "Clock.h"
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static const unsigned CAPTURE_MAGIC = 0x4352414F;	// "OARC"
+	static const unsigned CAPTURE_TRAILER_MAGIC = 0x5852414F;	// "OARX"
+	static const unsigned CAPTURE_VERSION = 1;
+	static const unsigned FRAME_ALIGNMENT = 64;
+
+	static unsigned long long s_align(unsigned long long value, unsigned alignment)
+	{
+		return (value + alignment - 1) & ~static_cast<unsigned long long>(alignment - 1);
+	}
+
+	CaptureWriter::CaptureWriter() : m_file(nullptr), m_offset(0)
+	{
+	}
+
+	CaptureWriter::~CaptureWriter()
+	{
+		Close();
+	}
+
+	bool CaptureWriter::Open(const char *path)
+	{
+		Close();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_file = fopen(path, "wb");
+		if (!m_file)
+			return false;
+
+		// big sequential writes, don't flush per record
+		setvbuf(m_file, nullptr, _IOFBF, 1 << 20);
+
+		CaptureFileHeader header = { CAPTURE_MAGIC, CAPTURE_VERSION };
+		fwrite(&header, sizeof(header), 1, m_file);
+		m_offset = sizeof(header);
+		m_index.clear();
+		std::lock_guard<std::mutex> inputLock(m_inputMutex);
+		m_queued.clear();
+		return true;
+	}
+
+	void CaptureWriter::Close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_file)
+			return;
+
+		m_writeInputs();
+		CaptureFileTrailer trailer = { m_offset, CAPTURE_TRAILER_MAGIC, 0 };
+		m_chunk(CHUNK_INDEX, m_index.empty() ? nullptr : &m_index[0],
+			static_cast<unsigned>(m_index.size() * sizeof(CaptureIndexEntry)));
+		fwrite(&trailer, sizeof(trailer), 1, m_file);
+
+		fclose(m_file);
+		m_file = nullptr;
+	}
+
+	void CaptureWriter::m_pad(unsigned alignment)
+	{
+		static const unsigned char zeros[FRAME_ALIGNMENT] = { 0 };
+		unsigned long long aligned = s_align(m_offset, alignment);
+		fwrite(zeros, 1, static_cast<size_t>(aligned - m_offset), m_file);
+		m_offset = aligned;
+	}
+
+	void CaptureWriter::m_chunk(unsigned type, const void *data, unsigned size)
+	{
+		if (type != CHUNK_INDEX)
+		{
+			CaptureIndexEntry entry = { m_offset, type, 0 };
+			m_index.push_back(entry);
+		}
+
+		CaptureChunk chunk = { type, size };
+		fwrite(&chunk, sizeof(chunk), 1, m_file);
+		if (size)
+			fwrite(data, size, 1, m_file);
+		m_offset += sizeof(chunk) + size;
+		m_pad(8);
+	}
+
+	void CaptureWriter::m_writeInputs()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_inputMutex);
+			m_writing.swap(m_queued);
+		}
+		for (size_t i = 0; i < m_writing.size(); i++)
+			m_chunk(CHUNK_INPUT, &m_writing[i], sizeof(InputRecord));
+		m_writing.clear();
+	}
+
+	void CaptureWriter::WriteFrame(const CameraFrame &frame)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_file || frame.eye[0].empty())
+			return;
+		m_writeInputs();
+
+		const unsigned long long payload = m_offset + sizeof(CaptureChunk);
+		const unsigned imageSize = static_cast<unsigned>(frame.eye[0].size());
+		const unsigned long long eye0 = s_align(payload + sizeof(CaptureFrameHeader), FRAME_ALIGNMENT);
+		const unsigned long long eye1 = s_align(eye0 + imageSize, FRAME_ALIGNMENT);
+
+		CaptureFrameHeader header;
+		header.sequence = frame.sequence;
+		header.captureTime = frame.captureTime;
+		header.width = frame.width;
+		header.height = frame.height;
+		header.pitch = frame.pitch;
+		header.format = frame.format;
+		header.eyeOffset[0] = static_cast<unsigned>(eye0 - payload);
+		header.eyeOffset[1] = static_cast<unsigned>(eye1 - payload);
+
+		CaptureIndexEntry entry = { m_offset, CHUNK_FRAME, 0 };
+		m_index.push_back(entry);
+
+		CaptureChunk chunk = { CHUNK_FRAME, header.eyeOffset[1] + imageSize };
+		fwrite(&chunk, sizeof(chunk), 1, m_file);
+		fwrite(&header, sizeof(header), 1, m_file);
+		m_offset = payload + sizeof(header);
+		for (int e = 0; e < 2; e++)
+		{
+			m_pad(FRAME_ALIGNMENT);
+			fwrite(&frame.eye[e][0], imageSize, 1, m_file);
+			m_offset += imageSize;
+		}
+		m_pad(8);
+	}
+
+	void CaptureWriter::WritePose(const PoseRecord &pose)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_file)
+			return;
+		m_writeInputs();
+		m_chunk(CHUNK_POSE, &pose, sizeof(pose));
+	}
+
+	void CaptureWriter::WriteInput(const InputRecord &input)
+	{
+		std::lock_guard<std::mutex> lock(m_inputMutex);
+		m_queued.push_back(input);
+	}
+
+	void CaptureWriter::WriteTiming(const TimingRecord &timing)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_file)
+			return;
+		m_writeInputs();
+		m_chunk(CHUNK_TIMING, &timing, sizeof(timing));
+	}
+
+//------------------------------------------------------------------
+
+	bool CaptureReader::Open(const char *path)
+	{
+		Close();
+		if (!m_map.Open(path))
+			return false;
+
+		const unsigned char *data = m_map.Data();
+		const size_t size = m_map.Size();
+
+		const CaptureFileHeader *header = reinterpret_cast<const CaptureFileHeader*>(data);
+		if (size < sizeof(CaptureFileHeader) || header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION)
+		{
+			Close();
+			return false;
+		}
+
+		// Use the index if the recording was closed properly
+		bool indexed = false;
+		if (size >= sizeof(CaptureFileHeader) + sizeof(CaptureChunk) + sizeof(CaptureFileTrailer))
+		{
+			// copied out, the file does not have to end on a multiple of 8
+			CaptureFileTrailer trailer;
+			memcpy(&trailer, data + size - sizeof(CaptureFileTrailer), sizeof(trailer));
+			const unsigned long long indexOffset = trailer.indexOffset;
+			// the index is a chunk like the others, on an 8 byte boundary so its entries are aligned
+			if (trailer.magic == CAPTURE_TRAILER_MAGIC && indexOffset % 8 == 0 && indexOffset >= sizeof(CaptureFileHeader) &&
+				indexOffset <= size - sizeof(CaptureFileTrailer) - sizeof(CaptureChunk))
+			{
+				const CaptureChunk *chunk = reinterpret_cast<const CaptureChunk*>(data + indexOffset);
+				if (chunk->type == CHUNK_INDEX && chunk->size <= size - sizeof(CaptureFileTrailer) - sizeof(CaptureChunk) - indexOffset)
+				{
+					const CaptureIndexEntry *entries = reinterpret_cast<const CaptureIndexEntry*>(chunk + 1);
+					const size_t count = chunk->size / sizeof(CaptureIndexEntry);
+					indexed = chunk->size % sizeof(CaptureIndexEntry) == 0;
+					// entries point at the chunks before the index in file order, of the type they say
+					unsigned long long next = sizeof(CaptureFileHeader);
+					for (size_t i = 0; i < count && indexed; i++)
+					{
+						indexed = entries[i].offset >= next && entries[i].offset < indexOffset && m_add(entries[i].offset, entries[i].type);
+						next = entries[i].offset + sizeof(CaptureChunk);
+					}
+				}
+			}
+		}
+
+		// Otherwise walk the chunks until the data ends or breaks off
+		if (!indexed)
+		{
+			m_frames.clear();
+			m_poses.clear();
+			m_inputs.clear();
+			m_timings.clear();
+
+			unsigned long long offset = sizeof(CaptureFileHeader);
+			while (offset + sizeof(CaptureChunk) <= size)
+			{
+				const CaptureChunk *chunk = reinterpret_cast<const CaptureChunk*>(data + offset);
+				if (chunk->type == CHUNK_INDEX || !m_add(offset, chunk->type))
+					break;
+				offset = s_align(offset + sizeof(CaptureChunk) + chunk->size, 8);
+			}
+		}
+
+		m_start = 0.0;
+		m_end = 0.0;
+		bool first = true;
+		#define SPAN(t) { double v = (t); if (first || v < m_start) m_start = v; if (first || v > m_end) m_end = v; first = false; }
+		if (!m_frames.empty())
+		{
+			SPAN(m_frames.front()->captureTime);
+			SPAN(m_frames.back()->captureTime);
+		}
+		if (!m_poses.empty())
+		{
+			SPAN(m_poses.front()->time);
+			SPAN(m_poses.back()->time);
+		}
+		if (!m_inputs.empty())
+		{
+			SPAN(m_inputs.front()->time);
+			SPAN(m_inputs.back()->time);
+		}
+		if (!m_timings.empty())
+		{
+			SPAN(m_timings.front()->frameStart);
+			SPAN(m_timings.back()->frameEnd);
+		}
+		#undef SPAN
+		return true;
+	}
+
+	void CaptureReader::Close()
+	{
+		m_frames.clear();
+		m_poses.clear();
+		m_inputs.clear();
+		m_timings.clear();
+		m_map.Close();
+		m_start = m_end = 0.0;
+	}
+
+	bool CaptureReader::m_add(unsigned long long offset, unsigned type)
+	{
+		// chunks start on 8 byte boundaries and end inside the file
+		const size_t size = m_map.Size();
+		if (offset % 8 != 0 || offset > size || size - offset < sizeof(CaptureChunk))
+			return false;
+
+		const CaptureChunk *chunk = reinterpret_cast<const CaptureChunk*>(m_map.Data() + offset);
+		if (chunk->type != type || size - offset - sizeof(CaptureChunk) < chunk->size)
+			return false;
+		const unsigned char *payload = reinterpret_cast<const unsigned char*>(chunk + 1);
+
+		switch (chunk->type)
+		{
+		case CHUNK_FRAME:
+			{
+				if (chunk->size < sizeof(CaptureFrameHeader))
+					return false;
+				const CaptureFrameHeader *frame = reinterpret_cast<const CaptureFrameHeader*>(payload);
+				if (frame->width <= 0 || frame->height <= 0 || frame->pitch <= 0 || frame->format < 0 || frame->format >= PIXEL_MAX)
+					return false;
+				const unsigned long long imageSize = static_cast<unsigned long long>(frame->pitch) * frame->height;
+				const unsigned long long payloadOffset = offset + sizeof(CaptureChunk);
+				for (int e = 0; e < 2; e++)
+					if ((payloadOffset + frame->eyeOffset[e]) % FRAME_ALIGNMENT != 0 || frame->eyeOffset[e] < sizeof(CaptureFrameHeader) ||
+						frame->eyeOffset[e] + imageSize > chunk->size)
+						return false;
+				m_frames.push_back(frame);
+			}
+			return true;
+		case CHUNK_POSE:
+			if (chunk->size < sizeof(PoseRecord))
+				return false;
+			m_poses.push_back(reinterpret_cast<const PoseRecord*>(payload));
+			return true;
+		case CHUNK_INPUT:
+			if (chunk->size < sizeof(InputRecord))
+				return false;
+			m_inputs.push_back(reinterpret_cast<const InputRecord*>(payload));
+			return true;
+		case CHUNK_TIMING:
+			if (chunk->size < sizeof(TimingRecord))
+				return false;
+			m_timings.push_back(reinterpret_cast<const TimingRecord*>(payload));
+			return true;
+		default:
+			// unknown chunks from newer versions are skipped
+			return true;
+		}
+	}
+
+	CaptureFrameView CaptureReader::Frame(size_t i) const
+	{
+		const CaptureFrameHeader *header = m_frames[i];
+		const unsigned char *payload = reinterpret_cast<const unsigned char*>(header);
+
+		CaptureFrameView view;
+		view.sequence = header->sequence;
+		view.captureTime = header->captureTime;
+		view.width = header->width;
+		view.height = header->height;
+		view.pitch = header->pitch;
+		view.format = static_cast<ePixelFormat>(header->format);
+		view.eye[0] = payload + header->eyeOffset[0];
+		view.eye[1] = payload + header->eyeOffset[1];
+		return view;
+	}
+
+	size_t CaptureReader::FindFrame(double time) const
+	{
+		size_t lo = 0, hi = m_frames.size();
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (m_frames[mid]->captureTime <= time)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo > 0 ? lo - 1 : 0;
+	}
+
+	size_t CaptureReader::FindPose(double time) const
+	{
+		size_t lo = 0, hi = m_poses.size();
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (m_poses[mid]->time <= time)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo > 0 ? lo - 1 : 0;
+	}
+
+//------------------------------------------------------------------
+
+	ReplayCameraSource::ReplayCameraSource(const CaptureReader *reader, bool realtime, bool loop) :
+		m_reader(reader), m_realtime(realtime), m_loop(loop), m_next(0), m_base(0.0)
+	{
+	}
+
+	bool ReplayCameraSource::Grab(CameraFrame &frame)
+	{
+		if (m_reader->FrameCount() == 0)
+			return false;
+		if (m_next >= m_reader->FrameCount())
+		{
+			if (!m_loop)
+				return false;
+			m_next = 0;
+			m_base = 0.0;
+		}
+
+		const CaptureFrameView view = m_reader->Frame(m_next++);
+		if (m_realtime)
+		{
+			// keep the recorded spacing between frames
+			const double first = m_reader->Frame(0).captureTime;
+			if (m_base == 0.0)
+				m_base = Clock::Now() - (view.captureTime - first);
+			Clock::Sleep(m_base + (view.captureTime - first) - Clock::Now());
+		}
+
+		frame.Allocate(view.width, view.height, view.format);
+		frame.sequence = view.sequence;
+		frame.captureTime = view.captureTime;
+		for (int e = 0; e < 2; e++)
+		{
+			if (view.pitch == frame.pitch)
+				memcpy(&frame.eye[e][0], view.eye[e], frame.eye[e].size());
+			else
+				for (int y = 0; y < view.height; y++)
+					memcpy(&frame.eye[e][y * frame.pitch], view.eye[e] + y * view.pitch, frame.pitch);
+		}
+		return true;
+	}
+
+	RecordingCameraSource::RecordingCameraSource(CameraSource *source, CaptureWriter *writer) :
+		m_source(source), m_writer(writer)
+	{
+	}
+
+	bool RecordingCameraSource::Grab(CameraFrame &frame)
+	{
+		if (!m_source->Grab(frame))
+			return false;
+		m_writer->WriteFrame(frame);
+		return true;
+	}
+
+//------------------------------------------------------------------
+}
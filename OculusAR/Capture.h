@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include "CameraSource.h"
+#include "MappedFile.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Recording of a session: stereo camera frames, tracking poses, input
+	// messages and frame timings, all stamped with Clock::Now().
+	//
+	// File layout:
+	//   CaptureFileHeader
+	//   chunks, each a CaptureChunk header followed by its payload, 8 byte aligned
+	//   index chunk listing every other chunk
+	//   CaptureFileTrailer pointing at the index
+	// A recording that was cut off has no index; the reader then walks the
+	// chunks and drops the incomplete last one. So does an index with an
+	// entry that does not point at a whole chunk of its type. Frame images start on 64
+	// byte boundaries so mapped views can be read with aligned SIMD loads.
+
+	enum eCaptureChunk
+	{
+		CHUNK_FRAME = 1,
+		CHUNK_POSE,
+		CHUNK_INPUT,
+		CHUNK_TIMING,
+		CHUNK_INDEX
+	};
+
+	// Same layout as ovrPosef
+	struct CapturePose
+	{
+		float orientation[4];	// quaternion x, y, z, w
+		float position[3];
+	};
+
+	struct PoseRecord
+	{
+		double time;
+		unsigned statusFlags;	// ovrTrackingState::StatusFlags
+		CapturePose head;
+		CapturePose eye[2];
+	};
+
+	// A window message as InputMgr::Run receives it
+	struct InputRecord
+	{
+		double time;
+		unsigned msg;
+		unsigned long long wParam;
+		long long lParam;
+	};
+
+	struct TimingRecord
+	{
+		double frameStart;
+		double frameEnd;
+		unsigned long long frameIndex;
+	};
+
+	struct CaptureFileHeader
+	{
+		unsigned magic;
+		unsigned version;
+	};
+
+	struct CaptureChunk
+	{
+		unsigned type;
+		unsigned size;	// payload bytes, without padding
+	};
+
+	struct CaptureFrameHeader
+	{
+		unsigned long long sequence;
+		double captureTime;
+		int width;
+		int height;
+		int pitch;
+		int format;
+		unsigned eyeOffset[2];	// from the start of the payload
+	};
+
+	struct CaptureIndexEntry
+	{
+		unsigned long long offset;	// of the chunk header
+		unsigned type;
+		unsigned reserved;
+	};
+
+	struct CaptureFileTrailer
+	{
+		unsigned long long indexOffset;
+		unsigned magic;
+		unsigned reserved;
+	};
+
+	// Appends records to a capture file. Safe to use from several threads,
+	// e.g. frames from the camera thread and poses from the render loop.
+	// Input records only go into a queue, so the window procedure never
+	// waits for a frame being written; the next frame, pose or timing
+	// record writes them out.
+	class CaptureWriter
+	{
+	public:
+		CaptureWriter();
+		~CaptureWriter();
+
+		bool Open(const char *path);
+		// Writes the index; without it the file is still readable, just slower to open
+		void Close();
+		bool IsOpen() const { return m_file != nullptr; }
+
+		void WriteFrame(const CameraFrame &frame);
+		void WritePose(const PoseRecord &pose);
+		void WriteInput(const InputRecord &input);
+		void WriteTiming(const TimingRecord &timing);
+
+	private:
+		void m_chunk(unsigned type, const void *data, unsigned size);
+		void m_pad(unsigned alignment);
+		// Writes the queued input records, with m_mutex held
+		void m_writeInputs();
+
+		FILE *m_file;
+		unsigned long long m_offset;
+		std::vector<CaptureIndexEntry> m_index;
+		std::mutex m_mutex;
+		std::vector<InputRecord> m_queued;
+		std::vector<InputRecord> m_writing;
+		std::mutex m_inputMutex;
+	};
+
+	// Frame image inside a mapped capture file, no copy involved
+	struct CaptureFrameView
+	{
+		unsigned long long sequence;
+		double captureTime;
+		int width;
+		int height;
+		int pitch;
+		ePixelFormat format;
+		const unsigned char *eye[2];
+	};
+
+	// Maps a capture file and gives direct access to its records
+	class CaptureReader
+	{
+	public:
+		bool Open(const char *path);
+		void Close();
+
+		size_t FrameCount() const { return m_frames.size(); }
+		CaptureFrameView Frame(size_t i) const;
+		// Last frame captured at or before time (the first one if none)
+		size_t FindFrame(double time) const;
+
+		size_t PoseCount() const { return m_poses.size(); }
+		const PoseRecord &Pose(size_t i) const { return *m_poses[i]; }
+		// Last pose sampled at or before time (the first one if none)
+		size_t FindPose(double time) const;
+
+		size_t InputCount() const { return m_inputs.size(); }
+		const InputRecord &Input(size_t i) const { return *m_inputs[i]; }
+
+		size_t TimingCount() const { return m_timings.size(); }
+		const TimingRecord &Timing(size_t i) const { return *m_timings[i]; }
+
+		// Time span covered by the recording
+		double StartTime() const { return m_start; }
+		double EndTime() const { return m_end; }
+
+	private:
+		// Adds the chunk at offset if it is whole, inside the file and of type
+		bool m_add(unsigned long long offset, unsigned type);
+
+		MappedFile m_map;
+		std::vector<const CaptureFrameHeader*> m_frames;
+		std::vector<const PoseRecord*> m_poses;
+		std::vector<const InputRecord*> m_inputs;
+		std::vector<const TimingRecord*> m_timings;
+		double m_start;
+		double m_end;
+	};
+
+	// Plays back the frames of a recording as a camera
+	class ReplayCameraSource : public CameraSource
+	{
+	public:
+		// realtime paces frames like they were captured, otherwise they come
+		// as fast as they are taken. loop restarts at the end.
+		ReplayCameraSource(const CaptureReader *reader, bool realtime, bool loop = false);
+
+		bool Grab(CameraFrame &frame);
+
+	private:
+		const CaptureReader *m_reader;
+		bool m_realtime;
+		bool m_loop;
+		size_t m_next;
+		double m_base;
+	};
+
+	// Passes frames through from another source and records them on the way
+	class RecordingCameraSource : public CameraSource
+	{
+	public:
+		RecordingCameraSource(CameraSource *source, CaptureWriter *writer);
+
+		bool Grab(CameraFrame &frame);
+
+	private:
+		CameraSource *m_source;
+		CaptureWriter *m_writer;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,66 @@
+#include "Clock.h"
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+#include <chrono>
+#include <thread>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+#ifdef _WIN32
+	// std::chrono::high_resolution_clock is not high resolution in VS2013,
+	// so go to the performance counter directly.
+	static long long s_frequency()
+	{
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		return freq.QuadPart;
+	}
+
+	double Clock::Now()
+	{
+		static const double invFrequency = 1.0 / static_cast<double>(s_frequency());
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return static_cast<double>(counter.QuadPart) * invFrequency;
+	}
+
+	unsigned long long Clock::NowNs()
+	{
+		static const long long frequency = s_frequency();
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		unsigned long long whole = counter.QuadPart / frequency;
+		unsigned long long part = counter.QuadPart % frequency;
+		return whole * 1000000000ULL + part * 1000000000ULL / frequency;
+	}
+#else
+	double Clock::Now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+	}
+
+	unsigned long long Clock::NowNs()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+	}
+#endif
+
+	void Clock::Sleep(double seconds)
+	{
+		if (seconds <= 0.0)
+			return;
+		std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long long>(seconds * 1e6)));
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Monotonic high-resolution clock. All timestamps (camera capture,
+	// frame timings) are taken from here so they can be compared.
+	class Clock
+	{
+	public:
+		// Seconds since an arbitrary fixed point
+		static double Now();
+		// Nanoseconds since the same point
+		static unsigned long long NowNs();
+
+		// Sleeps the calling thread for the given number of seconds
+		static void Sleep(double seconds);
+	};
+
+//------------------------------------------------------------------
+}
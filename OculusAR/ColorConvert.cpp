@@ -0,0 +1,646 @@
+#include "ColorConvert.h"
+#include "Simd.h"
+
+#if SIMD_X86
+#	include <emmintrin.h>
+#	include <immintrin.h>
+#endif
+#if SIMD_ARM_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	typedef void (*ConvertFn)(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch);
+
+	// YUYV -> RGB with 8 bit coefficients, which map Y 16 and 235 to 0
+	// and 255 exactly:
+	//   c = 298*(Y-16) + 128
+	//   R = (c + 409*(V-128)) >> 8
+	//   G = (c - 100*(U-128) - 208*(V-128)) >> 8
+	//   B = (c + 516*(U-128)) >> 8
+	// The sums need more than 16 bits, so the SIMD paths multiply pairs of
+	// 16 bit values into 32 bit sums (pmaddwd, vmlal) and narrow after the
+	// shift, which gives the same bytes as this.
+	enum { YUV_Y = 298, YUV_RV = 409, YUV_GU = -100, YUV_GV = -208, YUV_BU = 516 };
+
+	static inline unsigned char s_clamp(int v)
+	{
+		return static_cast<unsigned char>(v < 0 ? 0 : (v > 255 ? 255 : v));
+	}
+
+	static inline unsigned char s_avg(unsigned a, unsigned b)
+	{
+		return static_cast<unsigned char>((a + b + 1) >> 1);
+	}
+
+//------------------------------------------------------------------
+// Scalar
+
+	static void s_yuyvRow(const unsigned char *src, unsigned char *dst, int x, int width)
+	{
+		for (; x < width; x += 2)
+		{
+			const unsigned char *p = src + x * 2;
+			unsigned char *o = dst + x * 4;
+			const int d = p[1] - 128;
+			const int e = p[3] - 128;
+			for (int i = 0; i < 2; i++)
+			{
+				const int c = YUV_Y * (p[i * 2] - 16) + 128;
+				o[i * 4 + 0] = s_clamp((c + YUV_RV * e) >> 8);
+				o[i * 4 + 1] = s_clamp((c + YUV_GU * d + YUV_GV * e) >> 8);
+				o[i * 4 + 2] = s_clamp((c + YUV_BU * d) >> 8);
+				o[i * 4 + 3] = 255;
+			}
+		}
+	}
+
+	// GRBG:  G R G R ...
+	//        B G B G ...
+	static void s_bayerRow(const unsigned char *up, const unsigned char *cur, const unsigned char *down,
+		bool oddRow, unsigned char *dst, int x, int xEnd, int width)
+	{
+		for (; x < xEnd; x++)
+		{
+			// mirror at the borders, which keeps the colour of the neighbours right
+			const int l = x == 0 ? 1 : x - 1;
+			const int r = x == width - 1 ? width - 2 : x + 1;
+
+			const unsigned char c = cur[x];
+			const unsigned char hor = s_avg(cur[l], cur[r]);
+			const unsigned char ver = s_avg(up[x], down[x]);
+			const unsigned char cross = s_avg(hor, ver);
+			const unsigned char diag = s_avg(s_avg(up[l], up[r]), s_avg(down[l], down[r]));
+
+			unsigned char *o = dst + x * 4;
+			const bool oddCol = (x & 1) != 0;
+			if (!oddRow)
+			{
+				o[0] = oddCol ? c : hor;
+				o[1] = oddCol ? cross : c;
+				o[2] = oddCol ? diag : ver;
+			}
+			else
+			{
+				o[0] = oddCol ? ver : diag;
+				o[1] = oddCol ? c : cross;
+				o[2] = oddCol ? hor : c;
+			}
+			o[3] = 255;
+		}
+	}
+
+	static void s_rgbRow(const unsigned char *src, unsigned char *dst, int x, int width)
+	{
+		for (; x < width; x++)
+		{
+			dst[x * 4 + 0] = src[x * 3 + 0];
+			dst[x * 4 + 1] = src[x * 3 + 1];
+			dst[x * 4 + 2] = src[x * 3 + 2];
+			dst[x * 4 + 3] = 255;
+		}
+	}
+
+	static void s_bayerRows(const unsigned char *src, int srcPitch, int height, int y,
+		const unsigned char **up, const unsigned char **cur, const unsigned char **down)
+	{
+		*cur = src + y * srcPitch;
+		*up = src + (y == 0 ? 1 : y - 1) * srcPitch;
+		*down = src + (y == height - 1 ? height - 2 : y + 1) * srcPitch;
+	}
+
+	static void s_yuyvScalar(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		for (int y = 0; y < height; y++)
+			s_yuyvRow(src + y * srcPitch, dst + y * dstPitch, 0, width);
+	}
+
+	static void s_bayerScalar(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *up, *cur, *down;
+			s_bayerRows(src, srcPitch, height, y, &up, &cur, &down);
+			s_bayerRow(up, cur, down, (y & 1) != 0, dst + y * dstPitch, 0, width, width);
+		}
+	}
+
+	static void s_rgbScalar(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		for (int y = 0; y < height; y++)
+			s_rgbRow(src + y * srcPitch, dst + y * dstPitch, 0, width);
+	}
+
+	static void s_rgbaScalar(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *s = src + y * srcPitch;
+			unsigned char *d = dst + y * dstPitch;
+			for (int i = 0; i < width * 4; i++)
+				d[i] = s[i];
+		}
+	}
+
+#if SIMD_X86
+//------------------------------------------------------------------
+// SSE2
+
+	// Interleaves 16 R, G, B bytes with alpha = 255 and stores 16 RGBA pixels
+	static inline void s_storeRGBA16(unsigned char *dst, __m128i r, __m128i g, __m128i b)
+	{
+		const __m128i a = _mm_set1_epi8(-1);
+		const __m128i rgLo = _mm_unpacklo_epi8(r, g);
+		const __m128i rgHi = _mm_unpackhi_epi8(r, g);
+		const __m128i baLo = _mm_unpacklo_epi8(b, a);
+		const __m128i baHi = _mm_unpackhi_epi8(b, a);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst) + 0, _mm_unpacklo_epi16(rgLo, baLo));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst) + 1, _mm_unpackhi_epi16(rgLo, baLo));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst) + 2, _mm_unpacklo_epi16(rgHi, baHi));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst) + 3, _mm_unpackhi_epi16(rgHi, baHi));
+	}
+
+	static inline __m128i s_select(__m128i mask, __m128i a, __m128i b)
+	{
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	// a*ka + b*kb of 8 pairs of 16 bit values as two sets of 4 32 bit sums.
+	// k holds ka in the low and kb in the high half of each 32 bits.
+	static inline void s_madd8(__m128i a, __m128i b, __m128i k, __m128i &lo, __m128i &hi)
+	{
+		lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), k);
+		hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), k);
+	}
+
+	// Rounds and shifts the sums of s_madd8 down by 8 and packs them back to 16 bits
+	static inline __m128i s_yuvPack8(__m128i lo, __m128i hi)
+	{
+		const __m128i round = _mm_set1_epi32(128);
+		return _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(lo, round), 8), _mm_srai_epi32(_mm_add_epi32(hi, round), 8));
+	}
+
+	static inline __m128i s_yuvPair(int ka, int kb)
+	{
+		return _mm_set1_epi32(static_cast<int>((static_cast<unsigned>(ka) & 0xFFFFu) | (static_cast<unsigned>(kb) << 16)));
+	}
+
+	// 8 YUYV pixels to 16 bit R, G, B
+	static inline void s_yuyv8(__m128i src, __m128i &r, __m128i &g, __m128i &b)
+	{
+		const __m128i lo16 = _mm_set1_epi16(0x00FF);
+		const __m128i lo32 = _mm_set1_epi32(0x0000FFFF);
+
+		const __m128i y = _mm_and_si128(src, lo16);
+		const __m128i uv = _mm_srli_epi16(src, 8);							// U0 V0 U1 V1 ...
+		const __m128i u = _mm_or_si128(_mm_and_si128(uv, lo32), _mm_slli_epi32(uv, 16));	// U0 U0 U1 U1 ...
+		const __m128i v = _mm_or_si128(_mm_srli_epi32(uv, 16), _mm_andnot_si128(lo32, uv));	// V0 V0 V1 V1 ...
+
+		const __m128i c = _mm_sub_epi16(y, _mm_set1_epi16(16));
+		const __m128i d = _mm_sub_epi16(u, _mm_set1_epi16(128));
+		const __m128i e = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+		__m128i lo, hi, vLo, vHi;
+		s_madd8(c, e, s_yuvPair(YUV_Y, YUV_RV), lo, hi);
+		r = s_yuvPack8(lo, hi);
+		s_madd8(c, d, s_yuvPair(YUV_Y, YUV_GU), lo, hi);
+		s_madd8(e, _mm_setzero_si128(), s_yuvPair(YUV_GV, 0), vLo, vHi);
+		g = s_yuvPack8(_mm_add_epi32(lo, vLo), _mm_add_epi32(hi, vHi));
+		s_madd8(c, d, s_yuvPair(YUV_Y, YUV_BU), lo, hi);
+		b = s_yuvPack8(lo, hi);
+	}
+
+	static void s_yuyvSSE2(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *s = src + y * srcPitch;
+			unsigned char *d = dst + y * dstPitch;
+			int x = 0;
+			for (; x + 16 <= width; x += 16)
+			{
+				__m128i r0, g0, b0, r1, g1, b1;
+				s_yuyv8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + x * 2)), r0, g0, b0);
+				s_yuyv8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + x * 2 + 16)), r1, g1, b1);
+				s_storeRGBA16(d + x * 4, _mm_packus_epi16(r0, r1), _mm_packus_epi16(g0, g1), _mm_packus_epi16(b0, b1));
+			}
+			s_yuyvRow(s, d, x, width);
+		}
+	}
+
+	static void s_bayerSSE2(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		// lanes of odd columns, relative to an even starting column
+		const __m128i oddCol = _mm_set1_epi16(static_cast<short>(0xFF00));
+
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *up, *cur, *down;
+			s_bayerRows(src, srcPitch, height, y, &up, &cur, &down);
+			unsigned char *d = dst + y * dstPitch;
+			const bool oddRow = (y & 1) != 0;
+
+			// the first two columns go through the scalar path for the left border
+			s_bayerRow(up, cur, down, oddRow, d, 0, width < 2 ? width : 2, width);
+			int x = 2;
+			for (; x + 17 <= width; x += 16)
+			{
+				#define LOAD(p) _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+				const __m128i c = LOAD(cur + x);
+				const __m128i hor = _mm_avg_epu8(LOAD(cur + x - 1), LOAD(cur + x + 1));
+				const __m128i ver = _mm_avg_epu8(LOAD(up + x), LOAD(down + x));
+				const __m128i cross = _mm_avg_epu8(hor, ver);
+				const __m128i diag = _mm_avg_epu8(_mm_avg_epu8(LOAD(up + x - 1), LOAD(up + x + 1)),
+					_mm_avg_epu8(LOAD(down + x - 1), LOAD(down + x + 1)));
+				#undef LOAD
+
+				if (!oddRow)
+					s_storeRGBA16(d + x * 4, s_select(oddCol, c, hor), s_select(oddCol, cross, c), s_select(oddCol, diag, ver));
+				else
+					s_storeRGBA16(d + x * 4, s_select(oddCol, ver, diag), s_select(oddCol, c, cross), s_select(oddCol, hor, c));
+			}
+			s_bayerRow(up, cur, down, oddRow, d, x, width, width);
+		}
+	}
+
+	static void s_rgbSSE2(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		// Without a byte shuffle, 4 RGB pixels (12 bytes) are moved to their
+		// 32 bit slots by shifting the whole register 0, 1, 2 and 3 bytes
+		// and keeping the 3 bytes of one pixel from each
+		const __m128i keep0 = _mm_setr_epi32(0x00FFFFFF, 0, 0, 0);
+		const __m128i keep1 = _mm_setr_epi32(0, 0x00FFFFFF, 0, 0);
+		const __m128i keep2 = _mm_setr_epi32(0, 0, 0x00FFFFFF, 0);
+		const __m128i keep3 = _mm_setr_epi32(0, 0, 0, 0x00FFFFFF);
+		const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *s = src + y * srcPitch;
+			unsigned char *d = dst + y * dstPitch;
+			int x = 0;
+			// the last 16 byte load of a block reads 4 bytes past it
+			for (; x + 18 <= width; x += 16)
+			{
+				for (int i = 0; i < 4; i++)
+				{
+					const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + (x + i * 4) * 3));
+					const __m128i p01 = _mm_or_si128(_mm_and_si128(p, keep0), _mm_and_si128(_mm_slli_si128(p, 1), keep1));
+					const __m128i p23 = _mm_or_si128(_mm_and_si128(_mm_slli_si128(p, 2), keep2), _mm_and_si128(_mm_slli_si128(p, 3), keep3));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(d + (x + i * 4) * 4), _mm_or_si128(_mm_or_si128(p01, p23), alpha));
+				}
+			}
+			s_rgbRow(s, d, x, width);
+		}
+	}
+
+//------------------------------------------------------------------
+// AVX2
+
+	// Stores 32 RGBA pixels from R, G, B bytes in pixel order
+	SIMD_TARGET_AVX2 static inline void s_storeRGBA32(unsigned char *dst, __m256i r, __m256i g, __m256i b)
+	{
+		const __m256i a = _mm256_set1_epi8(-1);
+		const __m256i rgLo = _mm256_unpacklo_epi8(r, g);		// 0-7   | 16-23
+		const __m256i rgHi = _mm256_unpackhi_epi8(r, g);		// 8-15  | 24-31
+		const __m256i baLo = _mm256_unpacklo_epi8(b, a);
+		const __m256i baHi = _mm256_unpackhi_epi8(b, a);
+		const __m256i p0 = _mm256_unpacklo_epi16(rgLo, baLo);	// 0-3   | 16-19
+		const __m256i p1 = _mm256_unpackhi_epi16(rgLo, baLo);	// 4-7   | 20-23
+		const __m256i p2 = _mm256_unpacklo_epi16(rgHi, baHi);	// 8-11  | 24-27
+		const __m256i p3 = _mm256_unpackhi_epi16(rgHi, baHi);	// 12-15 | 28-31
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst) + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst) + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst) + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst) + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+	}
+
+	SIMD_TARGET_AVX2 static inline __m256i s_select256(__m256i mask, __m256i a, __m256i b)
+	{
+		return _mm256_blendv_epi8(b, a, mask);
+	}
+
+	SIMD_TARGET_AVX2 static inline void s_madd16(__m256i a, __m256i b, __m256i k, __m256i &lo, __m256i &hi)
+	{
+		lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), k);
+		hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), k);
+	}
+
+	// unpack and pack both work per 128 bit lane, so the pixels stay in order
+	SIMD_TARGET_AVX2 static inline __m256i s_yuvPack16(__m256i lo, __m256i hi)
+	{
+		const __m256i round = _mm256_set1_epi32(128);
+		return _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(lo, round), 8), _mm256_srai_epi32(_mm256_add_epi32(hi, round), 8));
+	}
+
+	SIMD_TARGET_AVX2 static inline __m256i s_yuvPair256(int ka, int kb)
+	{
+		return _mm256_set1_epi32(static_cast<int>((static_cast<unsigned>(ka) & 0xFFFFu) | (static_cast<unsigned>(kb) << 16)));
+	}
+
+	SIMD_TARGET_AVX2 static inline void s_yuyv16(__m256i src, __m256i &r, __m256i &g, __m256i &b)
+	{
+		const __m256i lo16 = _mm256_set1_epi16(0x00FF);
+		const __m256i lo32 = _mm256_set1_epi32(0x0000FFFF);
+
+		const __m256i y = _mm256_and_si256(src, lo16);
+		const __m256i uv = _mm256_srli_epi16(src, 8);
+		const __m256i u = _mm256_or_si256(_mm256_and_si256(uv, lo32), _mm256_slli_epi32(uv, 16));
+		const __m256i v = _mm256_or_si256(_mm256_srli_epi32(uv, 16), _mm256_andnot_si256(lo32, uv));
+
+		const __m256i c = _mm256_sub_epi16(y, _mm256_set1_epi16(16));
+		const __m256i d = _mm256_sub_epi16(u, _mm256_set1_epi16(128));
+		const __m256i e = _mm256_sub_epi16(v, _mm256_set1_epi16(128));
+
+		__m256i lo, hi, vLo, vHi;
+		s_madd16(c, e, s_yuvPair256(YUV_Y, YUV_RV), lo, hi);
+		r = s_yuvPack16(lo, hi);
+		s_madd16(c, d, s_yuvPair256(YUV_Y, YUV_GU), lo, hi);
+		s_madd16(e, _mm256_setzero_si256(), s_yuvPair256(YUV_GV, 0), vLo, vHi);
+		g = s_yuvPack16(_mm256_add_epi32(lo, vLo), _mm256_add_epi32(hi, vHi));
+		s_madd16(c, d, s_yuvPair256(YUV_Y, YUV_BU), lo, hi);
+		b = s_yuvPack16(lo, hi);
+	}
+
+	// packus works per 128 bit lane, this puts the 32 bytes back in pixel order
+	SIMD_TARGET_AVX2 static inline __m256i s_pack256(__m256i a, __m256i b)
+	{
+		return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+	}
+
+	SIMD_TARGET_AVX2 static void s_yuyvAVX2(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *s = src + y * srcPitch;
+			unsigned char *d = dst + y * dstPitch;
+			int x = 0;
+			for (; x + 32 <= width; x += 32)
+			{
+				__m256i r0, g0, b0, r1, g1, b1;
+				s_yuyv16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + x * 2)), r0, g0, b0);
+				s_yuyv16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + x * 2 + 32)), r1, g1, b1);
+				s_storeRGBA32(d + x * 4, s_pack256(r0, r1), s_pack256(g0, g1), s_pack256(b0, b1));
+			}
+			s_yuyvRow(s, d, x, width);
+		}
+	}
+
+	SIMD_TARGET_AVX2 static void s_bayerAVX2(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		const __m256i oddCol = _mm256_set1_epi16(static_cast<short>(0xFF00));
+
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *up, *cur, *down;
+			s_bayerRows(src, srcPitch, height, y, &up, &cur, &down);
+			unsigned char *d = dst + y * dstPitch;
+			const bool oddRow = (y & 1) != 0;
+
+			s_bayerRow(up, cur, down, oddRow, d, 0, width < 2 ? width : 2, width);
+			int x = 2;
+			for (; x + 33 <= width; x += 32)
+			{
+				#define LOAD(p) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+				const __m256i c = LOAD(cur + x);
+				const __m256i hor = _mm256_avg_epu8(LOAD(cur + x - 1), LOAD(cur + x + 1));
+				const __m256i ver = _mm256_avg_epu8(LOAD(up + x), LOAD(down + x));
+				const __m256i cross = _mm256_avg_epu8(hor, ver);
+				const __m256i diag = _mm256_avg_epu8(_mm256_avg_epu8(LOAD(up + x - 1), LOAD(up + x + 1)),
+					_mm256_avg_epu8(LOAD(down + x - 1), LOAD(down + x + 1)));
+				#undef LOAD
+
+				if (!oddRow)
+					s_storeRGBA32(d + x * 4, s_select256(oddCol, c, hor), s_select256(oddCol, cross, c), s_select256(oddCol, diag, ver));
+				else
+					s_storeRGBA32(d + x * 4, s_select256(oddCol, ver, diag), s_select256(oddCol, c, cross), s_select256(oddCol, hor, c));
+			}
+			s_bayerRow(up, cur, down, oddRow, d, x, width, width);
+		}
+	}
+
+	SIMD_TARGET_AVX2 static void s_rgbAVX2(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		// 4 RGB pixels (12 bytes) -> 4 RGBA pixels
+		const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *s = src + y * srcPitch;
+			unsigned char *d = dst + y * dstPitch;
+			int x = 0;
+			// the last 16 byte load of a block reads 4 bytes past it
+			for (; x + 18 <= width; x += 16)
+			{
+				for (int i = 0; i < 4; i++)
+				{
+					__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + (x + i * 4) * 3));
+					p = _mm_or_si128(_mm_shuffle_epi8(p, shuffle), alpha);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(d + (x + i * 4) * 4), p);
+				}
+			}
+			s_rgbRow(s, d, x, width);
+		}
+	}
+#endif
+
+#if SIMD_ARM_NEON
+//------------------------------------------------------------------
+// NEON
+
+	// YUV_Y*c + coefD*d + coefE*e in 32 bits, rounded, shifted down by 8 and clamped to bytes
+	static inline uint8x8_t s_yuvChannel(int16x8_t c, int16x8_t d, int coefD, int16x8_t e, int coefE)
+	{
+		int32x4_t lo = vmull_n_s16(vget_low_s16(c), YUV_Y);
+		int32x4_t hi = vmull_n_s16(vget_high_s16(c), YUV_Y);
+		lo = vmlal_n_s16(lo, vget_low_s16(d), static_cast<int16_t>(coefD));
+		hi = vmlal_n_s16(hi, vget_high_s16(d), static_cast<int16_t>(coefD));
+		lo = vmlal_n_s16(lo, vget_low_s16(e), static_cast<int16_t>(coefE));
+		hi = vmlal_n_s16(hi, vget_high_s16(e), static_cast<int16_t>(coefE));
+		return vqmovun_s16(vcombine_s16(vqrshrn_n_s32(lo, 8), vqrshrn_n_s32(hi, 8)));
+	}
+
+	static void s_yuyvNEON(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *s = src + y * srcPitch;
+			unsigned char *d = dst + y * dstPitch;
+			int x = 0;
+			for (; x + 16 <= width; x += 16)
+			{
+				// val[0] = even Y, val[1] = U, val[2] = odd Y, val[3] = V
+				const uint8x8x4_t p = vld4_u8(s + x * 2);
+				const int16x8_t du = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(p.val[1])), vdupq_n_s16(128));
+				const int16x8_t ev = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(p.val[3])), vdupq_n_s16(128));
+
+				uint8x8_t r[2], g[2], b[2];
+				for (int i = 0; i < 2; i++)
+				{
+					const int16x8_t c = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(p.val[i * 2])), vdupq_n_s16(16));
+					r[i] = s_yuvChannel(c, du, 0, ev, YUV_RV);
+					g[i] = s_yuvChannel(c, du, YUV_GU, ev, YUV_GV);
+					b[i] = s_yuvChannel(c, du, YUV_BU, ev, 0);
+				}
+
+				const uint8x8x2_t rr = vzip_u8(r[0], r[1]);
+				const uint8x8x2_t gg = vzip_u8(g[0], g[1]);
+				const uint8x8x2_t bb = vzip_u8(b[0], b[1]);
+				uint8x16x4_t o;
+				o.val[0] = vcombine_u8(rr.val[0], rr.val[1]);
+				o.val[1] = vcombine_u8(gg.val[0], gg.val[1]);
+				o.val[2] = vcombine_u8(bb.val[0], bb.val[1]);
+				o.val[3] = vdupq_n_u8(255);
+				vst4q_u8(d + x * 4, o);
+			}
+			s_yuyvRow(s, d, x, width);
+		}
+	}
+
+	static void s_bayerNEON(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		const uint8x16_t oddCol = vreinterpretq_u8_u16(vdupq_n_u16(0xFF00));
+
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *up, *cur, *down;
+			s_bayerRows(src, srcPitch, height, y, &up, &cur, &down);
+			unsigned char *d = dst + y * dstPitch;
+			const bool oddRow = (y & 1) != 0;
+
+			s_bayerRow(up, cur, down, oddRow, d, 0, width < 2 ? width : 2, width);
+			int x = 2;
+			for (; x + 17 <= width; x += 16)
+			{
+				const uint8x16_t c = vld1q_u8(cur + x);
+				const uint8x16_t hor = vrhaddq_u8(vld1q_u8(cur + x - 1), vld1q_u8(cur + x + 1));
+				const uint8x16_t ver = vrhaddq_u8(vld1q_u8(up + x), vld1q_u8(down + x));
+				const uint8x16_t cross = vrhaddq_u8(hor, ver);
+				const uint8x16_t diag = vrhaddq_u8(vrhaddq_u8(vld1q_u8(up + x - 1), vld1q_u8(up + x + 1)),
+					vrhaddq_u8(vld1q_u8(down + x - 1), vld1q_u8(down + x + 1)));
+
+				uint8x16x4_t o;
+				if (!oddRow)
+				{
+					o.val[0] = vbslq_u8(oddCol, c, hor);
+					o.val[1] = vbslq_u8(oddCol, cross, c);
+					o.val[2] = vbslq_u8(oddCol, diag, ver);
+				}
+				else
+				{
+					o.val[0] = vbslq_u8(oddCol, ver, diag);
+					o.val[1] = vbslq_u8(oddCol, c, cross);
+					o.val[2] = vbslq_u8(oddCol, hor, c);
+				}
+				o.val[3] = vdupq_n_u8(255);
+				vst4q_u8(d + x * 4, o);
+			}
+			s_bayerRow(up, cur, down, oddRow, d, x, width, width);
+		}
+	}
+
+	static void s_rgbNEON(const unsigned char *src, int srcPitch, int width, int height, unsigned char *dst, int dstPitch)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *s = src + y * srcPitch;
+			unsigned char *d = dst + y * dstPitch;
+			int x = 0;
+			for (; x + 16 <= width; x += 16)
+			{
+				const uint8x16x3_t p = vld3q_u8(s + x * 3);
+				uint8x16x4_t o;
+				o.val[0] = p.val[0];
+				o.val[1] = p.val[1];
+				o.val[2] = p.val[2];
+				o.val[3] = vdupq_n_u8(255);
+				vst4q_u8(d + x * 4, o);
+			}
+			s_rgbRow(s, d, x, width);
+		}
+	}
+#endif
+
+//------------------------------------------------------------------
+
+	static ConvertFn s_pick(ePixelFormat format, eSimdLevel level)
+	{
+		switch (format)
+		{
+		case PIXEL_YUYV:
+#if SIMD_X86
+			if (level == SIMD_AVX2)
+				return s_yuyvAVX2;
+			if (level == SIMD_SSE2)
+				return s_yuyvSSE2;
+#elif SIMD_ARM_NEON
+			if (level == SIMD_NEON)
+				return s_yuyvNEON;
+#endif
+			return s_yuyvScalar;
+		case PIXEL_BAYER_GRBG:
+#if SIMD_X86
+			if (level == SIMD_AVX2)
+				return s_bayerAVX2;
+			if (level == SIMD_SSE2)
+				return s_bayerSSE2;
+#elif SIMD_ARM_NEON
+			if (level == SIMD_NEON)
+				return s_bayerNEON;
+#endif
+			return s_bayerScalar;
+		case PIXEL_RGB24:
+#if SIMD_X86
+			if (level == SIMD_AVX2)
+				return s_rgbAVX2;
+			if (level == SIMD_SSE2)
+				return s_rgbSSE2;
+#elif SIMD_ARM_NEON
+			if (level == SIMD_NEON)
+				return s_rgbNEON;
+#endif
+			return s_rgbScalar;
+		case PIXEL_RGBA32:
+			return s_rgbaScalar;
+		default:
+			return nullptr;
+		}
+	}
+
+	static bool s_valid(ePixelFormat format, int width, int height)
+	{
+		if (width <= 0 || height <= 0)
+			return false;
+		if (format == PIXEL_YUYV && (width & 1))
+			return false;
+		if (format == PIXEL_BAYER_GRBG && (width < 2 || height < 2))
+			return false;
+		return true;
+	}
+
+	bool ColorConvert::ToRGBA(const unsigned char *src, int srcPitch, ePixelFormat format,
+		int width, int height, unsigned char *dst, int dstPitch)
+	{
+		ConvertFn fn = s_pick(format, Simd::Level());
+		if (!fn || !s_valid(format, width, height))
+			return false;
+		fn(src, srcPitch, width, height, dst, dstPitch);
+		return true;
+	}
+
+	bool ColorConvert::ToRGBAReference(const unsigned char *src, int srcPitch, ePixelFormat format,
+		int width, int height, unsigned char *dst, int dstPitch)
+	{
+		ConvertFn fn = s_pick(format, SIMD_SCALAR);
+		if (!fn || !s_valid(format, width, height))
+			return false;
+		fn(src, srcPitch, width, height, dst, dstPitch);
+		return true;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "CameraSource.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Converts raw camera images to the R8G8B8A8 layout the textured-quad
+	// shader samples (DXGI_FORMAT_R8G8B8A8_UNORM, alpha = 255).
+	//
+	// YUYV uses BT.601 studio range with 8 bit fixed point coefficients,
+	// so Y 16 and 235 give black and white exactly. Bayer images (GRBG) are demosaiced
+	// bilinearly with rounding averages and mirrored borders. The SIMD paths
+	// produce exactly the same bytes as the reference.
+	class ColorConvert
+	{
+	public:
+		// Converts one eye image. dst may be a mapped texture: only width*4
+		// bytes of each dstPitch-long row are written.
+		// YUYV needs an even width, Bayer at least 2x2 pixels.
+		static bool ToRGBA(const unsigned char *src, int srcPitch, ePixelFormat format,
+			int width, int height, unsigned char *dst, int dstPitch);
+
+		// Plain C++ version of the same conversion
+		static bool ToRGBAReference(const unsigned char *src, int srcPitch, ePixelFormat format,
+			int width, int height, unsigned char *dst, int dstPitch);
+	};
+
+//------------------------------------------------------------------
+}
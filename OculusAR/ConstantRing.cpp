@@ -0,0 +1,31 @@
+#include "ConstantRing.h"
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	ConstantRing::ConstantRing(unsigned capacity, unsigned alignment) :
+		m_data(capacity), m_alignment(alignment), m_used(0)
+	{
+	}
+
+	int ConstantRing::Allocate(unsigned size)
+	{
+		const unsigned offset = (m_used + m_alignment - 1) & ~(m_alignment - 1);
+		if (size == 0 || offset > m_data.size() || size > m_data.size() - offset)
+			return -1;
+		m_used = offset + size;
+		return static_cast<int>(offset);
+	}
+
+	int ConstantRing::Write(const void *data, unsigned size)
+	{
+		const int offset = Allocate(size);
+		if (offset >= 0)
+			memcpy(&m_data[offset], data, size);
+		return offset;
+	}
+
+//------------------------------------------------------------------
+}
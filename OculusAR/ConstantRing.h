@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// CPU side of the constant data of one frame. Draws append their
+	// constants, the whole block goes to the GPU with one map and every
+	// draw finds its data by offset. Reset starts the next frame at the
+	// beginning of the block again.
+	class ConstantRing
+	{
+	public:
+		// alignment must be a power of two
+		ConstantRing(unsigned capacity, unsigned alignment);
+
+		void Reset() { m_used = 0; }
+
+		// Offset of size fresh bytes, aligned to Alignment(), or -1 when
+		// they do not fit any more this frame
+		int Allocate(unsigned size);
+		// Allocate and copy
+		int Write(const void *data, unsigned size);
+
+		void *At(int offset) { return &m_data[offset]; }
+		const void *Data() const { return &m_data[0]; }
+		unsigned Used() const { return m_used; }
+		unsigned Capacity() const { return static_cast<unsigned>(m_data.size()); }
+		unsigned Alignment() const { return m_alignment; }
+
+	private:
+		std::vector<unsigned char> m_data;
+		unsigned m_alignment;
+		unsigned m_used;
+	};
+
+//------------------------------------------------------------------
+}
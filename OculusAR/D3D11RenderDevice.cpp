@@ -0,0 +1,359 @@
+#include "D3D11RenderDevice.h"
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	D3D11RenderDevice::D3D11RenderDevice(ID3D11DeviceContext *context, ID3D11RenderTargetView *eyeTarget, ID3D11DepthStencilView *depthStencil,
+		ID3D11Texture2D *eyeTexture, ID3D11Texture2D *resolveTexture, ID3D11Buffer *constantBuffer, ID3D11SamplerState *sampler) :
+		m_context(context), m_eyeTarget(eyeTarget), m_depthStencil(depthStencil), m_eyeTexture(eyeTexture),
+		m_resolveTexture(resolveTexture), m_constantBuffer(constantBuffer), m_sampler(sampler),
+		m_instanceBuffer(nullptr), m_overlayArray(nullptr), m_overlayTexture(nullptr), m_overlaySize(0), m_overlayLevels(0), m_overlayFormat(DXGI_FORMAT_UNKNOWN), m_ring(MaxDraws * DrawConstants, DrawConstants),
+		m_instanceRing(MaxInstances * sizeof(OverlayInstance), 4), m_texture(TEXTURE_OVERLAY_OUT), m_slot(0)
+	{
+		memset(&m_viewport, 0, sizeof(m_viewport));
+		m_draws.reserve(MaxDraws);
+		for (int i = 0; i < TEXTURE_COUNT; i++)
+		{
+			m_textures[i] = nullptr;
+			m_pending[i][0] = m_pending[i][1] = nullptr;
+			m_streamed[i] = nullptr;
+		}
+		m_cameraTextures[0] = nullptr;
+		m_cameraTextures[1] = nullptr;
+		memset(m_pipelines, 0, sizeof(m_pipelines));
+	}
+
+	D3D11RenderDevice::~D3D11RenderDevice()
+	{
+		for (int i = 0; i < TEXTURE_COUNT; i++)
+		{
+			for (int j = 0; j < 2; j++)
+				if (m_pending[i][j])
+					m_pending[i][j]->Release();
+			if (m_streamed[i])
+				m_streamed[i]->Release();
+		}
+		if (m_overlayTexture)
+			m_overlayTexture->Release();
+	}
+
+	DXGI_FORMAT D3D11RenderDevice::DxgiFormat(eTextureFormat format)
+	{
+		switch (format)
+		{
+		case FORMAT_BC1: return DXGI_FORMAT_BC1_UNORM;
+		case FORMAT_BC3: return DXGI_FORMAT_BC3_UNORM;
+		case FORMAT_BC7: return DXGI_FORMAT_BC7_UNORM;
+		default: return DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+	}
+
+	void D3D11RenderDevice::SetTexture(eSceneTexture texture, ID3D11ShaderResourceView *view)
+	{
+		if (m_streamed[texture])
+		{
+			m_streamed[texture]->Release();
+			m_streamed[texture] = nullptr;
+		}
+		m_textures[texture] = view;
+	}
+
+	void D3D11RenderDevice::SetCameraTextures(ID3D11Texture2D *left, ID3D11Texture2D *right)
+	{
+		m_cameraTextures[0] = left;
+		m_cameraTextures[1] = right;
+	}
+
+	void D3D11RenderDevice::SetInstancing(ID3D11Buffer *instanceBuffer, ID3D11ShaderResourceView *overlayArray, const D3D11Pipeline &quad, const D3D11Pipeline &instanced)
+	{
+		m_instanceBuffer = instanceBuffer;
+		m_overlayArray = overlayArray;
+		m_pipelines[0] = quad;
+		m_pipelines[1] = instanced;
+
+		// the array texture itself, for streamed slices
+		if (m_overlayTexture)
+			m_overlayTexture->Release();
+		m_overlayTexture = nullptr;
+		m_overlaySize = m_overlayLevels = 0;
+		m_overlayFormat = DXGI_FORMAT_UNKNOWN;
+		ID3D11Resource *resource = nullptr;
+		if (overlayArray)
+			overlayArray->GetResource(&resource);
+		if (resource && SUCCEEDED(resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&m_overlayTexture))))
+		{
+			D3D11_TEXTURE2D_DESC desc;
+			m_overlayTexture->GetDesc(&desc);
+			m_overlaySize = static_cast<int>(desc.Width);
+			m_overlayLevels = static_cast<int>(desc.MipLevels);
+			m_overlayFormat = desc.Format;
+		}
+		if (resource)
+			resource->Release();
+	}
+
+	void D3D11RenderDevice::BeginFrame()
+	{
+		float f[] = { 0.22f, 0.23f, 0.29f, 1 };
+		m_context->ClearRenderTargetView(m_eyeTarget, f);
+		m_context->ClearDepthStencilView(m_depthStencil, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1, 0);
+
+		// We use one single render target for both eyes.
+		m_context->OMSetRenderTargets(1, &m_eyeTarget, m_depthStencil);
+		m_context->PSSetSamplers(0, 1, &m_sampler);
+
+		m_ring.Reset();
+		m_instanceRing.Reset();
+		m_draws.clear();
+	}
+
+	void D3D11RenderDevice::SetViewport(const ovrRecti &viewport)
+	{
+		m_viewport = viewport;
+	}
+
+	int D3D11RenderDevice::AllocateConstants(unsigned count, void **data)
+	{
+		if (count == 0 || count > MaxDraws)
+			return -1;
+		// A full ring submits what is recorded so far and starts over
+		int offset = m_ring.Allocate(count * DrawConstants);
+		if (offset < 0)
+		{
+			m_flush(&m_ring);
+			offset = m_ring.Allocate(count * DrawConstants);
+		}
+		*data = m_ring.At(offset);
+		m_counters.constantWrites += count;
+		return offset / static_cast<int>(DrawConstants);
+	}
+
+	void D3D11RenderDevice::SetTexture(eSceneTexture texture)
+	{
+		m_texture = texture;
+	}
+
+	void D3D11RenderDevice::DrawQuad()
+	{
+		Draw draw = { m_viewport, m_texture, m_slot, 0 };
+		m_draws.push_back(draw);
+	}
+
+	int D3D11RenderDevice::AllocateInstances(unsigned count, OverlayInstance **data)
+	{
+		if (count == 0 || count > MaxInstances || !m_instanceBuffer)
+			return -1;
+		// every allocation is a multiple of the instance size, so are the offsets
+		int offset = m_instanceRing.Allocate(count * sizeof(OverlayInstance));
+		if (offset < 0)
+		{
+			m_flush(&m_instanceRing);
+			offset = m_instanceRing.Allocate(count * sizeof(OverlayInstance));
+		}
+		*data = static_cast<OverlayInstance*>(m_instanceRing.At(offset));
+		return offset / static_cast<int>(sizeof(OverlayInstance));
+	}
+
+	void D3D11RenderDevice::DrawInstances(int first, unsigned count)
+	{
+		if (count == 0)
+			return;
+		Draw draw = { m_viewport, TEXTURE_COUNT, static_cast<unsigned>(first), count };
+		m_draws.push_back(draw);
+	}
+
+	void D3D11RenderDevice::m_bindPipeline(int pipeline)
+	{
+		const D3D11Pipeline &p = m_pipelines[pipeline];
+		m_context->IASetInputLayout(p.layout);
+		m_context->VSSetShader(p.vertexShader, nullptr, 0);
+		m_context->PSSetShader(p.pixelShader, nullptr, 0);
+	}
+
+	void D3D11RenderDevice::m_flush(const ConstantRing *full)
+	{
+		if (m_draws.empty())
+		{
+			if (!full || full == &m_ring)
+				m_ring.Reset();
+			if (!full || full == &m_instanceRing)
+				m_instanceRing.Reset();
+			return;
+		}
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (m_ring.Used() != 0 && SUCCEEDED(m_context->Map(m_constantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		{
+			memcpy(mapped.pData, m_ring.Data(), m_ring.Used());
+			m_context->Unmap(m_constantBuffer, 0);
+			m_counters.constantMaps++;
+		}
+		if (m_instanceRing.Used() != 0 && SUCCEEDED(m_context->Map(m_instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		{
+			memcpy(mapped.pData, m_instanceRing.Data(), m_instanceRing.Used());
+			m_context->Unmap(m_instanceBuffer, 0);
+			m_counters.instanceMaps++;
+
+			const UINT stride = sizeof(OverlayInstance);
+			const UINT offset = 0;
+			m_context->IASetVertexBuffers(2, 1, &m_instanceBuffer, &stride, &offset);
+		}
+
+		// Only state changes between draws reach the context
+		const Draw *previous = nullptr;
+		int bound = 0;
+		for (size_t i = 0; i < m_draws.size(); i++)
+		{
+			const Draw &draw = m_draws[i];
+			if (!previous || memcmp(&previous->viewport, &draw.viewport, sizeof(ovrRecti)) != 0)
+			{
+				D3D11_VIEWPORT vp;
+				vp.Width = static_cast<float>(draw.viewport.Size.w);
+				vp.Height = static_cast<float>(draw.viewport.Size.h);
+				vp.TopLeftX = static_cast<float>(draw.viewport.Pos.x);
+				vp.TopLeftY = static_cast<float>(draw.viewport.Pos.y);
+				vp.MinDepth = 0.0f;
+				vp.MaxDepth = 1.0f;
+				m_context->RSSetViewports(1, &vp);
+			}
+			const int pipeline = draw.instances != 0 ? 1 : 0;
+			if (pipeline != bound)
+			{
+				m_bindPipeline(pipeline);
+				bound = pipeline;
+			}
+			if (!previous || previous->texture != draw.texture)
+			{
+				m_context->PSSetShaderResources(0, 1, draw.texture == TEXTURE_COUNT ? &m_overlayArray : &m_textures[draw.texture]);
+				m_counters.textureBinds++;
+			}
+			m_context->DrawIndexedInstanced(6, pipeline != 0 ? draw.instances : 1, 0, 0, draw.slot);
+			m_counters.draws++;
+			m_counters.instances += draw.instances;
+			previous = &draw;
+		}
+
+		// The context is left with the quad pipeline, as SetupScene bound it
+		if (bound != 0)
+			m_bindPipeline(0);
+
+		if (!full || full == &m_ring)
+			m_ring.Reset();
+		if (!full || full == &m_instanceRing)
+			m_instanceRing.Reset();
+		m_draws.clear();
+	}
+
+	unsigned char *D3D11RenderDevice::MapCameraTexture(int eye, int *pitch)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (!m_cameraTextures[eye] || FAILED(m_context->Map(m_cameraTextures[eye], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+			return nullptr;
+		m_counters.cameraUploads++;
+		*pitch = static_cast<int>(mapped.RowPitch);
+		return static_cast<unsigned char*>(mapped.pData);
+	}
+
+	void D3D11RenderDevice::UnmapCameraTexture(int eye)
+	{
+		m_context->Unmap(m_cameraTextures[eye], 0);
+	}
+
+	bool D3D11RenderDevice::BeginTexture(eSceneTexture texture, bool overlay, eTextureFormat format, int width, int height, int levels)
+	{
+		// slices are copied in, so they have to match the array exactly
+		if (overlay && (texture >= static_cast<int>(OverlaySlices) || !m_overlayTexture ||
+			width != m_overlaySize || height != m_overlaySize || levels != m_overlayLevels || DxgiFormat(format) != m_overlayFormat))
+			return false;
+
+		D3D11_TEXTURE2D_DESC desc;
+		memset(&desc, 0, sizeof(desc));
+		desc.Width = width;
+		desc.Height = height;
+		desc.MipLevels = levels;
+		desc.ArraySize = 1;
+		desc.Format = DxgiFormat(format);
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		// an overlay image is only copied into the array
+		desc.BindFlags = overlay ? 0 : D3D11_BIND_SHADER_RESOURCE;
+
+		ID3D11Device *device = nullptr;
+		m_context->GetDevice(&device);
+		ID3D11Texture2D *created = nullptr;
+		const HRESULT hr = device->CreateTexture2D(&desc, nullptr, &created);
+		device->Release();
+		if (FAILED(hr))
+			return false;
+
+		ID3D11Texture2D *&pending = m_pending[texture][overlay ? 1 : 0];
+		if (pending)
+			pending->Release();
+		pending = created;
+		return true;
+	}
+
+	void D3D11RenderDevice::UploadTextureRows(eSceneTexture texture, bool overlay, int level, int y, int height, const unsigned char *data, int pitch, size_t bytes)
+	{
+		ID3D11Texture2D *pending = m_pending[texture][overlay ? 1 : 0];
+		if (!pending)
+			return;
+		D3D11_TEXTURE2D_DESC desc;
+		pending->GetDesc(&desc);
+		const UINT levelWidth = desc.Width >> level ? desc.Width >> level : 1;
+		const UINT levelHeight = desc.Height >> level ? desc.Height >> level : 1;
+		const UINT bottom = static_cast<UINT>(y + height);
+		if (y == 0 && bottom >= levelHeight)
+			m_context->UpdateSubresource(pending, level, nullptr, data, pitch, 0);
+		else
+		{
+			// a block compressed box starts on a block row and ends on one or at the bottom
+			const D3D11_BOX box = { 0, static_cast<UINT>(y), 0, levelWidth, bottom < levelHeight ? bottom : levelHeight, 1 };
+			m_context->UpdateSubresource(pending, level, &box, data, pitch, 0);
+		}
+		m_counters.textureUploads++;
+		m_counters.textureBytes += bytes;
+	}
+
+	void D3D11RenderDevice::EndTexture(eSceneTexture texture, bool overlay)
+	{
+		ID3D11Texture2D *&pending = m_pending[texture][overlay ? 1 : 0];
+		if (!pending)
+			return;
+
+		if (overlay)
+		{
+			// GPU copies, the slice changes at once for every draw after this
+			for (int level = 0; level < m_overlayLevels; level++)
+				m_context->CopySubresourceRegion(m_overlayTexture, D3D11CalcSubresource(level, texture, m_overlayLevels), 0, 0, 0, pending, level, nullptr);
+		}
+		else
+		{
+			ID3D11Device *device = nullptr;
+			m_context->GetDevice(&device);
+			ID3D11ShaderResourceView *view = nullptr;
+			const HRESULT hr = device->CreateShaderResourceView(pending, nullptr, &view);
+			device->Release();
+			if (SUCCEEDED(hr))
+			{
+				if (m_streamed[texture])
+					m_streamed[texture]->Release();
+				m_streamed[texture] = view;
+				m_textures[texture] = view;
+			}
+		}
+		pending->Release();
+		pending = nullptr;
+	}
+
+	void D3D11RenderDevice::EndFrame()
+	{
+		m_flush(nullptr);
+		if (m_resolveTexture)
+			m_context->ResolveSubresource(m_resolveTexture, 0, m_eyeTexture, 0, DXGI_FORMAT_R8G8B8A8_UNORM);
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <d3d11.h>
+#include "RenderDevice.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Input layout and shaders of one kind of draw
+	struct D3D11Pipeline
+	{
+		ID3D11InputLayout *layout;
+		ID3D11VertexShader *vertexShader;
+		ID3D11PixelShader *pixelShader;
+	};
+
+	// RenderDevice on the scene set up in Source.cpp: one (possibly
+	// multisampled) eye texture for both eyes, a dynamic constant buffer
+	// with MaxDraws mvp matrices and the indexed quad already bound to the
+	// context, with the draw index as per-instance data in slot 1.
+	// Does not own any of the resources it is given; streamed textures are
+	// created here and released with the device.
+	//
+	// Draws are recorded during the frame; EndFrame uploads the constants
+	// of all of them with one map and submits them, each instanced once
+	// starting at its own draw index. Overlay instances go up the same way
+	// with one map of the instance buffer.
+	class D3D11RenderDevice : public RenderDevice
+	{
+	public:
+		// resolveTexture is only used with multisampling and may be null
+		D3D11RenderDevice(ID3D11DeviceContext *context, ID3D11RenderTargetView *eyeTarget, ID3D11DepthStencilView *depthStencil,
+			ID3D11Texture2D *eyeTexture, ID3D11Texture2D *resolveTexture, ID3D11Buffer *constantBuffer, ID3D11SamplerState *sampler);
+		~D3D11RenderDevice();
+
+		// The texture format streamed textures of format are created with
+		static DXGI_FORMAT DxgiFormat(eTextureFormat format);
+
+		void SetTexture(eSceneTexture texture, ID3D11ShaderResourceView *view);
+		// Dynamic RGBA textures the camera image is written to
+		void SetCameraTextures(ID3D11Texture2D *left, ID3D11Texture2D *right);
+		// Instanced overlays: a dynamic vertex buffer of MaxInstances
+		// OverlayInstance, the overlay texture array, and the pipelines to
+		// switch between. Without them DrawInstances draws nothing. Streamed
+		// overlay images are copied into the array, which needs default usage.
+		void SetInstancing(ID3D11Buffer *instanceBuffer, ID3D11ShaderResourceView *overlayArray, const D3D11Pipeline &quad, const D3D11Pipeline &instanced);
+
+		void BeginFrame();
+		void SetViewport(const ovrRecti &viewport);
+		int AllocateConstants(unsigned count, void **data);
+		void UseConstants(int slot) { m_slot = static_cast<unsigned>(slot); }
+		void SetTexture(eSceneTexture texture);
+		void DrawQuad();
+		int AllocateInstances(unsigned count, OverlayInstance **data);
+		void DrawInstances(int first, unsigned count);
+		unsigned char *MapCameraTexture(int eye, int *pitch);
+		void UnmapCameraTexture(int eye);
+		bool BeginTexture(eSceneTexture texture, bool overlay, eTextureFormat format, int width, int height, int levels);
+		void UploadTextureRows(eSceneTexture texture, bool overlay, int level, int y, int height, const unsigned char *data, int pitch, size_t bytes);
+		void EndTexture(eSceneTexture texture, bool overlay);
+		int OverlaySize() const { return m_overlaySize; }
+		void EndFrame();
+
+	private:
+		D3D11RenderDevice(const D3D11RenderDevice&);
+		D3D11RenderDevice &operator=(const D3D11RenderDevice&);
+
+		struct Draw
+		{
+			ovrRecti viewport;
+			// TEXTURE_COUNT for the overlay array of an instanced draw
+			eSceneTexture texture;
+			// Constant slot, or first instance of an instanced draw
+			unsigned slot;
+			// 0 for a single quad
+			unsigned instances;
+		};
+
+		// Submits the recorded draws. Only full, the ring that ran out,
+		// starts over: the other keeps what was allocated from it and not
+		// drawn yet, and is uploaded whole again with the next flush.
+		// nullptr at the end of the frame resets both.
+		void m_flush(const ConstantRing *full);
+		// 0 for quads, 1 for instanced overlays
+		void m_bindPipeline(int pipeline);
+
+		ID3D11DeviceContext *m_context;
+		ID3D11RenderTargetView *m_eyeTarget;
+		ID3D11DepthStencilView *m_depthStencil;
+		ID3D11Texture2D *m_eyeTexture;
+		ID3D11Texture2D *m_resolveTexture;
+		ID3D11Buffer *m_constantBuffer;
+		ID3D11SamplerState *m_sampler;
+		ID3D11ShaderResourceView *m_textures[TEXTURE_COUNT];
+		ID3D11Texture2D *m_cameraTextures[2];
+		ID3D11Buffer *m_instanceBuffer;
+		ID3D11ShaderResourceView *m_overlayArray;
+		ID3D11Texture2D *m_overlayTexture;
+		int m_overlaySize;
+		int m_overlayLevels;
+		DXGI_FORMAT m_overlayFormat;
+		D3D11Pipeline m_pipelines[2];
+		// Streamed textures being filled, as texture and as overlay slice,
+		// and the views of the finished ones
+		ID3D11Texture2D *m_pending[TEXTURE_COUNT][2];
+		ID3D11ShaderResourceView *m_streamed[TEXTURE_COUNT];
+
+		ConstantRing m_ring;
+		ConstantRing m_instanceRing;
+		std::vector<Draw> m_draws;
+		ovrRecti m_viewport;
+		eSceneTexture m_texture;
+		unsigned m_slot;
+	};
+
+//------------------------------------------------------------------
+}
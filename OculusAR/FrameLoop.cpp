@@ -0,0 +1,330 @@
+#include "FrameLoop.h"
+#include "HmdDevice.h"
+#include "RenderDevice.h"
+#include "CameraThread.h"
+#include "ColorConvert.h"
+#include "Undistort.h"
+#include "Clock.h"
+#include "PoseHistory.h"
+#include "TextureStreamer.h"
+#include "Log.h"
+#include <OVR.h>
+#include <algorithm>
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static const char *s_stageNames[STAGE_COUNT] = { "pose", "camera", "textures", "matrices", "cull", "constants", "draws", "present", "frame" };
+
+	void FrameStats::Clear()
+	{
+		for (int s = 0; s < STAGE_COUNT; s++)
+			m_samples[s].clear();
+	}
+
+	void FrameStats::Add(const unsigned long long ns[STAGE_COUNT])
+	{
+		for (int s = 0; s < STAGE_COUNT; s++)
+			m_samples[s].push_back(ns[s]);
+	}
+
+	double FrameStats::Percentile(eFrameStage stage, double p) const
+	{
+		if (m_samples[stage].empty())
+			return 0.0;
+		std::vector<unsigned long long> sorted(m_samples[stage]);
+		size_t n = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+		std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+		return sorted[n] / 1000.0;
+	}
+
+	double FrameStats::Mean(eFrameStage stage) const
+	{
+		if (m_samples[stage].empty())
+			return 0.0;
+		double sum = 0.0;
+		for (size_t i = 0; i < m_samples[stage].size(); i++)
+			sum += m_samples[stage][i];
+		return sum / m_samples[stage].size() / 1000.0;
+	}
+
+	const char *FrameStats::StageName(eFrameStage stage)
+	{
+		return stage >= 0 && stage < STAGE_COUNT ? s_stageNames[stage] : "?";
+	}
+
+//------------------------------------------------------------------
+
+	// Commonly used vectors.
+	static const OVR::Vector3f s_upVector(0.0f, 1.0f, 0.0f);
+	static const OVR::Vector3f s_forwardVector(0.0f, 0.0f, -1.0f);
+
+	// Position and angle of the player's body
+	static const OVR::Vector3f s_bodyPosition(0.5f, 0.5f, 0.0f);
+	static const float s_bodyYaw = 0.9f;
+
+	// Stretches the scene quad over the whole viewport at the far end of the depth range, so the
+	// camera image ends up behind everything else.
+	static const OVR::Matrix4f s_cameraBackgroundTransform(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 0.9999f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+
+	// The scene quad in model space, shader.hlsl draws it at z = -1
+	static const Aabb s_quadBounds = { { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, -1.0f } };
+
+	FrameLoop::FrameLoop(HmdDevice *hmd, RenderDevice *render) :
+		m_hmd(hmd), m_render(render), m_camera(nullptr), m_undistort(nullptr), m_pool(nullptr), m_poseHistory(nullptr),
+		m_streamer(nullptr), m_textureBudget(0),
+		m_cameraPoseValid(false), m_cameraUploaded(false), m_showCamera(false), m_reprojectCamera(false), m_scale(1.0f), m_frameIndex(0)
+	{
+		m_translate.x = m_translate.y = m_translate.z = 0.0f;
+		memset(m_eyePose, 0, sizeof(m_eyePose));
+		memset(&m_tracking, 0, sizeof(m_tracking));
+		memset(&m_cameraPose, 0, sizeof(m_cameraPose));
+		memset(m_stage, 0, sizeof(m_stage));
+
+		// Models are set every frame in RunFrame
+		static const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+		m_outer = m_transforms.Add(identity, true);
+		m_overlays.Add(TEXTURE_OVERLAY_OUT);
+		m_headLocked.push_back(m_outer);
+		m_inner = m_transforms.Add(identity, false);
+		m_overlays.Add(TEXTURE_OVERLAY_IN);
+		m_innerObject = m_scene.Add(Aabb::Transform(s_quadBounds, identity));
+		m_sceneQuad.push_back(m_inner);
+		m_mvps.resize(2 * m_transforms.Count() * 16);
+	}
+
+	void FrameLoop::SetCamera(CameraThread *camera, UndistortMap *undistort, ThreadPool *pool)
+	{
+		m_camera = camera;
+		m_undistort = undistort;
+		m_pool = pool;
+		if (m_undistort)
+		{
+			m_cameraRGBA[0].resize(m_undistort->Width() * m_undistort->Height() * 4);
+			m_cameraRGBA[1].resize(m_undistort->Width() * m_undistort->Height() * 4);
+		}
+	}
+
+	void FrameLoop::SetOverlay(float scale, const ovrVector3f &translate)
+	{
+		m_scale = scale;
+		m_translate = translate;
+	}
+
+	void FrameLoop::SetOverlayTexture(eSceneTexture overlay, unsigned slice, float u0, float v0, float u1, float v1)
+	{
+		const int quad = overlay == TEXTURE_OVERLAY_OUT ? m_outer : overlay == TEXTURE_OVERLAY_IN ? m_inner : -1;
+		if (quad < 0)
+			return;
+		m_overlays.SetSlice(quad, slice);
+		m_overlays.SetRect(quad, u0, v0, u1, v1);
+	}
+
+	void FrameLoop::RunFrame()
+	{
+		unsigned long long start = Clock::NowNs();
+		unsigned long long t = start;
+		memset(m_stage, 0, sizeof(m_stage));
+		// Adds the time since the previous mark to a stage
+		auto mark = [&](eFrameStage stage) {
+			const unsigned long long now = Clock::NowNs();
+			m_stage[stage] += now - t;
+			t = now;
+		};
+
+		m_hmd->BeginFrame(m_frameIndex);
+		m_hmd->GetEyePoses(m_eyePose, &m_tracking);
+		mark(STAGE_POSE);
+
+		// Without a new camera frame the last one stays in the textures and
+		// is shown again, turned to the new head orientation
+		if (m_showCamera)
+		{
+			if (m_uploadCamera())
+				m_cameraUploaded = true;
+			else if (m_cameraUploaded)
+				m_reprojection.reused++;
+			if (m_cameraUploaded)
+				m_reprojection.frames++;
+		}
+		mark(STAGE_CAMERA);
+
+		if (m_streamer)
+			m_streamer->Update(*m_render, m_textureBudget);
+		mark(STAGE_TEXTURES);
+
+		m_render->BeginFrame();
+		mark(STAGE_DRAWS);
+
+		// Outer overlay stays locked to the head, inner one sits in the world.
+		OVR::Matrix4f scale = OVR::Matrix4f::Scaling(m_scale);
+		OVR::Matrix4f rotate = OVR::Matrix4f::RotationY(0);
+		OVR::Matrix4f outer = OVR::Matrix4f::Translation(OVR::Vector3f(m_translate)) * scale * rotate;
+		OVR::Matrix4f inner = OVR::Matrix4f::Translation(0.0f, 0.0f, -2.0f) * scale * rotate;
+		m_transforms.SetModel(m_outer, &outer.M[0][0]);
+		m_transforms.SetModel(m_inner, &inner.M[0][0]);
+		m_scene.SetBounds(m_innerObject, Aabb::Transform(s_quadBounds, &inner.M[0][0]));
+
+		ovrPosef worldEyePose[2];
+		ovrFovPort fov[2];
+		Frustum eyeFrustum[2];
+		for (int eye = 0; eye < 2; eye++)
+		{
+			// Calculate projection and view for the current eye.
+			OVR::Posef currentEyePose = m_eyePose[eye];
+			OVR::Quatf quatBodyRotation = OVR::Quatf(s_upVector, s_bodyYaw);
+			OVR::Posef worldPose = OVR::Posef(
+				quatBodyRotation * currentEyePose.Rotation, // Final rotation (body AND head)
+				s_bodyPosition + quatBodyRotation.Rotate(currentEyePose.Translation) // Final position (body AND eye)
+				);
+			OVR::Vector3f up = worldPose.Rotation.Rotate(s_upVector);
+			OVR::Vector3f forward = worldPose.Rotation.Rotate(s_forwardVector);
+			OVR::Matrix4f view = OVR::Matrix4f::LookAtRH(worldPose.Translation, worldPose.Translation + forward, up);
+
+			fov[eye] = m_hmd->EyeFov(eye);
+			m_transforms.SetProjection(eye, fov[eye], 0.01f, 10000.0f);
+			m_transforms.SetView(eye, &view.M[0][0]);
+
+			worldEyePose[eye] = worldPose;
+			const OVR::Matrix4f clip = OVR::Matrix4f(ovrMatrix4f_Projection(fov[eye], 0.01f, 10000.0f, true)) * view;
+			eyeFrustum[eye].FromMatrix(&clip.M[0][0]);
+		}
+		m_transforms.Run(&m_mvps[0]);
+		mark(STAGE_MATRICES);
+
+		// Head-locked overlays and the visible world ones, in quad order
+		Frustum stereo;
+		stereo.FromStereo(fov, worldEyePose, 0.01f, 10000.0f);
+		m_scene.Cull(stereo, eyeFrustum, m_visible);
+		for (int eye = 0; eye < 2; eye++)
+		{
+			m_drawn[eye] = m_headLocked;
+			for (size_t i = 0; i < m_visible[eye].size(); i++)
+				m_drawn[eye].push_back(m_sceneQuad[m_visible[eye][i]]);
+			std::sort(m_drawn[eye].begin(), m_drawn[eye].end());
+		}
+		mark(STAGE_CULL);
+
+		// The overlays of eye 0, then those of eye 1, in one upload
+		const int drawn[2] = { static_cast<int>(m_drawn[0].size()), static_cast<int>(m_drawn[1].size()) };
+		OverlayInstance *instances = nullptr;
+		const int first = drawn[0] + drawn[1] > 0 ? m_render->AllocateInstances(drawn[0] + drawn[1], &instances) : -1;
+		if (first >= 0)
+		{
+			for (int eye = 0; eye < 2; eye++)
+				if (drawn[eye] > 0)
+					m_overlays.Build(&m_mvps[0], eye, &m_drawn[eye][0], drawn[eye], instances + eye * drawn[0]);
+		}
+		int background[2] = { -1, -1 };
+		if (m_showCamera)
+		{
+			// Head orientation when this frame is shown, from the same history as the capture pose
+			ovrPoseStatef display;
+			const double displayTime = m_hmd->DisplayTime() > 0.0 ? m_hmd->DisplayTime() : Clock::Now();
+			const bool reproject = m_reprojectCamera && m_poseHistory && m_cameraPoseValid && m_poseHistory->Sample(displayTime, &display);
+
+			void *constants = nullptr;
+			const int slot = m_render->AllocateConstants(reproject ? 2 : 1, &constants);
+			if (slot >= 0 && reproject)
+			{
+				// One warp per eye, their fovs differ
+				for (int eye = 0; eye < 2; eye++)
+				{
+					OVR::Matrix4f transform;
+					CameraReprojection::Transform(fov[eye], m_cameraPose.ThePose.Orientation, display.ThePose.Orientation, &transform.M[0][0]);
+					ovrMatrix4f transposed = transform.Transposed();
+					memcpy(static_cast<unsigned char*>(constants) + eye * RenderDevice::DrawConstants, transposed.M, sizeof(transposed.M));
+					background[eye] = slot + eye;
+				}
+
+				const double latency = displayTime - m_cameraPose.TimeInSeconds;
+				const double rotation = CameraReprojection::Angle(m_cameraPose.ThePose.Orientation, display.ThePose.Orientation);
+				m_reprojection.reprojected++;
+				m_reprojection.latencySum += latency;
+				m_reprojection.latencyMax = std::max(m_reprojection.latencyMax, latency);
+				m_reprojection.rotationSum += rotation;
+				m_reprojection.rotationMax = std::max(m_reprojection.rotationMax, rotation);
+			}
+			else if (slot >= 0)
+			{
+				// The shader expects the transposed matrix.
+				ovrMatrix4f transposedBackground = s_cameraBackgroundTransform.Transposed();
+				memcpy(constants, transposedBackground.M, sizeof(transposedBackground.M));
+				background[0] = background[1] = slot;
+			}
+		}
+		mark(STAGE_CONSTANTS);
+
+		// We'll assume people have at most two eyes.
+		for (int i = 0; i < 2; i++)
+		{
+			// The HMD might want us to render each eye in a specific order for best result.
+			const int eye = m_hmd->EyeRenderOrder(i);
+
+			m_render->SetViewport(m_hmd->EyeViewport(eye));
+
+			// Camera image first, so the overlays are drawn on top of it.
+			if (background[eye] >= 0)
+			{
+				m_render->UseConstants(background[eye]);
+				m_render->SetTexture(eye == 0 ? TEXTURE_CAMERA_LEFT : TEXTURE_CAMERA_RIGHT);
+				m_render->DrawQuad();
+			}
+
+			// All overlays of the eye with one draw call
+			if (first >= 0 && drawn[eye] > 0)
+				m_render->DrawInstances(first + eye * drawn[0], drawn[eye]);
+		}
+		mark(STAGE_DRAWS);
+
+		m_render->EndFrame();
+		m_hmd->EndFrame(m_eyePose);
+		mark(STAGE_PRESENT);
+
+		m_stage[STAGE_FRAME] = t - start;
+		m_stats.Add(m_stage);
+		const ovrQuatf &head = m_tracking.HeadPose.ThePose.Orientation;
+		LOG_DEBUG("frame %u: %.3f ms, camera %.3f ms, head %.4f %.4f %.4f %.4f", m_frameIndex, m_stage[STAGE_FRAME] * 1e-6,
+			m_stage[STAGE_CAMERA] * 1e-6, head.x, head.y, head.z, head.w);
+		m_frameIndex++;
+	}
+
+	bool FrameLoop::m_uploadCamera()
+	{
+		if (!m_camera || !m_undistort)
+			return false;
+
+		// Newest camera frame, if any. This never waits for the capture thread.
+		bool newCameraFrame = false;
+		const CameraFrame *frame = m_camera->Latest(&newCameraFrame);
+		if (!frame || !newCameraFrame || frame->width != m_undistort->Width() || frame->height != m_undistort->Height())
+			return false;
+
+		m_cameraPoseValid = m_poseHistory && m_poseHistory->Sample(frame->captureTime, &m_cameraPose);
+
+		const int width = m_undistort->Width();
+		const int height = m_undistort->Height();
+		for (int eye = 0; eye < 2; eye++)
+		{
+			ColorConvert::ToRGBA(&frame->eye[eye][0], frame->pitch, frame->format,
+				width, height, &m_cameraRGBA[eye][0], width * 4);
+
+			int pitch = 0;
+			unsigned char *dst = m_render->MapCameraTexture(eye, &pitch);
+			if (dst)
+			{
+				m_undistort->Apply(eye, &m_cameraRGBA[eye][0], width * 4, dst, pitch, m_pool);
+				m_render->UnmapCameraTexture(eye);
+			}
+		}
+		return true;
+	}
+
+//------------------------------------------------------------------
+}
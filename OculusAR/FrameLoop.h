@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <OVR_CAPI.h>
+#include "RenderDevice.h"
+#include "TransformBatch.h"
+#include "OverlayInstances.h"
+#include "SceneBvh.h"
+#include "CameraReprojection.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class HmdDevice;
+	class CameraThread;
+	class UndistortMap;
+	class ThreadPool;
+	class PoseHistory;
+	class TextureStreamer;
+
+	// Parts of a frame that are timed separately
+	enum eFrameStage
+	{
+		STAGE_POSE = 0,		// HMD begin frame and eye poses
+		STAGE_CAMERA,		// colour conversion, undistortion and upload of a new camera frame
+		STAGE_TEXTURES,		// streamed texture levels going to the device
+		STAGE_MATRICES,		// projection, view and model matrices of both eyes, batched
+		STAGE_CULL,			// frustum culling of the world-locked overlays
+		STAGE_CONSTANTS,	// overlay instances and constants into this frame's upload
+		STAGE_DRAWS,		// render target setup, viewports, texture binds and draw calls
+		STAGE_PRESENT,		// resolve and HMD end frame
+		STAGE_FRAME,		// the whole frame
+
+		STAGE_COUNT
+	};
+
+	// CPU time of every stage, one sample per frame
+	class FrameStats
+	{
+	public:
+		void Clear();
+		void Add(const unsigned long long ns[STAGE_COUNT]);
+
+		size_t Count() const { return m_samples[STAGE_FRAME].size(); }
+		// p in [0, 100], result in microseconds
+		double Percentile(eFrameStage stage, double p) const;
+		double Mean(eFrameStage stage) const;
+
+		static const char *StageName(eFrameStage stage);
+
+	private:
+		std::vector<unsigned long long> m_samples[STAGE_COUNT];
+	};
+
+	// One frame of the application: poses, camera background and the two
+	// overlay quads for both eyes. Knows nothing about windows, LibOVR
+	// rendering or D3D11, so it runs headless with the null devices.
+	class FrameLoop
+	{
+	public:
+		FrameLoop(HmdDevice *hmd, RenderDevice *render);
+
+		// Camera pipeline; any of them may be null to skip the camera
+		void SetCamera(CameraThread *camera, UndistortMap *undistort, ThreadPool *pool);
+		// Head poses over time, to know where the head was when a camera
+		// frame was taken. May be null.
+		void SetPoseHistory(const PoseHistory *history) { m_poseHistory = history; }
+		// Uploads up to budgetBytes of streamed textures every frame before
+		// drawing. May be null.
+		void SetTextureStreamer(TextureStreamer *streamer, size_t budgetBytes) { m_streamer = streamer; m_textureBudget = budgetBytes; }
+		// Draws the camera image behind the overlays
+		void SetShowCamera(bool show) { m_showCamera = show; }
+		// Turns the camera image from the head orientation it was captured
+		// at to the one it is displayed at. Needs the pose history.
+		void SetReprojectCamera(bool reproject) { m_reprojectCamera = reproject; }
+		// Scale of both overlays and position of the head-locked one
+		void SetOverlay(float scale, const ovrVector3f &translate);
+		// Where the image of an overlay is: the slice of the overlay array
+		// and the rectangle on it, the whole slice of the overlay by default
+		void SetOverlayTexture(eSceneTexture overlay, unsigned slice, float u0, float v0, float u1, float v1);
+
+		void RunFrame();
+
+		FrameStats &Stats() { return m_stats; }
+		unsigned FrameIndex() const { return m_frameIndex; }
+		// Poses and tracking state of the last frame
+		const ovrPosef *EyePoses() const { return m_eyePose; }
+		const ovrTrackingState &Tracking() const { return m_tracking; }
+		// Head pose at the capture time of the camera frame on screen, if
+		// there is a pose history
+		const ovrPoseStatef &CameraPose() const { return m_cameraPose; }
+		ReprojectionStats &Reprojection() { return m_reprojection; }
+
+	private:
+		// True if there was a new camera frame
+		bool m_uploadCamera();
+
+		HmdDevice *m_hmd;
+		RenderDevice *m_render;
+		CameraThread *m_camera;
+		UndistortMap *m_undistort;
+		ThreadPool *m_pool;
+		const PoseHistory *m_poseHistory;
+		TextureStreamer *m_streamer;
+		size_t m_textureBudget;
+		ovrPoseStatef m_cameraPose;
+		bool m_cameraPoseValid;
+		// A camera frame is in the camera textures
+		bool m_cameraUploaded;
+		std::vector<unsigned char> m_cameraRGBA[2];
+		bool m_showCamera;
+		bool m_reprojectCamera;
+		ReprojectionStats m_reprojection;
+		float m_scale;
+		ovrVector3f m_translate;
+
+		// Overlay quads of the scene, drawn instanced: their transforms and
+		// their texture slices, same order in both
+		TransformBatch m_transforms;
+		OverlayInstanceBuilder m_overlays;
+		std::vector<float> m_mvps;
+		// World-locked overlays by scene id, culled per eye; head-locked ones
+		// are always drawn
+		SceneBvh m_scene;
+		std::vector<int> m_sceneQuad;
+		std::vector<int> m_headLocked;
+		std::vector<int> m_visible[2];
+		// Quads drawn for each eye this frame, ascending
+		std::vector<int> m_drawn[2];
+		int m_outer;
+		int m_inner;
+		int m_innerObject;
+
+		unsigned m_frameIndex;
+		ovrPosef m_eyePose[2];
+		ovrTrackingState m_tracking;
+		unsigned long long m_stage[STAGE_COUNT];
+		FrameStats m_stats;
+	};
+
+//------------------------------------------------------------------
+}
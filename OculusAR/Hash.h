@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// 64 bit FNV-1a. Pass the previous result as seed to hash several pieces.
+	inline unsigned long long HashBytes(const void *data, size_t size, unsigned long long seed = 14695981039346656037ULL)
+	{
+		const unsigned char *p = static_cast<const unsigned char*>(data);
+		unsigned long long h = seed;
+		for (size_t i = 0; i < size; i++)
+		{
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,169 @@
+#include "HmdDevice.h"
+#include "Capture.h"
+#include "Clock.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Refresh rate of a DK2
+	static const double NULL_REFRESH_RATE = 75.0;
+
+	NullHmdDevice::NullHmdDevice() : m_frameIndex(0), m_displayTime(0.0)
+	{
+		// DefaultEyeFov and ovrHmd_GetFovTextureSize of a DK2
+		const ovrFovPort fov = { 1.3316f, 1.3316f, 1.0587f, 1.0924f };
+		m_fov[0] = fov;
+		m_fov[1] = fov;
+		std::swap(m_fov[1].LeftTan, m_fov[1].RightTan);
+
+		const int eyeWidth = 1182;
+		const int eyeHeight = 1461;
+		m_viewport[0].Pos.x = 0;
+		m_viewport[0].Pos.y = 0;
+		m_viewport[0].Size.w = eyeWidth;
+		m_viewport[0].Size.h = eyeHeight;
+		m_viewport[1] = m_viewport[0];
+		m_viewport[1].Pos.x = eyeWidth;
+	}
+
+	void NullHmdDevice::BeginFrame(unsigned frameIndex)
+	{
+		m_frameIndex = frameIndex;
+		m_displayTime = Clock::Now() + 1.0 / NULL_REFRESH_RATE;
+	}
+
+	void NullHmdDevice::GetEyePoses(ovrPosef eyePose[2], ovrTrackingState *tracking)
+	{
+		// yaw around the Y axis, eyes 64 mm apart
+		const float yaw = 0.3f * std::sin(m_frameIndex * 0.01f);
+		ovrPosef head;
+		head.Orientation.x = 0.0f;
+		head.Orientation.y = std::sin(yaw * 0.5f);
+		head.Orientation.z = 0.0f;
+		head.Orientation.w = std::cos(yaw * 0.5f);
+		head.Position.x = 0.0f;
+		head.Position.y = 0.0f;
+		head.Position.z = 0.0f;
+
+		for (int eye = 0; eye < 2; eye++)
+		{
+			const float offset = eye == 0 ? -0.032f : 0.032f;
+			eyePose[eye] = head;
+			eyePose[eye].Position.x = offset * std::cos(yaw);
+			eyePose[eye].Position.z = -offset * std::sin(yaw);
+		}
+
+		if (tracking)
+		{
+			memset(tracking, 0, sizeof(*tracking));
+			tracking->HeadPose.ThePose = head;
+			tracking->HeadPose.TimeInSeconds = Clock::Now();
+		}
+	}
+
+	bool NullHmdDevice::GetHeadState(ovrPoseStatef *state)
+	{
+		HeadStateAt(Clock::Now(), state);
+		return true;
+	}
+
+	void NullHmdDevice::HeadStateAt(double time, ovrPoseStatef *state)
+	{
+		// yaw = 0.3 sin(2 t) around Y plus a slow sway sideways and nod
+		const double yaw = 0.3 * std::sin(2.0 * time);
+		const double yawRate = 0.6 * std::cos(2.0 * time);
+		const double yawAccel = -1.2 * std::sin(2.0 * time);
+		const double pitch = 0.1 * std::sin(3.0 * time);
+		const double pitchRate = 0.3 * std::cos(3.0 * time);
+		const double pitchAccel = -0.9 * std::sin(3.0 * time);
+
+		// orientation yaw * pitch; world space angular velocity is
+		// yawRate * Y + pitchRate * (yaw applied to X)
+		memset(state, 0, sizeof(*state));
+		const double cy = std::cos(yaw * 0.5), sy = std::sin(yaw * 0.5);
+		const double cp = std::cos(pitch * 0.5), sp = std::sin(pitch * 0.5);
+		state->ThePose.Orientation.x = static_cast<float>(cy * sp);
+		state->ThePose.Orientation.y = static_cast<float>(sy * cp);
+		state->ThePose.Orientation.z = static_cast<float>(-sy * sp);
+		state->ThePose.Orientation.w = static_cast<float>(cy * cp);
+		const double xAxisX = std::cos(yaw), xAxisZ = -std::sin(yaw);
+		state->AngularVelocity.x = static_cast<float>(pitchRate * xAxisX);
+		state->AngularVelocity.y = static_cast<float>(yawRate);
+		state->AngularVelocity.z = static_cast<float>(pitchRate * xAxisZ);
+		// d/dt of the above
+		state->AngularAcceleration.x = static_cast<float>(pitchAccel * xAxisX - pitchRate * yawRate * std::sin(yaw));
+		state->AngularAcceleration.y = static_cast<float>(yawAccel);
+		state->AngularAcceleration.z = static_cast<float>(pitchAccel * xAxisZ - pitchRate * yawRate * std::cos(yaw));
+
+		state->ThePose.Position.x = static_cast<float>(0.05 * std::sin(1.5 * time));
+		state->LinearVelocity.x = static_cast<float>(0.075 * std::cos(1.5 * time));
+		state->LinearAcceleration.x = static_cast<float>(-0.1125 * std::sin(1.5 * time));
+		state->TimeInSeconds = time;
+	}
+
+//------------------------------------------------------------------
+
+	ReplayHmdDevice::ReplayHmdDevice(HmdDevice *display, const CaptureReader *reader, bool realtime) :
+		m_display(display), m_reader(reader), m_realtime(realtime), m_wallStart(0.0), m_time(0.0), m_pose(0), m_looped(false)
+	{
+	}
+
+	void ReplayHmdDevice::BeginFrame(unsigned frameIndex)
+	{
+		m_display->BeginFrame(frameIndex);
+
+		m_looped = false;
+		if (m_reader->PoseCount() == 0)
+			return;
+
+		if (m_realtime)
+		{
+			if (frameIndex == 0 || m_wallStart == 0.0)
+				m_wallStart = Clock::Now();
+			const double span = m_reader->EndTime() - m_reader->StartTime();
+			const double elapsed = Clock::Now() - m_wallStart;
+			double offset = span > 0.0 ? elapsed - span * std::floor(elapsed / span) : 0.0;
+			const double time = m_reader->StartTime() + offset;
+			m_looped = time < m_time;
+			m_time = time;
+			m_pose = m_reader->FindPose(m_time);
+		}
+		else
+		{
+			if (frameIndex > 0)
+				m_pose++;
+			if (m_pose >= m_reader->PoseCount())
+			{
+				m_pose = 0;
+				m_looped = true;
+			}
+			m_time = m_reader->Pose(m_pose).time;
+		}
+	}
+
+	void ReplayHmdDevice::GetEyePoses(ovrPosef eyePose[2], ovrTrackingState *tracking)
+	{
+		if (m_reader->PoseCount() == 0)
+		{
+			m_display->GetEyePoses(eyePose, tracking);
+			return;
+		}
+
+		const PoseRecord &pose = m_reader->Pose(m_pose);
+		memcpy(&eyePose[0], &pose.eye[0], sizeof(ovrPosef));
+		memcpy(&eyePose[1], &pose.eye[1], sizeof(ovrPosef));
+		if (tracking)
+		{
+			memset(tracking, 0, sizeof(*tracking));
+			memcpy(&tracking->HeadPose.ThePose, &pose.head, sizeof(ovrPosef));
+			tracking->HeadPose.TimeInSeconds = pose.time;
+			tracking->StatusFlags = pose.statusFlags;
+		}
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <OVR_CAPI.h>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class CaptureReader;
+
+	// What the frame loop needs from a head mounted display
+	class HmdDevice
+	{
+	public:
+		virtual ~HmdDevice() {}
+
+		// Per-eye setup, fixed after initialization
+		virtual ovrFovPort EyeFov(int eye) const = 0;
+		virtual ovrRecti EyeViewport(int eye) const = 0;
+		// The HMD may want the eyes rendered in a specific order
+		virtual int EyeRenderOrder(int i) const { return i; }
+
+		virtual void BeginFrame(unsigned frameIndex) = 0;
+		// Eye poses for the frame being rendered. tracking may be null.
+		virtual void GetEyePoses(ovrPosef eyePose[2], ovrTrackingState *tracking) = 0;
+		// Presents the rendered eye texture
+		virtual void EndFrame(const ovrPosef eyePose[2]) = 0;
+		virtual void Recenter() {}
+		// Head pose right now with its derivatives, stamped with Clock::Now().
+		// Called from the pose sampler thread. False if there is none.
+		virtual bool GetHeadState(ovrPoseStatef *) { return false; }
+		// Clock::Now() time at which the frame begun last is shown, 0 if unknown
+		virtual double DisplayTime() const { return 0.0; }
+	};
+
+	// HMD stand-in without hardware: DK2 field of view and eye buffer size,
+	// head slowly looking left and right, nothing presented
+	class NullHmdDevice : public HmdDevice
+	{
+	public:
+		NullHmdDevice();
+
+		ovrFovPort EyeFov(int eye) const { return m_fov[eye]; }
+		ovrRecti EyeViewport(int eye) const { return m_viewport[eye]; }
+
+		void BeginFrame(unsigned frameIndex);
+		void GetEyePoses(ovrPosef eyePose[2], ovrTrackingState *tracking);
+		void EndFrame(const ovrPosef[2]) {}
+		// The head turning left and right over time, with exact derivatives
+		bool GetHeadState(ovrPoseStatef *state);
+		// One DK2 refresh after BeginFrame
+		double DisplayTime() const { return m_displayTime; }
+
+		// The same motion at any time
+		static void HeadStateAt(double time, ovrPoseStatef *state);
+
+	private:
+		ovrFovPort m_fov[2];
+		ovrRecti m_viewport[2];
+		unsigned m_frameIndex;
+		double m_displayTime;
+	};
+
+	// Takes the eye poses from a recording and everything else from
+	// another HMD, real or null
+	class ReplayHmdDevice : public HmdDevice
+	{
+	public:
+		// realtime follows the recording clock from the first frame on,
+		// otherwise every frame takes the next recorded pose. Both loop.
+		ReplayHmdDevice(HmdDevice *display, const CaptureReader *reader, bool realtime);
+
+		ovrFovPort EyeFov(int eye) const { return m_display->EyeFov(eye); }
+		ovrRecti EyeViewport(int eye) const { return m_display->EyeViewport(eye); }
+		int EyeRenderOrder(int i) const { return m_display->EyeRenderOrder(i); }
+
+		void BeginFrame(unsigned frameIndex);
+		void GetEyePoses(ovrPosef eyePose[2], ovrTrackingState *tracking);
+		void EndFrame(const ovrPosef eyePose[2]) { m_display->EndFrame(eyePose); }
+		void Recenter() { m_display->Recenter(); }
+		double DisplayTime() const { return m_display->DisplayTime(); }
+
+		// Recording time of the current frame
+		double Time() const { return m_time; }
+		// True once the frame wrapped around to the start of the recording
+		bool Looped() const { return m_looped; }
+
+	private:
+		HmdDevice *m_display;
+		const CaptureReader *m_reader;
+		bool m_realtime;
+		double m_wallStart;
+		double m_time;
+		size_t m_pose;
+		bool m_looped;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,1177 @@
+#include "ImageDecode.h"
+#include "MappedFile.h"
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	void ImageRgba::Allocate(int w, int h)
+	{
+		width = w;
+		height = h;
+		pixels.resize(static_cast<size_t>(w) * h * 4);
+	}
+
+	bool ImageDecode::Decode(const unsigned char *data, size_t size, ImageRgba &image)
+	{
+		if (size >= 8 && data[0] == 0x89 && data[1] == 'P' && data[2] == 'N' && data[3] == 'G')
+			return Png(data, size, image);
+		if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF)
+			return Jpeg(data, size, image);
+		return false;
+	}
+
+	bool ImageDecode::Load(const char *path, ImageRgba &image)
+	{
+		MappedFile file;
+		return file.Open(path) && Decode(file.Data(), file.Size(), image);
+	}
+
+	static unsigned s_be32(const unsigned char *p)
+	{
+		return static_cast<unsigned>(p[0]) << 24 | static_cast<unsigned>(p[1]) << 16 | static_cast<unsigned>(p[2]) << 8 | p[3];
+	}
+
+	static unsigned char s_clamp(int value)
+	{
+		return static_cast<unsigned char>(value < 0 ? 0 : value > 255 ? 255 : value);
+	}
+
+	// Range of the IDCT inputs and intermediates that keeps its sums in 32
+	// bits, the odd part of a pass peaks at about 1.4e9 with 13 bit inputs;
+	// valid 8 bit data stays inside
+	static int s_clampIdct(int value)
+	{
+		return value < -8191 ? -8191 : value > 8191 ? 8191 : value;
+	}
+
+//------------------------------------------------------------------
+// DEFLATE (RFC 1950, 1951)
+
+	// Canonical Huffman code; codes of up to FastBits bits are found with one
+	// lookup of the next bits, longer ones by comparing against the last
+	// code of every length
+	struct InflateCode
+	{
+		static const int FastBits = 9;
+
+		unsigned short fast[1 << FastBits];	// length << 9 | symbol, 0 if longer
+		unsigned short firstCode[17];
+		unsigned short firstSymbol[17];
+		unsigned maxCode[18];	// one past the last code of a length, left aligned to 16 bits
+		unsigned short symbols[288];
+
+		bool Build(const unsigned char *lengths, int count)
+		{
+			int sizes[17] = {};
+			for (int i = 0; i < count; i++)
+				sizes[lengths[i]]++;
+			sizes[0] = 0;
+			memset(fast, 0, sizeof(fast));
+
+			unsigned next[17];
+			unsigned code = 0;
+			int k = 0;
+			for (int s = 1; s <= 16; s++)
+			{
+				next[s] = code;
+				firstCode[s] = static_cast<unsigned short>(code);
+				firstSymbol[s] = static_cast<unsigned short>(k);
+				code += sizes[s];
+				if (sizes[s] && code - 1 >= 1u << s)
+					return false;
+				maxCode[s] = code << (16 - s);
+				code <<= 1;
+				k += sizes[s];
+			}
+			maxCode[17] = 0x10000;
+
+			for (int i = 0; i < count; i++)
+			{
+				const int s = lengths[i];
+				if (!s)
+					continue;
+				symbols[next[s] - firstCode[s] + firstSymbol[s]] = static_cast<unsigned short>(i);
+				if (s <= FastBits)
+				{
+					// the stream has the code bits in reverse
+					unsigned reversed = 0;
+					for (int b = 0; b < s; b++)
+						reversed |= (next[s] >> b & 1) << (s - 1 - b);
+					for (unsigned j = reversed; j < (1u << FastBits); j += 1u << s)
+						fast[j] = static_cast<unsigned short>(s << 9 | i);
+				}
+				next[s]++;
+			}
+			return true;
+		}
+	};
+
+	class Inflater
+	{
+	public:
+		Inflater(const unsigned char *data, size_t size, unsigned char *out, size_t capacity) :
+			m_p(data), m_end(data + size), m_bits(0), m_count(0), m_out(out), m_pos(0), m_capacity(capacity) {}
+
+		// Inflates the whole stream; false if it is broken or does not fit
+		bool Run()
+		{
+			bool last = false;
+			while (!last)
+			{
+				last = m_get(1) != 0;
+				const unsigned type = m_get(2);
+				bool ok = false;
+				if (type == 0)
+					ok = m_stored();
+				else if (type == 1)
+					ok = m_fixed() && m_block();
+				else if (type == 2)
+					ok = m_dynamic() && m_block();
+				if (!ok)
+					return false;
+			}
+			return true;
+		}
+
+		size_t Size() const { return m_pos; }
+
+	private:
+		void m_fill()
+		{
+			// past the end of the data come zeros; a stream that reads them
+			// ends up short or broken
+			while (m_count <= 56)
+			{
+				if (m_p < m_end)
+					m_bits |= static_cast<unsigned long long>(*m_p++) << m_count;
+				m_count += 8;
+			}
+		}
+
+		unsigned m_get(int n)
+		{
+			if (m_count < n)
+				m_fill();
+			const unsigned value = static_cast<unsigned>(m_bits & ((1u << n) - 1));
+			m_bits >>= n;
+			m_count -= n;
+			return value;
+		}
+
+		// -1 for a broken code
+		int m_decode(const InflateCode &code)
+		{
+			if (m_count < 16)
+				m_fill();
+			const unsigned fast = code.fast[m_bits & ((1 << InflateCode::FastBits) - 1)];
+			if (fast)
+			{
+				m_bits >>= fast >> 9;
+				m_count -= fast >> 9;
+				return fast & 511;
+			}
+			unsigned k = 0;
+			for (int b = 0; b < 16; b++)
+				k |= (m_bits >> b & 1) << (15 - b);
+			int s = InflateCode::FastBits + 1;
+			while (k >= code.maxCode[s])
+				s++;
+			if (s > 16)
+				return -1;
+			m_bits >>= s;
+			m_count -= s;
+			return code.symbols[(k >> (16 - s)) - code.firstCode[s] + code.firstSymbol[s]];
+		}
+
+		bool m_stored()
+		{
+			m_get(m_count & 7);
+			const unsigned length = m_get(16);
+			if ((m_get(16) ^ 0xFFFF) != length || length > m_capacity - m_pos)
+				return false;
+			unsigned left = length;
+			for (; left > 0 && m_count >= 8; left--)
+				m_out[m_pos++] = static_cast<unsigned char>(m_get(8));
+			// the bit buffer is empty now, the rest comes straight from the data
+			if (left > 0)
+			{
+				if (m_p + left > m_end)
+					return false;
+				memcpy(m_out + m_pos, m_p, left);
+				m_p += left;
+				m_pos += left;
+			}
+			return true;
+		}
+
+		bool m_fixed()
+		{
+			unsigned char lengths[288 + 32];
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			memset(lengths + 288, 5, 32);
+			return m_literals.Build(lengths, 288) && m_distances.Build(lengths + 288, 32);
+		}
+
+		bool m_dynamic()
+		{
+			static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+			const int literals = static_cast<int>(m_get(5)) + 257;
+			const int distances = static_cast<int>(m_get(5)) + 1;
+			const int codeLengths = static_cast<int>(m_get(4)) + 4;
+			if (literals > 286 || distances > 30)
+				return false;
+
+			unsigned char lengthLengths[19] = {};
+			for (int i = 0; i < codeLengths; i++)
+				lengthLengths[order[i]] = static_cast<unsigned char>(m_get(3));
+			InflateCode lengthCode;
+			if (!lengthCode.Build(lengthLengths, 19))
+				return false;
+
+			unsigned char lengths[286 + 30];
+			int n = 0;
+			while (n < literals + distances)
+			{
+				const int symbol = m_decode(lengthCode);
+				if (symbol < 0)
+					return false;
+				if (symbol < 16)
+				{
+					lengths[n++] = static_cast<unsigned char>(symbol);
+					continue;
+				}
+				unsigned char fill = 0;
+				int repeat;
+				if (symbol == 16)
+				{
+					if (n == 0)
+						return false;
+					fill = lengths[n - 1];
+					repeat = 3 + static_cast<int>(m_get(2));
+				}
+				else if (symbol == 17)
+					repeat = 3 + static_cast<int>(m_get(3));
+				else
+					repeat = 11 + static_cast<int>(m_get(7));
+				if (n + repeat > literals + distances)
+					return false;
+				memset(lengths + n, fill, repeat);
+				n += repeat;
+			}
+			if (lengths[256] == 0)
+				return false;
+			return m_literals.Build(lengths, literals) && m_distances.Build(lengths + literals, distances);
+		}
+
+		bool m_block()
+		{
+			static const unsigned short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static const unsigned char lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static const unsigned short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+				4097, 6145, 8193, 12289, 16385, 24577 };
+			static const unsigned char distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+			for (;;)
+			{
+				const int symbol = m_decode(m_literals);
+				if (symbol < 256)
+				{
+					if (symbol < 0 || m_pos == m_capacity)
+						return false;
+					m_out[m_pos++] = static_cast<unsigned char>(symbol);
+					continue;
+				}
+				if (symbol == 256)
+					return true;
+				if (symbol > 285)
+					return false;
+				const size_t length = lengthBase[symbol - 257] + m_get(lengthExtra[symbol - 257]);
+				const int d = m_decode(m_distances);
+				if (d < 0 || d >= 30)
+					return false;
+				const size_t distance = distanceBase[d] + m_get(distanceExtra[d]);
+				if (distance > m_pos || length > m_capacity - m_pos)
+					return false;
+				unsigned char *out = m_out + m_pos;
+				const unsigned char *from = out - distance;
+				if (distance >= length)
+					memcpy(out, from, length);
+				else
+					for (size_t i = 0; i < length; i++)
+						out[i] = from[i];
+				m_pos += length;
+			}
+		}
+
+		const unsigned char *m_p;
+		const unsigned char *m_end;
+		unsigned long long m_bits;
+		int m_count;
+		unsigned char *m_out;
+		size_t m_pos;
+		size_t m_capacity;
+		InflateCode m_literals;
+		InflateCode m_distances;
+	};
+
+//------------------------------------------------------------------
+// PNG
+
+	struct PngInfo
+	{
+		int width;
+		int height;
+		int depth;
+		int colorType;
+		int channels;
+		unsigned char palette[256][4];
+		bool hasKey;
+		unsigned key[3];	// tRNS colour of greyscale and truecolour images, full depth
+	};
+
+	static size_t s_pngRowBytes(const PngInfo &png, int width)
+	{
+		return (static_cast<size_t>(width) * png.channels * png.depth + 7) / 8;
+	}
+
+	static unsigned s_pngSample(const unsigned char *row, int index, int depth)
+	{
+		if (depth == 8)
+			return row[index];
+		if (depth == 16)
+			return static_cast<unsigned>(row[index * 2]) << 8 | row[index * 2 + 1];
+		const int bit = index * depth;
+		return row[bit >> 3] >> (8 - depth - (bit & 7)) & ((1u << depth) - 1);
+	}
+
+	// Unfilters row in place; prior is the row above, zeros for the first
+	static bool s_pngUnfilter(int filter, unsigned char *row, const unsigned char *prior, size_t bytes, int bpp)
+	{
+		switch (filter)
+		{
+		case 0:
+			break;
+		case 1:
+			for (size_t i = bpp; i < bytes; i++)
+				row[i] = static_cast<unsigned char>(row[i] + row[i - bpp]);
+			break;
+		case 2:
+			for (size_t i = 0; i < bytes; i++)
+				row[i] = static_cast<unsigned char>(row[i] + prior[i]);
+			break;
+		case 3:
+			for (size_t i = 0; i < static_cast<size_t>(bpp) && i < bytes; i++)
+				row[i] = static_cast<unsigned char>(row[i] + (prior[i] >> 1));
+			for (size_t i = bpp; i < bytes; i++)
+				row[i] = static_cast<unsigned char>(row[i] + ((row[i - bpp] + prior[i]) >> 1));
+			break;
+		case 4:
+			for (size_t i = 0; i < static_cast<size_t>(bpp) && i < bytes; i++)
+				row[i] = static_cast<unsigned char>(row[i] + prior[i]);
+			for (size_t i = bpp; i < bytes; i++)
+			{
+				const int a = row[i - bpp], b = prior[i], c = prior[i - bpp];
+				const int p = a + b - c;
+				const int pa = p > a ? p - a : a - p, pb = p > b ? p - b : b - p, pc = p > c ? p - c : c - p;
+				row[i] = static_cast<unsigned char>(row[i] + (pa <= pb && pa <= pc ? a : pb <= pc ? b : c));
+			}
+			break;
+		default:
+			return false;
+		}
+		return true;
+	}
+
+	// count pixels of an unfiltered row to RGBA, step pixels apart
+	static void s_pngPixels(const PngInfo &png, const unsigned char *row, int count, unsigned char *out, int step)
+	{
+		const int stride = step * 4;
+		if (png.depth == 8 && png.colorType == 6)
+		{
+			for (int i = 0; i < count; i++, out += stride, row += 4)
+				memcpy(out, row, 4);
+			return;
+		}
+		if (png.depth == 8 && png.colorType == 2 && !png.hasKey)
+		{
+			for (int i = 0; i < count; i++, out += stride, row += 3)
+			{
+				out[0] = row[0];
+				out[1] = row[1];
+				out[2] = row[2];
+				out[3] = 255;
+			}
+			return;
+		}
+
+		// greyscale below 8 bits spreads over 0..255
+		const unsigned scale = png.depth >= 8 ? 1 : 255 / ((1u << png.depth) - 1);
+		const int shift = png.depth == 16 ? 8 : 0;
+		for (int i = 0; i < count; i++, out += stride)
+		{
+			const int first = i * png.channels;
+			switch (png.colorType)
+			{
+			case 0:
+				{
+					const unsigned g = s_pngSample(row, first, png.depth);
+					out[0] = out[1] = out[2] = static_cast<unsigned char>((g >> shift) * scale);
+					out[3] = png.hasKey && g == png.key[0] ? 0 : 255;
+				}
+				break;
+			case 2:
+				{
+					const unsigned r = s_pngSample(row, first, png.depth);
+					const unsigned g = s_pngSample(row, first + 1, png.depth);
+					const unsigned b = s_pngSample(row, first + 2, png.depth);
+					out[0] = static_cast<unsigned char>(r >> shift);
+					out[1] = static_cast<unsigned char>(g >> shift);
+					out[2] = static_cast<unsigned char>(b >> shift);
+					out[3] = png.hasKey && r == png.key[0] && g == png.key[1] && b == png.key[2] ? 0 : 255;
+				}
+				break;
+			case 3:
+				memcpy(out, png.palette[s_pngSample(row, first, png.depth)], 4);
+				break;
+			case 4:
+				out[0] = out[1] = out[2] = static_cast<unsigned char>(s_pngSample(row, first, png.depth) >> shift);
+				out[3] = static_cast<unsigned char>(s_pngSample(row, first + 1, png.depth) >> shift);
+				break;
+			default:
+				for (int c = 0; c < 4; c++)
+					out[c] = static_cast<unsigned char>(s_pngSample(row, first + c, png.depth) >> shift);
+				break;
+			}
+		}
+	}
+
+	bool ImageDecode::Png(const unsigned char *data, size_t size, ImageRgba &image)
+	{
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+		if (size < 8 || memcmp(data, signature, 8) != 0)
+			return false;
+
+		PngInfo png;
+		memset(&png, 0, sizeof(png));
+		int interlace = 0;
+		int paletteSize = 0;
+		bool header = false;
+		std::vector<unsigned char> compressed;
+		for (size_t at = 8; ; )
+		{
+			if (size - at < 12)
+				return false;
+			const unsigned length = s_be32(data + at);
+			const unsigned char *type = data + at + 4;
+			const unsigned char *chunk = data + at + 8;
+			if (length > size - at - 12)
+				return false;
+			at += 12 + length;
+
+			if (memcmp(type, "IHDR", 4) == 0)
+			{
+				if (length < 13)
+					return false;
+				png.width = static_cast<int>(s_be32(chunk));
+				png.height = static_cast<int>(s_be32(chunk + 4));
+				png.depth = chunk[8];
+				png.colorType = chunk[9];
+				interlace = chunk[12];
+				static const int channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+				png.channels = png.colorType <= 6 ? channels[png.colorType] : 0;
+				const int d = png.depth;
+				const bool depthOk = png.colorType == 0 ? d == 1 || d == 2 || d == 4 || d == 8 || d == 16 :
+					png.colorType == 3 ? d == 1 || d == 2 || d == 4 || d == 8 : d == 8 || d == 16;
+				if (png.width <= 0 || png.height <= 0 || png.width > MaxSize || png.height > MaxSize || !png.channels || !depthOk ||
+					chunk[10] != 0 || chunk[11] != 0 || interlace > 1)
+					return false;
+				header = true;
+			}
+			else if (memcmp(type, "PLTE", 4) == 0)
+			{
+				paletteSize = static_cast<int>(length / 3);
+				if (paletteSize > 256)
+					return false;
+				for (int i = 0; i < paletteSize; i++)
+				{
+					memcpy(png.palette[i], chunk + i * 3, 3);
+					png.palette[i][3] = 255;
+				}
+			}
+			else if (memcmp(type, "tRNS", 4) == 0)
+			{
+				if (png.colorType == 3)
+				{
+					for (unsigned i = 0; i < length && i < 256; i++)
+						png.palette[i][3] = chunk[i];
+				}
+				else if (png.colorType == 0 && length >= 2)
+				{
+					png.hasKey = true;
+					png.key[0] = static_cast<unsigned>(chunk[0]) << 8 | chunk[1];
+				}
+				else if (png.colorType == 2 && length >= 6)
+				{
+					png.hasKey = true;
+					for (int c = 0; c < 3; c++)
+						png.key[c] = static_cast<unsigned>(chunk[c * 2]) << 8 | chunk[c * 2 + 1];
+				}
+			}
+			else if (memcmp(type, "IDAT", 4) == 0)
+				compressed.insert(compressed.end(), chunk, chunk + length);
+			else if (memcmp(type, "IEND", 4) == 0)
+				break;
+			// unknown chunks are skipped unless they are critical
+			else if (!(type[0] & 0x20))
+				return false;
+		}
+		if (!header || compressed.size() < 2 || (png.colorType == 3 && paletteSize == 0))
+			return false;
+		// zlib header: deflate, no preset dictionary
+		if ((compressed[0] & 0x0F) != 8 || ((compressed[0] << 8) | compressed[1]) % 31 != 0 || (compressed[1] & 0x20))
+			return false;
+
+		static const int passX[7] = { 0, 4, 0, 2, 0, 1, 0 }, passY[7] = { 0, 0, 4, 0, 2, 0, 1 };
+		static const int passDX[7] = { 8, 8, 4, 4, 2, 2, 1 }, passDY[7] = { 8, 8, 8, 4, 4, 2, 2 };
+		const int passes = interlace ? 7 : 1;
+		int passWidth[7], passHeight[7];
+		size_t rawSize = 0;
+		for (int p = 0; p < passes; p++)
+		{
+			passWidth[p] = interlace ? (png.width - passX[p] + passDX[p] - 1) / passDX[p] : png.width;
+			passHeight[p] = interlace ? (png.height - passY[p] + passDY[p] - 1) / passDY[p] : png.height;
+			if (passWidth[p] > 0 && passHeight[p] > 0)
+				rawSize += (1 + s_pngRowBytes(png, passWidth[p])) * passHeight[p];
+		}
+
+		std::vector<unsigned char> raw(rawSize);
+		Inflater inflater(&compressed[2], compressed.size() - 2, &raw[0], rawSize);
+		if (!inflater.Run() || inflater.Size() != rawSize)
+			return false;
+
+		image.Allocate(png.width, png.height);
+		const int bpp = png.channels * png.depth >= 8 ? png.channels * png.depth / 8 : 1;
+		std::vector<unsigned char> zeros(s_pngRowBytes(png, png.width) + 1, 0);
+		unsigned char *at = &raw[0];
+		for (int p = 0; p < passes; p++)
+		{
+			if (passWidth[p] <= 0 || passHeight[p] <= 0)
+				continue;
+			const size_t bytes = s_pngRowBytes(png, passWidth[p]);
+			const unsigned char *prior = &zeros[0];
+			for (int y = 0; y < passHeight[p]; y++, at += bytes + 1)
+			{
+				unsigned char *row = at + 1;
+				if (!s_pngUnfilter(at[0], row, prior, bytes, bpp))
+					return false;
+				prior = row;
+				if (interlace)
+					s_pngPixels(png, row, passWidth[p], image.Row(passY[p] + y * passDY[p]) + passX[p] * 4, passDX[p]);
+				else
+					s_pngPixels(png, row, png.width, image.Row(y), 1);
+			}
+		}
+		return true;
+	}
+
+//------------------------------------------------------------------
+// JPEG (ITU T.81), sequential Huffman only
+
+	static const unsigned char s_zigzag[64 + 16] =
+	{
+		0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+		12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+		58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+		// a broken run may go past the end
+		63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63
+	};
+
+	// Huffman table of a DHT segment, codes read most significant bit first
+	struct JpegCode
+	{
+		static const int FastBits = 9;
+
+		unsigned char fast[1 << FastBits];	// index into values, 255 if longer
+		unsigned char lengths[256];
+		unsigned char values[256];
+		int delta[17];			// value index minus code, for each length
+		unsigned maxCode[18];	// one past the last code of a length, left aligned to 16 bits
+		bool defined;
+
+		bool Build(const unsigned char counts[16], const unsigned char *symbols, int total)
+		{
+			memset(fast, 255, sizeof(fast));
+			unsigned code = 0;
+			int k = 0;
+			for (int s = 1; s <= 16; s++)
+			{
+				delta[s] = k - static_cast<int>(code);
+				for (int i = 0; i < counts[s - 1]; i++)
+				{
+					// more codes of this length than there is room for
+					if (code >= (1u << s))
+						return false;
+					lengths[k] = static_cast<unsigned char>(s);
+					values[k] = symbols[k];
+					if (s <= FastBits)
+					{
+						const unsigned first = code << (FastBits - s);
+						for (unsigned j = 0; j < (1u << (FastBits - s)); j++)
+							fast[first + j] = static_cast<unsigned char>(k);
+					}
+					code++;
+					k++;
+				}
+				maxCode[s] = code << (16 - s);
+				code <<= 1;
+			}
+			maxCode[17] = 0xFFFFFFFF;
+			defined = k == total;
+			return defined;
+		}
+	};
+
+	struct JpegComponent
+	{
+		int id;
+		int h;
+		int v;
+		int quant;
+		int dcTable;
+		int acTable;
+		int dcPred;
+		int blocksX;	// blocks of the plane, a whole number of MCUs
+		int blocksY;
+		int width;		// samples that are part of the image
+		int height;
+		std::vector<unsigned char> plane;
+	};
+
+	class JpegDecoder
+	{
+	public:
+		JpegDecoder(const unsigned char *data, size_t size) : m_p(data), m_end(data + size), m_frame(false), m_components(0),
+			m_restartInterval(0), m_transform(-1), m_bits(0), m_count(0), m_marker(0)
+		{
+			memset(m_dc, 0, sizeof(m_dc));
+			memset(m_ac, 0, sizeof(m_ac));
+		}
+
+		bool Run(ImageRgba &image)
+		{
+			if (m_end - m_p < 2 || m_p[0] != 0xFF || m_p[1] != 0xD8)
+				return false;
+			m_p += 2;
+			bool scanned = false;
+			for (;;)
+			{
+				// markers may be padded with any number of 0xFF
+				while (m_p < m_end && *m_p != 0xFF)
+					m_p++;
+				while (m_p < m_end && *m_p == 0xFF)
+					m_p++;
+				if (m_p >= m_end)
+					return false;
+				const unsigned char marker = *m_p++;
+				if (marker == 0xD9)
+					break;
+				// restart markers and stuffed bytes left over from a scan
+				if (marker == 0 || (marker >= 0xD0 && marker <= 0xD7))
+					continue;
+				if (m_end - m_p < 2)
+					return false;
+				const size_t length = static_cast<size_t>(m_p[0]) << 8 | m_p[1];
+				if (length < 2 || length > static_cast<size_t>(m_end - m_p))
+					return false;
+				const unsigned char *segment = m_p + 2;
+				const size_t bytes = length - 2;
+				m_p += length;
+
+				bool ok = true;
+				switch (marker)
+				{
+				case 0xC0: case 0xC1:
+					ok = m_readFrame(segment, bytes);
+					break;
+				case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+				case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+					// progressive, lossless, hierarchical or arithmetic coded
+					return false;
+				case 0xC4:
+					ok = m_readHuffman(segment, bytes);
+					break;
+				case 0xDB:
+					ok = m_readQuant(segment, bytes);
+					break;
+				case 0xDD:
+					ok = bytes >= 2;
+					if (ok)
+						m_restartInterval = segment[0] << 8 | segment[1];
+					break;
+				case 0xEE:
+					// Adobe: the transform flag says whether three components are YCbCr
+					if (bytes >= 12 && memcmp(segment, "Adobe", 5) == 0)
+						m_transform = segment[11];
+					break;
+				case 0xDA:
+					ok = m_frame && m_scan(segment, bytes);
+					scanned = scanned || ok;
+					break;
+				default:
+					break;
+				}
+				if (!ok)
+					return false;
+			}
+			if (!scanned)
+				return false;
+			m_output(image);
+			return true;
+		}
+
+	private:
+		bool m_readFrame(const unsigned char *s, size_t bytes)
+		{
+			if (m_frame || bytes < 6 || s[0] != 8)
+				return false;
+			m_height = s[1] << 8 | s[2];
+			m_width = s[3] << 8 | s[4];
+			m_components = s[5];
+			// no DNL support, the height must be known
+			if (m_width <= 0 || m_height <= 0 || m_width > ImageDecode::MaxSize || m_height > ImageDecode::MaxSize ||
+				(m_components != 1 && m_components != 3) || bytes < 6 + 3u * m_components)
+				return false;
+			m_hmax = m_vmax = 1;
+			for (int c = 0; c < m_components; c++)
+			{
+				JpegComponent &comp = m_comp[c];
+				comp.id = s[6 + c * 3];
+				comp.h = s[7 + c * 3] >> 4;
+				comp.v = s[7 + c * 3] & 15;
+				comp.quant = s[8 + c * 3];
+				if (comp.h < 1 || comp.h > 4 || comp.v < 1 || comp.v > 4 || comp.quant > 3)
+					return false;
+				m_hmax = comp.h > m_hmax ? comp.h : m_hmax;
+				m_vmax = comp.v > m_vmax ? comp.v : m_vmax;
+			}
+			m_mcusX = (m_width + 8 * m_hmax - 1) / (8 * m_hmax);
+			m_mcusY = (m_height + 8 * m_vmax - 1) / (8 * m_vmax);
+			for (int c = 0; c < m_components; c++)
+			{
+				JpegComponent &comp = m_comp[c];
+				// only whole subsampling ratios
+				if (m_hmax % comp.h || m_vmax % comp.v)
+					return false;
+				comp.blocksX = m_mcusX * comp.h;
+				comp.blocksY = m_mcusY * comp.v;
+				comp.width = (m_width * comp.h + m_hmax - 1) / m_hmax;
+				comp.height = (m_height * comp.v + m_vmax - 1) / m_vmax;
+				comp.plane.assign(static_cast<size_t>(comp.blocksX) * comp.blocksY * 64, 0);
+			}
+			m_frame = true;
+			return true;
+		}
+
+		bool m_readHuffman(const unsigned char *s, size_t bytes)
+		{
+			while (bytes > 0)
+			{
+				if (bytes < 17)
+					return false;
+				const int kind = s[0] >> 4, index = s[0] & 15;
+				int total = 0;
+				for (int i = 0; i < 16; i++)
+					total += s[1 + i];
+				if (kind > 1 || index > 3 || total > 256 || bytes < 17u + total)
+					return false;
+				JpegCode &code = kind == 0 ? m_dc[index] : m_ac[index];
+				if (!code.Build(s + 1, s + 17, total))
+					return false;
+				s += 17 + total;
+				bytes -= 17 + total;
+			}
+			return true;
+		}
+
+		bool m_readQuant(const unsigned char *s, size_t bytes)
+		{
+			while (bytes > 0)
+			{
+				const int precision = s[0] >> 4, index = s[0] & 15;
+				const size_t size = 1 + 64 * (precision ? 2 : 1);
+				if (precision > 1 || index > 3 || bytes < size)
+					return false;
+				for (int i = 0; i < 64; i++)
+					m_quant[index][i] = static_cast<unsigned short>(precision ? s[1 + i * 2] << 8 | s[2 + i * 2] : s[1 + i]);
+				s += size;
+				bytes -= size;
+			}
+			return true;
+		}
+
+		// --- entropy coded data ---
+
+		void m_fill()
+		{
+			while (m_count <= 24)
+			{
+				unsigned byte = 0;
+				// a marker ends the data, what follows reads as zeros
+				if (!m_marker && m_p < m_end)
+				{
+					byte = *m_p;
+					if (byte == 0xFF)
+					{
+						const unsigned next = m_p + 1 < m_end ? m_p[1] : 0xD9;
+						if (next == 0)
+							m_p += 2;
+						else
+						{
+							m_marker = next;
+							byte = 0;
+						}
+					}
+					else
+						m_p++;
+				}
+				m_bits |= byte << (24 - m_count);
+				m_count += 8;
+			}
+		}
+
+		int m_decode(const JpegCode &code)
+		{
+			if (m_count < 16)
+				m_fill();
+			const unsigned k = code.fast[m_bits >> (32 - JpegCode::FastBits)];
+			if (k < 255)
+			{
+				const int s = code.lengths[k];
+				m_bits <<= s;
+				m_count -= s;
+				return code.values[k];
+			}
+			const unsigned top = m_bits >> 16;
+			int s = JpegCode::FastBits + 1;
+			while (top >= code.maxCode[s])
+				s++;
+			if (s > 16)
+				return -1;
+			const int index = static_cast<int>(top >> (16 - s)) + code.delta[s];
+			m_bits <<= s;
+			m_count -= s;
+			return code.values[index];
+		}
+
+		// s bits as a signed coefficient
+		int m_receive(int s)
+		{
+			if (s == 0)
+				return 0;
+			if (m_count < s)
+				m_fill();
+			const unsigned value = m_bits >> (32 - s);
+			m_bits <<= s;
+			m_count -= s;
+			return value & (1u << (s - 1)) ? static_cast<int>(value) : static_cast<int>(value) - (1 << s) + 1;
+		}
+
+		bool m_block(JpegComponent &comp, int bx, int by)
+		{
+			int coefficients[64];
+			memset(coefficients, 0, sizeof(coefficients));
+			const unsigned short *q = m_quant[comp.quant];
+
+			const int t = m_decode(m_dc[comp.dcTable]);
+			if (t < 0 || t > 16)
+				return false;
+			comp.dcPred += m_receive(t);
+			// broken data can run the prediction away, keep it to the range of a coefficient
+			comp.dcPred = comp.dcPred < -32768 ? -32768 : comp.dcPred > 32767 ? 32767 : comp.dcPred;
+			coefficients[0] = s_clampIdct(comp.dcPred * q[0]);
+
+			const JpegCode &ac = m_ac[comp.acTable];
+			for (int k = 1; k < 64; )
+			{
+				const int rs = m_decode(ac);
+				if (rs < 0)
+					return false;
+				const int run = rs >> 4, s = rs & 15;
+				if (s == 0)
+				{
+					if (run != 15)
+						break;
+					k += 16;
+					continue;
+				}
+				k += run;
+				if (k > 63)
+					return false;
+				coefficients[s_zigzag[k]] = s_clampIdct(m_receive(s) * q[k]);
+				k++;
+			}
+			s_idct(coefficients, &comp.plane[(static_cast<size_t>(by) * 8 * comp.blocksX + bx) * 8], comp.blocksX * 8);
+			return true;
+		}
+
+		bool m_restart()
+		{
+			m_bits = 0;
+			m_count = 0;
+			// the restart marker the decoder stopped at, or the next one
+			if (!m_marker)
+			{
+				while (m_p + 1 < m_end && !(m_p[0] == 0xFF && m_p[1] >= 0xD0 && m_p[1] <= 0xD7))
+					m_p++;
+				if (m_p + 1 >= m_end)
+					return false;
+				m_marker = m_p[1];
+			}
+			if (m_marker < 0xD0 || m_marker > 0xD7)
+				return false;
+			m_p += 2;
+			m_marker = 0;
+			for (int c = 0; c < m_components; c++)
+				m_comp[c].dcPred = 0;
+			return true;
+		}
+
+		bool m_scan(const unsigned char *s, size_t bytes)
+		{
+			const int count = bytes > 0 ? s[0] : 0;
+			if (count < 1 || count > m_components || bytes < 4u + 2 * count)
+				return false;
+			JpegComponent *comps[3];
+			for (int i = 0; i < count; i++)
+			{
+				comps[i] = nullptr;
+				for (int c = 0; c < m_components; c++)
+					if (m_comp[c].id == s[1 + i * 2])
+						comps[i] = &m_comp[c];
+				if (!comps[i])
+					return false;
+				comps[i]->dcTable = s[2 + i * 2] >> 4;
+				comps[i]->acTable = s[2 + i * 2] & 15;
+				if (comps[i]->dcTable > 3 || comps[i]->acTable > 3 || !m_dc[comps[i]->dcTable].defined || !m_ac[comps[i]->acTable].defined)
+					return false;
+				comps[i]->dcPred = 0;
+			}
+			m_bits = 0;
+			m_count = 0;
+			m_marker = 0;
+
+			// one component alone is coded block by block over its own size,
+			// several interleaved in MCUs
+			const int unitsX = count == 1 ? (comps[0]->width + 7) / 8 : m_mcusX;
+			const int unitsY = count == 1 ? (comps[0]->height + 7) / 8 : m_mcusY;
+			int left = m_restartInterval;
+			for (int uy = 0; uy < unitsY; uy++)
+			{
+				for (int ux = 0; ux < unitsX; ux++)
+				{
+					if (m_restartInterval && left-- == 0)
+					{
+						if (!m_restart())
+							return false;
+						left = m_restartInterval - 1;
+					}
+					if (count == 1)
+					{
+						if (!m_block(*comps[0], ux, uy))
+							return false;
+						continue;
+					}
+					for (int i = 0; i < count; i++)
+						for (int y = 0; y < comps[i]->v; y++)
+							for (int x = 0; x < comps[i]->h; x++)
+								if (!m_block(*comps[i], ux * comps[i]->h + x, uy * comps[i]->v + y))
+									return false;
+				}
+			}
+			// m_p is at the marker that ended the data, or somewhere before it
+			return true;
+		}
+
+		// --- output ---
+
+		// Row y of an image sized component, 4 times the samples. Two to one
+		// subsampling is interpolated 3:1 between the nearest samples like
+		// libjpeg's fancy upsampling, other ratios repeat samples.
+		void m_upsampleRow(const JpegComponent &comp, int y, std::vector<int> &column, unsigned char *out)
+		{
+			const int vs = m_vmax / comp.v, hs = m_hmax / comp.h;
+			const int stride = comp.blocksX * 8;
+			const unsigned char *plane = &comp.plane[0];
+			if (vs == 2 && hs <= 2)
+			{
+				const int cy = y >> 1;
+				int near = y & 1 ? cy + 1 : cy - 1;
+				near = near < 0 ? 0 : near >= comp.height ? comp.height - 1 : near;
+				const unsigned char *a = plane + static_cast<size_t>(cy) * stride, *b = plane + static_cast<size_t>(near) * stride;
+				for (int x = 0; x < comp.width; x++)
+					column[x] = 3 * a[x] + b[x];
+			}
+			else
+			{
+				const unsigned char *a = plane + static_cast<size_t>(y / vs) * stride;
+				for (int x = 0; x < comp.width; x++)
+					column[x] = 4 * a[x];
+			}
+
+			if (hs == 2 && vs <= 2)
+			{
+				const int last = comp.width - 1;
+				for (int x = 0; x < m_width; x++)
+				{
+					const int cx = x >> 1;
+					const int near = x & 1 ? (cx < last ? cx + 1 : last) : (cx > 0 ? cx - 1 : 0);
+					out[x * 4] = static_cast<unsigned char>((3 * column[cx] + column[near] + (x & 1 ? 7 : 8)) >> 4);
+				}
+			}
+			else
+			{
+				for (int x = 0; x < m_width; x++)
+					out[x * 4] = static_cast<unsigned char>((column[x / hs] + 2) >> 2);
+			}
+		}
+
+		void m_output(ImageRgba &image)
+		{
+			image.Allocate(m_width, m_height);
+			std::vector<int> column(m_mcusX * m_hmax * 8);
+			// components go to the R, G, B bytes first and are converted in place
+			for (int y = 0; y < m_height; y++)
+			{
+				unsigned char *row = image.Row(y);
+				for (int c = 0; c < m_components; c++)
+					m_upsampleRow(m_comp[c], y, column, row + c);
+				if (m_components == 1)
+				{
+					for (int x = 0; x < m_width; x++)
+					{
+						row[x * 4 + 1] = row[x * 4 + 2] = row[x * 4];
+						row[x * 4 + 3] = 255;
+					}
+				}
+				else if (m_transform == 0)
+				{
+					for (int x = 0; x < m_width; x++)
+						row[x * 4 + 3] = 255;
+				}
+				else
+				{
+					// BT.601 full range, 16 bit fixed point
+					for (int x = 0; x < m_width; x++)
+					{
+						unsigned char *p = row + x * 4;
+						const int luma = (p[0] << 16) + 32768;
+						const int cb = p[1] - 128, cr = p[2] - 128;
+						p[0] = s_clamp((luma + cr * 91881) >> 16);
+						p[1] = s_clamp((luma - cb * 22554 - cr * 46802) >> 16);
+						p[2] = s_clamp((luma + cb * 116130) >> 16);
+						p[3] = 255;
+					}
+				}
+			}
+		}
+
+		// Inverse DCT of dequantized coefficients to 8x8 samples, integer
+		// version of libjpeg's "islow": 13 bit constants, 2 extra bits
+		// between the passes
+		static void s_idct(const int *in, unsigned char *out, int pitch)
+		{
+			#define FIX(x) static_cast<int>((x) * 8192 + 0.5)
+			#define IDCT_1D(s0, s1, s2, s3, s4, s5, s6, s7) \
+				const int z1 = (s2 + s6) * FIX(0.541196100); \
+				const int t2 = z1 + s6 * -FIX(1.847759065); \
+				const int t3 = z1 + s2 * FIX(0.765366865); \
+				const int t0 = (s0 + s4) * 8192; \
+				const int t1 = (s0 - s4) * 8192; \
+				const int e0 = t0 + t3, e3 = t0 - t3, e1 = t1 + t2, e2 = t1 - t2; \
+				const int z5 = (s7 + s5 + s3 + s1) * FIX(1.175875602); \
+				const int z13 = z5 + (s7 + s3) * -FIX(1.961570560), z24 = z5 + (s5 + s1) * -FIX(0.390180644); \
+				const int z17 = (s7 + s1) * -FIX(0.899976223), z35 = (s5 + s3) * -FIX(2.562915447); \
+				const int o0 = s7 * FIX(0.298631336) + z17 + z13; \
+				const int o1 = s5 * FIX(2.053119869) + z35 + z24; \
+				const int o2 = s3 * FIX(3.072711026) + z35 + z13; \
+				const int o3 = s1 * FIX(1.501321110) + z17 + z24;
+
+			int work[64];
+			for (int c = 0; c < 8; c++)
+			{
+				const int *d = in + c;
+				if (!(d[8] | d[16] | d[24] | d[32] | d[40] | d[48] | d[56]))
+				{
+					const int dc = d[0] * 4;
+					for (int r = 0; r < 8; r++)
+						work[r * 8 + c] = dc;
+					continue;
+				}
+				IDCT_1D(d[0], d[8], d[16], d[24], d[32], d[40], d[48], d[56])
+				const int round = 1 << 10;
+				work[0 * 8 + c] = s_clampIdct((e0 + o3 + round) >> 11);
+				work[7 * 8 + c] = s_clampIdct((e0 - o3 + round) >> 11);
+				work[1 * 8 + c] = s_clampIdct((e1 + o2 + round) >> 11);
+				work[6 * 8 + c] = s_clampIdct((e1 - o2 + round) >> 11);
+				work[2 * 8 + c] = s_clampIdct((e2 + o1 + round) >> 11);
+				work[5 * 8 + c] = s_clampIdct((e2 - o1 + round) >> 11);
+				work[3 * 8 + c] = s_clampIdct((e3 + o0 + round) >> 11);
+				work[4 * 8 + c] = s_clampIdct((e3 - o0 + round) >> 11);
+			}
+			for (int r = 0; r < 8; r++, out += pitch)
+			{
+				const int *w = work + r * 8;
+				IDCT_1D(w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7])
+				// 13 bits of the constants, 2 extra and 3 of the 8 point scale; plus the level shift
+				const int round = (1 << 17) + (128 << 18);
+				out[0] = s_clamp((e0 + o3 + round) >> 18);
+				out[7] = s_clamp((e0 - o3 + round) >> 18);
+				out[1] = s_clamp((e1 + o2 + round) >> 18);
+				out[6] = s_clamp((e1 - o2 + round) >> 18);
+				out[2] = s_clamp((e2 + o1 + round) >> 18);
+				out[5] = s_clamp((e2 - o1 + round) >> 18);
+				out[3] = s_clamp((e3 + o0 + round) >> 18);
+				out[4] = s_clamp((e3 - o0 + round) >> 18);
+			}
+			#undef IDCT_1D
+			#undef FIX
+		}
+
+		const unsigned char *m_p;
+		const unsigned char *m_end;
+		bool m_frame;
+		int m_width;
+		int m_height;
+		int m_components;
+		int m_hmax;
+		int m_vmax;
+		int m_mcusX;
+		int m_mcusY;
+		int m_restartInterval;
+		int m_transform;
+		JpegComponent m_comp[3];
+		unsigned short m_quant[4][64];	// zigzag order
+		JpegCode m_dc[4];
+		JpegCode m_ac[4];
+
+		unsigned m_bits;	// left aligned
+		int m_count;
+		unsigned m_marker;
+	};
+
+	bool ImageDecode::Jpeg(const unsigned char *data, size_t size, ImageRgba &image)
+	{
+		JpegDecoder *decoder = new JpegDecoder(data, size);
+		const bool ok = decoder->Run(image);
+		delete decoder;
+		return ok;
+	}
+
+//------------------------------------------------------------------
+}
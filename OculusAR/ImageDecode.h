@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// 8 bit RGBA image, the layout of DXGI_FORMAT_R8G8B8A8_UNORM, rows packed
+	struct ImageRgba
+	{
+		ImageRgba() : width(0), height(0) {}
+
+		// Keeps memory if the size did not change
+		void Allocate(int w, int h);
+		int Pitch() const { return width * 4; }
+		unsigned char *Row(int y) { return &pixels[static_cast<size_t>(y) * width * 4]; }
+		const unsigned char *Row(int y) const { return &pixels[static_cast<size_t>(y) * width * 4]; }
+
+		int width;
+		int height;
+		std::vector<unsigned char> pixels;
+	};
+
+	// Decodes the image files the scene is textured with to RGBA, without
+	// any library, so it works the same everywhere and on any thread.
+	//
+	// PNG: every colour type and bit depth, palettes, tRNS transparency and
+	// interlacing; 16 bit samples keep their high byte. Checksums are not
+	// verified. JPEG: baseline and extended Huffman, greyscale and YCbCr with
+	// any integer subsampling, upsampled like libjpeg's fancy upsampling, and
+	// restart intervals. Progressive and arithmetic coded JPEGs, CMYK and
+	// 12 bit samples are not supported.
+	class ImageDecode
+	{
+	public:
+		// Images larger than this either way are refused
+		static const int MaxSize = 16384;
+
+		// PNG or JPEG by the signature of data. False if the data is not an
+		// image this decodes, or broken.
+		static bool Decode(const unsigned char *data, size_t size, ImageRgba &image);
+		static bool Png(const unsigned char *data, size_t size, ImageRgba &image);
+		static bool Jpeg(const unsigned char *data, size_t size, ImageRgba &image);
+
+		// Decodes a file
+		static bool Load(const char *path, ImageRgba &image);
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,222 @@
+#include "ImageEncode.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static void s_putBig(std::vector<unsigned char> &out, unsigned value)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+			out.push_back(static_cast<unsigned char>(value >> shift));
+	}
+
+	static unsigned s_crc32(const unsigned char *data, size_t size)
+	{
+		unsigned crc = ~0u;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc ^= data[i];
+			for (int k = 0; k < 8; k++)
+				crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+		}
+		return ~crc;
+	}
+
+	static unsigned s_adler32(const std::vector<unsigned char> &data)
+	{
+		unsigned a = 1, b = 0;
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			a = (a + data[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		return b << 16 | a;
+	}
+
+	static void s_pngChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data)
+	{
+		s_putBig(out, static_cast<unsigned>(data.size()));
+		const size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		s_putBig(out, s_crc32(&out[start], out.size() - start));
+	}
+
+	// Deflate bits, the first one in the lowest bit
+	struct DeflateBits
+	{
+		explicit DeflateBits(std::vector<unsigned char> &out) : out(out), bits(0), count(0) {}
+
+		void Put(unsigned value, int n)
+		{
+			bits |= static_cast<unsigned long long>(value) << count;
+			count += n;
+			for (; count >= 8; count -= 8, bits >>= 8)
+				out.push_back(static_cast<unsigned char>(bits));
+		}
+		void Flush() { if (count > 0) out.push_back(static_cast<unsigned char>(bits)); bits = 0; count = 0; }
+
+		std::vector<unsigned char> &out;
+		unsigned long long bits;
+		int count;
+	};
+
+	// Fixed Huffman code of a deflate literal/length symbol
+	static void s_deflateSymbol(DeflateBits &writer, int symbol)
+	{
+		unsigned code;
+		int length;
+		if (symbol < 144) { code = 0x30 + symbol; length = 8; }
+		else if (symbol < 256) { code = 0x190 + symbol - 144; length = 9; }
+		else if (symbol < 280) { code = symbol - 256; length = 7; }
+		else { code = 0xC0 + symbol - 280; length = 8; }
+		unsigned reversed = 0;
+		for (int i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		writer.Put(reversed, length);
+	}
+
+	// zlib stream of one fixed Huffman block, greedy matches on a 3 byte hash
+	static void s_deflateFixed(const std::vector<unsigned char> &data, std::vector<unsigned char> &out)
+	{
+		static const int lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const int lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const int distanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const int distanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		out.push_back(0x78);
+		out.push_back(0x01);
+		DeflateBits writer(out);
+		writer.Put(1, 1);
+		writer.Put(1, 2);
+		std::vector<int> head(1 << 15, -1);
+		const size_t size = data.size();
+		size_t i = 0;
+		while (i < size)
+		{
+			size_t length = 0, distance = 0;
+			if (i + 3 <= size)
+			{
+				const unsigned hash = ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & 0x7FFF;
+				const int candidate = head[hash];
+				head[hash] = static_cast<int>(i);
+				if (candidate >= 0 && i - candidate <= 32768)
+				{
+					const size_t limit = std::min<size_t>(258, size - i);
+					while (length < limit && data[candidate + length] == data[i + length])
+						length++;
+					distance = i - candidate;
+				}
+			}
+			if (length < 3)
+			{
+				s_deflateSymbol(writer, data[i++]);
+				continue;
+			}
+
+			int l = 28;
+			while (lengthBase[l] > static_cast<int>(length))
+				l--;
+			s_deflateSymbol(writer, 257 + l);
+			writer.Put(static_cast<unsigned>(length - lengthBase[l]), lengthExtra[l]);
+			int d = 29;
+			while (distanceBase[d] > static_cast<int>(distance))
+				d--;
+			unsigned reversed = 0;
+			for (int b = 0; b < 5; b++)
+				reversed |= ((d >> b) & 1) << (4 - b);
+			writer.Put(reversed, 5);
+			writer.Put(static_cast<unsigned>(distance - distanceBase[d]), distanceExtra[d]);
+			i += length;
+		}
+		s_deflateSymbol(writer, 256);
+		writer.Flush();
+		s_putBig(out, s_adler32(data));
+	}
+
+	// zlib stream of stored blocks of up to 64 KB
+	static void s_deflateStored(const std::vector<unsigned char> &data, std::vector<unsigned char> &out)
+	{
+		out.push_back(0x78);
+		out.push_back(0x01);
+		size_t offset = 0;
+		do
+		{
+			const size_t length = std::min<size_t>(data.size() - offset, 65535);
+			out.push_back(offset + length == data.size() ? 1 : 0);
+			const unsigned char sizes[4] = { static_cast<unsigned char>(length), static_cast<unsigned char>(length >> 8),
+				static_cast<unsigned char>(~length), static_cast<unsigned char>(~length >> 8) };
+			out.insert(out.end(), sizes, sizes + 4);
+			out.insert(out.end(), data.begin() + offset, data.begin() + offset + length);
+			offset += length;
+		} while (offset < data.size());
+		s_putBig(out, s_adler32(data));
+	}
+
+	// The rows, each behind its filter byte: 0, or the five filters in turn
+	static void s_pngRows(const ImageRgba &image, bool filter, std::vector<unsigned char> &out)
+	{
+		const int pitch = image.Pitch();
+		out.clear();
+		out.reserve(static_cast<size_t>(pitch + 1) * image.height);
+		for (int y = 0; y < image.height; y++)
+		{
+			const unsigned char *row = image.Row(y);
+			if (!filter)
+			{
+				out.push_back(0);
+				out.insert(out.end(), row, row + pitch);
+				continue;
+			}
+			const unsigned char *up = y > 0 ? image.Row(y - 1) : nullptr;
+			const int type = y % 5;
+			out.push_back(static_cast<unsigned char>(type));
+			for (int x = 0; x < pitch; x++)
+			{
+				const int a = x >= 4 ? row[x - 4] : 0;
+				const int b = up ? up[x] : 0;
+				const int c = up && x >= 4 ? up[x - 4] : 0;
+				int predicted = 0;
+				if (type == 1)
+					predicted = a;
+				else if (type == 2)
+					predicted = b;
+				else if (type == 3)
+					predicted = (a + b) >> 1;
+				else if (type == 4)
+				{
+					const int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+					predicted = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+				}
+				out.push_back(static_cast<unsigned char>(row[x] - predicted));
+			}
+		}
+	}
+
+	void ImageEncode::Png(const ImageRgba &image, ePngCompression compression, std::vector<unsigned char> &out)
+	{
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+		out.assign(signature, signature + 8);
+
+		std::vector<unsigned char> chunk;
+		s_putBig(chunk, static_cast<unsigned>(image.width));
+		s_putBig(chunk, static_cast<unsigned>(image.height));
+		static const unsigned char format[5] = { 8, 6, 0, 0, 0 };	// 8 bit RGBA, no interlacing
+		chunk.insert(chunk.end(), format, format + 5);
+		s_pngChunk(out, "IHDR", chunk);
+
+		std::vector<unsigned char> rows;
+		s_pngRows(image, compression == PNG_FILTERED, rows);
+		chunk.clear();
+		if (compression == PNG_FILTERED)
+			s_deflateFixed(rows, chunk);
+		else
+			s_deflateStored(rows, chunk);
+		s_pngChunk(out, "IDAT", chunk);
+		s_pngChunk(out, "IEND", std::vector<unsigned char>());
+	}
+
+//------------------------------------------------------------------
+}
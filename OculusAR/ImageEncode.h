@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ImageDecode.h"
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	enum ePngCompression
+	{
+		// Filter 0 rows in stored deflate blocks: no time spent, no bytes saved
+		PNG_STORED = 0,
+		// Each of the five row filters in turn, one fixed Huffman block with
+		// greedy matches on a 3 byte hash: smaller, and every path a
+		// decoder has gets used
+		PNG_FILTERED
+	};
+
+	// Writes RGBA images as 8 bit RGBA PNGs that ImageDecode reads back
+	// exactly: atlas pages, and the test images of the benchmarks.
+	class ImageEncode
+	{
+	public:
+		static void Png(const ImageRgba &image, ePngCompression compression, std::vector<unsigned char> &out);
+	};
+
+//------------------------------------------------------------------
+}
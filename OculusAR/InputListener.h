@@ -4,20 +4,30 @@ namespace D3D11Framework
 {
 //------------------------------------------------------------------
 
+	class InputMgr;
+
 	//  
 	struct MouseEvent
 	{
-		MouseEvent(int nx, int ny) :  x(nx), y(ny) {}
+		MouseEvent(int nx, int ny, double t = 0.0, int ndx = 0, int ndy = 0, unsigned n = 1) :  x(nx), y(ny), dx(ndx), dy(ndy), count(n), time(t) {}
 
 		//  
 		int x;				
 		int y;
+		// Relative motion since the previous MouseMove, raw mouse counts if
+		// the raw mouse is used, else pixels
+		int dx;
+		int dy;
+		// Mouse events of the frame merged into this one
+		unsigned count;
+		// Clock::Now() of the frame the event is handed on in
+		double time;
 	};
 
 	//    
 	struct MouseEventClick : public MouseEvent
 	{
-		MouseEventClick(eMouseKeyCodes b, int nx, int ny) : MouseEvent(nx,ny), btn(b) {}
+		MouseEventClick(eMouseKeyCodes b, int nx, int ny, double t = 0.0) : MouseEvent(nx,ny,t), btn(b) {}
 
 		const eMouseKeyCodes btn;	// 
 	};
@@ -25,18 +35,33 @@ namespace D3D11Framework
 	//   
 	struct MouseEventWheel : public MouseEvent
 	{
-		MouseEventWheel(int nwheel, int nx, int ny) : MouseEvent(nx,ny), wheel(nwheel) {}
+		MouseEventWheel(int nwheel, int nx, int ny, double t = 0.0, unsigned n = 1) : MouseEvent(nx,ny,t,0,0,n), wheel(nwheel) {}
 
+		// notches, fine wheels add up to whole ones
 		int wheel;
 	};
 
 	//  
 	struct KeyEvent
 	{
-		KeyEvent(wchar_t c, eKeyCodes kc) : wc(c), code(kc) {}
+		KeyEvent(eKeyCodes kc, unsigned short sc, unsigned char flags, const InputMgr *input, double t = 0.0) :
+			code(kc), scan(sc), time(t), m_input(input), m_flags(flags), m_char(0), m_translated(false) {}
+
+		// Character the key types with the modifiers held. It is only
+		// worked out if a listener asks.
+		wchar_t Char() const;
 
-		const wchar_t wc;
 		const eKeyCodes code;
+		// hardware scan code
+		const unsigned short scan;
+		// Clock::Now() of the frame the event is handed on in
+		const double time;
+
+	private:
+		const InputMgr *m_input;
+		unsigned char m_flags;
+		mutable wchar_t m_char;
+		mutable bool m_translated;
 	};
 
 	class InputListener
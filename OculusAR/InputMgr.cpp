@@ -1,165 +1,440 @@
-#include "Headers.h"
 #include "InputMgr.h"
 #include "InputCodes.h"
 #include "InputListener.h"
+#include "InputRecorder.h"
+#include "Clock.h"
 #include "Log.h"
+#include <cstring>
+#ifdef _WIN32
+#	include <windowsx.h>
+#endif
 
 namespace D3D11Framework
 {
 //------------------------------------------------------------------
 
+	InputMgr::InputMgr() : m_dropped(0), m_dispatching(false), m_tablesDirty(false), m_recorder(nullptr), m_coalesced(0), m_moves(0), m_wheels(0), m_dx(0), m_dy(0), m_wheelUnits(0),
+		m_mousex(0), m_mousey(0), m_rawMouse(false), m_curx(0), m_cury(0)
+	{
+		memset(m_down, 0, sizeof(m_down));
+		memset(m_pressed, 0, sizeof(m_pressed));
+	}
+
 	void InputMgr::Init()
 	{
-		m_MouseWheel = m_curx = m_cury = 0;
+		m_curx = m_cury = 0;
 		Log::Get()->Debug("InputMgr init");
 	}
 
 	void InputMgr::Close()
 	{
-		if (!m_Listener.empty())
-			m_Listener.clear();
+		m_registered.clear();
+		m_buildTables();
 		Log::Get()->Debug("InputMgr close");
 	}
 
-	void InputMgr::SetWinRect(const RECT &winrect)
+	void InputMgr::AddListener(InputListener *Listener, int priority, unsigned kinds)
 	{
-		m_windowrect.left = winrect.left;
-		m_windowrect.right = winrect.right;
-		m_windowrect.top = winrect.top;
-		m_windowrect.bottom = winrect.bottom;
+		if (!Listener)
+			return;
+		// after those of the same priority
+		size_t at = 0;
+		while (at < m_registered.size() && m_registered[at].priority >= priority)
+			at++;
+		const ListenerEntry entry = { Listener, priority, kinds };
+		m_registered.insert(m_registered.begin() + at, entry);
+		m_buildTables();
 	}
 
-	void InputMgr::AddListener(InputListener *Listener)
+	void InputMgr::RemoveListener(InputListener *Listener)
 	{
-		m_Listener.push_back(Listener);
+		for (size_t i = 0; i < m_registered.size(); )
+		{
+			if (m_registered[i].listener == Listener)
+				m_registered.erase(m_registered.begin() + i);
+			else
+				i++;
+		}
+		// the tables Dispatch walks keep their size, the listener is only
+		// blanked in them so it is not called again
+		if (m_dispatching)
+			for (int t = 0; t < TABLE_MAX; t++)
+				for (size_t i = 0; i < m_tables[t].size(); i++)
+					if (m_tables[t][i] == Listener)
+						m_tables[t][i] = nullptr;
+		m_buildTables();
 	}
 
-	void InputMgr::Run(const UINT &msg, WPARAM wParam, LPARAM lParam)
+	void InputMgr::m_buildTables()
 	{
-		if (m_Listener.empty())
+		// the tables stay as they are while Dispatch walks them
+		if (m_dispatching)
+		{
+			m_tablesDirty = true;
 			return;
+		}
+		static const unsigned kinds[TABLE_MAX] = { LISTEN_MOUSE_MOVE, LISTEN_MOUSE_BUTTON, LISTEN_MOUSE_WHEEL, LISTEN_KEY };
+		for (int t = 0; t < TABLE_MAX; t++)
+		{
+			m_tables[t].clear();
+			for (size_t i = 0; i < m_registered.size(); i++)
+				if (m_registered[i].kinds & kinds[t])
+					m_tables[t].push_back(m_registered[i].listener);
+		}
+		m_tablesDirty = false;
+	}
+
+	bool InputMgr::Push(const InputEvent &event)
+	{
+		if (m_events.Push(event))
+			return true;
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
 
-		eKeyCodes KeyIndex;
-		wchar_t buffer[1];
-		BYTE lpKeyState[256];
+//------------------------------------------------------------------
+
+#ifdef _WIN32
+	bool InputMgr::UseRawMouse(HWND window)
+	{
+		// generic desktop page, mouse
+		RAWINPUTDEVICE device;
+		device.usUsagePage = 0x01;
+		device.usUsage = 0x02;
+		device.dwFlags = 0;
+		device.hwndTarget = window;
+		m_rawMouse = RegisterRawInputDevices(&device, 1, sizeof(device)) != FALSE;
+		if (!m_rawMouse)
+			Log::Get()->Err("InputMgr: raw mouse not available, error %u", static_cast<unsigned>(GetLastError()));
+		return m_rawMouse;
+	}
+
+	void InputMgr::Run(const UINT &msg, WPARAM wParam, LPARAM lParam)
+	{
+		const double time = Clock::Now();
+		InputEvent event = {};
+		event.time = time;
 
-		m_eventcursor();//   
+		event.x = m_curx;
+		event.y = m_cury;
 		switch(msg)
 		{
-		case WM_KEYDOWN:
-			KeyIndex = static_cast<eKeyCodes>(wParam);
-			GetKeyboardState(lpKeyState);
-			ToUnicode(wParam, HIWORD(lParam)&0xFF, lpKeyState, buffer, 1, 0);
-			m_eventkey(KeyIndex,buffer[0],true);
-			break;
-		case WM_KEYUP:
-			KeyIndex = static_cast<eKeyCodes>(wParam);
-			GetKeyboardState(lpKeyState);
-			ToUnicode(wParam, HIWORD(lParam)&0xFF, lpKeyState, buffer, 1, 0);
-			m_eventkey(KeyIndex,buffer[0],false);
-			break;
-		case WM_LBUTTONDOWN:
-			m_eventmouse(MOUSE_LEFT,true);
-			break;
-		case WM_LBUTTONUP:
-			m_eventmouse(MOUSE_LEFT,false);
+		case WM_MOUSEMOVE:
+			m_eventcursor(lParam, time);//   
 			break;
-		case WM_RBUTTONDOWN:
-			m_eventmouse(MOUSE_RIGHT,true);
+		case WM_INPUT:
+			m_rawinput(lParam, time);
 			break;
-		case WM_RBUTTONUP:
-			m_eventmouse(MOUSE_RIGHT,false);
-			break;
-		case WM_MBUTTONDOWN:
-			m_eventmouse(MOUSE_MIDDLE,true);
+		case WM_KEYDOWN:
+		case WM_KEYUP:
+			event.type = msg == WM_KEYDOWN ? INPUT_KEY_PRESS : INPUT_KEY_RELEASE;
+			event.key = static_cast<eKeyCodes>(wParam);
+			event.scan = HIWORD(lParam)&0xFF;
+			// toggles are only known here, the held keys Dispatch keeps itself
+			if (GetKeyState(VK_CAPITAL) & 1)
+				event.flags |= INPUT_FLAG_CAPS_LOCK;
+			Push(event);
 			break;
-		case WM_MBUTTONUP:
-			m_eventmouse(MOUSE_MIDDLE,false);
+		case WM_LBUTTONDOWN: case WM_LBUTTONUP:
+		case WM_RBUTTONDOWN: case WM_RBUTTONUP:
+		case WM_MBUTTONDOWN: case WM_MBUTTONUP:
+			event.x = GET_X_LPARAM(lParam);
+			event.y = GET_Y_LPARAM(lParam);
+			event.type = msg == WM_LBUTTONDOWN || msg == WM_RBUTTONDOWN || msg == WM_MBUTTONDOWN ? INPUT_MOUSE_PRESS : INPUT_MOUSE_RELEASE;
+			event.button = static_cast<unsigned char>(msg == WM_LBUTTONDOWN || msg == WM_LBUTTONUP ? MOUSE_LEFT :
+				msg == WM_RBUTTONDOWN || msg == WM_RBUTTONUP ? MOUSE_RIGHT : MOUSE_MIDDLE);
+			Push(event);
 			break;
 		case WM_MOUSEWHEEL:
-			m_mousewheel( (short)GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA );
+			// the raw mouse has it already
+			if (m_rawMouse)
+				break;
+			event.wheel = GET_WHEEL_DELTA_WPARAM(wParam);
+			event.type = INPUT_MOUSE_WHEEL;
+			Push(event);
+			break;
+		case WM_KILLFOCUS:
+			event.type = INPUT_FOCUS_LOST;
+			Push(event);
 			break;
 		}
 	}
 
-	void InputMgr::m_eventcursor()
+	wchar_t InputMgr::Translate(eKeyCodes key, unsigned short scan, unsigned char flags) const
+	{
+		BYTE state[256] = {};
+		if (IsDown(eKeyCodes::KEY_SHIFT))
+			state[VK_SHIFT] = 0x80;
+		if (IsDown(eKeyCodes::KEY_CONTROL))
+			state[VK_CONTROL] = 0x80;
+		if (flags & INPUT_FLAG_CAPS_LOCK)
+			state[VK_CAPITAL] = 0x01;
+		wchar_t buffer[2] = {};
+		// flag 4 leaves the dead key state of the keyboard alone, the key
+		// may be long gone by the time a listener asks
+		return ToUnicode(static_cast<UINT>(key), scan, state, buffer, 2, 4) != 0 ? buffer[0] : 0;
+	}
+
+	void InputMgr::m_eventcursor(LPARAM lParam, double time)
 	{
-		POINT Position;
-		GetCursorPos(&Position);	//    
+		// client coordinates of the window
+		const int x = GET_X_LPARAM(lParam);
+		const int y = GET_Y_LPARAM(lParam);
+		if (m_curx==x && m_cury==y)
+			return;
 
-		Position.x -= m_windowrect.left;
-		Position.y -= m_windowrect.top;
+		InputEvent event = {};
+		event.time = time;
+		event.type = INPUT_MOUSE_MOVE;
+		event.x = x;
+		event.y = y;
+		event.dx = x - m_curx;
+		event.dy = y - m_cury;
+		m_curx = x;
+		m_cury = y;
+		// the raw mouse brings the motion, this only keeps the cursor
+		if (!m_rawMouse)
+			Push(event);
+	}
 
-		if (m_curx==Position.x && m_cury==Position.y)
+	void InputMgr::m_rawinput(LPARAM lParam, double time)
+	{
+		RAWINPUT raw;
+		UINT size = sizeof(raw);
+		if (GetRawInputData(reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &raw, &size, sizeof(RAWINPUTHEADER)) == static_cast<UINT>(-1) ||
+			raw.header.dwType != RIM_TYPEMOUSE)
 			return;
 
-		m_curx = Position.x;
-		m_cury = Position.y;
+		InputEvent event = {};
+		event.time = time;
+		event.x = m_curx;
+		event.y = m_cury;
+		// tablets and remote desktops report absolute positions, leave those to WM_MOUSEMOVE
+		if (!(raw.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE) && (raw.data.mouse.lLastX != 0 || raw.data.mouse.lLastY != 0))
+		{
+			event.type = INPUT_MOUSE_MOVE;
+			event.dx = raw.data.mouse.lLastX;
+			event.dy = raw.data.mouse.lLastY;
+			Push(event);
+		}
+		if (raw.data.mouse.usButtonFlags & RI_MOUSE_WHEEL)
+		{
+			event.type = INPUT_MOUSE_WHEEL;
+			event.dx = event.dy = 0;
+			event.wheel = static_cast<short>(raw.data.mouse.usButtonData);
+			Push(event);
+		}
+	}
+#else
+	// No keyboard layout to ask, a US one
+	wchar_t InputMgr::Translate(eKeyCodes key, unsigned short, unsigned char flags) const
+	{
+		const unsigned code = static_cast<unsigned>(key);
+		const bool shift = IsDown(eKeyCodes::KEY_SHIFT);
+		if (code >= 'A' && code <= 'Z')
+		{
+			if (IsDown(eKeyCodes::KEY_CONTROL))
+				return static_cast<wchar_t>(code - 'A' + 1);
+			return static_cast<wchar_t>(shift != ((flags & INPUT_FLAG_CAPS_LOCK) != 0) ? code : code - 'A' + 'a');
+		}
+		if (code >= '0' && code <= '9')
+			return static_cast<wchar_t>(shift ? ")!@#$%^&*("[code - '0'] : code);
+		if (key >= eKeyCodes::KEY_NUMPAD0 && key <= eKeyCodes::KEY_NUMPAD9)
+			return static_cast<wchar_t>('0' + code - static_cast<unsigned>(eKeyCodes::KEY_NUMPAD0));
+		switch (key)
+		{
+		case eKeyCodes::KEY_SPACE: return L' ';
+		case eKeyCodes::KEY_RETURN: return L'\r';
+		case eKeyCodes::KEY_TAB: return L'\t';
+		case eKeyCodes::KEY_BACK: return L'\b';
+		case eKeyCodes::KEY_ESCAPE: return 0x1B;
+		case eKeyCodes::KEY_COMMA: return shift ? L'<' : L',';
+		case eKeyCodes::KEY_PERIOD: return shift ? L'>' : L'.';
+		case eKeyCodes::KEY_MINUS: return shift ? L'_' : L'-';
+		case eKeyCodes::KEY_PLUS: return shift ? L'+' : L'=';
+		default: return 0;
+		}
+	}
+#endif
+
+//------------------------------------------------------------------
 
-		for(auto it = m_Listener.begin(); it != m_Listener.end(); ++it)
+	wchar_t KeyEvent::Char() const
+	{
+		if (!m_translated)
 		{
-			if (!(*it))
-				continue;
-			else if ((*it)->MouseMove(MouseEvent(m_curx,m_cury))==true)
-				return;
+			m_char = m_input ? m_input->Translate(code, scan, m_flags) : 0;
+			m_translated = true;
 		}
+		return m_char;
 	}
 
-	void InputMgr::m_eventmouse(const eMouseKeyCodes Code, bool press)
+//------------------------------------------------------------------
+
+	unsigned InputMgr::Dispatch(double frameTime)
 	{
-		for(auto it = m_Listener.begin(); it != m_Listener.end(); ++it)
+		// only what is queued now; events coming in meanwhile wait for the next frame
+		unsigned count = m_events.Size();
+		unsigned dispatched = 0;
+		memset(m_pressed, 0, sizeof(m_pressed));
+		m_dispatching = true;
+		InputEvent event;
+		while (count-- > 0 && m_events.Pop(event))
 		{
-			if (!(*it))
-				continue;
-			//  
-			if (press==true)
+			if (m_recorder)
+				m_recorder->Write(event);
+			switch (event.type)
 			{
-				if ((*it)->MousePressed(MouseEventClick(Code, m_curx,m_cury))==true)
-					return;
+			case INPUT_MOUSE_MOVE:
+				m_moves++;
+				m_dx += event.dx;
+				m_dy += event.dy;
+				m_mousex = event.x;
+				m_mousey = event.y;
+				break;
+			case INPUT_MOUSE_WHEEL:
+				m_wheels++;
+				m_wheelUnits += event.wheel;
+				m_mousex = event.x;
+				m_mousey = event.y;
+				break;
+			default:
+				// what came before a click or key goes first
+				dispatched += m_flushmouse(frameTime);
+				m_dispatch(event, frameTime);
+				dispatched++;
+				break;
 			}
-			//  
-			else
+		}
+		dispatched += m_flushmouse(frameTime);
+		if (m_recorder)
+			m_recorder->Frame(frameTime);
+		m_dispatching = false;
+		if (m_tablesDirty)
+			m_buildTables();
+		return dispatched;
+	}
+
+	unsigned InputMgr::m_flushmouse(double frameTime)
+	{
+		unsigned dispatched = 0;
+		if (m_moves > 0)
+		{
+			const MouseEvent move(m_mousex, m_mousey, frameTime, m_dx, m_dy, m_moves);
+			m_coalesced += m_moves - 1;
+			m_moves = 0;
+			m_dx = m_dy = 0;
+			dispatched++;
+			InputListener *const *listeners = m_tables[TABLE_MOUSE_MOVE].data();
+			const size_t count = m_tables[TABLE_MOUSE_MOVE].size();
+			for (size_t i = 0; i < count; i++)
+				if (listeners[i] && listeners[i]->MouseMove(move))
+					break;
+		}
+		if (m_wheels > 0)
+		{
+			// whole notches; what is left of a fine wheel waits for more
+			const int notches = m_wheelUnits / WheelUnits;
+			m_wheelUnits -= notches * WheelUnits;
+			m_coalesced += notches != 0 ? m_wheels - 1 : m_wheels;
+			const unsigned wheels = m_wheels;
+			m_wheels = 0;
+			if (notches != 0)
 			{
-				if ((*it)->MouseReleased(MouseEventClick(Code, m_curx,m_cury))==true)
-					return;
+				dispatched++;
+				const MouseEventWheel wheel(notches, m_mousex, m_mousey, frameTime, wheels);
+				InputListener *const *listeners = m_tables[TABLE_MOUSE_WHEEL].data();
+				const size_t count = m_tables[TABLE_MOUSE_WHEEL].size();
+				for (size_t i = 0; i < count; i++)
+					if (listeners[i] && listeners[i]->MouseWheel(wheel))
+						break;
 			}
 		}
+		return dispatched;
+	}
+
+	void InputMgr::m_setDown(unsigned bit, bool down)
+	{
+		const unsigned mask = 1u << (bit & 31);
+		unsigned &word = m_down[bit >> 5];
+		if (down && !(word & mask))
+			m_pressed[bit >> 5] |= mask;
+		word = down ? word | mask : word & ~mask;
 	}
 
-	void InputMgr::m_mousewheel(short Value)
+	void InputMgr::m_dispatch(const InputEvent &event, double frameTime)
 	{
-		if (m_MouseWheel==Value)
+		// the state first, so that listeners asking see the event in it
+		switch (event.type)
+		{
+		case INPUT_MOUSE_PRESS:
+		case INPUT_MOUSE_RELEASE:
+			m_setDown(KeyBits + event.button, event.type == INPUT_MOUSE_PRESS);
+			break;
+		case INPUT_KEY_PRESS:
+		case INPUT_KEY_RELEASE:
+			m_setDown(static_cast<unsigned>(event.key) & 0xFF, event.type == INPUT_KEY_PRESS);
+			break;
+		case INPUT_FOCUS_LOST:
+			// no release will come for what is held now
+			memset(m_down, 0, sizeof(m_down));
 			return;
+		}
 
-		m_MouseWheel = Value;
+		switch (event.type)
+		{
+		case INPUT_MOUSE_PRESS:
+		case INPUT_MOUSE_RELEASE:
+			m_eventmouse(static_cast<eMouseKeyCodes>(event.button), event.type == INPUT_MOUSE_PRESS, event.x, event.y, frameTime);
+			break;
+		case INPUT_KEY_PRESS:
+		case INPUT_KEY_RELEASE:
+			m_eventkey(event.key, event.scan, event.flags, event.type == INPUT_KEY_PRESS, frameTime);
+			break;
+		}
+	}
 
-		for(auto it = m_Listener.begin(); it != m_Listener.end(); ++it)
+	void InputMgr::m_eventmouse(const eMouseKeyCodes Code, bool press, int x, int y, double frameTime)
+	{
+		const MouseEventClick click(Code, x, y, frameTime);
+		// the table does not change size during Dispatch, removed listeners are null
+		InputListener *const *listeners = m_tables[TABLE_MOUSE_BUTTON].data();
+		const size_t count = m_tables[TABLE_MOUSE_BUTTON].size();
+		//  
+		if (press==true)
 		{
-			if (!(*it))
-				continue;
-			else if ((*it)->MouseWheel(MouseEventWheel(m_MouseWheel, m_curx,m_cury))==true)
-				return;
+			for (size_t i = 0; i < count; i++)
+				if (listeners[i] && listeners[i]->MousePressed(click))
+					return;
+		}
+		//  
+		else
+		{
+			for (size_t i = 0; i < count; i++)
+				if (listeners[i] && listeners[i]->MouseReleased(click))
+					return;
 		}
 	}
 
-	void InputMgr::m_eventkey(const eKeyCodes KeyCode, const wchar_t ch, bool press)
+	void InputMgr::m_eventkey(const eKeyCodes KeyCode, unsigned short scan, unsigned char flags, bool press, double frameTime)
 	{
-		for(auto it = m_Listener.begin(); it != m_Listener.end(); ++it)
+		// one event for all, so the character is worked out once at most
+		const KeyEvent key(KeyCode, scan, flags, this, frameTime);
+		InputListener *const *listeners = m_tables[TABLE_KEY].data();
+		const size_t count = m_tables[TABLE_KEY].size();
+		//  
+		if (press==true)
 		{
-			if (!(*it))
-				continue;
-			//  
-			if (press==true)
-			{
-				if ((*it)->KeyPressed(KeyEvent(ch,KeyCode))==true)
+			for (size_t i = 0; i < count; i++)
+				if (listeners[i] && listeners[i]->KeyPressed(key))
 					return;
-			}
-			//  
-			else
-			{
-				if ((*it)->KeyReleased(KeyEvent(ch,KeyCode))==true)
+		}
+		//  
+		else
+		{
+			for (size_t i = 0; i < count; i++)
+				if (listeners[i] && listeners[i]->KeyReleased(key))
 					return;
-			}
 		}
 	}
 
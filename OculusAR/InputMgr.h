@@ -1,43 +1,216 @@
 #pragma once
 
 #include "InputCodes.h"
-#include "Headers.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <vector>
+#ifdef _WIN32
+#	include "Headers.h"
+#endif
 
 namespace D3D11Framework
 {
 //------------------------------------------------------------------
 
 	class InputListener;
+	class InputRecorder;
 
+	enum eInputEventType
+	{
+		INPUT_MOUSE_MOVE = 0,
+		INPUT_MOUSE_PRESS,
+		INPUT_MOUSE_RELEASE,
+		INPUT_MOUSE_WHEEL,
+		INPUT_KEY_PRESS,
+		INPUT_KEY_RELEASE,
+		// the window lost the keyboard, nothing is held any more
+		INPUT_FOCUS_LOST
+	};
+
+	enum eInputEventFlags
+	{
+		INPUT_FLAG_CAPS_LOCK = 1
+	};
+
+	// Kinds of events a listener handles
+	enum eInputListen
+	{
+		LISTEN_MOUSE_MOVE = 1,
+		LISTEN_MOUSE_BUTTON = 2,	// MousePressed, MouseReleased
+		LISTEN_MOUSE_WHEEL = 4,
+		LISTEN_KEY = 8,				// KeyPressed, KeyReleased
+		LISTEN_ALL = 15
+	};
+
+	// One input event as the message thread saw it
+	struct InputEvent
+	{
+		double time;			// Clock::Now() when the message came in
+		unsigned char type;		// eInputEventType
+		unsigned char button;	// eMouseKeyCodes of a mouse button
+		unsigned char flags;	// eInputEventFlags
+		eKeyCodes key;
+		unsigned short scan;	// scan code of a key
+		int x;					// cursor in window coordinates
+		int y;
+		int dx;					// relative motion of a mouse move
+		int dy;
+		int wheel;				// wheel units, WheelUnits a notch
+	};
+
+	// The window procedure only puts events into a queue, the frame loop
+	// hands them to the listeners in one go at a fixed point of the frame.
+	// The listeners and whatever state they keep are thus only ever touched
+	// from the frame thread, and everything a frame reads from them is
+	// settled before the frame starts.
+	//
+	// Dispatch also keeps which keys and mouse buttons are held, so the
+	// frame can simply ask instead of following the events.
+	//
+	// A mouse reports a few hundred to thousands of times a second. Dispatch
+	// adds up the moves and wheel turns that follow each other into one
+	// MouseMove with the relative motion and one MouseWheel, so the listeners
+	// see a couple of mouse events a frame at any polling rate. With the raw
+	// mouse the motion comes from WM_INPUT, unaccelerated and in mouse counts.
+	//
+	// Every kind of event has its own array of the listeners that handle it,
+	// in priority order, so an event only goes to those that want it.
 	class InputMgr
 	{
 	public:
+		// Events the queue holds, a power of two
+		static const unsigned Capacity = 4096;
+		// Wheel units of a notch, WHEEL_DELTA
+		static const int WheelUnits = 120;
+
+		InputMgr();
+
 		void Init();
 		void Close();
 
+		// --- message thread ---
+
+#ifdef _WIN32
+		// Translates a window message to events and queues them
 		void Run(const UINT &msg, WPARAM wParam, LPARAM lParam);
 
-		void AddListener(InputListener *Listener);
+		// Takes mouse motion and wheel from WM_INPUT of window from now on.
+		// False if the raw mouse cannot be registered, the window messages
+		// are used then.
+		bool UseRawMouse(HWND window);
+#endif
 
-		//  
-		void SetWinRect(const RECT &winrect);
+		// Queues an event. False if the queue is full and it is dropped.
+		bool Push(const InputEvent &event);
+
+		// --- frame thread ---
+
+		// Listeners of higher priority get an event first, those of equal
+		// priority in the order they were added. kinds are the eInputListen
+		// the listener handles, it gets no other events. Adding from inside
+		// a listener takes effect after the current Dispatch; a listener
+		// removed from inside one gets no further events, so it may be
+		// deleted right away.
+		void AddListener(InputListener *Listener, int priority = 0, unsigned kinds = LISTEN_ALL);
+		void RemoveListener(InputListener *Listener);
+
+		// Hands the events queued so far to the listeners in order, stamped
+		// with frameTime, mouse moves and wheel turns merged as above.
+		// Returns the number of events handed on.
+		unsigned Dispatch(double frameTime);
+
+		// Dispatch writes every event it takes from the queue to recorder,
+		// and its frame time; nullptr stops. See InputReplay for feeding a
+		// recording back in.
+		void RecordTo(InputRecorder *recorder) { m_recorder = recorder; }
+
+		// Held now, i.e. after the events Dispatch has handed on so far.
+		// Inside a listener this includes the event at hand.
+		bool IsDown(eKeyCodes key) const { return m_test(m_down, static_cast<unsigned>(key) & 0xFF); }
+		bool IsDown(eMouseKeyCodes button) const { return m_test(m_down, KeyBits + button); }
+		// Went down in the events of the last Dispatch; key repeat does not count
+		bool WasPressedThisFrame(eKeyCodes key) const { return m_test(m_pressed, static_cast<unsigned>(key) & 0xFF); }
+		bool WasPressedThisFrame(eMouseKeyCodes button) const { return m_test(m_pressed, KeyBits + button); }
+
+		// Character key types with the modifiers held now, 0 if none.
+		// This is what KeyEvent::Char asks.
+		wchar_t Translate(eKeyCodes key, unsigned short scan, unsigned char flags) const;
+
+		// Events dropped for a full queue, and mouse events Dispatch merged
+		// into others
+		unsigned long long Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+		unsigned long long Coalesced() const { return m_coalesced; }
 
 	private:
+		InputMgr(const InputMgr&);
+		InputMgr &operator=(const InputMgr&);
+
+		// one bit per key (eKeyCodes), then one per mouse button
+		static const unsigned KeyBits = 256;
+		static const unsigned StateWords = (KeyBits + MOUSE_MAX + 31) / 32;
+
+		static bool m_test(const unsigned *bits, unsigned bit) { return (bits[bit >> 5] >> (bit & 31) & 1) != 0; }
+		void m_setDown(unsigned bit, bool down);
+
+		enum eListenerTable
+		{
+			TABLE_MOUSE_MOVE = 0,
+			TABLE_MOUSE_BUTTON,
+			TABLE_MOUSE_WHEEL,
+			TABLE_KEY,
+
+			TABLE_MAX
+		};
+
+		struct ListenerEntry
+		{
+			InputListener *listener;
+			int priority;
+			unsigned kinds;
+		};
+
+		// Rebuilds the tables from m_registered
+		void m_buildTables();
+
+#ifdef _WIN32
 		//   
-		void m_eventcursor();
+		void m_eventcursor(LPARAM lParam, double time);
+		void m_rawinput(LPARAM lParam, double time);
+#endif
+		void m_dispatch(const InputEvent &event, double frameTime);
+		// Hands on the motion and wheel added up since the last call
+		unsigned m_flushmouse(double frameTime);
 		//   
-		void m_eventmouse(const eMouseKeyCodes KeyCode, bool press);
-		//   
-		void m_mousewheel(short Value);
+		void m_eventmouse(const eMouseKeyCodes KeyCode, bool press, int x, int y, double frameTime);
 		//   
-		void m_eventkey(const eKeyCodes KeyCode, const wchar_t ch, bool press);
+		void m_eventkey(const eKeyCodes KeyCode, unsigned short scan, unsigned char flags, bool press, double frameTime);
+
+		SpscQueue<InputEvent, Capacity> m_events;
+		std::atomic<unsigned long long> m_dropped;
 
-		std::list<InputListener*> m_Listener;
+		// frame thread
+		// listeners in priority order, and those of each kind of event
+		std::vector<ListenerEntry> m_registered;
+		std::vector<InputListener*> m_tables[TABLE_MAX];
+		bool m_dispatching;
+		bool m_tablesDirty;
+		InputRecorder *m_recorder;
+		unsigned long long m_coalesced;
+		unsigned m_down[StateWords];
+		unsigned m_pressed[StateWords];
+		// mouse events added up, the wheel units left over from whole notches
+		unsigned m_moves;
+		unsigned m_wheels;
+		int m_dx;
+		int m_dy;
+		int m_wheelUnits;
+		int m_mousex;
+		int m_mousey;
 
-		RECT m_windowrect;
+		// message thread
+		bool m_rawMouse;
 		int m_curx;
 		int m_cury;
-		int m_MouseWheel;
 	};
 
 //------------------------------------------------------------------
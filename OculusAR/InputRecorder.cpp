@@ -0,0 +1,314 @@
+#include "InputRecorder.h"
+#include "Clock.h"
+#include "MappedFile.h"
+#include <cmath>
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static const unsigned INPUT_RECORDING_MAGIC = 0x4952414F;	// "OARI"
+	static const unsigned INPUT_RECORDING_VERSION = 1;
+	// entry type of a Dispatch, after the eInputEventType
+	static const unsigned RECORD_FRAME = 0xFF;
+
+	static long long s_nanoseconds(double seconds)
+	{
+		return static_cast<long long>(std::floor(seconds * 1e9 + 0.5));
+	}
+
+	InputRecorder::InputRecorder() : m_file(nullptr), m_size(0), m_lastTime(0), m_lastx(0), m_lasty(0), m_bytes(0), m_entries(0)
+	{
+	}
+
+	InputRecorder::~InputRecorder()
+	{
+		Close();
+	}
+
+	bool InputRecorder::Open(const char *path)
+	{
+		Close();
+		m_file = fopen(path, "wb");
+		if (!m_file)
+			return false;
+		setvbuf(m_file, nullptr, _IOFBF, 1 << 16);
+
+		const InputRecordingHeader header = { INPUT_RECORDING_MAGIC, INPUT_RECORDING_VERSION };
+		fwrite(&header, sizeof(header), 1, m_file);
+		m_bytes = sizeof(header);
+		m_entries = 0;
+		m_lastTime = 0;
+		m_lastx = m_lasty = 0;
+		return true;
+	}
+
+	void InputRecorder::Close()
+	{
+		if (!m_file)
+			return;
+		fclose(m_file);
+		m_file = nullptr;
+	}
+
+	void InputRecorder::m_begin(unsigned type, double time)
+	{
+		m_size = 0;
+		m_entry[m_size++] = static_cast<unsigned char>(type);
+		const long long ns = s_nanoseconds(time);
+		// the first entry carries the whole time
+		m_int(ns - m_lastTime);
+		m_lastTime = ns;
+	}
+
+	void InputRecorder::m_uint(unsigned long long value)
+	{
+		while (value >= 0x80)
+		{
+			m_entry[m_size++] = static_cast<unsigned char>(value | 0x80);
+			value >>= 7;
+		}
+		m_entry[m_size++] = static_cast<unsigned char>(value);
+	}
+
+	void InputRecorder::m_int(long long value)
+	{
+		m_uint(static_cast<unsigned long long>(value) << 1 ^ static_cast<unsigned long long>(value >> 63));
+	}
+
+	void InputRecorder::m_end()
+	{
+		fwrite(m_entry, 1, m_size, m_file);
+		m_bytes += m_size;
+		m_entries++;
+	}
+
+	void InputRecorder::Write(const InputEvent &event)
+	{
+		if (!m_file)
+			return;
+		m_begin(event.type, event.time);
+		switch (event.type)
+		{
+		case INPUT_MOUSE_MOVE:
+		case INPUT_MOUSE_PRESS:
+		case INPUT_MOUSE_RELEASE:
+		case INPUT_MOUSE_WHEEL:
+			if (event.type == INPUT_MOUSE_MOVE)
+			{
+				m_int(event.dx);
+				m_int(event.dy);
+			}
+			else if (event.type == INPUT_MOUSE_WHEEL)
+				m_int(event.wheel);
+			else
+				m_entry[m_size++] = event.button;
+			m_int(static_cast<long long>(event.x) - m_lastx);
+			m_int(static_cast<long long>(event.y) - m_lasty);
+			m_lastx = event.x;
+			m_lasty = event.y;
+			break;
+		case INPUT_KEY_PRESS:
+		case INPUT_KEY_RELEASE:
+			m_entry[m_size++] = static_cast<unsigned char>(event.key);
+			m_entry[m_size++] = event.flags;
+			m_uint(event.scan);
+			break;
+		}
+		m_end();
+	}
+
+	void InputRecorder::Frame(double frameTime)
+	{
+		if (!m_file)
+			return;
+		m_begin(RECORD_FRAME, frameTime);
+		m_end();
+	}
+
+//------------------------------------------------------------------
+
+	// Reads the numbers InputRecorder writes; a read past the end sets failed
+	class InputRecordingReader
+	{
+	public:
+		InputRecordingReader(const unsigned char *data, size_t size) : failed(false), m_p(data), m_end(data + size) {}
+
+		bool AtEnd() const { return m_p == m_end; }
+
+		unsigned Byte()
+		{
+			if (m_p == m_end)
+			{
+				failed = true;
+				return 0;
+			}
+			return *m_p++;
+		}
+
+		unsigned long long Uint()
+		{
+			unsigned long long value = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7)
+			{
+				const unsigned b = Byte();
+				value |= static_cast<unsigned long long>(b & 0x7F) << shift;
+				if (!(b & 0x80))
+					return value;
+			}
+			failed = true;
+			return 0;
+		}
+
+		long long Int()
+		{
+			const unsigned long long value = Uint();
+			return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+		}
+
+		bool failed;
+
+	private:
+		const unsigned char *m_p;
+		const unsigned char *m_end;
+	};
+
+	InputReplay::InputReplay(bool realtime) : m_realtime(realtime), m_next(0), m_base(0.0)
+	{
+	}
+
+	bool InputReplay::Open(const char *path)
+	{
+		Close();
+		MappedFile file;
+		if (!file.Open(path))
+			return false;
+		if (!m_decode(file.Data(), file.Size()))
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void InputReplay::Close()
+	{
+		m_events.clear();
+		m_frames.clear();
+		Rewind();
+	}
+
+	void InputReplay::Rewind()
+	{
+		m_next = 0;
+		m_base = 0.0;
+	}
+
+	bool InputReplay::m_decode(const unsigned char *data, size_t size)
+	{
+		InputRecordingHeader header;
+		if (size < sizeof(header))
+			return false;
+		memcpy(&header, data, sizeof(header));
+		if (header.magic != INPUT_RECORDING_MAGIC || header.version != INPUT_RECORDING_VERSION)
+			return false;
+
+		InputRecordingReader reader(data + sizeof(header), size - sizeof(header));
+		long long time = 0;
+		int x = 0, y = 0;
+		// events of the Dispatch being read; they only count once its mark is there
+		size_t complete = 0;
+		while (!reader.AtEnd())
+		{
+			const unsigned type = reader.Byte();
+			time += reader.Int();
+			InputEvent event = {};
+			event.type = static_cast<unsigned char>(type);
+			event.time = static_cast<double>(time) * 1e-9;
+			switch (type)
+			{
+			case RECORD_FRAME:
+				{
+					if (reader.failed)
+						break;
+					const Frame frame = { event.time, static_cast<unsigned>(m_events.size()) };
+					m_frames.push_back(frame);
+					complete = m_events.size();
+				}
+				continue;
+			case INPUT_MOUSE_MOVE:
+			case INPUT_MOUSE_PRESS:
+			case INPUT_MOUSE_RELEASE:
+			case INPUT_MOUSE_WHEEL:
+				if (type == INPUT_MOUSE_MOVE)
+				{
+					event.dx = static_cast<int>(reader.Int());
+					event.dy = static_cast<int>(reader.Int());
+				}
+				else if (type == INPUT_MOUSE_WHEEL)
+					event.wheel = static_cast<int>(reader.Int());
+				else
+				{
+					event.button = static_cast<unsigned char>(reader.Byte());
+					if (event.button >= MOUSE_MAX)
+						reader.failed = true;
+				}
+				x += static_cast<int>(reader.Int());
+				y += static_cast<int>(reader.Int());
+				event.x = x;
+				event.y = y;
+				break;
+			case INPUT_KEY_PRESS:
+			case INPUT_KEY_RELEASE:
+				event.key = static_cast<eKeyCodes>(reader.Byte());
+				event.flags = static_cast<unsigned char>(reader.Byte());
+				event.scan = static_cast<unsigned short>(reader.Uint());
+				break;
+			case INPUT_FOCUS_LOST:
+				break;
+			default:
+				reader.failed = true;
+				break;
+			}
+			if (reader.failed)
+				break;
+			m_events.push_back(event);
+		}
+		// a recording cut off in the middle of a Dispatch ends with the one before
+		m_events.resize(complete);
+		return true;
+	}
+
+	bool InputReplay::NextFrame(InputMgr &input, double &frameTime)
+	{
+		if (m_next >= m_frames.size())
+			return false;
+
+		const Frame &frame = m_frames[m_next];
+		const unsigned begin = m_next > 0 ? m_frames[m_next - 1].end : 0;
+		m_next++;
+
+		double shift = 0.0;
+		if (m_realtime)
+		{
+			// keep the recorded spacing between frames
+			const double first = m_frames[0].time;
+			if (m_base == 0.0)
+				m_base = Clock::Now() - (frame.time - first);
+			Clock::Sleep(m_base + (frame.time - first) - Clock::Now());
+			shift = m_base - first;
+		}
+
+		for (unsigned i = begin; i < frame.end; i++)
+		{
+			InputEvent event = m_events[i];
+			event.time += shift;
+			input.Push(event);
+		}
+		frameTime = frame.time + shift;
+		return true;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+#include "InputMgr.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Recording of the input stream as InputMgr dispatches it: every event
+	// with the time it came in, and a mark for every Dispatch with its frame
+	// time, so a replay hands the listeners the same events in the same
+	// frames.
+	//
+	// File layout:
+	//   InputRecordingHeader
+	//   entries, each a type byte (eInputEventType, or RECORD_FRAME for a
+	//   Dispatch) and the time since the previous entry in nanoseconds,
+	//   followed by the fields of the type
+	// Numbers are variable length, 7 bits a byte, signed ones zigzag coded;
+	// cursor positions are stored relative to the previous one. A mouse move
+	// takes about 9 bytes. There is no index or trailer, a recording that
+	// was cut off just ends with its last complete Dispatch.
+
+	struct InputRecordingHeader
+	{
+		unsigned magic;
+		unsigned version;
+	};
+
+	class InputRecorder
+	{
+	public:
+		InputRecorder();
+		~InputRecorder();
+
+		bool Open(const char *path);
+		void Close();
+		bool IsOpen() const { return m_file != nullptr; }
+
+		// Called by InputMgr::Dispatch for every event it takes from the
+		// queue, then once with the frame time
+		void Write(const InputEvent &event);
+		void Frame(double frameTime);
+
+		// Bytes and entries written so far
+		unsigned long long Bytes() const { return m_bytes; }
+		unsigned long long Entries() const { return m_entries; }
+
+	private:
+		InputRecorder(const InputRecorder&);
+		InputRecorder &operator=(const InputRecorder&);
+
+		void m_begin(unsigned type, double time);
+		void m_uint(unsigned long long value);
+		void m_int(long long value);
+		void m_end();
+
+		FILE *m_file;
+		unsigned char m_entry[64];
+		unsigned m_size;
+		long long m_lastTime;
+		int m_lastx;
+		int m_lasty;
+		unsigned long long m_bytes;
+		unsigned long long m_entries;
+	};
+
+	// Feeds a recording back into an InputMgr, one recorded Dispatch at a
+	// time, with no window behind it. The events go through Push and
+	// Dispatch like live ones.
+	class InputReplay
+	{
+	public:
+		// realtime waits until a frame is due like it was recorded and moves
+		// the times to the clock of now; otherwise every frame comes at once
+		// with the recorded times, which makes a run reproducible.
+		explicit InputReplay(bool realtime = false);
+
+		bool Open(const char *path);
+		void Close();
+
+		size_t FrameCount() const { return m_frames.size(); }
+		size_t EventCount() const { return m_events.size(); }
+		// Time span covered by the recording
+		double StartTime() const { return m_frames.empty() ? 0.0 : m_frames.front().time; }
+		double EndTime() const { return m_frames.empty() ? 0.0 : m_frames.back().time; }
+
+		// Queues the events of the next recorded Dispatch into input and
+		// gives the frame time to Dispatch them with. False at the end.
+		bool NextFrame(InputMgr &input, double &frameTime);
+		void Rewind();
+
+	private:
+		struct Frame
+		{
+			double time;
+			unsigned end;	// one past its last event
+		};
+
+		bool m_decode(const unsigned char *data, size_t size);
+
+		std::vector<InputEvent> m_events;
+		std::vector<Frame> m_frames;
+		bool m_realtime;
+		size_t m_next;
+		double m_base;
+	};
+
+//------------------------------------------------------------------
+}
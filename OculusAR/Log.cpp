@@ -1,76 +1,249 @@
-#include "Headers.h"
 #include "Log.h"
+#include "Clock.h"
+#include <algorithm>
+#include <clocale>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
 
 #define LOGNAME "log.txt"
+#define BINARY_LOGNAME "log.bin"
 
 namespace D3D11Framework
 {
 //------------------------------------------------------------------
-	
+
+	// Lines the writer collects before one write to the console and the file
+	static const size_t BATCH_SIZE = 64 * 1024;
+	// Longest line of a message with deferred formatting, and longest format kept in log.bin
+	static const unsigned MAX_LINE = 1024;
+	static const unsigned MAX_FORMAT = 4096;
+	// Writer nap when the ring is empty
+	static const double IDLE_SLEEP = 0.001;
+	// How long Err waits for room in a full ring before it drops
+	static const unsigned long long ERROR_WAIT_NS = 1000000;
+
+	// By eLogLevel
+	static const char *s_levelText[] = { "*DEBUG: ", "", "*ERROR: " };
+
+	static FILE *s_open(const char *path, const char *mode)
+	{
+#ifdef _WIN32
+		FILE *file = nullptr;
+		return fopen_s(&file, path, mode) == 0 ? file : nullptr;
+#else
+		return fopen(path, mode);
+#endif
+	}
+
+	// Local date and time as mm/dd/yy and hh:mm:ss, like _strdate and _strtime
+	static void s_now(char (&date)[9], char (&timer)[9])
+	{
+#ifdef _WIN32
+		_strtime_s(timer, 9);
+		_strdate_s(date, 9);
+#else
+		const time_t now = time(nullptr);
+		tm local;
+		localtime_r(&now, &local);
+		strftime(timer, sizeof(timer), "%H:%M:%S", &local);
+		strftime(date, sizeof(date), "%m/%d/%y", &local);
+#endif
+	}
+
+	static void s_writeHeader(FILE *file, const char *date, const char *timer)
+	{
+		fprintf(file, " : %s %s.\n", date, timer);
+		fprintf(file, "---------------------------------------\n\n");
+	}
+
+	static void s_writeFooter(FILE *file, const char *date, const char *timer)
+	{
+		fprintf(file, "\n---------------------------------------\n");
+		fprintf(file, " : %s %s.", date, timer);
+	}
+
+	// One line of the text log, the same from the writer and from Decode
+	static int s_formatLine(char *out, size_t size, unsigned long long ns, int level, const char *text, unsigned length)
+	{
+		const char *levelText = level >= LOG_LEVEL_DEBUG && level <= LOG_LEVEL_ERROR ? s_levelText[level] : "";
+		return snprintf(out, size, "%10.6f: %s%.*s\n", ns * 1e-9, levelText, static_cast<int>(length), text);
+	}
+
+	// Packs the arguments of a printf format for LogArgs::Format, false if
+	// Format would not print them the same or they do not all fit
+	static bool s_packArgs(const char *format, va_list args, LogArgs &packed)
+	{
+		for (const char *p = strchr(format, '%'); p; p = strchr(p, '%'))
+		{
+			p++;
+			if (*p == '%')
+			{
+				p++;
+				continue;
+			}
+			while (*p && strchr("-+ #0", *p))
+				p++;
+			while ((*p >= '0' && *p <= '9') || *p == '.')
+				p++;
+
+			// 0 for int, 1 for long, 2 for long long
+			const int sizeLongs = sizeof(size_t) == sizeof(long long) ? 2 : 0;
+			int longs = 0;
+			for (;; p++)
+			{
+				if (*p == 'l')
+					longs++;
+				else if (*p == 'j' || *p == 'q')
+					longs = 2;
+				else if (*p == 'z' || *p == 't')
+					longs = sizeLongs;
+				else if (*p == 'I')
+				{
+					// I32, I64 or I for size_t
+					longs = p[1] == '3' && p[2] == '2' ? 0 : (p[1] == '6' && p[2] == '4' ? 2 : sizeLongs);
+					while (p[1] >= '0' && p[1] <= '9')
+						p++;
+				}
+				else
+					break;
+			}
+
+			const char conversion = *p++;
+			if (conversion == 'd' || conversion == 'i')
+			{
+				if (longs == 0)
+					packed.Add(va_arg(args, int));
+				else if (longs == 1)
+					packed.Add(va_arg(args, long));
+				else
+					packed.Add(va_arg(args, long long));
+			}
+			else if (conversion && strchr("ouxX", conversion))
+			{
+				if (longs == 0)
+					packed.Add(va_arg(args, unsigned));
+				else if (longs == 1)
+					packed.Add(va_arg(args, unsigned long));
+				else
+					packed.Add(va_arg(args, unsigned long long));
+			}
+			else if (conversion == 'c' && longs == 0)
+				packed.Add(va_arg(args, int));
+			else if (conversion == 's' && longs == 0)
+				packed.Add(va_arg(args, const char*));
+			else if (conversion && strchr("fFeEgGaA", conversion))
+				packed.Add(va_arg(args, double));
+			else
+				return false;
+		}
+		return !packed.Full();
+	}
+
+	static int s_formatDropped(char *out, size_t size, unsigned long long ns, unsigned long long dropped)
+	{
+		return snprintf(out, size, "%10.6f: *ERROR: log full, %llu messages dropped\n", ns * 1e-9, dropped);
+	}
+
 	Log *Log::m_instance = nullptr;
 
-	Log::Log()
+	Log::Log(const char *path, bool console, bool binary) :
+		m_file(nullptr), m_console(console), m_binary(binary), m_start(0), m_slots(nullptr), m_enqueue(0), m_dequeue(0), m_reportedDrops(0),
+		m_batch(nullptr), m_batchUsed(0), m_binaryBatch(nullptr), m_binaryUsed(0), m_written(0), m_dropped(0), m_truncated(0), m_running(false)
 	{	
 		if (!m_instance)
 		{
-			m_file = nullptr;
 			m_instance = this;
-			m_init();
+			m_init(path ? path : (binary ? BINARY_LOGNAME : LOGNAME));
 		}
 		else
-			Err("Log   ");
+			m_instance->Err("Log   ");
 	}
 
 	Log::~Log()
 	{
+		if (m_instance != this)
+			return;
 		m_close();
 		m_instance = nullptr;
 	}
 
-	void Log::m_init()
+	void Log::m_init(const char *path)
 	{	
 		setlocale(LC_ALL, "rus");
 
-		if( fopen_s(&m_file, LOGNAME, "w") == 0 )
+		// Everything the log calls need is allocated here, once
+		m_slots = new Slot[Capacity];
+		for (unsigned i = 0; i < Capacity; i++)
+			m_slots[i].sequence.store(i, std::memory_order_relaxed);
+		m_batch = new char[BATCH_SIZE];
+		if (m_binary)
+			m_binaryBatch = new char[BATCH_SIZE];
+		m_start = Clock::NowNs();
+
+		m_file = s_open(path, m_binary ? "wb" : "w");
+		if (m_file)
 		{
-			char timer[9];
-			_strtime_s(timer,9);
-			char date[9];
-			_strdate_s(date,9);
-			fprintf(m_file, " : %s %s.\n", date, timer);
-			fprintf(m_file, "---------------------------------------\n\n");
+			char date[9], timer[9];
+			s_now(date, timer);
+			if (m_binary)
+			{
+				fwrite(LogBinary::Magic, 1, sizeof(LogBinary::Magic), m_file);
+				fwrite(&LogBinary::Version, sizeof(LogBinary::Version), 1, m_file);
+				fwrite(date, 1, LogBinary::DateSize, m_file);
+				fwrite(timer, 1, LogBinary::DateSize, m_file);
+			}
+			else
+				s_writeHeader(m_file, date, timer);
 		}		
 		else
 		{
 			printf("    ...\n");
 			m_file = nullptr;
 		}
+
+		m_running = true;
+		m_thread = std::thread(&Log::m_run, this);
 	}
 
 	void Log::m_close()
 	{
+		// The writer empties the ring before it ends
+		m_running = false;
+		if (m_thread.joinable())
+			m_thread.join();
+		delete[] m_slots;
+		m_slots = nullptr;
+		delete[] m_batch;
+		m_batch = nullptr;
+		delete[] m_binaryBatch;
+		m_binaryBatch = nullptr;
+
 		if (!m_file)
 			return;
 
-		char timer[9];
-		_strtime_s(timer,9);
-		char date[9];
-		_strdate_s(date,9);
-		fprintf(m_file, "\n---------------------------------------\n");
-		fprintf(m_file, " : %s %s.", date, timer);
+		char date[9], timer[9];
+		s_now(date, timer);
+		if (m_binary)
+		{
+			const unsigned char type = LogBinary::RECORD_END;
+			fwrite(&type, 1, 1, m_file);
+			fwrite(date, 1, LogBinary::DateSize, m_file);
+			fwrite(timer, 1, LogBinary::DateSize, m_file);
+		}
+		else
+			s_writeFooter(m_file, date, timer);
 		fclose(m_file);
+		m_file = nullptr;
 	}
 
 	void Log::Print(const char *message, ...)
 	{
 		va_list args;
 		va_start(args, message);
-		int len = _vscprintf( message, args ) + 1;
-		char *buffer = static_cast<char*>( malloc(len*sizeof(char)) );
-		vsprintf_s( buffer, len, message, args );
-		m_print("", buffer);
+		m_push(LOG_LEVEL_PRINT, message, args);
 		va_end(args);
-		free(buffer);
 	}
 
 	void Log::Debug(const char *message, ...)
@@ -78,39 +251,405 @@ namespace D3D11Framework
 #ifdef _DEBUG
 		va_list args;
 		va_start(args, message);
-		int len = _vscprintf( message, args ) + 1;
-		char *buffer = static_cast<char*>( malloc(len*sizeof(char)) );
-		vsprintf_s( buffer, len, message, args );
-		m_print("*DEBUG: ", buffer);
+		m_push(LOG_LEVEL_DEBUG, message, args);
 		va_end(args);
-		free(buffer);
 #endif
 	}
+
 	void Log::Err(const char *message, ...)
 	{
 		va_list args;
 		va_start(args, message);
-		int len = _vscprintf( message, args ) + 1;
-		char *buffer = static_cast<char*>( malloc(len*sizeof(char)) );
-		vsprintf_s( buffer, len, message, args );
-		m_print("*ERROR: ", buffer);
+		m_push(LOG_LEVEL_ERROR, message, args);
 		va_end(args);
-		free(buffer);
 	}
 
-	void Log::m_print(const char *levtext, const char *text)
+	void Log::Flush()
+	{
+		const unsigned long long target = m_enqueue.load(std::memory_order_acquire);
+		while (Written() < target)
+			std::this_thread::yield();
+	}
+
+	unsigned long long Log::m_claim(int level, Slot **slot, unsigned long long *pos)
+	{
+		const unsigned long long time = Clock::NowNs();
+		const unsigned long long deadline = level == LOG_LEVEL_ERROR ? time + ERROR_WAIT_NS : 0;
+
+		// Claim the next free slot. Its sequence says whether the writer
+		// is done with it (== pos), still behind (< pos) or another thread
+		// took pos first (> pos).
+		unsigned long long next = m_enqueue.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Slot *candidate = &m_slots[next & (Capacity - 1)];
+			const unsigned long long sequence = candidate->sequence.load(std::memory_order_acquire);
+			if (sequence == next)
+			{
+				if (m_enqueue.compare_exchange_weak(next, next + 1, std::memory_order_relaxed))
+				{
+					*slot = candidate;
+					*pos = next;
+					return time;
+				}
+			}
+			else if (sequence < next)
+			{
+				// full
+				if (deadline == 0 || Clock::NowNs() > deadline)
+				{
+					m_dropped.fetch_add(1, std::memory_order_relaxed);
+					*slot = nullptr;
+					return time;
+				}
+				std::this_thread::yield();
+				next = m_enqueue.load(std::memory_order_relaxed);
+			}
+			else
+				next = m_enqueue.load(std::memory_order_relaxed);
+		}
+	}
+
+	void Log::m_publish(Slot *slot, unsigned long long pos, unsigned long long time, int level,
+		const LogFormat *format, unsigned formatLength, unsigned length, bool truncated)
 	{
-		char timer[9];
-		_strtime_s(timer,9);
-		clock_t cl = clock();
+		if (truncated)
+			m_truncated.fetch_add(1, std::memory_order_relaxed);
+		slot->time = time;
+		slot->level = level;
+		slot->format = format;
+		slot->formatLength = formatLength;
+		slot->length = length;
+		slot->sequence.store(pos + 1, std::memory_order_release);
+	}
+
+	void Log::m_push(int level, const char *message, va_list args)
+	{
+		Slot *slot = nullptr;
+		unsigned long long pos = 0;
+		const unsigned long long time = m_claim(level, &slot, &pos);
+		if (!slot)
+			return;
+
+		// the format and the raw arguments, the writer formats them
+		const size_t formatLength = strlen(message) + 1;
+		if (formatLength < MaxMessage)
+		{
+			va_list copy;
+			va_copy(copy, args);
+			LogArgs packed(reinterpret_cast<unsigned char*>(slot->text) + formatLength, static_cast<unsigned>(MaxMessage - formatLength));
+			const bool deferred = s_packArgs(message, copy, packed);
+			va_end(copy);
+			if (deferred)
+			{
+				memcpy(slot->text, message, formatLength);
+				m_publish(slot, pos, time, level, nullptr, static_cast<unsigned>(formatLength),
+					static_cast<unsigned>(formatLength) + packed.Size(), false);
+				return;
+			}
+		}
+
+		int length = vsnprintf(slot->text, MaxMessage, message, args);
+		const bool truncated = length >= static_cast<int>(MaxMessage);
+		if (length < 0)
+			length = 0;
+		else if (truncated)
+			length = MaxMessage - 1;
+		m_publish(slot, pos, time, level, nullptr, 0, static_cast<unsigned>(length), truncated);
+	}
+
+	void Log::m_run()
+	{
+		while (m_running)
+		{
+			if (!m_drain())
+				Clock::Sleep(IDLE_SLEEP);
+		}
+		m_drain();
+	}
+
+	bool Log::m_drain()
+	{
+		// the console and a text file get text, a binary file the records
+		const bool text = m_console || !m_binary;
+		bool any = false;
+		unsigned long long pending = 0;
+		for (;;)
+		{
+			Slot &slot = m_slots[m_dequeue & (Capacity - 1)];
+			if (slot.sequence.load(std::memory_order_acquire) != m_dequeue + 1)
+				break;
+
+			// room for the longest line and record
+			if (m_batchUsed + MAX_LINE + 64 > BATCH_SIZE || m_binaryUsed + MaxMessage + 64 > BATCH_SIZE)
+			{
+				m_writeBatch();
+				m_written.fetch_add(pending, std::memory_order_release);
+				pending = 0;
+			}
+
+			const unsigned long long ns = slot.time - m_start;
+			// what Print, Debug and Err left to format, cut as they used to
+			const char *message = slot.text;
+			unsigned messageLength = slot.length;
+			char deferred[MAX_LINE];
+			if (slot.formatLength > 0)
+			{
+				messageLength = LogArgs::Format(slot.text, reinterpret_cast<const unsigned char*>(slot.text) + slot.formatLength,
+					slot.length - slot.formatLength, deferred, sizeof(deferred));
+				if (messageLength >= MaxMessage)
+				{
+					messageLength = MaxMessage - 1;
+					m_truncated.fetch_add(1, std::memory_order_relaxed);
+				}
+				message = deferred;
+			}
+			const unsigned short length16 = static_cast<unsigned short>(messageLength);
+			if (m_binary)
+			{
+				unsigned char record[16];
+				size_t size = 0;
+				if (slot.format)
+				{
+					const unsigned id = m_formatId(slot.format);
+					record[0] = LogBinary::RECORD_ARGS;
+					memcpy(record + 1, &ns, 8);
+					memcpy(record + 9, &id, 4);
+					memcpy(record + 13, &length16, 2);
+					size = 15;
+				}
+				else
+				{
+					record[0] = LogBinary::RECORD_TEXT;
+					memcpy(record + 1, &ns, 8);
+					record[9] = static_cast<unsigned char>(slot.level);
+					memcpy(record + 10, &length16, 2);
+					size = 12;
+				}
+				m_binaryRecord(record, size);
+				m_binaryRecord(message, messageLength);
+			}
+			if (text)
+			{
+				int length = 0;
+				if (slot.format)
+				{
+					// the formatting the caller left for later
+					char message[MAX_LINE];
+					const unsigned messageLength = LogArgs::Format(slot.format->format, reinterpret_cast<const unsigned char*>(slot.text),
+						slot.length, message, sizeof(message));
+					length = s_formatLine(m_batch + m_batchUsed, BATCH_SIZE - m_batchUsed, ns, slot.level, message, messageLength);
+				}
+				else
+					length = s_formatLine(m_batch + m_batchUsed, BATCH_SIZE - m_batchUsed, ns, slot.level, message, messageLength);
+				if (length > 0)
+					m_batchUsed += std::min(static_cast<size_t>(length), BATCH_SIZE - 1 - m_batchUsed);
+			}
+
+			// free for the message Capacity places further on
+			slot.sequence.store(m_dequeue + Capacity, std::memory_order_release);
+			m_dequeue++;
+			pending++;
+			any = true;
+		}
+
+		const unsigned long long dropped = m_dropped.load(std::memory_order_relaxed);
+		if (dropped != m_reportedDrops)
+		{
+			m_reserve(128);
+			const unsigned long long ns = Clock::NowNs() - m_start;
+			const unsigned long long count = dropped - m_reportedDrops;
+			if (text)
+			{
+				const int length = s_formatDropped(m_batch + m_batchUsed, BATCH_SIZE - m_batchUsed, ns, count);
+				if (length > 0)
+					m_batchUsed += length;
+			}
+			if (m_binary)
+			{
+				unsigned char record[17];
+				record[0] = LogBinary::RECORD_DROPPED;
+				memcpy(record + 1, &ns, 8);
+				memcpy(record + 9, &count, 8);
+				m_binaryRecord(record, sizeof(record));
+			}
+			m_reportedDrops = dropped;
+			any = true;
+		}
+
+		m_writeBatch();
+		m_written.fetch_add(pending, std::memory_order_release);
+		return any;
+	}
+
+	unsigned Log::m_formatId(const LogFormat *format)
+	{
+		std::unordered_map<const LogFormat*, unsigned>::const_iterator found = m_formatIds.find(format);
+		if (found != m_formatIds.end())
+			return found->second;
+
+		// first record of this call site: its format goes first
+		const unsigned id = static_cast<unsigned>(m_formatIds.size());
+		m_formatIds[format] = id;
+		size_t length = strlen(format->format);
+		if (length > MAX_FORMAT)
+			length = MAX_FORMAT;
+		m_reserve(length + 16 + MaxMessage + 64);
+		const unsigned short length16 = static_cast<unsigned short>(length);
+		unsigned char record[8];
+		record[0] = LogBinary::RECORD_FORMAT;
+		memcpy(record + 1, &id, 4);
+		record[5] = static_cast<unsigned char>(format->level);
+		memcpy(record + 6, &length16, 2);
+		m_binaryRecord(record, sizeof(record));
+		m_binaryRecord(format->format, length);
+		return id;
+	}
+
+	void Log::m_binaryRecord(const void *data, size_t size)
+	{
+		memcpy(m_binaryBatch + m_binaryUsed, data, size);
+		m_binaryUsed += size;
+	}
+
+	void Log::m_reserve(size_t size)
+	{
+		if (m_batchUsed + size > BATCH_SIZE || m_binaryUsed + size > BATCH_SIZE)
+			m_writeBatch();
+	}
+
+	void Log::m_writeBatch()
+	{
+		if (m_console && m_batchUsed > 0)
+			fwrite(m_batch, 1, m_batchUsed, stdout);
+		if (m_file)
+		{
+			if (m_binary && m_binaryUsed > 0)
+				fwrite(m_binaryBatch, 1, m_binaryUsed, m_file);
+			else if (!m_binary && m_batchUsed > 0)
+				fwrite(m_batch, 1, m_batchUsed, m_file);
+			if (m_batchUsed > 0 || m_binaryUsed > 0)
+				fflush(m_file);
+		}
+		m_batchUsed = 0;
+		m_binaryUsed = 0;
+	}
+
+//------------------------------------------------------------------
+
+	bool Log::Decode(const char *binaryPath, const char *textPath)
+	{
+		FILE *in = s_open(binaryPath, "rb");
+		if (!in)
+			return false;
+		std::vector<unsigned char> data;
+		unsigned char chunk[64 * 1024];
+		size_t read = 0;
+		while ((read = fread(chunk, 1, sizeof(chunk), in)) > 0)
+			data.insert(data.end(), chunk, chunk + read);
+		fclose(in);
+
+		const size_t headerSize = sizeof(LogBinary::Magic) + sizeof(LogBinary::Version) + 2 * LogBinary::DateSize;
+		unsigned version = 0;
+		if (data.size() < headerSize || memcmp(&data[0], LogBinary::Magic, sizeof(LogBinary::Magic)) != 0)
+			return false;
+		memcpy(&version, &data[sizeof(LogBinary::Magic)], sizeof(version));
+		if (version != LogBinary::Version)
+			return false;
+
+		FILE *out = s_open(textPath, "w");
+		if (!out)
+			return false;
+		char date[LogBinary::DateSize], timer[LogBinary::DateSize];
+		const size_t datePos = sizeof(LogBinary::Magic) + sizeof(LogBinary::Version);
+		memcpy(date, &data[datePos], LogBinary::DateSize);
+		memcpy(timer, &data[datePos + LogBinary::DateSize], LogBinary::DateSize);
+		date[LogBinary::DateSize - 1] = timer[LogBinary::DateSize - 1] = 0;
+		s_writeHeader(out, date, timer);
 
-		printf("%s::%d: %s%s\n", timer, cl, levtext, text); 
-		if(m_file)
+		// Formats by id; a log cut short by a crash ends without footer
+		std::vector<std::string> formats;
+		std::vector<int> levels;
+		std::vector<char> line(MAX_LINE + 64);
+		char message[MAX_LINE];
+		size_t pos = headerSize;
+		bool ok = true;
+		while (pos < data.size())
 		{
-			fprintf(m_file, "%s::%d: %s%s\n", timer, cl, levtext, text);
-			fflush(m_file);
+			const unsigned char type = data[pos++];
+			const size_t left = data.size() - pos;
+			const unsigned char *record = &data[0] + pos;
+			unsigned long long ns = 0;
+			unsigned short length = 0;
+			if (type == LogBinary::RECORD_FORMAT && left >= 7)
+			{
+				unsigned id = 0;
+				memcpy(&id, record, 4);
+				memcpy(&length, record + 5, 2);
+				if (left < 7u + length || id != formats.size())
+				{
+					ok = false;
+					break;
+				}
+				formats.push_back(std::string(reinterpret_cast<const char*>(record + 7), length));
+				levels.push_back(record[4]);
+				pos += 7 + length;
+			}
+			else if (type == LogBinary::RECORD_TEXT && left >= 11)
+			{
+				memcpy(&ns, record, 8);
+				memcpy(&length, record + 9, 2);
+				if (left < 11u + length)
+				{
+					ok = false;
+					break;
+				}
+				const int n = s_formatLine(&line[0], line.size(), ns, record[8], reinterpret_cast<const char*>(record + 11), length);
+				fwrite(&line[0], 1, std::min(static_cast<size_t>(n), line.size() - 1), out);
+				pos += 11 + length;
+			}
+			else if (type == LogBinary::RECORD_ARGS && left >= 14)
+			{
+				unsigned id = 0;
+				memcpy(&ns, record, 8);
+				memcpy(&id, record + 8, 4);
+				memcpy(&length, record + 12, 2);
+				if (left < 14u + length || id >= formats.size())
+				{
+					ok = false;
+					break;
+				}
+				const unsigned messageLength = LogArgs::Format(formats[id].c_str(), record + 14, length, message, sizeof(message));
+				const int n = s_formatLine(&line[0], line.size(), ns, levels[id], message, messageLength);
+				fwrite(&line[0], 1, std::min(static_cast<size_t>(n), line.size() - 1), out);
+				pos += 14 + length;
+			}
+			else if (type == LogBinary::RECORD_DROPPED && left >= 16)
+			{
+				unsigned long long dropped = 0;
+				memcpy(&ns, record, 8);
+				memcpy(&dropped, record + 8, 8);
+				const int n = s_formatDropped(&line[0], line.size(), ns, dropped);
+				fwrite(&line[0], 1, std::min(static_cast<size_t>(n), line.size() - 1), out);
+				pos += 16;
+			}
+			else if (type == LogBinary::RECORD_END && left >= 2 * LogBinary::DateSize)
+			{
+				memcpy(date, record, LogBinary::DateSize);
+				memcpy(timer, record + LogBinary::DateSize, LogBinary::DateSize);
+				date[LogBinary::DateSize - 1] = timer[LogBinary::DateSize - 1] = 0;
+				s_writeFooter(out, date, timer);
+				pos += 2 * LogBinary::DateSize;
+			}
+			else
+			{
+				ok = false;
+				break;
+			}
 		}
+		fclose(out);
+		return ok;
 	}
 
 //------------------------------------------------------------------
-}
\ No newline at end of file
+}
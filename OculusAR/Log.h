@@ -1,13 +1,44 @@
 #pragma once
 
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+#include "LogFormat.h"
+
 namespace D3D11Framework
 {
 //------------------------------------------------------------------
 
+	// Print, Debug and Err copy their format and raw arguments into a slot
+	// of a preallocated ring and return; a writer thread takes the messages
+	// out in order, formats them and writes them to the console and the
+	// file in batches. Formats LogArgs cannot print the same (* widths, %p,
+	// %n, h and L lengths, wide strings) and messages too long for a slot
+	// are formatted on the calling thread as before. Any number of threads
+	// may log at once, none of them locks, allocates or touches the disk.
+	//
+	// When the ring is full Print and Debug drop their message, Err waits
+	// for the writer a little while before it drops. Dropped messages are
+	// counted and reported in the log.
+	//
+	// The LOG_ macros below go further for per-frame telemetry: the call
+	// only copies its raw arguments into the slot, the format string stays
+	// with the call site, and the writer formats the text later. In binary
+	// mode the writer does not even do that but writes the records to
+	// log.bin, which Decode turns into the usual text log afterwards.
 	class Log
 	{
 	public:
-		Log();
+		// Messages the ring holds, a power of two
+		static const unsigned Capacity = 4096;
+		// Longer messages are cut to MaxMessage - 1 characters
+		static const unsigned MaxMessage = 232;
+
+		// path null writes log.txt, or log.bin in binary mode. The console
+		// always gets text.
+		Log(const char *path = nullptr, bool console = true, bool binary = false);
 		~Log();
 
 		static Log* Get(){return m_instance;}
@@ -16,15 +47,109 @@ namespace D3D11Framework
 		void Debug(const char *message, ...);
 		void Err(const char *message, ...);
 
+		// The call behind the LOG_ macros: only the arguments are copied
+		template<typename... Args>
+		void Write(const LogFormat &format, const Args&... args)
+		{
+			Slot *slot = nullptr;
+			unsigned long long pos = 0;
+			const unsigned long long time = m_claim(format.level, &slot, &pos);
+			if (!slot)
+				return;
+			LogArgs packed(reinterpret_cast<unsigned char*>(slot->text), MaxMessage);
+			packed.AddAll(args...);
+			m_publish(slot, pos, time, format.level, &format, 0, packed.Size(), packed.Full());
+		}
+
+		// Writes the text log of a binary one, false if it cannot be read
+		static bool Decode(const char *binaryPath, const char *textPath);
+
+		// Waits until everything logged before the call is written out
+		void Flush();
+
+		// Messages written, dropped for a full ring and cut to MaxMessage
+		unsigned long long Written() const { return m_written.load(std::memory_order_acquire); }
+		unsigned long long Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+		unsigned long long Truncated() const { return m_truncated.load(std::memory_order_relaxed); }
+
 	private:
+		struct Slot
+		{
+			// Message pos is in the slot once sequence is pos + 1, the slot
+			// is free for message pos once it is pos
+			std::atomic<unsigned long long> sequence;
+			unsigned long long time;
+			int level;
+			// Call site of packed arguments in text, null for plain text
+			const LogFormat *format;
+			// Length of the format Print, Debug or Err copied in front of
+			// packed arguments in text, 0 if there is none
+			unsigned formatLength;
+			unsigned length;
+			char text[MaxMessage];
+		};
+
+		Log(const Log&);
+		Log &operator=(const Log&);
+
 		static Log *m_instance;
 
-		void m_init();
+		void m_init(const char *path);
 		void m_close();
-		void m_print(const char *levtext, const char *text);
+		// Takes a free slot and returns the time of the call. The slot is
+		// null if the message is dropped.
+		unsigned long long m_claim(int level, Slot **slot, unsigned long long *pos);
+		void m_publish(Slot *slot, unsigned long long pos, unsigned long long time, int level,
+			const LogFormat *format, unsigned formatLength, unsigned length, bool truncated);
+		void m_push(int level, const char *message, va_list args);
+		void m_run();
+		// Writes out the messages ready in the ring, false if there were none
+		bool m_drain();
+		// Writes the batches out if fewer than size bytes are left in one
+		void m_reserve(size_t size);
+		void m_writeBatch();
+		void m_binaryRecord(const void *data, size_t size);
+		unsigned m_formatId(const LogFormat *format);
+
+		FILE *m_file;
+		bool m_console;
+		bool m_binary;
+		unsigned long long m_start;
 
-		FILE *m_file;	
+		Slot *m_slots;
+		std::atomic<unsigned long long> m_enqueue;
+		// writer only
+		unsigned long long m_dequeue;
+		unsigned long long m_reportedDrops;
+		// Text lines for the console and the text file, records for the
+		// binary file
+		char *m_batch;
+		size_t m_batchUsed;
+		char *m_binaryBatch;
+		size_t m_binaryUsed;
+		// Ids of the call sites seen so far
+		std::unordered_map<const LogFormat*, unsigned> m_formatIds;
+
+		std::atomic<unsigned long long> m_written;
+		std::atomic<unsigned long long> m_dropped;
+		std::atomic<unsigned long long> m_truncated;
+		std::atomic<bool> m_running;
+		std::thread m_thread;
 	};
 
 //------------------------------------------------------------------
-}
\ No newline at end of file
+}
+
+// Logs through Log::Get() if there is a log and the level is compiled in.
+// Every call site keeps its format as a LogFormat of its own.
+#define LOG_WRITE(level, format, ...) \
+	do { \
+		if (D3D11Framework::LogGate<level>::Enabled && D3D11Framework::Log::Get()) { \
+			static const D3D11Framework::LogFormat s_logFormat = { level, format }; \
+			D3D11Framework::Log::Get()->Write(s_logFormat, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+#define LOG_DEBUG(format, ...) LOG_WRITE(D3D11Framework::LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define LOG_PRINT(format, ...) LOG_WRITE(D3D11Framework::LOG_LEVEL_PRINT, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_WRITE(D3D11Framework::LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
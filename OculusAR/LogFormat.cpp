@@ -0,0 +1,220 @@
+#include "LogFormat.h"
+#include <cstdio>
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Longest string argument Format prints
+	static const unsigned MAX_STRING = 1024;
+
+	void LogArgs::m_put(eType type, const void *value, unsigned size)
+	{
+		if (m_full || m_size + 1 + size > m_capacity)
+		{
+			m_full = true;
+			return;
+		}
+		m_buffer[m_size] = static_cast<unsigned char>(type);
+		memcpy(m_buffer + m_size + 1, value, size);
+		m_size += 1 + size;
+	}
+
+	void LogArgs::Add(const char *text)
+	{
+		if (!text)
+			text = "(null)";
+		if (m_full || m_size + 3 > m_capacity)
+		{
+			m_full = true;
+			return;
+		}
+		// a long string takes what is left
+		size_t length = strlen(text);
+		const unsigned room = m_capacity - m_size - 3;
+		if (length > room)
+		{
+			length = room;
+			m_full = true;
+		}
+		if (length > 0xFFFF)
+			length = 0xFFFF;
+		const unsigned short length16 = static_cast<unsigned short>(length);
+		m_buffer[m_size] = TYPE_STRING;
+		memcpy(m_buffer + m_size + 1, &length16, 2);
+		memcpy(m_buffer + m_size + 3, text, length);
+		m_size += 3 + length16;
+	}
+
+//------------------------------------------------------------------
+
+	unsigned LogArgs::Format(const char *format, const unsigned char *args, unsigned argsSize, char *out, unsigned size)
+	{
+		if (size == 0)
+			return 0;
+		unsigned used = 0;
+		unsigned read = 0;
+		// Appends up to length characters, keeping room for the terminator
+		auto append = [&](const char *text, size_t length) {
+			if (length > size - 1 - used)
+				length = size - 1 - used;
+			memcpy(out + used, text, length);
+			used += static_cast<unsigned>(length);
+		};
+
+		const char *p = format;
+		while (*p && used < size - 1)
+		{
+			if (*p != '%')
+			{
+				const char *next = strchr(p, '%');
+				const size_t length = next ? static_cast<size_t>(next - p) : strlen(p);
+				append(p, length);
+				p += length;
+				continue;
+			}
+			if (p[1] == '%')
+			{
+				append("%", 1);
+				p += 2;
+				continue;
+			}
+
+			// %[flags][width][.precision][length]conversion; the length is
+			// dropped and replaced by the one of the packed argument
+			const char *start = p++;
+			while (*p && strchr("-+ #0", *p))
+				p++;
+			while (*p && ((*p >= '0' && *p <= '9') || *p == '.'))
+				p++;
+			const char *lengthStart = p;
+			while (*p && strchr("hlLjztqI", *p))
+			{
+				// the 64 of I64
+				p++;
+				while (*p >= '0' && *p <= '9')
+					p++;
+			}
+			const char conversion = *p;
+			if (!conversion)
+				break;
+			p++;
+
+			// a spec too long for spec[] prints "?" but still takes its argument
+			char spec[48];
+			const size_t prefix = static_cast<size_t>(lengthStart - start);
+			const bool printable = prefix + 4 <= sizeof(spec);
+			if (printable)
+				memcpy(spec, start, prefix);
+
+			if (read >= argsSize)
+			{
+				append("?", 1);
+				continue;
+			}
+			const eType type = static_cast<eType>(args[read]);
+			const bool integer = strchr("diouxXc", conversion) != nullptr;
+			const bool floating = strchr("fFeEgGaA", conversion) != nullptr;
+			const bool isSigned = conversion == 'd' || conversion == 'i' || conversion == 'c';
+
+			char text[MAX_STRING + 64];
+			int length = -1;
+			if (type == TYPE_STRING && read + 3 <= argsSize)
+			{
+				unsigned short stringLength = 0;
+				memcpy(&stringLength, args + read + 1, 2);
+				if (read + 3 + stringLength > argsSize)
+					break;
+				if (conversion == 's' && prefix == 1)
+				{
+					// a bare %s goes straight in
+					append(reinterpret_cast<const char*>(args + read + 3), stringLength < MAX_STRING ? stringLength : MAX_STRING);
+					read += 3 + stringLength;
+					continue;
+				}
+				if (conversion == 's' && printable)
+				{
+					char value[MAX_STRING + 1];
+					const unsigned copy = stringLength < MAX_STRING ? stringLength : MAX_STRING;
+					memcpy(value, args + read + 3, copy);
+					value[copy] = 0;
+					spec[prefix] = 's';
+					spec[prefix + 1] = 0;
+					length = snprintf(text, sizeof(text), spec, value);
+				}
+				read += 3 + stringLength;
+			}
+			else if (type == TYPE_INT32 || type == TYPE_UINT32 || type == TYPE_INT64 || type == TYPE_UINT64 || type == TYPE_DOUBLE)
+			{
+				const unsigned valueSize = type == TYPE_INT32 || type == TYPE_UINT32 ? 4 : 8;
+				if (read + 1 + valueSize > argsSize)
+					break;
+				long long integerValue = 0;
+				double doubleValue = 0.0;
+				switch (type)
+				{
+				case TYPE_INT32: { int v; memcpy(&v, args + read + 1, 4); integerValue = v; doubleValue = v; break; }
+				case TYPE_UINT32: { unsigned v; memcpy(&v, args + read + 1, 4); integerValue = v; doubleValue = v; break; }
+				case TYPE_INT64: { long long v; memcpy(&v, args + read + 1, 8); integerValue = v; doubleValue = static_cast<double>(v); break; }
+				case TYPE_UINT64: { unsigned long long v; memcpy(&v, args + read + 1, 8); integerValue = static_cast<long long>(v); doubleValue = static_cast<double>(v); break; }
+				default: { memcpy(&doubleValue, args + read + 1, 8); integerValue = static_cast<long long>(doubleValue); break; }
+				}
+				read += 1 + valueSize;
+
+				if (!printable)
+					length = -1;
+				else if (prefix == 1 && (conversion == 'd' || conversion == 'i' || conversion == 'u'))
+				{
+					// bare %d and %u, the most of them, without snprintf
+					unsigned long long magnitude = static_cast<unsigned long long>(integerValue);
+					const bool negative = isSigned && integerValue < 0;
+					if (negative)
+						magnitude = 0 - magnitude;
+					char *end = text + sizeof(text), *digit = end;
+					do
+					{
+						*--digit = static_cast<char>('0' + magnitude % 10);
+						magnitude /= 10;
+					} while (magnitude > 0);
+					if (negative)
+						*--digit = '-';
+					append(digit, static_cast<size_t>(end - digit));
+					continue;
+				}
+				else if (integer && conversion == 'c')
+				{
+					spec[prefix] = 'c';
+					spec[prefix + 1] = 0;
+					length = snprintf(text, sizeof(text), spec, static_cast<int>(integerValue));
+				}
+				else if (integer)
+				{
+					spec[prefix] = 'l';
+					spec[prefix + 1] = 'l';
+					spec[prefix + 2] = conversion;
+					spec[prefix + 3] = 0;
+					length = isSigned ? snprintf(text, sizeof(text), spec, integerValue) :
+						snprintf(text, sizeof(text), spec, static_cast<unsigned long long>(integerValue));
+				}
+				else if (floating)
+				{
+					spec[prefix] = conversion;
+					spec[prefix + 1] = 0;
+					length = snprintf(text, sizeof(text), spec, doubleValue);
+				}
+			}
+			else
+				break;
+
+			if (length < 0)
+				append("?", 1);
+			else
+				append(text, static_cast<size_t>(length) < sizeof(text) ? static_cast<size_t>(length) : sizeof(text) - 1);
+		}
+		out[used] = 0;
+		return used;
+	}
+
+//------------------------------------------------------------------
+}
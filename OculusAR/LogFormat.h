@@ -0,0 +1,116 @@
+#pragma once
+
+// Lowest log level compiled in. Release builds leave out LOG_LEVEL_DEBUG.
+#ifndef LOG_MIN_LEVEL
+#	ifdef _DEBUG
+#		define LOG_MIN_LEVEL 0
+#	else
+#		define LOG_MIN_LEVEL 1
+#	endif
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	enum eLogLevel
+	{
+		LOG_LEVEL_DEBUG = 0,
+		LOG_LEVEL_PRINT,
+		LOG_LEVEL_ERROR
+	};
+
+	// Compile-time level filter. A log macro below LOG_MIN_LEVEL becomes
+	// "if (false)", so neither the call nor its arguments are left.
+	template<int Level>
+	struct LogGate
+	{
+		enum { Enabled = Level >= LOG_MIN_LEVEL };
+	};
+
+	// One call site of the LOG_ macros: its level and printf format. It is
+	// a constant the compiler puts into the image, nothing registers it at
+	// run time; the log writer numbers the sites as they first come by.
+	struct LogFormat
+	{
+		int level;
+		const char *format;
+	};
+
+	// Arguments of a log call packed as they are, to be formatted later on
+	// the writer thread or by the decoder: a type byte, then the value.
+	// Integers and doubles are kept raw, strings are copied. Arguments that
+	// do not fit any more are left out and Full() is set.
+	class LogArgs
+	{
+	public:
+		enum eType
+		{
+			TYPE_INT32 = 1,
+			TYPE_UINT32,
+			TYPE_INT64,
+			TYPE_UINT64,
+			TYPE_DOUBLE,
+			TYPE_STRING		// 16-bit length, then the characters
+		};
+
+		LogArgs(unsigned char *buffer, unsigned capacity) : m_buffer(buffer), m_capacity(capacity), m_size(0), m_full(false) {}
+
+		void Add(int value) { m_put(TYPE_INT32, &value, sizeof(value)); }
+		void Add(unsigned value) { m_put(TYPE_UINT32, &value, sizeof(value)); }
+		void Add(long value) { Add(static_cast<long long>(value)); }
+		void Add(unsigned long value) { Add(static_cast<unsigned long long>(value)); }
+		void Add(long long value) { m_put(TYPE_INT64, &value, sizeof(value)); }
+		void Add(unsigned long long value) { m_put(TYPE_UINT64, &value, sizeof(value)); }
+		void Add(double value) { m_put(TYPE_DOUBLE, &value, sizeof(value)); }
+		void Add(const char *text);
+
+		void AddAll() {}
+		template<typename T, typename... Rest>
+		void AddAll(const T &first, const Rest&... rest)
+		{
+			Add(first);
+			AddAll(rest...);
+		}
+
+		unsigned Size() const { return m_size; }
+		bool Full() const { return m_full; }
+
+		// Formats packed arguments with their printf format into out, cut
+		// to size - 1 characters. Length modifiers in the format are
+		// replaced by those of the packed types; * widths are not supported.
+		// Conversions without a fitting argument print "?". Returns the
+		// length written.
+		static unsigned Format(const char *format, const unsigned char *args, unsigned argsSize, char *out, unsigned size);
+
+	private:
+		void m_put(eType type, const void *value, unsigned size);
+
+		unsigned char *m_buffer;
+		unsigned m_capacity;
+		unsigned m_size;
+		bool m_full;
+	};
+
+	// Layout of log.bin, little endian, no padding. The header is followed
+	// by records, each starting with its type byte. Times are nanoseconds
+	// since the log was opened.
+	namespace LogBinary
+	{
+		// "OARLOG" 0 0, version, creation date and time as the text log prints them
+		static const char Magic[8] = { 'O', 'A', 'R', 'L', 'O', 'G', 0, 0 };
+		static const unsigned Version = 1;
+		static const unsigned DateSize = 9;
+
+		enum eRecord
+		{
+			RECORD_FORMAT = 1,	// u32 id, u8 level, u16 length, format
+			RECORD_TEXT,		// u64 time, u8 level, u16 length, text
+			RECORD_ARGS,		// u64 time, u32 format id, u16 length, LogArgs
+			RECORD_DROPPED,		// u64 time, u64 messages dropped
+			RECORD_END			// closing date and time
+		};
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,126 @@
+#include "MappedFile.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+#ifdef _WIN32
+	MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+	{
+	}
+
+	bool MappedFile::Open(const char *path)
+	{
+		Close();
+
+		m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0 || static_cast<unsigned long long>(size.QuadPart) > static_cast<size_t>(-1))
+		{
+			Close();
+			return false;
+		}
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping)
+			m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!m_data)
+		{
+			Close();
+			return false;
+		}
+		m_size = static_cast<size_t>(size.QuadPart);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+		m_data = nullptr;
+		m_size = 0;
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#else
+	MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_fd(-1)
+	{
+	}
+
+	bool MappedFile::Open(const char *path)
+	{
+		Close();
+
+		m_fd = open(path, O_RDONLY);
+		if (m_fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+		{
+			Close();
+			return false;
+		}
+
+		void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+		if (data == MAP_FAILED)
+		{
+			Close();
+			return false;
+		}
+		m_data = static_cast<const unsigned char*>(data);
+		m_size = st.st_size;
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_data)
+			munmap(const_cast<unsigned char*>(m_data), m_size);
+		if (m_fd >= 0)
+			close(m_fd);
+		m_data = nullptr;
+		m_size = 0;
+		m_fd = -1;
+	}
+#endif
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool LoadFile(const char *path, std::vector<unsigned char> &data)
+	{
+		FILE *file = fopen(path, "rb");
+		if (!file)
+			return false;
+		data.clear();
+		unsigned char buffer[65536];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			data.insert(data.end(), buffer, buffer + read);
+		const bool ok = ferror(file) == 0;
+		fclose(file);
+		return ok;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Read-only view of a whole file mapped into memory.
+	// Win32 builds have little address space, keep mapped files well below 1 GB there.
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool Open(const char *path);
+		void Close();
+
+		bool IsOpen() const { return m_data != nullptr; }
+		const unsigned char *Data() const { return m_data; }
+		size_t Size() const { return m_size; }
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile &operator=(const MappedFile&);
+
+		const unsigned char *m_data;
+		size_t m_size;
+#ifdef _WIN32
+		void *m_file;
+		void *m_mapping;
+#else
+		int m_fd;
+#endif
+	};
+
+	// A whole file copied into data, for files that are small or may be
+	// empty. False if it cannot be opened or read.
+	bool LoadFile(const char *path, std::vector<unsigned char> &data);
+
+	// Offset rounded up to 16 bytes, where the cache files start each blob
+	inline unsigned long long Align16(unsigned long long offset)
+	{
+		return (offset + 15) & ~15ULL;
+	}
+
+//------------------------------------------------------------------
+}
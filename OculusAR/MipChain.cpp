@@ -0,0 +1,403 @@
+#include "MipChain.h"
+#include "Simd.h"
+#include <cmath>
+
+#if SIMD_X86
+#	include <emmintrin.h>
+#endif
+#if SIMD_ARM_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static const double KAISER_ALPHA = 4.0;
+	// in texels of the smaller image
+	static const double KAISER_RADIUS = 3.0;
+
+	// Source texels and weights of every destination texel along one axis.
+	// Taps outside the image are folded onto the edge texel.
+	struct ResampleTaps
+	{
+		std::vector<int> first;
+		std::vector<int> count;
+		std::vector<float> weights;	// stride of maxCount
+		int maxCount;
+	};
+
+	typedef void (*BoxFn)(const ImageRgba &src, ImageRgba &dst);
+	typedef void (*KaiserRowFn)(const unsigned char *src, const ResampleTaps &taps, float *out);
+	typedef void (*KaiserColumnFn)(const float *const *rows, const float *weights, int count, int width, unsigned char *dst);
+
+	static double s_bessel0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 50 && term > sum * 1e-12; k++)
+		{
+			const double t = x / (2.0 * k);
+			term *= t * t;
+			sum += term;
+		}
+		return sum;
+	}
+
+	// Filter at t destination texels from the centre
+	static double s_kaiser(double t)
+	{
+		if (std::fabs(t) >= KAISER_RADIUS)
+			return 0.0;
+		const double pt = 3.14159265358979323846 * t;
+		const double sinc = t == 0.0 ? 1.0 : std::sin(pt) / pt;
+		const double r = t / KAISER_RADIUS;
+		return sinc * s_bessel0(KAISER_ALPHA * std::sqrt(1.0 - r * r)) / s_bessel0(KAISER_ALPHA);
+	}
+
+	static void s_taps(int srcSize, int dstSize, ResampleTaps &taps)
+	{
+		const double scale = static_cast<double>(srcSize) / dstSize;
+		// enlarging samples the filter at its own size
+		const double stretch = scale > 1.0 ? scale : 1.0;
+		const double radius = KAISER_RADIUS * stretch;
+		taps.maxCount = static_cast<int>(std::ceil(radius * 2.0)) + 1;
+		taps.first.resize(dstSize);
+		taps.count.resize(dstSize);
+		taps.weights.assign(static_cast<size_t>(dstSize) * taps.maxCount, 0.0f);
+
+		std::vector<double> w(taps.maxCount);
+		for (int d = 0; d < dstSize; d++)
+		{
+			const double center = (d + 0.5) * scale;
+			const int lo = static_cast<int>(std::ceil(center - radius - 0.5));
+			const int hi = static_cast<int>(std::floor(center + radius - 0.5));
+			const int first = lo < 0 ? 0 : lo;
+			const int last = hi > srcSize - 1 ? srcSize - 1 : hi;
+			const int count = last - first + 1;
+			for (int i = 0; i < count; i++)
+				w[i] = 0.0;
+			double sum = 0.0;
+			for (int i = lo; i <= hi; i++)
+			{
+				const double weight = s_kaiser((i + 0.5 - center) / stretch);
+				const int at = (i < first ? first : i > last ? last : i) - first;
+				w[at] += weight;
+				sum += weight;
+			}
+			taps.first[d] = first;
+			taps.count[d] = count;
+			float *out = &taps.weights[static_cast<size_t>(d) * taps.maxCount];
+			for (int i = 0; i < count; i++)
+				out[i] = static_cast<float>(w[i] / sum);
+		}
+	}
+
+	static inline unsigned char s_round(float v)
+	{
+		return static_cast<unsigned char>(v <= 0.0f ? 0 : v >= 255.0f ? 255 : static_cast<int>(v + 0.5f));
+	}
+
+//------------------------------------------------------------------
+// Scalar
+
+	static void s_boxRows(const ImageRgba &src, ImageRgba &dst, int x, int y)
+	{
+		const int x1 = src.width > 1 ? 1 : 0;
+		const unsigned char *r0 = src.Row(y * 2);
+		const unsigned char *r1 = src.Row(y * 2 + 1 < src.height ? y * 2 + 1 : y * 2);
+		unsigned char *d = dst.Row(y);
+		for (; x < dst.width; x++)
+		{
+			const unsigned char *a = r0 + x * 8, *b = r1 + x * 8;
+			for (int c = 0; c < 4; c++)
+				d[x * 4 + c] = static_cast<unsigned char>((a[c] + a[x1 * 4 + c] + b[c] + b[x1 * 4 + c] + 2) >> 2);
+		}
+	}
+
+	static void s_boxScalar(const ImageRgba &src, ImageRgba &dst)
+	{
+		for (int y = 0; y < dst.height; y++)
+			s_boxRows(src, dst, 0, y);
+	}
+
+	static void s_kaiserRowScalar(const unsigned char *src, const ResampleTaps &taps, float *out)
+	{
+		const int width = static_cast<int>(taps.first.size());
+		for (int x = 0; x < width; x++)
+		{
+			const unsigned char *s = src + taps.first[x] * 4;
+			const float *w = &taps.weights[static_cast<size_t>(x) * taps.maxCount];
+			float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+			for (int i = 0; i < taps.count[x]; i++, s += 4)
+			{
+				r = r + w[i] * s[0];
+				g = g + w[i] * s[1];
+				b = b + w[i] * s[2];
+				a = a + w[i] * s[3];
+			}
+			out[x * 4 + 0] = r;
+			out[x * 4 + 1] = g;
+			out[x * 4 + 2] = b;
+			out[x * 4 + 3] = a;
+		}
+	}
+
+	static void s_kaiserColumnScalar(const float *const *rows, const float *weights, int count, int width, unsigned char *dst)
+	{
+		for (int i = 0; i < width * 4; i++)
+		{
+			float v = 0.0f;
+			for (int k = 0; k < count; k++)
+				v = v + weights[k] * rows[k][i];
+			dst[i] = s_round(v);
+		}
+	}
+
+#if SIMD_X86
+//------------------------------------------------------------------
+// SSE2
+
+	static void s_boxSSE2(const ImageRgba &src, ImageRgba &dst)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		// 4 destination pixels from 8 of each source row
+		const int blocks = src.width >= 2 ? (src.width / 2) / 4 : 0;
+		for (int y = 0; y < dst.height; y++)
+		{
+			const unsigned char *r0 = src.Row(y * 2);
+			const unsigned char *r1 = src.Row(y * 2 + 1 < src.height ? y * 2 + 1 : y * 2);
+			unsigned char *d = dst.Row(y);
+			for (int i = 0; i < blocks; i++)
+			{
+				#define LOAD(p) _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+				const __m128i a0 = LOAD(r0 + i * 32), a1 = LOAD(r0 + i * 32 + 16);
+				const __m128i b0 = LOAD(r1 + i * 32), b1 = LOAD(r1 + i * 32 + 16);
+				#undef LOAD
+				// vertical sums, two pixels a register
+				const __m128i p01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+				const __m128i p23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+				const __m128i p45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+				const __m128i p67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+				// even plus odd pixels
+				const __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi64(p01, p23), _mm_unpackhi_epi64(p01, p23)), two);
+				const __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi64(p45, p67), _mm_unpackhi_epi64(p45, p67)), two);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 16), _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2)));
+			}
+			s_boxRows(src, dst, blocks * 4, y);
+		}
+	}
+
+	static inline __m128 s_loadPixel(const unsigned char *p)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i v = _mm_cvtsi32_si128(*reinterpret_cast<const int*>(p));
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero));
+	}
+
+	static void s_kaiserRowSSE2(const unsigned char *src, const ResampleTaps &taps, float *out)
+	{
+		const int width = static_cast<int>(taps.first.size());
+		for (int x = 0; x < width; x++)
+		{
+			const unsigned char *s = src + taps.first[x] * 4;
+			const float *w = &taps.weights[static_cast<size_t>(x) * taps.maxCount];
+			__m128 acc = _mm_setzero_ps();
+			for (int i = 0; i < taps.count[x]; i++, s += 4)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[i]), s_loadPixel(s)));
+			_mm_storeu_ps(out + x * 4, acc);
+		}
+	}
+
+	static void s_kaiserColumnSSE2(const float *const *rows, const float *weights, int count, int width, unsigned char *dst)
+	{
+		const __m128 zero = _mm_setzero_ps(), max = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+		for (int i = 0; i < width * 4; i += 4)
+		{
+			__m128 v = _mm_setzero_ps();
+			for (int k = 0; k < count; k++)
+				v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+			const __m128i n = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(v, zero), max), half));
+			const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(n, n), n);
+			*reinterpret_cast<int*>(dst + i) = _mm_cvtsi128_si32(packed);
+		}
+	}
+#endif
+
+#if SIMD_ARM_NEON
+//------------------------------------------------------------------
+// NEON
+
+	static void s_boxNEON(const ImageRgba &src, ImageRgba &dst)
+	{
+		const int blocks = src.width >= 2 ? (src.width / 2) / 4 : 0;
+		for (int y = 0; y < dst.height; y++)
+		{
+			const unsigned char *r0 = src.Row(y * 2);
+			const unsigned char *r1 = src.Row(y * 2 + 1 < src.height ? y * 2 + 1 : y * 2);
+			unsigned char *d = dst.Row(y);
+			for (int i = 0; i < blocks; i++)
+			{
+				// even and odd pixels apart
+				const uint32x4x2_t a = vld2q_u32(reinterpret_cast<const uint32_t*>(r0 + i * 32));
+				const uint32x4x2_t b = vld2q_u32(reinterpret_cast<const uint32_t*>(r1 + i * 32));
+				const uint8x16_t ae = vreinterpretq_u8_u32(a.val[0]), ao = vreinterpretq_u8_u32(a.val[1]);
+				const uint8x16_t be = vreinterpretq_u8_u32(b.val[0]), bo = vreinterpretq_u8_u32(b.val[1]);
+				const uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(ae), vget_low_u8(ao)), vaddl_u8(vget_low_u8(be), vget_low_u8(bo)));
+				const uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(ae), vget_high_u8(ao)), vaddl_u8(vget_high_u8(be), vget_high_u8(bo)));
+				// rounding shift adds the 2
+				vst1q_u8(d + i * 16, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+			}
+			s_boxRows(src, dst, blocks * 4, y);
+		}
+	}
+
+	static void s_kaiserRowNEON(const unsigned char *src, const ResampleTaps &taps, float *out)
+	{
+		const int width = static_cast<int>(taps.first.size());
+		for (int x = 0; x < width; x++)
+		{
+			const unsigned char *s = src + taps.first[x] * 4;
+			const float *w = &taps.weights[static_cast<size_t>(x) * taps.maxCount];
+			float32x4_t acc = vdupq_n_f32(0.0f);
+			for (int i = 0; i < taps.count[x]; i++, s += 4)
+			{
+				const uint16x4_t p = vget_low_u16(vmovl_u8(vcreate_u8(*reinterpret_cast<const uint32_t*>(s))));
+				acc = vaddq_f32(acc, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(p)), w[i]));
+			}
+			vst1q_f32(out + x * 4, acc);
+		}
+	}
+
+	static void s_kaiserColumnNEON(const float *const *rows, const float *weights, int count, int width, unsigned char *dst)
+	{
+		const float32x4_t zero = vdupq_n_f32(0.0f), max = vdupq_n_f32(255.0f), half = vdupq_n_f32(0.5f);
+		for (int i = 0; i < width * 4; i += 4)
+		{
+			float32x4_t v = vdupq_n_f32(0.0f);
+			for (int k = 0; k < count; k++)
+				v = vaddq_f32(v, vmulq_n_f32(vld1q_f32(rows[k] + i), weights[k]));
+			const uint32x4_t n = vcvtq_u32_f32(vaddq_f32(vminq_f32(vmaxq_f32(v, zero), max), half));
+			const uint8x8_t packed = vmovn_u16(vcombine_u16(vmovn_u32(n), vmovn_u32(n)));
+			vst1_lane_u32(reinterpret_cast<uint32_t*>(dst + i), vreinterpret_u32_u8(packed), 0);
+		}
+	}
+#endif
+
+//------------------------------------------------------------------
+
+	static BoxFn s_pickBox(eSimdLevel level)
+	{
+#if SIMD_X86
+		if (level == SIMD_AVX2 || level == SIMD_SSE2)
+			return s_boxSSE2;
+#elif SIMD_ARM_NEON
+		if (level == SIMD_NEON)
+			return s_boxNEON;
+#endif
+		(void)level;
+		return s_boxScalar;
+	}
+
+	static void s_pickKaiser(eSimdLevel level, KaiserRowFn &row, KaiserColumnFn &column)
+	{
+		row = s_kaiserRowScalar;
+		column = s_kaiserColumnScalar;
+#if SIMD_X86
+		if (level == SIMD_AVX2 || level == SIMD_SSE2)
+		{
+			row = s_kaiserRowSSE2;
+			column = s_kaiserColumnSSE2;
+		}
+#elif SIMD_ARM_NEON
+		if (level == SIMD_NEON)
+		{
+			row = s_kaiserRowNEON;
+			column = s_kaiserColumnNEON;
+		}
+#endif
+		(void)level;
+	}
+
+	// Horizontal pass into a ring of float rows, as many as one destination
+	// row needs, then the vertical pass
+	static void s_resample(const ImageRgba &src, ImageRgba &dst, eSimdLevel level)
+	{
+		KaiserRowFn rowFn;
+		KaiserColumnFn columnFn;
+		s_pickKaiser(level, rowFn, columnFn);
+
+		ResampleTaps horizontal, vertical;
+		s_taps(src.width, dst.width, horizontal);
+		s_taps(src.height, dst.height, vertical);
+
+		const int ring = vertical.maxCount;
+		const size_t rowFloats = static_cast<size_t>(dst.width) * 4;
+		std::vector<float> rows(rowFloats * ring);
+		std::vector<int> rowOf(ring, -1);
+		std::vector<const float*> inputs(ring);
+		for (int y = 0; y < dst.height; y++)
+		{
+			const int first = vertical.first[y], count = vertical.count[y];
+			for (int k = 0; k < count; k++)
+			{
+				const int slot = (first + k) % ring;
+				if (rowOf[slot] != first + k)
+				{
+					rowFn(src.Row(first + k), horizontal, &rows[slot * rowFloats]);
+					rowOf[slot] = first + k;
+				}
+				inputs[k] = &rows[slot * rowFloats];
+			}
+			columnFn(&inputs[0], &vertical.weights[static_cast<size_t>(y) * vertical.maxCount], count, dst.width, dst.Row(y));
+		}
+	}
+
+	static void s_downsample(const ImageRgba &src, ImageRgba &dst, eMipFilter filter, eSimdLevel level)
+	{
+		dst.Allocate(src.width > 1 ? src.width / 2 : 1, src.height > 1 ? src.height / 2 : 1);
+		if (filter == MIP_KAISER)
+			s_resample(src, dst, level);
+		else
+			s_pickBox(level)(src, dst);
+	}
+
+	int MipChain::LevelCount(int width, int height)
+	{
+		int levels = 1;
+		while (width > 1 || height > 1)
+		{
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+			levels++;
+		}
+		return levels;
+	}
+
+	void MipChain::Downsample(const ImageRgba &src, ImageRgba &dst, eMipFilter filter)
+	{
+		s_downsample(src, dst, filter, Simd::Level());
+	}
+
+	void MipChain::DownsampleReference(const ImageRgba &src, ImageRgba &dst, eMipFilter filter)
+	{
+		s_downsample(src, dst, filter, SIMD_SCALAR);
+	}
+
+	void MipChain::Resample(const ImageRgba &src, ImageRgba &dst)
+	{
+		s_resample(src, dst, Simd::Level());
+	}
+
+	void MipChain::Build(std::vector<ImageRgba> &levels, eMipFilter filter, int maxLevels)
+	{
+		int count = LevelCount(levels[0].width, levels[0].height);
+		if (maxLevels > 0 && maxLevels < count)
+			count = maxLevels;
+		levels.resize(count);
+		for (int i = 1; i < count; i++)
+			Downsample(levels[i - 1], levels[i], filter);
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include "ImageDecode.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	enum eMipFilter
+	{
+		// 2x2 average, rounded
+		MIP_BOX = 0,
+		// Kaiser windowed sinc (alpha 4, 3 texels of the smaller image either
+		// side), sharper than the box and without its aliasing
+		MIP_KAISER
+	};
+
+	// Builds mip chains of RGBA images on the CPU, for textures that are
+	// uploaded level by level instead of having the GPU generate their mips.
+	//
+	// Level sizes follow D3D11: each level halves the previous one rounding
+	// down, to at least 1. The box filter of an odd sized level drops its
+	// last column or row. The Kaiser filter clamps at the edges and works in
+	// float. The SIMD box paths produce exactly the reference bytes, the
+	// Kaiser ones round the same float sums the same way.
+	class MipChain
+	{
+	public:
+		// Levels of a full chain down to 1x1
+		static int LevelCount(int width, int height);
+
+		// Allocates dst at the next level's size and filters src into it
+		static void Downsample(const ImageRgba &src, ImageRgba &dst, eMipFilter filter);
+		static void DownsampleReference(const ImageRgba &src, ImageRgba &dst, eMipFilter filter);
+
+		// Scales src to the size dst is allocated at with the Kaiser filter,
+		// e.g. to fit an image into a texture array slice
+		static void Resample(const ImageRgba &src, ImageRgba &dst);
+
+		// Fills levels 1 and on from levels[0], maxLevels of them in all
+		// (0 for the full chain)
+		static void Build(std::vector<ImageRgba> &levels, eMipFilter filter, int maxLevels = 0);
+	};
+
+//------------------------------------------------------------------
+}
@@ -1,56 +1,115 @@
-#include "Headers.h"
-#include "InputListener.h"
+#pragma once
+
+#include <OVR.h>
+#include <cmath>
 #include "InputCodes.h"
+#include "InputMgr.h"
+#include "ActionMap.h"
 
 using namespace D3D11Framework;
-class MyInput : public InputListener
+
+// Bindings when no file is given, and the format of one
+static const char *const MYINPUT_BINDINGS =
+	"# action = keys and mouse buttons\n"
+	"move_forward = UP\n"
+	"move_back = DOWN\n"
+	"move_left = LEFT\n"
+	"move_right = RIGHT\n"
+	"move_down = CONTROL\n"
+	"move_up = SHIFT\n"
+	"scale_up = Z\n"
+	"scale_down = X\n"
+	"recenter = SPACE\n";
+
+// Moves and scales the overlay while the bound keys are held, by the time
+// they are held and not by the key repeat of the system
+class MyInput
 {
 public:
+	enum eAction
+	{
+		ACTION_MOVE_FORWARD = 0,
+		ACTION_MOVE_BACK,
+		ACTION_MOVE_LEFT,
+		ACTION_MOVE_RIGHT,
+		ACTION_MOVE_DOWN,
+		ACTION_MOVE_UP,
+		ACTION_SCALE_UP,
+		ACTION_SCALE_DOWN,
+		ACTION_RECENTER,
+
+		ACTION_MAX
+	};
+
 	bool recenter = false;
 	float scaleAmount = 1.0f;
 	OVR::Vector3f translate = OVR::Vector3f(-2.0f,-0.0f,-0.0f); 
-	bool KeyPressed(const KeyEvent &arg)
+	// units a second, and the factor the scale changes by in a second
+	float translateSpeed = 2.0f;
+	float scaleSpeed = 2.0f;
+
+	MyInput() : actions(s_actionNames(), ACTION_MAX)
 	{
-		printf("key press %c\n", arg.wc);
-		switch (arg.code)
-		{
-		case eKeyCodes::KEY_Z:
-			scaleAmount *= 1.2f;
-			break;
-		case eKeyCodes::KEY_X:
-			scaleAmount *= 0.8f;
-		case eKeyCodes::KEY_UP:
-			translate.z -= 0.1f;
-			break;
-		case eKeyCodes::KEY_DOWN:
-			translate.z += 0.1f;
-			break;
-		case eKeyCodes::KEY_LEFT:
-			translate.x -= 0.1f;
-			break;
-		case eKeyCodes::KEY_RIGHT:
-			translate.x += 0.1f;
-			break;
-		case eKeyCodes::KEY_CONTROL:
-			translate.y-= 0.1f;
-			break; 
-		case eKeyCodes::KEY_SHIFT:
-				translate.y += 0.1f;
-				break;
-		case eKeyCodes::KEY_SPACE:
-			recenter = true;
-			break;
+		actions.Parse(MYINPUT_BINDINGS);
+	}
 
-		default:
-			break;
-		}
-		return false;
+	// Replaces the bindings by those of a file; false, keeping the old
+	// ones, if it cannot be read or has bad lines
+	bool LoadBindings(const char *path)
+	{
+		ActionMap loaded(s_actionNames(), ACTION_MAX);
+		if (!loaded.Load(path))
+			return false;
+		actions = loaded;
+		return true;
 	}
-	bool MouseMove(const MouseEvent &arg)
+
+	// Applies the actions held after InputMgr::Dispatch over the dt seconds
+	// of the frame
+	void Update(const InputMgr &input, double dt)
 	{
-		return false;
+		const unsigned held = actions.Held(input);
+		const float step = translateSpeed * static_cast<float>(dt);
+		OVR::Vector3f move(0.0f, 0.0f, 0.0f);
+		if (held & 1u << ACTION_MOVE_FORWARD)
+			move.z -= step;
+		if (held & 1u << ACTION_MOVE_BACK)
+			move.z += step;
+		if (held & 1u << ACTION_MOVE_LEFT)
+			move.x -= step;
+		if (held & 1u << ACTION_MOVE_RIGHT)
+			move.x += step;
+		if (held & 1u << ACTION_MOVE_DOWN)
+			move.y -= step;
+		if (held & 1u << ACTION_MOVE_UP)
+			move.y += step;
+		translate += move;
+
+		// exponential, so any split of the time gives the same scale
+		int scale = 0;
+		if (held & 1u << ACTION_SCALE_UP)
+			scale++;
+		if (held & 1u << ACTION_SCALE_DOWN)
+			scale--;
+		if (scale != 0)
+			scaleAmount *= static_cast<float>(std::pow(static_cast<double>(scaleSpeed), scale * dt));
+
+		if (actions.Pressed(input) & 1u << ACTION_RECENTER)
+			recenter = true;
 	}
+
 	float getScale() {
 		return scaleAmount;
 	}
+
+	ActionMap actions;
+
+private:
+	static const char *const *s_actionNames()
+	{
+		static const char *const names[ACTION_MAX] = {
+			"move_forward", "move_back", "move_left", "move_right", "move_down", "move_up", "scale_up", "scale_down", "recenter"
+		};
+		return names;
+	}
 };
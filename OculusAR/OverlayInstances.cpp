@@ -0,0 +1,65 @@
+#include "OverlayInstances.h"
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static unsigned short s_packUnorm16(float value)
+	{
+		// also turns NaN into 0
+		if (!(value > 0.0f))
+			return 0;
+		if (value >= 1.0f)
+			return 65535;
+		return static_cast<unsigned short>(value * 65535.0f + 0.5f);
+	}
+
+	int OverlayInstanceBuilder::Add(unsigned slice, float u0, float v0, float u1, float v1)
+	{
+		Quad quad;
+		quad.slice = slice;
+		m_quads.push_back(quad);
+		SetRect(Count() - 1, u0, v0, u1, v1);
+		return Count() - 1;
+	}
+
+	void OverlayInstanceBuilder::SetRect(int index, float u0, float v0, float u1, float v1)
+	{
+		Quad &quad = m_quads[index];
+		quad.uvRect[0] = s_packUnorm16(u0);
+		quad.uvRect[1] = s_packUnorm16(v0);
+		quad.uvRect[2] = s_packUnorm16(u1);
+		quad.uvRect[3] = s_packUnorm16(v1);
+	}
+
+	void OverlayInstanceBuilder::Build(const float *mvps, OverlayInstance *out) const
+	{
+		const size_t count = m_quads.size();
+		for (int eye = 0; eye < 2; eye++)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				OverlayInstance &instance = *out++;
+				memcpy(instance.mvp, mvps, sizeof(instance.mvp));
+				mvps += 16;
+				memcpy(instance.uvRect, m_quads[i].uvRect, sizeof(instance.uvRect));
+				instance.slice = m_quads[i].slice;
+			}
+		}
+	}
+
+	void OverlayInstanceBuilder::Build(const float *mvps, int eye, const int *quads, int count, OverlayInstance *out) const
+	{
+		mvps += eye * m_quads.size() * 16;
+		for (int i = 0; i < count; i++)
+		{
+			const Quad &quad = m_quads[quads[i]];
+			memcpy(out[i].mvp, mvps + quads[i] * 16, sizeof(out[i].mvp));
+			memcpy(out[i].uvRect, quad.uvRect, sizeof(out[i].uvRect));
+			out[i].slice = quad.slice;
+		}
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// One overlay quad as the instanced vertex shader reads it from the
+	// instance buffer. shader.hlsl and the input layout in Source.cpp
+	// follow this layout.
+	struct OverlayInstance
+	{
+		// Transposed mvp, like the constants of a single draw
+		float mvp[16];
+		// u0, v0, u1, v1 of the texture rectangle, unorm16
+		unsigned short uvRect[4];
+		// Slice of the overlay texture array
+		unsigned slice;
+	};
+	static_assert(sizeof(OverlayInstance) == 76, "OverlayInstance must stay packed for the input layout");
+
+	// Builds the instance data of a set of overlay quads. The texture part
+	// of every quad is packed once when it is added; Build only copies in
+	// the matrices of the frame.
+	class OverlayInstanceBuilder
+	{
+	public:
+		void Clear() { m_quads.clear(); }
+		// Returns the index of the quad. The rectangle is in texture
+		// coordinates, clamped to [0, 1].
+		int Add(unsigned slice, float u0 = 0.0f, float v0 = 0.0f, float u1 = 1.0f, float v1 = 1.0f);
+		void SetRect(int index, float u0, float v0, float u1, float v1);
+		void SetSlice(int index, unsigned slice) { m_quads[index].slice = slice; }
+		int Count() const { return static_cast<int>(m_quads.size()); }
+
+		// mvps holds 2 * Count() transposed matrices, all of eye 0 first,
+		// the way TransformBatch::Run writes them. Writes 2 * Count()
+		// instances in the same order.
+		void Build(const float *mvps, OverlayInstance *out) const;
+		// Instances of the listed quads for one eye only, mvps as above
+		void Build(const float *mvps, int eye, const int *quads, int count, OverlayInstance *out) const;
+
+		// Texture coordinate the shader sees for a stored unorm16 value
+		static float Unpack(unsigned short value) { return value / 65535.0f; }
+
+	private:
+		struct Quad
+		{
+			unsigned short uvRect[4];
+			unsigned slice;
+		};
+
+		std::vector<Quad> m_quads;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,56 @@
+#include "OvrHmdDevice.h"
+#include "Clock.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	OvrHmdDevice::OvrHmdDevice(ovrHmd hmd, const ovrEyeRenderDesc eyeRenderDesc[2], const ovrRecti eyeViewport[2], const ovrTexture eyeTexture[2]) :
+		m_hmd(hmd), m_displayTime(0.0)
+	{
+		for (int eye = 0; eye < 2; eye++)
+		{
+			m_eyeRenderDesc[eye] = eyeRenderDesc[eye];
+			m_eyeViewport[eye] = eyeViewport[eye];
+			m_eyeTexture[eye] = eyeTexture[eye];
+			m_hmdToEyeViewOffset[eye] = eyeRenderDesc[eye].HmdToEyeViewOffset;
+		}
+	}
+
+	void OvrHmdDevice::BeginFrame(unsigned)
+	{
+		// Frame index 0 lets LibOVR count frames itself, matching ovrHmd_GetEyePoses below
+		const ovrFrameTiming timing = ovrHmd_BeginFrame(m_hmd, 0);
+		// LibOVR time rebased onto our clock, like GetHeadState
+		m_displayTime = Clock::Now() + (timing.ScanoutMidpointSeconds - ovr_GetTimeInSeconds());
+	}
+
+	void OvrHmdDevice::GetEyePoses(ovrPosef eyePose[2], ovrTrackingState *tracking)
+	{
+		ovrHmd_GetEyePoses(m_hmd, 0, m_hmdToEyeViewOffset, eyePose, tracking);
+	}
+
+	void OvrHmdDevice::EndFrame(const ovrPosef eyePose[2])
+	{
+		ovrHmd_EndFrame(m_hmd, eyePose, m_eyeTexture);
+	}
+
+	void OvrHmdDevice::Recenter()
+	{
+		ovrHmd_RecenterPose(m_hmd);
+	}
+
+	bool OvrHmdDevice::GetHeadState(ovrPoseStatef *state)
+	{
+		const double now = ovr_GetTimeInSeconds();
+		const ovrTrackingState tracking = ovrHmd_GetTrackingState(m_hmd, now);
+		if (!(tracking.StatusFlags & (ovrStatus_OrientationTracked | ovrStatus_PositionTracked)))
+			return false;
+		// Same age on our clock as on the LibOVR one
+		*state = tracking.HeadPose;
+		state->TimeInSeconds = Clock::Now() - (now - tracking.HeadPose.TimeInSeconds);
+		return true;
+	}
+
+//------------------------------------------------------------------
+}
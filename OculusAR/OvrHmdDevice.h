@@ -0,0 +1,38 @@
+#pragma once
+
+#include "HmdDevice.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// HmdDevice on top of a LibOVR HMD that rendering was configured for
+	class OvrHmdDevice : public HmdDevice
+	{
+	public:
+		// eyeTexture is what ovrHmd_EndFrame presents, one entry per eye
+		OvrHmdDevice(ovrHmd hmd, const ovrEyeRenderDesc eyeRenderDesc[2], const ovrRecti eyeViewport[2], const ovrTexture eyeTexture[2]);
+
+		ovrFovPort EyeFov(int eye) const { return m_eyeRenderDesc[eye].Fov; }
+		ovrRecti EyeViewport(int eye) const { return m_eyeViewport[eye]; }
+		int EyeRenderOrder(int i) const { return m_hmd->EyeRenderOrder[i]; }
+
+		void BeginFrame(unsigned frameIndex);
+		void GetEyePoses(ovrPosef eyePose[2], ovrTrackingState *tracking);
+		void EndFrame(const ovrPosef eyePose[2]);
+		void Recenter();
+		bool GetHeadState(ovrPoseStatef *state);
+		// Scanout midpoint LibOVR predicts the eye poses for
+		double DisplayTime() const { return m_displayTime; }
+
+	private:
+		ovrHmd m_hmd;
+		ovrEyeRenderDesc m_eyeRenderDesc[2];
+		ovrRecti m_eyeViewport[2];
+		ovrTexture m_eyeTexture[2];
+		ovrVector3f m_hmdToEyeViewOffset[2];
+		double m_displayTime;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,51 @@
+#include "Headers.h"
+#include <ovrvision.h>
+#include <cstring>
+#include "OvrvisionSource.h"
+#include "Clock.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	OvrvisionSource::OvrvisionSource(OVR::Ovrvision *device, int quality) :
+		m_device(device), m_quality(quality), m_period(0.0), m_next(0.0), m_sequence(0)
+	{
+		int rate = m_device->GetImageRate();
+		if (rate > 0)
+			m_period = 1.0 / rate;
+	}
+
+	bool OvrvisionSource::Grab(CameraFrame &frame)
+	{
+		if (!m_device->isOpen())
+			return false;
+
+		// The SDK only hands out its latest image, so pace ourselves to the camera rate
+		double now = Clock::Now();
+		if (m_next == 0.0)
+			m_next = now;
+		Clock::Sleep(m_next - now);
+		m_next += m_period;
+
+		int width = m_device->GetImageWidth();
+		int height = m_device->GetImageHeight();
+		// The SDK demosaics on its own (the quality setting) and only hands
+		// out RGB24, the raw sensor data is not exposed
+		frame.Allocate(width, height, PIXEL_RGB24);
+		frame.captureTime = Clock::Now();
+
+		const OVR::OvPSQuality quality = static_cast<OVR::OvPSQuality>(m_quality);
+		unsigned char *left = m_device->GetCamImage(OVR::OV_CAMEYE_LEFT, quality);
+		unsigned char *right = m_device->GetCamImage(OVR::OV_CAMEYE_RIGHT, quality);
+		if (!left || !right)
+			return false;
+
+		memcpy(&frame.eye[0][0], left, frame.eye[0].size());
+		memcpy(&frame.eye[1][0], right, frame.eye[1].size());
+		frame.sequence = ++m_sequence;
+		return true;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "CameraSource.h"
+
+namespace OVR
+{
+	class Ovrvision;
+}
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// CameraSource reading the stereo pair from an opened Ovrvision device
+	class OvrvisionSource : public CameraSource
+	{
+	public:
+		// The device stays owned by the caller
+		OvrvisionSource(OVR::Ovrvision *device, int quality);
+
+		bool Grab(CameraFrame &frame);
+
+	private:
+		OVR::Ovrvision *m_device;
+		int m_quality;
+		double m_period;
+		double m_next;
+		unsigned long long m_sequence;
+	};
+
+//------------------------------------------------------------------
+}
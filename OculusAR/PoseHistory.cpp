@@ -0,0 +1,350 @@
+#include "PoseHistory.h"
+#include "HmdDevice.h"
+#include "Clock.h"
+#include <cmath>
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Oldest samples a query leaves alone, the writer is about to reuse their slots
+	static const unsigned READ_MARGIN = 16;
+
+	// Quaternion of the rotation vector r (axis * angle)
+	static ovrQuatf s_fromRotationVector(double x, double y, double z)
+	{
+		const double angle = std::sqrt(x * x + y * y + z * z);
+		ovrQuatf q;
+		if (angle < 1e-12)
+		{
+			q.x = static_cast<float>(x * 0.5);
+			q.y = static_cast<float>(y * 0.5);
+			q.z = static_cast<float>(z * 0.5);
+			q.w = 1.0f;
+			return q;
+		}
+		const double s = std::sin(angle * 0.5) / angle;
+		q.x = static_cast<float>(x * s);
+		q.y = static_cast<float>(y * s);
+		q.z = static_cast<float>(z * s);
+		q.w = static_cast<float>(std::cos(angle * 0.5));
+		return q;
+	}
+
+	// a * b
+	static ovrQuatf s_multiply(const ovrQuatf &a, const ovrQuatf &b)
+	{
+		ovrQuatf r;
+		r.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+		r.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+		r.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+		r.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+		return r;
+	}
+
+	static ovrQuatf s_normalize(const ovrQuatf &q)
+	{
+		const double length = std::sqrt(static_cast<double>(q.x) * q.x + static_cast<double>(q.y) * q.y +
+			static_cast<double>(q.z) * q.z + static_cast<double>(q.w) * q.w);
+		const double inv = length > 0.0 ? 1.0 / length : 0.0;
+		ovrQuatf r = { static_cast<float>(q.x * inv), static_cast<float>(q.y * inv), static_cast<float>(q.z * inv), static_cast<float>(q.w * inv) };
+		return r;
+	}
+
+	// Shortest rotation from a to b, f in [0, 1]
+	static ovrQuatf s_slerp(const ovrQuatf &a, ovrQuatf b, double f)
+	{
+		double dot = static_cast<double>(a.x) * b.x + static_cast<double>(a.y) * b.y + static_cast<double>(a.z) * b.z + static_cast<double>(a.w) * b.w;
+		if (dot < 0.0)
+		{
+			b.x = -b.x;
+			b.y = -b.y;
+			b.z = -b.z;
+			b.w = -b.w;
+			dot = -dot;
+		}
+		double wa = 1.0 - f, wb = f;
+		// nearly the same rotation: the linear blend is as good and stays stable
+		if (dot < 0.9995)
+		{
+			const double theta = std::acos(dot);
+			const double s = 1.0 / std::sin(theta);
+			wa = std::sin((1.0 - f) * theta) * s;
+			wb = std::sin(f * theta) * s;
+		}
+		ovrQuatf r = { static_cast<float>(a.x * wa + b.x * wb), static_cast<float>(a.y * wa + b.y * wb),
+			static_cast<float>(a.z * wa + b.z * wb), static_cast<float>(a.w * wa + b.w * wb) };
+		return s_normalize(r);
+	}
+
+	static ovrVector3f s_lerp(const ovrVector3f &a, const ovrVector3f &b, double f)
+	{
+		ovrVector3f r = { static_cast<float>(a.x + (b.x - a.x) * f), static_cast<float>(a.y + (b.y - a.y) * f), static_cast<float>(a.z + (b.z - a.z) * f) };
+		return r;
+	}
+
+	// (b - a) / dt
+	static ovrVector3f s_derivative(const ovrVector3f &a, const ovrVector3f &b, double dt)
+	{
+		ovrVector3f r = { static_cast<float>((b.x - a.x) / dt), static_cast<float>((b.y - a.y) / dt), static_cast<float>((b.z - a.z) / dt) };
+		return r;
+	}
+
+//------------------------------------------------------------------
+
+	PoseHistory::PoseHistory() : m_written(0), m_maxPrediction(0.1)
+	{
+		for (unsigned i = 0; i < Capacity; i++)
+		{
+			m_slots[i].sequence.store(0, std::memory_order_relaxed);
+			memset(&m_slots[i].state, 0, sizeof(m_slots[i].state));
+		}
+		memset(&m_last, 0, sizeof(m_last));
+	}
+
+	void PoseHistory::Clear()
+	{
+		for (unsigned i = 0; i < Capacity; i++)
+			m_slots[i].sequence.store(0, std::memory_order_relaxed);
+		m_written.store(0, std::memory_order_release);
+	}
+
+	void PoseHistory::Push(const ovrPoseStatef &state)
+	{
+		const unsigned long long index = m_written.load(std::memory_order_relaxed);
+		Slot &slot = m_slots[index & (Capacity - 1)];
+		// odd while writing, readers of the old sample in this slot notice
+		slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.state = state;
+		slot.sequence.store(2 * index + 2, std::memory_order_release);
+		m_written.store(index + 1, std::memory_order_release);
+		m_last = state;
+	}
+
+	void PoseHistory::PushPose(double time, const ovrPosef &pose)
+	{
+		ovrPoseStatef state;
+		memset(&state, 0, sizeof(state));
+		state.ThePose = pose;
+		state.TimeInSeconds = time;
+
+		const unsigned long long count = m_written.load(std::memory_order_relaxed);
+		if (count > 0)
+		{
+			const double dt = time - m_last.TimeInSeconds;
+			if (dt <= 0.0)
+				return;
+			state.LinearVelocity = s_derivative(m_last.ThePose.Position, pose.Position, dt);
+
+			// World space rotation from the last pose to this one, as a rotation vector
+			const ovrQuatf &last = m_last.ThePose.Orientation;
+			const ovrQuatf inverse = { -last.x, -last.y, -last.z, last.w };
+			ovrQuatf delta = s_multiply(pose.Orientation, inverse);
+			if (delta.w < 0.0f)
+			{
+				delta.x = -delta.x;
+				delta.y = -delta.y;
+				delta.z = -delta.z;
+				delta.w = -delta.w;
+			}
+			const double sinHalf = std::sqrt(static_cast<double>(delta.x) * delta.x + static_cast<double>(delta.y) * delta.y + static_cast<double>(delta.z) * delta.z);
+			const double angle = 2.0 * std::atan2(sinHalf, static_cast<double>(delta.w));
+			const double scale = sinHalf > 1e-12 ? angle / sinHalf / dt : 2.0 / dt;
+			state.AngularVelocity.x = static_cast<float>(delta.x * scale);
+			state.AngularVelocity.y = static_cast<float>(delta.y * scale);
+			state.AngularVelocity.z = static_cast<float>(delta.z * scale);
+
+			// the first velocity is not known, so neither is the acceleration to it
+			if (count > 1)
+			{
+				state.LinearAcceleration = s_derivative(m_last.LinearVelocity, state.LinearVelocity, dt);
+				state.AngularAcceleration = s_derivative(m_last.AngularVelocity, state.AngularVelocity, dt);
+			}
+		}
+		Push(state);
+	}
+
+	bool PoseHistory::m_read(unsigned long long index, ovrPoseStatef *state) const
+	{
+		const Slot &slot = m_slots[index & (Capacity - 1)];
+		const unsigned long long expected = 2 * index + 2;
+		if (slot.sequence.load(std::memory_order_acquire) != expected)
+			return false;
+		memcpy(state, &slot.state, sizeof(*state));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot.sequence.load(std::memory_order_relaxed) == expected;
+	}
+
+	bool PoseHistory::Latest(ovrPoseStatef *state) const
+	{
+		for (;;)
+		{
+			const unsigned long long written = Count();
+			if (written == 0)
+				return false;
+			if (m_read(written - 1, state))
+				return true;
+		}
+	}
+
+	bool PoseHistory::Sample(double t, ovrPoseStatef *state, ePrediction prediction) const
+	{
+		// A read only fails when the writer went all the way around the ring
+		// meanwhile; then the query starts over on the new samples.
+		for (;;)
+		{
+			const unsigned long long written = Count();
+			if (written == 0)
+				return false;
+
+			ovrPoseStatef newest;
+			if (!m_read(written - 1, &newest))
+				continue;
+			if (t >= newest.TimeInSeconds)
+			{
+				const double limit = newest.TimeInSeconds + m_maxPrediction;
+				Predict(newest, t < limit ? t : limit, prediction, state);
+				return true;
+			}
+
+			unsigned long long lo = written > Capacity ? written - Capacity + READ_MARGIN : 0;
+			unsigned long long hi = written - 1;
+			ovrPoseStatef before, after = newest;
+			if (!m_read(lo, &before))
+				continue;
+			if (t <= before.TimeInSeconds)
+			{
+				*state = before;
+				return true;
+			}
+
+			// before.time < t < after.time
+			bool lapped = false;
+			while (hi - lo > 1)
+			{
+				const unsigned long long mid = lo + (hi - lo) / 2;
+				ovrPoseStatef sample;
+				if (!m_read(mid, &sample))
+				{
+					lapped = true;
+					break;
+				}
+				if (sample.TimeInSeconds <= t)
+				{
+					lo = mid;
+					before = sample;
+				}
+				else
+				{
+					hi = mid;
+					after = sample;
+				}
+			}
+			if (lapped)
+				continue;
+			Interpolate(before, after, t, state);
+			return true;
+		}
+	}
+
+	void PoseHistory::Interpolate(const ovrPoseStatef &a, const ovrPoseStatef &b, double t, ovrPoseStatef *state)
+	{
+		const double span = b.TimeInSeconds - a.TimeInSeconds;
+		const double f = span > 0.0 ? (t - a.TimeInSeconds) / span : 0.0;
+		state->ThePose.Orientation = s_slerp(a.ThePose.Orientation, b.ThePose.Orientation, f);
+		state->ThePose.Position = s_lerp(a.ThePose.Position, b.ThePose.Position, f);
+		state->AngularVelocity = s_lerp(a.AngularVelocity, b.AngularVelocity, f);
+		state->LinearVelocity = s_lerp(a.LinearVelocity, b.LinearVelocity, f);
+		state->AngularAcceleration = s_lerp(a.AngularAcceleration, b.AngularAcceleration, f);
+		state->LinearAcceleration = s_lerp(a.LinearAcceleration, b.LinearAcceleration, f);
+		state->TimeInSeconds = t;
+	}
+
+	void PoseHistory::Predict(const ovrPoseStatef &from, double t, ePrediction prediction, ovrPoseStatef *state)
+	{
+		*state = from;
+		state->TimeInSeconds = t;
+		const double dt = t - from.TimeInSeconds;
+		if (prediction == PREDICT_HOLD || dt <= 0.0)
+			return;
+
+		const double half = prediction == PREDICT_ACCELERATION ? 0.5 * dt * dt : 0.0;
+		const double accel = prediction == PREDICT_ACCELERATION ? dt : 0.0;
+		const ovrVector3f &w = from.AngularVelocity, &alpha = from.AngularAcceleration;
+		const ovrVector3f &v = from.LinearVelocity, &a = from.LinearAcceleration;
+
+		// rotation vector w * dt + alpha * dt^2 / 2, applied in world space
+		const ovrQuatf delta = s_fromRotationVector(w.x * dt + alpha.x * half, w.y * dt + alpha.y * half, w.z * dt + alpha.z * half);
+		state->ThePose.Orientation = s_normalize(s_multiply(delta, from.ThePose.Orientation));
+		state->ThePose.Position.x = static_cast<float>(from.ThePose.Position.x + v.x * dt + a.x * half);
+		state->ThePose.Position.y = static_cast<float>(from.ThePose.Position.y + v.y * dt + a.y * half);
+		state->ThePose.Position.z = static_cast<float>(from.ThePose.Position.z + v.z * dt + a.z * half);
+		state->AngularVelocity.x = static_cast<float>(w.x + alpha.x * accel);
+		state->AngularVelocity.y = static_cast<float>(w.y + alpha.y * accel);
+		state->AngularVelocity.z = static_cast<float>(w.z + alpha.z * accel);
+		state->LinearVelocity.x = static_cast<float>(v.x + a.x * accel);
+		state->LinearVelocity.y = static_cast<float>(v.y + a.y * accel);
+		state->LinearVelocity.z = static_cast<float>(v.z + a.z * accel);
+	}
+
+//------------------------------------------------------------------
+
+	PoseSampler::PoseSampler() : m_hmd(nullptr), m_history(nullptr), m_period(0.001), m_running(false), m_samples(0), m_misses(0)
+	{
+	}
+
+	PoseSampler::~PoseSampler()
+	{
+		Stop();
+	}
+
+	bool PoseSampler::Start(HmdDevice *hmd, PoseHistory *history, double rate)
+	{
+		if (m_running || !hmd || !history || rate <= 0.0)
+			return false;
+
+		m_hmd = hmd;
+		m_history = history;
+		m_period = 1.0 / rate;
+		m_running = true;
+		m_thread = std::thread(&PoseSampler::m_run, this);
+		return true;
+	}
+
+	void PoseSampler::Stop()
+	{
+		m_running = false;
+		if (m_thread.joinable())
+			m_thread.join();
+		m_hmd = nullptr;
+		m_history = nullptr;
+	}
+
+	void PoseSampler::m_run()
+	{
+		double next = Clock::Now();
+		while (m_running)
+		{
+			ovrPoseStatef state;
+			if (m_hmd->GetHeadState(&state))
+			{
+				m_history->Push(state);
+				m_samples.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+				m_misses.fetch_add(1, std::memory_order_relaxed);
+
+			// Fixed ticks; after a long stall start again from now instead of catching up
+			next += m_period;
+			const double wait = next - Clock::Now();
+			if (wait > 0.0)
+				Clock::Sleep(wait);
+			else if (wait < -m_period)
+				next = Clock::Now();
+		}
+	}
+
+//------------------------------------------------------------------
+}
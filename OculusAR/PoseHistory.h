@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <OVR_CAPI.h>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class HmdDevice;
+
+	// How PoseHistory::Sample goes past the newest sample
+	enum ePrediction
+	{
+		PREDICT_HOLD = 0,		// keep the newest pose
+		PREDICT_VELOCITY,		// constant linear and angular velocity
+		PREDICT_ACCELERATION	// constant linear and angular acceleration
+	};
+
+	// Timestamped head poses of the last second or so, written by one
+	// thread and read by any number of others without locks. Every slot is
+	// guarded by a sequence number; a reader that finds a slot rewritten
+	// under it reads again.
+	//
+	// Times are Clock::Now() seconds, so camera frames (captureTime) and
+	// render frames can ask for the pose at their own time. Angular
+	// velocity and acceleration are in world space, like the rest of the
+	// pose.
+	class PoseHistory
+	{
+	public:
+		// Samples kept, a power of two
+		static const unsigned Capacity = 1024;
+
+		PoseHistory();
+
+		// --- writer side, one thread, times increasing ---
+
+		void Push(const ovrPoseStatef &state);
+		// Pose without derivatives, e.g. from a recording: velocities and
+		// accelerations are estimated from the previous samples
+		void PushPose(double time, const ovrPosef &pose);
+		// Forgets all samples; not while readers are active
+		void Clear();
+
+		// --- reader side, any thread ---
+
+		// Samples pushed so far
+		unsigned long long Count() const { return m_written.load(std::memory_order_acquire); }
+		bool Latest(ovrPoseStatef *state) const;
+		// Pose at time t: interpolated between the samples around it,
+		// predicted from the newest sample (at most MaxPrediction ahead),
+		// or the oldest kept sample for times before it. False if empty.
+		bool Sample(double t, ovrPoseStatef *state, ePrediction prediction = PREDICT_ACCELERATION) const;
+
+		void SetMaxPrediction(double seconds) { m_maxPrediction = seconds; }
+		double MaxPrediction() const { return m_maxPrediction; }
+
+		// The two halves of Sample, usable on their own
+		static void Interpolate(const ovrPoseStatef &a, const ovrPoseStatef &b, double t, ovrPoseStatef *state);
+		static void Predict(const ovrPoseStatef &from, double t, ePrediction prediction, ovrPoseStatef *state);
+
+	private:
+		PoseHistory(const PoseHistory&);
+		PoseHistory &operator=(const PoseHistory&);
+
+		struct Slot
+		{
+			// 2 * index + 1 while sample index is written, 2 * index + 2 after
+			std::atomic<unsigned long long> sequence;
+			ovrPoseStatef state;
+		};
+
+		// False if sample index is not (or no longer) in its slot
+		bool m_read(unsigned long long index, ovrPoseStatef *state) const;
+
+		Slot m_slots[Capacity];
+		std::atomic<unsigned long long> m_written;
+		double m_maxPrediction;
+		// writer only: last pushed state for PushPose
+		ovrPoseStatef m_last;
+	};
+
+	// Fills a PoseHistory from HmdDevice::GetHeadState on its own thread at
+	// a fixed rate, independent of the frame rate
+	class PoseSampler
+	{
+	public:
+		PoseSampler();
+		~PoseSampler();
+
+		// The device and history must outlive the thread (until Stop)
+		bool Start(HmdDevice *hmd, PoseHistory *history, double rate = 1000.0);
+		void Stop();
+
+		unsigned long long Samples() const { return m_samples.load(std::memory_order_relaxed); }
+		// Ticks where the device had no pose to give
+		unsigned long long Misses() const { return m_misses.load(std::memory_order_relaxed); }
+
+	private:
+		void m_run();
+
+		HmdDevice *m_hmd;
+		PoseHistory *m_history;
+		double m_period;
+		std::thread m_thread;
+		std::atomic<bool> m_running;
+		std::atomic<unsigned long long> m_samples;
+		std::atomic<unsigned long long> m_misses;
+	};
+
+//------------------------------------------------------------------
+}
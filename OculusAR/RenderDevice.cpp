@@ -0,0 +1,86 @@
+#include "RenderDevice.h"
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	NullRenderDevice::NullRenderDevice(int cameraWidth, int cameraHeight) :
+		m_ring(MaxDraws * DrawConstants, DrawConstants), m_constants(MaxDraws * DrawConstants),
+		m_instanceRing(MaxInstances * sizeof(OverlayInstance), 4), m_instances(MaxInstances * sizeof(OverlayInstance)), m_cameraPitch(cameraWidth * 4), m_overlaySize(0)
+	{
+		m_camera[0].resize(m_cameraPitch * cameraHeight);
+		m_camera[1].resize(m_cameraPitch * cameraHeight);
+	}
+
+	void RenderDevice::WriteConstants(const void *data, unsigned size)
+	{
+		void *dst = nullptr;
+		const int slot = AllocateConstants(1, &dst);
+		if (slot < 0)
+			return;
+		memcpy(dst, data, size < DrawConstants ? size : DrawConstants);
+		UseConstants(slot);
+	}
+
+//------------------------------------------------------------------
+
+	int NullRenderDevice::AllocateConstants(unsigned count, void **data)
+	{
+		if (count == 0 || count > MaxDraws)
+			return -1;
+		int offset = m_ring.Allocate(count * DrawConstants);
+		if (offset < 0)
+		{
+			m_flush(&m_ring);
+			offset = m_ring.Allocate(count * DrawConstants);
+		}
+		*data = m_ring.At(offset);
+		m_counters.constantWrites += count;
+		return offset / static_cast<int>(DrawConstants);
+	}
+
+	int NullRenderDevice::AllocateInstances(unsigned count, OverlayInstance **data)
+	{
+		if (count == 0 || count > MaxInstances)
+			return -1;
+		// every allocation is a multiple of the instance size, so are the offsets
+		int offset = m_instanceRing.Allocate(count * sizeof(OverlayInstance));
+		if (offset < 0)
+		{
+			m_flush(&m_instanceRing);
+			offset = m_instanceRing.Allocate(count * sizeof(OverlayInstance));
+		}
+		*data = static_cast<OverlayInstance*>(m_instanceRing.At(offset));
+		return offset / static_cast<int>(sizeof(OverlayInstance));
+	}
+
+	void NullRenderDevice::m_flush(const ConstantRing *full)
+	{
+		if (m_ring.Used() != 0)
+		{
+			memcpy(&m_constants[0], m_ring.Data(), m_ring.Used());
+			m_counters.constantMaps++;
+		}
+		if (m_instanceRing.Used() != 0)
+		{
+			memcpy(&m_instances[0], m_instanceRing.Data(), m_instanceRing.Used());
+			m_counters.instanceMaps++;
+		}
+		if (!full || full == &m_ring)
+			m_ring.Reset();
+		if (!full || full == &m_instanceRing)
+			m_instanceRing.Reset();
+	}
+
+	unsigned char *NullRenderDevice::MapCameraTexture(int eye, int *pitch)
+	{
+		if (m_camera[eye].empty())
+			return nullptr;
+		m_counters.cameraUploads++;
+		*pitch = m_cameraPitch;
+		return &m_camera[eye][0];
+	}
+
+//------------------------------------------------------------------
+}
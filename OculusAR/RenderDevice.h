@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <OVR_CAPI.h>
+#include "ConstantRing.h"
+#include "OverlayInstances.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Textures the scene draws with
+	enum eSceneTexture
+	{
+		TEXTURE_OVERLAY_OUT = 0,
+		TEXTURE_OVERLAY_IN,
+		TEXTURE_CAMERA_LEFT,
+		TEXTURE_CAMERA_RIGHT,
+
+		TEXTURE_COUNT
+	};
+
+	// Texel layouts of streamed textures
+	enum eTextureFormat
+	{
+		FORMAT_RGBA8 = 0,	// DXGI_FORMAT_R8G8B8A8_UNORM
+		FORMAT_BC1,			// DXGI_FORMAT_BC1_UNORM: 4x4 texels in 8 bytes, alpha 0 or 255
+		FORMAT_BC3,			// DXGI_FORMAT_BC3_UNORM: 4x4 texels in 16 bytes, BC1 colour and 8 bit alpha
+		FORMAT_BC7			// DXGI_FORMAT_BC7_UNORM: 4x4 texels in 16 bytes
+	};
+
+	// Work a RenderDevice did since the last ResetCounters
+	struct RenderCounters
+	{
+		unsigned long long constantWrites;
+		// Constant buffer maps, one per frame unless a frame overflows the ring
+		unsigned long long constantMaps;
+		unsigned long long textureBinds;
+		// Draw calls, an instanced one counts once
+		unsigned long long draws;
+		unsigned long long instances;
+		// Instance buffer maps, like constantMaps
+		unsigned long long instanceMaps;
+		unsigned long long cameraUploads;
+		// Uploads of streamed texture rows, a level or part of one, and their bytes
+		unsigned long long textureUploads;
+		unsigned long long textureBytes;
+	};
+
+	// What the frame loop needs from the graphics API: one render target
+	// holding both eyes, a constant buffer with the mvp, the textured quad
+	class RenderDevice
+	{
+	public:
+		// Constants of up to MaxDraws draws go to the GPU at once, DrawConstants
+		// bytes each: 64 KB, the 4096 float4 a constant buffer can hold.
+		// shader.hlsl declares its mvp array with the same size.
+		static const unsigned MaxDraws = 1024;
+		static const unsigned DrawConstants = 64;
+		// Overlay instances a frame can upload at once
+		static const unsigned MaxInstances = 4096;
+		// Instanced quads sample a texture array whose slices are the
+		// images of TEXTURE_OVERLAY_OUT and TEXTURE_OVERLAY_IN, in this order
+		static const unsigned OverlaySlices = 2;
+
+		RenderDevice() { ResetCounters(); }
+		virtual ~RenderDevice() {}
+
+		// Clears the eye render target and binds it
+		virtual void BeginFrame() = 0;
+		virtual void SetViewport(const ovrRecti &viewport) = 0;
+		// Room for the vertex shader constants (the transposed mvp) of count
+		// draws in this frame's upload, filled in by the caller. Returns the
+		// first slot, or -1 if count is more than MaxDraws. The slots stay
+		// valid until a constant allocation no longer fits the frame, which
+		// submits everything drawn so far; a full instance upload does not
+		// move them.
+		virtual int AllocateConstants(unsigned count, void **data) = 0;
+		// Constants of the next DrawQuad
+		virtual void UseConstants(int slot) = 0;
+		// Copies the constants of the next DrawQuad into a slot of their own
+		void WriteConstants(const void *data, unsigned size);
+		virtual void SetTexture(eSceneTexture texture) = 0;
+		// Draws the textured quad with the current constants and texture
+		virtual void DrawQuad() = 0;
+		// Room for count overlay instances in this frame's instance upload.
+		// Returns the first instance, or -1 if count is more than
+		// MaxInstances. A full upload is submitted like full constants and
+		// leaves the constant slots alone.
+		virtual int AllocateInstances(unsigned count, OverlayInstance **data) = 0;
+		// Draws count overlay quads starting at instance first with one
+		// instanced draw call, in the current viewport
+		virtual void DrawInstances(int first, unsigned count) = 0;
+		// CPU access to a camera texture (RGBA). Returns null if there is none.
+		virtual unsigned char *MapCameraTexture(int eye, int *pitch) = 0;
+		virtual void UnmapCameraTexture(int eye) = 0;
+		// Streamed textures come up a few rows at a time between BeginTexture
+		// and EndTexture; draws keep the previous image until EndTexture.
+		// overlay targets the texture's slice of the overlay array, which
+		// has OverlaySize() square levels down to 1x1. BeginTexture is false
+		// if the device cannot take the image, e.g. in that format.
+		// UploadTextureRows fills the texel rows [y, y + height) of a level
+		// over its whole width; for the BC formats y is a multiple of 4. data
+		// is the first of them, pitch bytes per row of texels, or of blocks
+		// for the BC formats.
+		virtual bool BeginTexture(eSceneTexture texture, bool overlay, eTextureFormat format, int width, int height, int levels) = 0;
+		virtual void UploadTextureRows(eSceneTexture texture, bool overlay, int level, int y, int height, const unsigned char *data, int pitch, size_t bytes) = 0;
+		virtual void EndTexture(eSceneTexture texture, bool overlay) = 0;
+		// Size of the overlay array slices, 0 if the device has none
+		virtual int OverlaySize() const = 0;
+		// Finishes rendering into the eye texture
+		virtual void EndFrame() = 0;
+
+		const RenderCounters &Counters() const { return m_counters; }
+		void ResetCounters() { m_counters = RenderCounters(); }
+
+	protected:
+		RenderCounters m_counters;
+	};
+
+	// Renders nothing, but keeps the CPU side of the work: constants go
+	// through a ring like on D3D11 and camera textures live in system memory
+	class NullRenderDevice : public RenderDevice
+	{
+	public:
+		NullRenderDevice(int cameraWidth, int cameraHeight);
+
+		void BeginFrame() { m_ring.Reset(); m_instanceRing.Reset(); }
+		void SetViewport(const ovrRecti &) {}
+		int AllocateConstants(unsigned count, void **data);
+		void UseConstants(int) {}
+		void SetTexture(eSceneTexture) { m_counters.textureBinds++; }
+		void DrawQuad() { m_counters.draws++; }
+		int AllocateInstances(unsigned count, OverlayInstance **data);
+		void DrawInstances(int, unsigned count) { m_counters.draws++; m_counters.instances += count; }
+		unsigned char *MapCameraTexture(int eye, int *pitch);
+		void UnmapCameraTexture(int) {}
+		bool BeginTexture(eSceneTexture, bool, eTextureFormat, int, int, int) { return true; }
+		void UploadTextureRows(eSceneTexture, bool, int, int, int, const unsigned char *, int, size_t bytes) { m_counters.textureUploads++; m_counters.textureBytes += bytes; }
+		void EndTexture(eSceneTexture, bool) {}
+		int OverlaySize() const { return m_overlaySize; }
+		void EndFrame() { m_flush(nullptr); }
+
+		const ConstantRing &Ring() const { return m_ring; }
+		// Pretends to have an overlay array of that size
+		void SetOverlaySize(int size) { m_overlaySize = size; }
+
+	private:
+		// Uploads both rings, as D3D11 does before it submits the draws.
+		// Only full, the ring that ran out, starts over: what was allocated
+		// from the other one and not drawn yet stays valid. nullptr at the
+		// end of the frame resets both.
+		void m_flush(const ConstantRing *full);
+
+		ConstantRing m_ring;
+		std::vector<unsigned char> m_constants;
+		ConstantRing m_instanceRing;
+		std::vector<unsigned char> m_instances;
+		int m_cameraPitch;
+		std::vector<unsigned char> m_camera[2];
+		int m_overlaySize;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,777 @@
+#include "SceneBvh.h"
+#include "Simd.h"
+#include <OVR.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if SIMD_X86
+#	include <emmintrin.h>
+#	include <immintrin.h>
+#endif
+#if SIMD_ARM_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Objects per leaf, at most a pass of the widest object kernel
+	static const int LEAF_SIZE = 8;
+	// Rebuild once the refitted boxes have this much more area, relative to
+	// the root, than right after the build
+	static const float REBUILD_RATIO = 1.5f;
+
+	Aabb Aabb::Transform(const Aabb &local, const float model[16])
+	{
+		// Arvo: every output extent is the sum of the smaller and the larger
+		// products of a matrix element with the input extent
+		Aabb out;
+		for (int i = 0; i < 3; i++)
+		{
+			out.min[i] = out.max[i] = model[i * 4 + 3];
+			for (int j = 0; j < 3; j++)
+			{
+				const float e = model[i * 4 + j] * local.min[j];
+				const float f = model[i * 4 + j] * local.max[j];
+				out.min[i] += e < f ? e : f;
+				out.max[i] += e < f ? f : e;
+			}
+		}
+		return out;
+	}
+
+	void Aabb::Merge(const Aabb &other)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			min[i] = std::min(min[i], other.min[i]);
+			max[i] = std::max(max[i], other.max[i]);
+		}
+	}
+
+	float Aabb::SurfaceArea() const
+	{
+		const float x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+		return 2.0f * (x * y + y * z + z * x);
+	}
+
+//------------------------------------------------------------------
+
+	Frustum::Frustum()
+	{
+		for (int p = 0; p < MaxPlanes; p++)
+		{
+			a[p] = b[p] = c[p] = 0.0f;
+			d[p] = 1.0f;
+		}
+	}
+
+	void Frustum::FromMatrix(const float clip[16])
+	{
+		// Gribb and Hartmann: -w <= x, y <= w and 0 <= z <= w of the clip
+		// coordinates as planes in world space
+		const float *r0 = clip, *r1 = clip + 4, *r2 = clip + 8, *r3 = clip + 12;
+		const float sign[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 0.0f, -1.0f };
+		const float *row[6] = { r0, r0, r1, r1, r2, r2 };
+		for (int p = 0; p < 6; p++)
+		{
+			float plane[4];
+			for (int i = 0; i < 4; i++)
+				plane[i] = p == 4 ? r2[i] : r3[i] + sign[p] * row[p][i];
+			const float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+			a[p] = plane[0] * scale;
+			b[p] = plane[1] * scale;
+			c[p] = plane[2] * scale;
+			d[p] = length > 0.0f ? plane[3] * scale : 1.0f;
+		}
+		for (int p = 6; p < MaxPlanes; p++)
+		{
+			a[p] = b[p] = c[p] = 0.0f;
+			d[p] = 1.0f;
+		}
+	}
+
+	void Frustum::FromStereo(const ovrFovPort fov[2], const ovrPosef eyePose[2], float znear, float zfar)
+	{
+		const OVR::Quatf orientation(eyePose[0].Orientation);
+		const OVR::Vector3f right = orientation.Rotate(OVR::Vector3f(1.0f, 0.0f, 0.0f));
+		const OVR::Vector3f up = orientation.Rotate(OVR::Vector3f(0.0f, 1.0f, 0.0f));
+		const OVR::Vector3f forward = orientation.Rotate(OVR::Vector3f(0.0f, 0.0f, -1.0f));
+		const OVR::Vector3f center = (OVR::Vector3f(eyePose[0].Position) + OVR::Vector3f(eyePose[1].Position)) * 0.5f;
+
+		ovrFovPort both;
+		both.LeftTan = std::max(fov[0].LeftTan, fov[1].LeftTan);
+		both.RightTan = std::max(fov[0].RightTan, fov[1].RightTan);
+		both.UpTan = std::max(fov[0].UpTan, fov[1].UpTan);
+		both.DownTan = std::max(fov[0].DownTan, fov[1].DownTan);
+
+		// The apex goes back far enough that each side of the wider fov
+		// passes outside both eye positions; the eye frusta, no wider than
+		// that fov, then stay inside from there on.
+		float back = 0.0f;
+		float nearest = 0.0f, farthest = 0.0f;
+		for (int eye = 0; eye < 2; eye++)
+		{
+			const OVR::Vector3f offset = OVR::Vector3f(eyePose[eye].Position) - center;
+			const float x = offset.Dot(right), y = offset.Dot(up), z = offset.Dot(forward);
+			if (both.LeftTan > 0.0f)
+				back = std::max(back, -x / both.LeftTan - z);
+			if (both.RightTan > 0.0f)
+				back = std::max(back, x / both.RightTan - z);
+			if (both.UpTan > 0.0f)
+				back = std::max(back, y / both.UpTan - z);
+			if (both.DownTan > 0.0f)
+				back = std::max(back, -y / both.DownTan - z);
+			nearest = eye == 0 ? z : std::min(nearest, z);
+			farthest = eye == 0 ? z : std::max(farthest, z);
+		}
+
+		const OVR::Vector3f apex = center - forward * back;
+		const float nearDistance = std::max(back + nearest + znear, znear * 0.5f);
+		const float farDistance = back + farthest + zfar;
+		const OVR::Matrix4f projection = ovrMatrix4f_Projection(both, nearDistance, farDistance, true);
+		const OVR::Matrix4f view = OVR::Matrix4f::LookAtRH(apex, apex + forward, up);
+		const OVR::Matrix4f clip = projection * view;
+		FromMatrix(&clip.M[0][0]);
+	}
+
+//------------------------------------------------------------------
+
+	// Tests a box against the planes in mask. Returns false when it is
+	// outside one of them, otherwise mask keeps the planes it crosses.
+	static bool s_boxTestScalar(const Frustum &f, const float center[3], const float extent[3], unsigned *mask)
+	{
+		unsigned crossing = 0;
+		for (int p = 0; p < Frustum::MaxPlanes; p++)
+		{
+			if (!(*mask & (1u << p)))
+				continue;
+			const float distance = f.a[p] * center[0] + f.b[p] * center[1] + f.c[p] * center[2] + f.d[p];
+			const float radius = fabsf(f.a[p]) * extent[0] + fabsf(f.b[p]) * extent[1] + fabsf(f.c[p]) * extent[2];
+			if (distance + radius < 0.0f)
+				return false;
+			if (distance - radius < 0.0f)
+				crossing |= 1u << p;
+		}
+		*mask = crossing;
+		return true;
+	}
+
+#if SIMD_ARM_NEON
+	static unsigned s_movemaskNEON(uint32x4_t v)
+	{
+		return (vgetq_lane_u32(v, 0) & 1) | (vgetq_lane_u32(v, 1) & 2) | (vgetq_lane_u32(v, 2) & 4) | (vgetq_lane_u32(v, 3) & 8);
+	}
+
+#endif
+
+	// Tests count (up to 8) boxes from first of the SoA bounds, centers x,
+	// y, z then extents x, y, z stride floats apart, against all planes.
+	// Returns a bit for every box not outside any of them. Planes that
+	// accept everything are skipped; they cannot change the answer.
+	typedef unsigned (*BoxesTestFn)(const Frustum &f, const float *soa, int stride, int first, int count);
+
+	static bool s_unusedPlane(const Frustum &f, int p)
+	{
+		return f.a[p] == 0.0f && f.b[p] == 0.0f && f.c[p] == 0.0f && f.d[p] >= 0.0f;
+	}
+
+	static unsigned s_boxesTestScalar(const Frustum &f, const float *soa, int stride, int first, int count)
+	{
+		int planes[Frustum::MaxPlanes];
+		int used = 0;
+		for (int p = 0; p < Frustum::MaxPlanes; p++)
+			if (!s_unusedPlane(f, p))
+				planes[used++] = p;
+
+		unsigned inside = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const int o = first + i;
+			const float cx = soa[o], cy = soa[stride + o], cz = soa[2 * stride + o];
+			const float ex = soa[3 * stride + o], ey = soa[4 * stride + o], ez = soa[5 * stride + o];
+			int k = 0;
+			for (; k < used; k++)
+			{
+				const int p = planes[k];
+				const float distance = f.a[p] * cx + f.b[p] * cy + f.c[p] * cz + f.d[p];
+				const float radius = fabsf(f.a[p]) * ex + fabsf(f.b[p]) * ey + fabsf(f.c[p]) * ez;
+				if (distance + radius < 0.0f)
+					break;
+			}
+			if (k == used)
+				inside |= 1u << i;
+		}
+		return inside;
+	}
+
+#if SIMD_X86
+	// 4 boxes per step, one plane at a time, same sums in the same order as the scalar test
+	static unsigned s_boxesTestSSE2(const Frustum &f, const float *soa, int stride, int first, int count)
+	{
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const __m128 zero = _mm_setzero_ps();
+		unsigned inside = 0;
+		for (int i = 0; i < count; i += 4)
+		{
+			const float *s = soa + first + i;
+			const __m128 cx = _mm_loadu_ps(s), cy = _mm_loadu_ps(s + stride), cz = _mm_loadu_ps(s + 2 * stride);
+			const __m128 ex = _mm_loadu_ps(s + 3 * stride), ey = _mm_loadu_ps(s + 4 * stride), ez = _mm_loadu_ps(s + 5 * stride);
+			__m128 outside = zero;
+			for (int p = 0; p < Frustum::MaxPlanes; p++)
+			{
+				if (s_unusedPlane(f, p))
+					continue;
+				const __m128 a = _mm_set1_ps(f.a[p]), b = _mm_set1_ps(f.b[p]), c = _mm_set1_ps(f.c[p]);
+				const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_mul_ps(c, cz)), _mm_set1_ps(f.d[p]));
+				const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(a, absMask), ex), _mm_mul_ps(_mm_and_ps(b, absMask), ey)),
+					_mm_mul_ps(_mm_and_ps(c, absMask), ez));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+			}
+			inside |= (~static_cast<unsigned>(_mm_movemask_ps(outside)) & 0xF) << i;
+		}
+		return inside & ((1u << count) - 1);
+	}
+
+	SIMD_TARGET_AVX2 static unsigned s_boxesTestAVX2(const Frustum &f, const float *soa, int stride, int first, int count)
+	{
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		const __m256 zero = _mm256_setzero_ps();
+		const float *s = soa + first;
+		const __m256 cx = _mm256_loadu_ps(s), cy = _mm256_loadu_ps(s + stride), cz = _mm256_loadu_ps(s + 2 * stride);
+		const __m256 ex = _mm256_loadu_ps(s + 3 * stride), ey = _mm256_loadu_ps(s + 4 * stride), ez = _mm256_loadu_ps(s + 5 * stride);
+		__m256 outside = zero;
+		for (int p = 0; p < Frustum::MaxPlanes; p++)
+		{
+			if (s_unusedPlane(f, p))
+				continue;
+			const __m256 a = _mm256_set1_ps(f.a[p]), b = _mm256_set1_ps(f.b[p]), c = _mm256_set1_ps(f.c[p]);
+			const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(b, cy)), _mm256_mul_ps(c, cz)),
+				_mm256_set1_ps(f.d[p]));
+			const __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_and_ps(a, absMask), ex), _mm256_mul_ps(_mm256_and_ps(b, absMask), ey)),
+				_mm256_mul_ps(_mm256_and_ps(c, absMask), ez));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+		}
+		return ~static_cast<unsigned>(_mm256_movemask_ps(outside)) & ((1u << count) - 1);
+	}
+#endif
+
+#if SIMD_ARM_NEON
+	static unsigned s_boxesTestNEON(const Frustum &f, const float *soa, int stride, int first, int count)
+	{
+		const float32x4_t zero = vdupq_n_f32(0.0f);
+		unsigned inside = 0;
+		for (int i = 0; i < count; i += 4)
+		{
+			const float *s = soa + first + i;
+			const float32x4_t cx = vld1q_f32(s), cy = vld1q_f32(s + stride), cz = vld1q_f32(s + 2 * stride);
+			const float32x4_t ex = vld1q_f32(s + 3 * stride), ey = vld1q_f32(s + 4 * stride), ez = vld1q_f32(s + 5 * stride);
+			uint32x4_t outside = vdupq_n_u32(0);
+			for (int p = 0; p < Frustum::MaxPlanes; p++)
+			{
+				if (s_unusedPlane(f, p))
+					continue;
+				const float a = f.a[p], b = f.b[p], c = f.c[p];
+				// separate multiplies and adds, a fused vmla would round differently
+				const float32x4_t distance = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(cx, a), vmulq_n_f32(cy, b)), vmulq_n_f32(cz, c)), vdupq_n_f32(f.d[p]));
+				const float32x4_t radius = vaddq_f32(vaddq_f32(vmulq_n_f32(ex, fabsf(a)), vmulq_n_f32(ey, fabsf(b))), vmulq_n_f32(ez, fabsf(c)));
+				outside = vorrq_u32(outside, vcltq_f32(vaddq_f32(distance, radius), zero));
+			}
+			inside |= (~s_movemaskNEON(outside) & 0xF) << i;
+		}
+		return inside & ((1u << count) - 1);
+	}
+#endif
+
+	static BoxesTestFn s_pickBoxesTest(eSimdLevel level)
+	{
+#if SIMD_X86
+		if (level == SIMD_AVX2)
+			return s_boxesTestAVX2;
+		if (level == SIMD_SSE2)
+			return s_boxesTestSSE2;
+#elif SIMD_ARM_NEON
+		if (level == SIMD_NEON)
+			return s_boxesTestNEON;
+#endif
+		(void)level;
+		return s_boxesTestScalar;
+	}
+
+	// Tests count (up to 4) boxes stored as centers x, y, z then extents
+	// x, y, z of 4 floats each against the planes in mask. Returns a bit for
+	// every box not outside one of them; crossing gets the planes of mask
+	// each of those boxes crosses.
+	typedef unsigned (*NodeTestFn)(const Frustum &f, const float bounds[6][4], int count, unsigned mask, unsigned crossing[4]);
+
+	static unsigned s_nodeTestScalar(const Frustum &f, const float bounds[6][4], int count, unsigned mask, unsigned crossing[4])
+	{
+		unsigned inside = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const float center[3] = { bounds[0][i], bounds[1][i], bounds[2][i] };
+			const float extent[3] = { bounds[3][i], bounds[4][i], bounds[5][i] };
+			crossing[i] = mask;
+			if (s_boxTestScalar(f, center, extent, &crossing[i]))
+				inside |= 1u << i;
+		}
+		return inside;
+	}
+
+#if SIMD_X86
+	// AVX2 uses this one too, a node only has 4 children
+	static unsigned s_nodeTestSSE2(const Frustum &f, const float bounds[6][4], int count, unsigned mask, unsigned crossing[4])
+	{
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 cx = _mm_loadu_ps(bounds[0]), cy = _mm_loadu_ps(bounds[1]), cz = _mm_loadu_ps(bounds[2]);
+		const __m128 ex = _mm_loadu_ps(bounds[3]), ey = _mm_loadu_ps(bounds[4]), ez = _mm_loadu_ps(bounds[5]);
+		__m128 outside = zero;
+		crossing[0] = crossing[1] = crossing[2] = crossing[3] = 0;
+		for (int p = 0; p < Frustum::MaxPlanes; p++)
+		{
+			if (!(mask & (1u << p)))
+				continue;
+			const __m128 a = _mm_set1_ps(f.a[p]), b = _mm_set1_ps(f.b[p]), c = _mm_set1_ps(f.c[p]);
+			const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_mul_ps(c, cz)), _mm_set1_ps(f.d[p]));
+			const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(a, absMask), ex), _mm_mul_ps(_mm_and_ps(b, absMask), ey)),
+				_mm_mul_ps(_mm_and_ps(c, absMask), ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+			const unsigned crosses = static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero)));
+			for (int i = 0; i < 4; i++)
+				crossing[i] |= ((crosses >> i) & 1) << p;
+		}
+		return ~static_cast<unsigned>(_mm_movemask_ps(outside)) & ((1u << count) - 1);
+	}
+#endif
+
+#if SIMD_ARM_NEON
+	static unsigned s_nodeTestNEON(const Frustum &f, const float bounds[6][4], int count, unsigned mask, unsigned crossing[4])
+	{
+		const float32x4_t zero = vdupq_n_f32(0.0f);
+		const float32x4_t cx = vld1q_f32(bounds[0]), cy = vld1q_f32(bounds[1]), cz = vld1q_f32(bounds[2]);
+		const float32x4_t ex = vld1q_f32(bounds[3]), ey = vld1q_f32(bounds[4]), ez = vld1q_f32(bounds[5]);
+		uint32x4_t outside = vdupq_n_u32(0);
+		crossing[0] = crossing[1] = crossing[2] = crossing[3] = 0;
+		for (int p = 0; p < Frustum::MaxPlanes; p++)
+		{
+			if (!(mask & (1u << p)))
+				continue;
+			const float a = f.a[p], b = f.b[p], c = f.c[p];
+			const float32x4_t distance = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(cx, a), vmulq_n_f32(cy, b)), vmulq_n_f32(cz, c)), vdupq_n_f32(f.d[p]));
+			const float32x4_t radius = vaddq_f32(vaddq_f32(vmulq_n_f32(ex, fabsf(a)), vmulq_n_f32(ey, fabsf(b))), vmulq_n_f32(ez, fabsf(c)));
+			outside = vorrq_u32(outside, vcltq_f32(vaddq_f32(distance, radius), zero));
+			const unsigned crosses = s_movemaskNEON(vcltq_f32(vsubq_f32(distance, radius), zero));
+			for (int i = 0; i < 4; i++)
+				crossing[i] |= ((crosses >> i) & 1) << p;
+		}
+		return ~s_movemaskNEON(outside) & ((1u << count) - 1);
+	}
+#endif
+
+	static NodeTestFn s_pickNodeTest(eSimdLevel level)
+	{
+#if SIMD_X86
+		if (level == SIMD_AVX2 || level == SIMD_SSE2)
+			return s_nodeTestSSE2;
+#elif SIMD_ARM_NEON
+		if (level == SIMD_NEON)
+			return s_nodeTestNEON;
+#endif
+		(void)level;
+		return s_nodeTestScalar;
+	}
+
+	static void s_centerExtent(const Aabb &box, float center[3], float extent[3])
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			center[i] = (box.min[i] + box.max[i]) * 0.5f;
+			extent[i] = (box.max[i] - box.min[i]) * 0.5f;
+		}
+	}
+
+//------------------------------------------------------------------
+
+	SceneBvh::SceneBvh() : m_soaStride(0), m_built(false), m_linear(false), m_builtArea(0.0f), m_builds(0)
+	{
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
+	void SceneBvh::Clear()
+	{
+		m_bounds.clear();
+		m_nodes.clear();
+		m_wide.clear();
+		m_laneOf.clear();
+		m_order.clear();
+		m_leafOf.clear();
+		m_slot.clear();
+		m_soa.clear();
+		m_moved.clear();
+		m_dirty.clear();
+		m_flags.clear();
+		m_built = false;
+	}
+
+	int SceneBvh::Add(const Aabb &bounds)
+	{
+		m_bounds.push_back(bounds);
+		m_leafOf.push_back(-1);
+		m_slot.push_back(-1);
+		// new objects need a new tree
+		m_built = false;
+		return Count() - 1;
+	}
+
+	void SceneBvh::SetBounds(int id, const Aabb &bounds)
+	{
+		m_bounds[id] = bounds;
+		if (m_built)
+			m_moved.push_back(id);
+	}
+
+	void SceneBvh::Build()
+	{
+		m_nodes.clear();
+		m_moved.clear();
+		m_order.resize(m_bounds.size());
+		for (size_t i = 0; i < m_order.size(); i++)
+			m_order[i] = static_cast<int>(i);
+		m_wide.clear();
+		m_linear = Count() < LinearCount;
+		if (!m_linear)
+		{
+			m_nodes.reserve(2 * m_bounds.size() / LEAF_SIZE + 1);
+			m_nodes.resize(1);
+			m_build(0, -1, 0, Count());
+			m_laneOf.assign(m_nodes.size(), -1);
+			m_wide.reserve(m_nodes.size() / 4 + 1);
+			m_flatten(0);
+		}
+
+		// the kernels load 8 floats from any object on
+		m_soaStride = Count() + 8;
+		m_soa.assign(6 * m_soaStride, 0.0f);
+		for (int i = 0; i < Count(); i++)
+			m_slot[m_order[i]] = i;
+		for (int id = 0; id < Count(); id++)
+			m_storeBounds(id);
+		m_flags.assign(m_bounds.size(), 0);
+		m_dirty.assign(m_nodes.size(), 0);
+		m_built = true;
+		m_builtArea = m_totalArea();
+		m_builds++;
+	}
+
+	void SceneBvh::m_build(int index, int parent, int begin, int end)
+	{
+		Aabb bounds = m_bounds[m_order[begin]];
+		Aabb centroids;
+		for (int i = 0; i < 3; i++)
+			centroids.min[i] = centroids.max[i] = (bounds.min[i] + bounds.max[i]) * 0.5f;
+		for (int o = begin + 1; o < end; o++)
+		{
+			const Aabb &box = m_bounds[m_order[o]];
+			bounds.Merge(box);
+			Aabb centroid;
+			for (int i = 0; i < 3; i++)
+				centroid.min[i] = centroid.max[i] = (box.min[i] + box.max[i]) * 0.5f;
+			centroids.Merge(centroid);
+		}
+
+		Node &node = m_nodes[index];
+		node.bounds = bounds;
+		node.parent = parent;
+		if (end - begin <= LEAF_SIZE)
+		{
+			node.left = -1;
+			node.first = begin;
+			node.count = end - begin;
+			for (int o = begin; o < end; o++)
+				m_leafOf[m_order[o]] = index;
+			return;
+		}
+
+		int axis = 0;
+		for (int i = 1; i < 3; i++)
+			if (centroids.max[i] - centroids.min[i] > centroids.max[axis] - centroids.min[axis])
+				axis = i;
+		const int middle = (begin + end) / 2;
+		const std::vector<Aabb> &boxes = m_bounds;
+		std::nth_element(m_order.begin() + begin, m_order.begin() + middle, m_order.begin() + end, [&](int x, int y) {
+			return boxes[x].min[axis] + boxes[x].max[axis] < boxes[y].min[axis] + boxes[y].max[axis];
+		});
+
+		const int left = static_cast<int>(m_nodes.size());
+		node.left = left;
+		node.first = 0;
+		node.count = 0;
+		// node is not valid past the resize
+		m_nodes.resize(left + 2);
+		m_build(left, index, begin, middle);
+		m_build(left + 1, index, middle, end);
+	}
+
+	int SceneBvh::m_flatten(int index)
+	{
+		// the children, or their children where they have some
+		int lanes[4];
+		int count = 0;
+		for (int c = 0; c < 2; c++)
+		{
+			const Node &child = m_nodes[m_nodes[index].left + c];
+			if (child.left < 0)
+				lanes[count++] = m_nodes[index].left + c;
+			else
+			{
+				lanes[count++] = child.left;
+				lanes[count++] = child.left + 1;
+			}
+		}
+
+		const int wide = static_cast<int>(m_wide.size());
+		m_wide.push_back(WideNode());
+		memset(&m_wide[wide], 0, sizeof(WideNode));
+		m_wide[wide].count = count;
+		for (int i = 0; i < count; i++)
+		{
+			m_laneOf[lanes[i]] = wide * 4 + i;
+			m_storeLane(lanes[i]);
+			// m_wide grows on the way down, no references across this
+			const int child = m_nodes[lanes[i]].left < 0 ? ~lanes[i] : m_flatten(lanes[i]);
+			m_wide[wide].child[i] = child;
+		}
+		return wide;
+	}
+
+	void SceneBvh::m_storeLane(int index)
+	{
+		const int lane = m_laneOf[index];
+		if (lane < 0)
+			return;
+		float center[3], extent[3];
+		s_centerExtent(m_nodes[index].bounds, center, extent);
+		WideNode &wide = m_wide[lane >> 2];
+		for (int i = 0; i < 3; i++)
+		{
+			wide.bounds[i][lane & 3] = center[i];
+			wide.bounds[3 + i][lane & 3] = extent[i];
+		}
+	}
+
+	void SceneBvh::m_storeBounds(int id)
+	{
+		float center[3], extent[3];
+		s_centerExtent(m_bounds[id], center, extent);
+		float *soa = &m_soa[m_slot[id]];
+		for (int i = 0; i < 3; i++)
+		{
+			soa[i * m_soaStride] = center[i];
+			soa[(3 + i) * m_soaStride] = extent[i];
+		}
+	}
+
+	float SceneBvh::m_totalArea() const
+	{
+		if (m_nodes.empty())
+			return 0.0f;
+		double area = 0.0;
+		for (size_t i = 0; i < m_nodes.size(); i++)
+			area += m_nodes[i].bounds.SurfaceArea();
+		const float root = m_nodes[0].bounds.SurfaceArea();
+		return root > 0.0f ? static_cast<float>(area / root) : 0.0f;
+	}
+
+	void SceneBvh::Refit()
+	{
+		if (!m_built)
+		{
+			Build();
+			return;
+		}
+		if (m_moved.empty())
+			return;
+		for (size_t i = 0; i < m_moved.size(); i++)
+			m_storeBounds(m_moved[i]);
+		if (m_linear)
+		{
+			m_moved.clear();
+			return;
+		}
+
+		// Leaves first, each one once, then up while the boxes change
+		std::vector<int> leaves;
+		for (size_t i = 0; i < m_moved.size(); i++)
+		{
+			const int leaf = m_leafOf[m_moved[i]];
+			if (!m_dirty[leaf])
+			{
+				m_dirty[leaf] = 1;
+				leaves.push_back(leaf);
+			}
+		}
+		m_moved.clear();
+
+		for (size_t i = 0; i < leaves.size(); i++)
+		{
+			int index = leaves[i];
+			m_dirty[index] = 0;
+			Node *node = &m_nodes[index];
+			Aabb bounds = m_bounds[m_order[node->first]];
+			for (int o = 1; o < node->count; o++)
+				bounds.Merge(m_bounds[m_order[node->first + o]]);
+			for (;;)
+			{
+				if (memcmp(&bounds, &node->bounds, sizeof(bounds)) == 0)
+					break;
+				node->bounds = bounds;
+				m_storeLane(index);
+				if (node->parent < 0)
+					break;
+				index = node->parent;
+				node = &m_nodes[index];
+				bounds = m_nodes[node->left].bounds;
+				bounds.Merge(m_nodes[node->left + 1].bounds);
+			}
+		}
+
+		if (m_totalArea() > m_builtArea * REBUILD_RATIO)
+			Build();
+	}
+
+	void SceneBvh::Cull(const Frustum &stereo, const Frustum eye[2], std::vector<int> visible[2])
+	{
+		Refit();
+		const NodeTestFn testNode = s_pickNodeTest(Simd::Level());
+		const BoxesTestFn testBoxes = s_pickBoxesTest(Simd::Level());
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_candidates.clear();
+		visible[0].clear();
+		visible[1].clear();
+		if (m_bounds.empty())
+			return;
+
+		// The objects at [first, first + count) of m_order against each eye,
+		// 8 at a time. In id order they go straight to visible, otherwise
+		// they are flagged and sorted out afterwards.
+		const float *soa = &m_soa[0];
+		auto testObjects = [&](int first, int count, bool inOrder) {
+			m_stats.candidates += count;
+			for (int o = 0; o < count; o += 8)
+			{
+				const int n = std::min(8, count - o);
+				const unsigned inside[2] = { testBoxes(eye[0], soa, m_soaStride, first + o, n), testBoxes(eye[1], soa, m_soaStride, first + o, n) };
+				for (int i = 0; i < n; i++)
+				{
+					const unsigned flags = ((inside[0] >> i) & 1) | (((inside[1] >> i) & 1) << 1);
+					if (!flags)
+						continue;
+					const int id = m_order[first + o + i];
+					if (inOrder)
+					{
+						if (flags & 1)
+							visible[0].push_back(id);
+						if (flags & 2)
+							visible[1].push_back(id);
+					}
+					else
+					{
+						m_flags[id] = static_cast<unsigned char>(flags);
+						m_candidates.push_back(id);
+					}
+				}
+			}
+		};
+
+		if (m_linear)
+			testObjects(0, Count(), true);
+		else
+		{
+			// Both eyes at once down the wide nodes, 4 children per test
+			const unsigned allPlanes = (1u << Frustum::MaxPlanes) - 1;
+			m_stack.clear();
+			m_stack.push_back(std::make_pair(0, allPlanes));
+			while (!m_stack.empty())
+			{
+				const WideNode &node = m_wide[m_stack.back().first];
+				const unsigned mask = m_stack.back().second;
+				m_stack.pop_back();
+
+				unsigned crossing[4] = { 0, 0, 0, 0 };
+				const unsigned inside = mask != 0 ? testNode(stereo, node.bounds, node.count, mask, crossing) : (1u << node.count) - 1;
+				m_stats.nodesTested += node.count;
+				for (int i = node.count - 1; i >= 0; i--)
+				{
+					if (!(inside & (1u << i)))
+						continue;
+					if (node.child[i] >= 0)
+						m_stack.push_back(std::make_pair(node.child[i], crossing[i]));
+					else
+					{
+						const Node &leaf = m_nodes[~node.child[i]];
+						testObjects(leaf.first, leaf.count, false);
+					}
+				}
+			}
+
+			// Back to id order: a few objects are sorted, many are picked up
+			// by going over the flags, 8 at a time past the empty ones
+			if (m_candidates.size() * 32 < m_bounds.size())
+			{
+				std::sort(m_candidates.begin(), m_candidates.end());
+				for (size_t i = 0; i < m_candidates.size(); i++)
+				{
+					const int id = m_candidates[i];
+					if (m_flags[id] & 1)
+						visible[0].push_back(id);
+					if (m_flags[id] & 2)
+						visible[1].push_back(id);
+					m_flags[id] = 0;
+				}
+			}
+			else
+			{
+				const int count = Count();
+				for (int id = 0; id < count;)
+				{
+					unsigned long long word;
+					if (id + 8 <= count && (memcpy(&word, &m_flags[id], sizeof(word)), word == 0))
+					{
+						id += 8;
+						continue;
+					}
+					if (m_flags[id] & 1)
+						visible[0].push_back(id);
+					if (m_flags[id] & 2)
+						visible[1].push_back(id);
+					m_flags[id++] = 0;
+				}
+			}
+		}
+		m_stats.visible[0] = static_cast<unsigned>(visible[0].size());
+		m_stats.visible[1] = static_cast<unsigned>(visible[1].size());
+	}
+
+	void SceneBvh::CullReference(const Frustum eye[2], std::vector<int> visible[2]) const
+	{
+		visible[0].clear();
+		visible[1].clear();
+		for (int id = 0; id < Count(); id++)
+		{
+			float center[3], extent[3];
+			s_centerExtent(m_bounds[id], center, extent);
+			for (int e = 0; e < 2; e++)
+			{
+				unsigned mask = (1u << Frustum::MaxPlanes) - 1;
+				if (s_boxTestScalar(eye[e], center, extent, &mask))
+					visible[e].push_back(id);
+			}
+		}
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <OVR_CAPI.h>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Axis aligned box in world space
+	struct Aabb
+	{
+		float min[3];
+		float max[3];
+
+		// Bounds of the local box after the row-major model transform
+		static Aabb Transform(const Aabb &local, const float model[16]);
+		void Merge(const Aabb &other);
+		float SurfaceArea() const;
+	};
+
+	// Up to 8 planes a * x + b * y + c * z + d >= 0 on the inside, normalized
+	// and stored per component, so a box meets all of them in one SIMD
+	// pass. Unused planes accept everything.
+	struct Frustum
+	{
+		static const int MaxPlanes = 8;
+		float a[MaxPlanes];
+		float b[MaxPlanes];
+		float c[MaxPlanes];
+		float d[MaxPlanes];
+
+		Frustum();
+		// Six planes of a row-major projection * view with D3D depth, like
+		// the ones ovrMatrix4f_Projection and OVR::Matrix4f produce
+		void FromMatrix(const float clip[16]);
+		// One frustum holding both eye frusta: the union of the fovs from an
+		// apex pulled back behind the eyes. The eyes must share their
+		// orientation, as the LibOVR eye poses of a frame do.
+		void FromStereo(const ovrFovPort fov[2], const ovrPosef eyePose[2], float znear, float zfar);
+	};
+
+	// Counters of the last SceneBvh::Cull
+	struct CullStats
+	{
+		unsigned nodesTested;
+		// Objects tested against the eyes
+		unsigned candidates;
+		unsigned visible[2];
+	};
+
+	// Overlay objects in a bounding-volume hierarchy for frustum culling.
+	// Objects moving only refit the boxes above them; once the refitted
+	// tree has become much looser than a fresh one it is rebuilt.
+	//
+	// Cull walks the tree once against the combined stereo frustum, nodes
+	// fully inside a plane stop testing it, and tests the objects of the
+	// leaves that survive against each eye. For the walk the binary tree is
+	// flattened into nodes of 4 children (its grandchildren) whose bounds
+	// are stored as centers and extents per component, and the object
+	// bounds are kept the same way in leaf order, so the SSE2, NEON and
+	// AVX2 kernels test 4 children or 4 to 8 objects per plane at once.
+	// Every level gives the same answer as the scalar one.
+	//
+	// Below LinearCount objects no tree is built: walking one costs more
+	// than it saves, and every object is tested against each eye in id
+	// order instead.
+	class SceneBvh
+	{
+	public:
+		// Fewer objects are culled without a tree
+		static const int LinearCount = 2048;
+
+		SceneBvh();
+
+		void Clear();
+		// Returns the id of the object, ids count up from 0
+		int Add(const Aabb &bounds);
+		// Takes effect with the next Refit or Build
+		void SetBounds(int id, const Aabb &bounds);
+		int Count() const { return static_cast<int>(m_bounds.size()); }
+		const Aabb &Bounds(int id) const { return m_bounds[id]; }
+
+		// Builds the tree from scratch, splitting at the median centroid
+		// of the longest axis, or only lays out the bounds below LinearCount
+		void Build();
+		// Fits the boxes above moved objects; rebuilds instead when the tree
+		// has not been built yet or has degraded
+		void Refit();
+		unsigned Builds() const { return m_builds; }
+		// No tree, every object is tested
+		bool Linear() const { return m_linear; }
+
+		// Ids of the objects at least partly inside each eye frustum,
+		// ascending. Refits first.
+		void Cull(const Frustum &stereo, const Frustum eye[2], std::vector<int> visible[2]);
+		// The same by testing every object against each eye, for checking
+		void CullReference(const Frustum eye[2], std::vector<int> visible[2]) const;
+		const CullStats &Stats() const { return m_stats; }
+
+	private:
+		struct Node
+		{
+			Aabb bounds;
+			int parent;
+			// Inner nodes: child nodes left and left + 1. Leaves: left < 0
+			// and count objects from first in m_order.
+			int left;
+			int first;
+			int count;
+		};
+
+		struct WideNode
+		{
+			// Centers x, y, z then extents x, y, z of up to 4 children
+			float bounds[6][4];
+			// Child wide node, or ~index of a leaf in m_nodes
+			int child[4];
+			int count;
+		};
+
+		void m_build(int index, int parent, int begin, int end);
+		// Wide node of an inner node, with its grandchildren as children
+		int m_flatten(int index);
+		// Bounds of a node into its lane of a wide node, if it has one
+		void m_storeLane(int index);
+		float m_totalArea() const;
+		// Center and extent of an object into its place in m_soa
+		void m_storeBounds(int id);
+
+		std::vector<Aabb> m_bounds;
+		std::vector<Node> m_nodes;
+		std::vector<WideNode> m_wide;
+		// Wide node * 4 + lane holding every node of m_nodes, -1 for the
+		// root and the nodes skipped by flattening
+		std::vector<int> m_laneOf;
+		// Object ids grouped by leaf
+		std::vector<int> m_order;
+		// Leaf of every object, and its place in m_order
+		std::vector<int> m_leafOf;
+		std::vector<int> m_slot;
+		// Centers x, y, z then extents x, y, z of the objects in m_order
+		// order, m_soaStride floats each, padded for the widest kernel
+		std::vector<float> m_soa;
+		int m_soaStride;
+		std::vector<int> m_moved;
+		std::vector<unsigned char> m_dirty;
+		bool m_built;
+		bool m_linear;
+		float m_builtArea;
+		unsigned m_builds;
+
+		std::vector<int> m_candidates;
+		// Bit per eye of the objects found visible out of id order
+		std::vector<unsigned char> m_flags;
+		std::vector<std::pair<int, unsigned> > m_stack;
+		CullStats m_stats;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,219 @@
+#include "ShaderCache.h"
+#include "Hash.h"
+#include "Log.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static const unsigned SHADER_ARCHIVE_MAGIC = 0x4853414F;	// "OASH"
+	static const unsigned SHADER_ARCHIVE_VERSION = 1;
+
+	ShaderCache::ShaderCache(const char *archivePath, const ShaderCompiler &compiler, unsigned long long compilerId) :
+		m_path(archivePath), m_compiler(compiler), m_compilerId(compilerId), m_hits(0), m_compiled(0)
+	{
+	}
+
+	unsigned long long ShaderCache::Key(const ShaderRequest &request, const unsigned char *source, size_t size)
+	{
+		unsigned long long key = HashBytes(source, size);
+		key = HashBytes(request.entry.c_str(), request.entry.size() + 1, key);
+		key = HashBytes(request.profile.c_str(), request.profile.size() + 1, key);
+		return HashBytes(&request.flags, sizeof(request.flags), key);
+	}
+
+	bool ShaderCache::m_open()
+	{
+		if (m_archive.IsOpen())
+			return true;
+		if (!m_archive.Open(m_path.c_str()))
+			return false;
+
+		const unsigned char *data = m_archive.Data();
+		const size_t size = m_archive.Size();
+		const ShaderArchiveHeader *header = reinterpret_cast<const ShaderArchiveHeader*>(data);
+		bool ok = size >= sizeof(ShaderArchiveHeader) && header->magic == SHADER_ARCHIVE_MAGIC && header->version == SHADER_ARCHIVE_VERSION &&
+			header->compiler == m_compilerId && (size - sizeof(ShaderArchiveHeader)) / sizeof(ShaderArchiveEntry) >= header->entries;
+		const ShaderArchiveEntry *entries = reinterpret_cast<const ShaderArchiveEntry*>(data + sizeof(ShaderArchiveHeader));
+		for (unsigned i = 0; ok && i < header->entries; i++)
+			ok = entries[i].offset <= size && entries[i].size <= size - entries[i].offset && (i == 0 || entries[i - 1].key < entries[i].key);
+		if (!ok)
+			m_archive.Close();
+		return ok;
+	}
+
+	bool ShaderCache::m_find(unsigned long long key, ShaderBlob &blob) const
+	{
+		if (!m_archive.IsOpen())
+			return false;
+		const unsigned char *data = m_archive.Data();
+		const ShaderArchiveHeader *header = reinterpret_cast<const ShaderArchiveHeader*>(data);
+		const ShaderArchiveEntry *entries = reinterpret_cast<const ShaderArchiveEntry*>(data + sizeof(ShaderArchiveHeader));
+		const ShaderArchiveEntry *end = entries + header->entries;
+		const ShaderArchiveEntry *entry = std::lower_bound(entries, end, key, [](const ShaderArchiveEntry &e, unsigned long long k) { return e.key < k; });
+		if (entry == end || entry->key != key)
+			return false;
+		blob.data = data + entry->offset;
+		blob.size = static_cast<size_t>(entry->size);
+		return true;
+	}
+
+	bool ShaderCache::m_write(const std::string &path, const std::vector<unsigned long long> &keys) const
+	{
+		// every shader once, by key
+		std::vector<std::pair<unsigned long long, size_t> > order;
+		for (size_t i = 0; i < keys.size(); i++)
+			if (m_blobs[i].size > 0)
+				order.push_back(std::make_pair(keys[i], i));
+		std::sort(order.begin(), order.end());
+		order.erase(std::unique(order.begin(), order.end(), [](const std::pair<unsigned long long, size_t> &a, const std::pair<unsigned long long, size_t> &b) {
+			return a.first == b.first;
+		}), order.end());
+
+		FILE *file = fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+		const ShaderArchiveHeader header = { SHADER_ARCHIVE_MAGIC, SHADER_ARCHIVE_VERSION, m_compilerId, static_cast<unsigned>(order.size()), 0 };
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		unsigned long long position = sizeof(header) + order.size() * sizeof(ShaderArchiveEntry);
+		unsigned long long offset = Align16(position);
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			const ShaderBlob &blob = m_blobs[order[i].second];
+			const ShaderArchiveEntry entry = { order[i].first, offset, blob.size };
+			ok = ok && fwrite(&entry, sizeof(entry), 1, file) == 1;
+			offset = Align16(offset + blob.size);
+		}
+		static const unsigned char padding[16] = {};
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			const ShaderBlob &blob = m_blobs[order[i].second];
+			const size_t pad = static_cast<size_t>(Align16(position) - position);
+			ok = ok && fwrite(padding, 1, pad, file) == pad && fwrite(blob.data, 1, blob.size, file) == blob.size;
+			position += pad + blob.size;
+		}
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+			remove(path.c_str());
+		return ok;
+	}
+
+	bool ShaderCache::Load(const std::vector<ShaderRequest> &requests, ThreadPool *pool)
+	{
+		const ShaderBlob none = { nullptr, 0 };
+		const int count = static_cast<int>(requests.size());
+		m_blobs.assign(count, none);
+		m_owned.clear();
+		m_hits = 0;
+		m_compiled = 0;
+
+		// each file once
+		std::vector<std::string> paths;
+		std::vector<std::vector<unsigned char> > sources;
+		std::vector<int> source(count);
+		bool ok = true;
+		for (int i = 0; i < count; i++)
+		{
+			source[i] = static_cast<int>(std::find(paths.begin(), paths.end(), requests[i].path) - paths.begin());
+			if (source[i] < static_cast<int>(paths.size()))
+				continue;
+			paths.push_back(requests[i].path);
+			sources.push_back(std::vector<unsigned char>());
+			if (!LoadFile(requests[i].path.c_str(), sources.back()))
+			{
+				Log::Get()->Err("Could not read shader file %s", requests[i].path.c_str());
+				ok = false;
+			}
+		}
+
+		std::vector<unsigned long long> keys(count);
+		std::vector<int> misses;
+		m_open();
+		for (int i = 0; i < count; i++)
+		{
+			const std::vector<unsigned char> &text = sources[source[i]];
+			keys[i] = Key(requests[i], text.empty() ? nullptr : &text[0], text.size());
+			if (m_find(keys[i], m_blobs[i]))
+				m_hits++;
+			else if (!text.empty())
+				misses.push_back(i);
+		}
+		if (misses.empty())
+			return ok;
+
+		std::vector<std::vector<unsigned char> > compiled(misses.size());
+		std::vector<std::string> errors(misses.size());
+		std::vector<char> succeeded(misses.size(), 0);
+		auto compile = [&](int begin, int end) {
+			for (int m = begin; m < end; m++)
+			{
+				const int i = misses[m];
+				const std::vector<unsigned char> &text = sources[source[i]];
+				succeeded[m] = m_compiler(requests[i], &text[0], text.size(), compiled[m], errors[m]) && !compiled[m].empty() ? 1 : 0;
+			}
+		};
+		if (pool)
+			pool->ParallelFor(static_cast<int>(misses.size()), 1, compile);
+		else
+			compile(0, static_cast<int>(misses.size()));
+
+		for (size_t m = 0; m < misses.size(); m++)
+		{
+			const ShaderRequest &request = requests[misses[m]];
+			if (!succeeded[m])
+			{
+				Log::Get()->Err("Could not compile %s of %s for %s: %s", request.entry.c_str(), request.path.c_str(), request.profile.c_str(), errors[m].c_str());
+				ok = false;
+				continue;
+			}
+			m_compiled++;
+			m_owned.push_back(std::vector<unsigned char>());
+			m_owned.back().swap(compiled[m]);
+			m_blobs[misses[m]].data = &m_owned.back()[0];
+			m_blobs[misses[m]].size = m_owned.back().size();
+		}
+		if (m_compiled == 0)
+			return ok;
+
+		// the archive is replaced while mapped blobs are in use, so they are copied out first
+		const std::string temporary = m_path + ".tmp";
+		if (!m_write(temporary, keys))
+		{
+			Log::Get()->Err("Could not write the shader archive %s", temporary.c_str());
+			return ok;
+		}
+		m_owned.reserve(m_owned.size() + m_hits);
+		for (int i = 0; i < count; i++)
+		{
+			ShaderBlob &blob = m_blobs[i];
+			if (blob.size == 0 || !m_archive.IsOpen() || blob.data < m_archive.Data() || blob.data >= m_archive.Data() + m_archive.Size())
+				continue;
+			m_owned.push_back(std::vector<unsigned char>(blob.data, blob.data + blob.size));
+			blob.data = &m_owned.back()[0];
+		}
+		m_archive.Close();
+		// rename does not replace an existing file everywhere
+		remove(m_path.c_str());
+		if (rename(temporary.c_str(), m_path.c_str()) != 0)
+		{
+			Log::Get()->Err("Could not replace the shader archive %s", m_path.c_str());
+			remove(temporary.c_str());
+			return ok;
+		}
+
+		// from the new archive from now on
+		if (!m_open())
+			return ok;
+		for (int i = 0; i < count; i++)
+			if (m_blobs[i].size > 0)
+				m_find(keys[i], m_blobs[i]);
+		std::vector<std::vector<unsigned char> >().swap(m_owned);
+		return ok;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class ThreadPool;
+
+	// One entry point of a shader file, compiled for a profile with flags
+	struct ShaderRequest
+	{
+		std::string path;
+		std::string entry;
+		std::string profile;
+		unsigned flags;
+	};
+
+	// Compiled shader, pointing into the archive or into the cache's own
+	// memory, valid as long as the cache is not loaded again or destroyed
+	struct ShaderBlob
+	{
+		const unsigned char *data;
+		size_t size;
+	};
+
+	// Compiles source (the whole file, named path for messages) as the
+	// request says, into blob or into errors. Called on pool threads, so it
+	// has to be safe to call concurrently.
+	typedef std::function<bool(const ShaderRequest &request, const unsigned char *source, size_t size,
+		std::vector<unsigned char> &blob, std::string &errors)> ShaderCompiler;
+
+	// Layout of the archive:
+	//   ShaderArchiveHeader
+	//   ShaderArchiveEntry of each shader, ascending by key
+	//   the blobs, each starting at a multiple of 16 bytes
+	struct ShaderArchiveHeader
+	{
+		unsigned magic;
+		unsigned version;
+		unsigned long long compiler;
+		unsigned entries;
+		unsigned reserved;
+	};
+
+	struct ShaderArchiveEntry
+	{
+		unsigned long long key;
+		unsigned long long offset;
+		unsigned long long size;
+	};
+
+	// Compiled shaders of the last launch in one archive file, mapped and
+	// handed to the device in place. A shader's key hashes its source file,
+	// entry point, profile and flags, and the archive is tied to the
+	// compiler, so only shaders whose file changed are compiled again, all
+	// of them at once on the pool. Files included by a shader file are not
+	// part of its key.
+	//
+	// When anything had to be compiled the archive is written again with
+	// exactly the shaders of this Load, under a temporary name first.
+	class ShaderCache
+	{
+	public:
+		// compilerId is anything that changes with the compiler, like its
+		// version; an archive of another compiler is not used
+		ShaderCache(const char *archivePath, const ShaderCompiler &compiler, unsigned long long compilerId);
+
+		// Blobs of all requests, in their order. False if a file could not
+		// be read or a shader did not compile, the errors are logged and
+		// those blobs are empty; the others are still there.
+		bool Load(const std::vector<ShaderRequest> &requests, ThreadPool *pool);
+		const ShaderBlob &Blob(size_t index) const { return m_blobs[index]; }
+
+		// Of the last Load
+		int Hits() const { return m_hits; }
+		int Compiled() const { return m_compiled; }
+
+		static unsigned long long Key(const ShaderRequest &request, const unsigned char *source, size_t size);
+
+	private:
+		ShaderCache(const ShaderCache&);
+		ShaderCache &operator=(const ShaderCache&);
+
+		// Maps the archive if it is not, false if it is not there or not valid
+		bool m_open();
+		bool m_find(unsigned long long key, ShaderBlob &blob) const;
+		bool m_write(const std::string &path, const std::vector<unsigned long long> &keys) const;
+
+		std::string m_path;
+		ShaderCompiler m_compiler;
+		unsigned long long m_compilerId;
+		MappedFile m_archive;
+		std::vector<ShaderBlob> m_blobs;
+		// Blobs of the last Load that are not in the mapped archive
+		std::vector<std::vector<unsigned char> > m_owned;
+		int m_hits;
+		int m_compiled;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,96 @@
+#include "Simd.h"
+
+#if SIMD_X86
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static eSimdLevel s_detect()
+	{
+#if SIMD_X86
+		int regs[4] = { 0 };
+		int maxLeaf;
+#	ifdef _MSC_VER
+		__cpuid(regs, 0);
+		maxLeaf = regs[0];
+		__cpuid(regs, 1);
+#	else
+		__cpuid(0, regs[0], regs[1], regs[2], regs[3]);
+		maxLeaf = regs[0];
+		__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#	endif
+		const bool sse2 = (regs[3] & (1 << 26)) != 0;
+		const bool osxsave = (regs[2] & (1 << 27)) != 0;
+		const bool avx = (regs[2] & (1 << 28)) != 0;
+
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osxsave && avx)
+		{
+			// The OS has to save the YMM registers too
+#	ifdef _MSC_VER
+			unsigned long long xcr0 = _xgetbv(0);
+			__cpuidex(regs, 7, 0);
+#	else
+			unsigned eax, edx;
+			__asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+			__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#	endif
+			avx2 = (xcr0 & 6) == 6 && (regs[1] & (1 << 5)) != 0;
+		}
+
+		if (avx2)
+			return SIMD_AVX2;
+		if (sse2)
+			return SIMD_SSE2;
+		return SIMD_SCALAR;
+#elif SIMD_ARM_NEON
+		return SIMD_NEON;
+#else
+		return SIMD_SCALAR;
+#endif
+	}
+
+	static eSimdLevel s_detected = s_detect();
+	static eSimdLevel s_level = s_detected;
+
+	eSimdLevel Simd::Level()
+	{
+		return s_level;
+	}
+
+	void Simd::Force(eSimdLevel level)
+	{
+		if (level == SIMD_SCALAR || level == s_detected || (level == SIMD_SSE2 && s_detected == SIMD_AVX2))
+			s_level = level;
+	}
+
+	void Simd::Reset()
+	{
+		s_level = s_detected;
+	}
+
+	const char *Simd::Name(eSimdLevel level)
+	{
+		switch (level)
+		{
+		case SIMD_SSE2:
+			return "SSE2";
+		case SIMD_AVX2:
+			return "AVX2";
+		case SIMD_NEON:
+			return "NEON";
+		default:
+			return "scalar";
+		}
+	}
+
+//------------------------------------------------------------------
+}
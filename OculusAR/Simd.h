@@ -0,0 +1,45 @@
+#pragma once
+
+// Instruction sets compiled into this build
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#	define SIMD_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM) || defined(_M_ARM64)
+#	define SIMD_ARM_NEON 1
+#endif
+
+// GCC and clang only emit AVX2 code in functions marked for it; MSVC does it anywhere
+#if defined(__GNUC__) && !defined(__AVX2__)
+#	define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#	define SIMD_TARGET_AVX2
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	enum eSimdLevel
+	{
+		SIMD_SCALAR = 0,
+		SIMD_SSE2,
+		SIMD_AVX2,
+		SIMD_NEON
+	};
+
+	class Simd
+	{
+	public:
+		// Best level supported by both the build and the CPU, or the forced one
+		static eSimdLevel Level();
+		// Caps Level() at the given level, e.g. to compare against the scalar path.
+		// Levels the CPU does not have are ignored.
+		static void Force(eSimdLevel level);
+		// Undoes Force()
+		static void Reset();
+
+		static const char *Name(eSimdLevel level);
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,643 @@
+#include "SoftwareRenderDevice.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if SIMD_X86
+#	include <emmintrin.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	typedef SoftwareRenderDevice::Triangle Triangle;
+
+	static const int TILE_SIZE = 64;
+	// Vertices may land this far outside the viewport before x and y are clipped.
+	// Keeps the edge functions of a partially covered tile in 32 bits for targets
+	// up to 4096 pixels wide.
+	static const float GUARD_BAND = 1024.0f;
+	// Texture coordinates are clamped to this many texels before wrapping
+	static const float COORD_LIMIT = 4194304.0f;
+
+	// The clear colour of D3D11RenderDevice, { 0.22, 0.23, 0.29, 1 } as UNORM
+	static const unsigned CLEAR_COLOR = 56u | (59u << 8) | (74u << 16) | (255u << 24);
+
+	// The quad of SetupScene: position and texture coordinate, two clockwise triangles
+	static const float s_quadVertices[4][5] =
+	{
+		{ -1.0f, -1.0f, -1.0f, 0.0f, 1.0f },
+		{ 1.0f, -1.0f, -1.0f, 1.0f, 1.0f },
+		{ 1.0f, 1.0f, -1.0f, 1.0f, 0.0f },
+		{ -1.0f, 1.0f, -1.0f, 0.0f, 0.0f },
+	};
+	static const int s_quadIndices[6] = { 3, 1, 0, 2, 1, 3 };
+
+	static inline int s_floorDiv(int a, int b)
+	{
+		return a >= 0 ? a / b : -((-a + b - 1) / b);
+	}
+
+//------------------------------------------------------------------
+// Pixel pipeline, the same arithmetic in every path:
+//   planes   p0 + p1 * dx + p2 * dy, dx and dy relative to the triangle bounds
+//   depth    LESS against the float depth buffer
+//   texcoord u = (u/w) / (1/w), texel = u * width - 0.5, floor and 8 bit fraction
+//   filter   top = (tl * (256 - fx) + tr * fx + 128) >> 8, same for bottom and vertically
+
+	typedef void (*RasterRowFn)(const Triangle &t, const int edge[3], const int step[3], int x, int xEnd, int y, unsigned *color, float *depth);
+
+	static inline int s_texel(float f, int size, int *weight)
+	{
+		f = f < COORD_LIMIT ? f : COORD_LIMIT;
+		f = f > -COORD_LIMIT ? f : -COORD_LIMIT;
+		int i = static_cast<int>(f);
+		if (static_cast<float>(i) > f)
+			i--;
+		*weight = static_cast<int>((f - static_cast<float>(i)) * 256.0f);
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+
+	static inline unsigned s_sample(const SoftwareTexture &tex, float u, float v)
+	{
+		int fx, fy;
+		const int x0 = s_texel(u * static_cast<float>(tex.width) - 0.5f, tex.width, &fx);
+		const int y0 = s_texel(v * static_cast<float>(tex.height) - 0.5f, tex.height, &fy);
+		const int x1 = x0 + 1 == tex.width ? 0 : x0 + 1;
+		const int y1 = y0 + 1 == tex.height ? 0 : y0 + 1;
+		const unsigned char *row0 = &tex.texels[y0 * tex.width * 4];
+		const unsigned char *row1 = &tex.texels[y1 * tex.width * 4];
+
+		unsigned out = 0;
+		for (int c = 0; c < 4; c++)
+		{
+			const unsigned top = (row0[x0 * 4 + c] * (256 - fx) + row0[x1 * 4 + c] * fx + 128) >> 8;
+			const unsigned bot = (row1[x0 * 4 + c] * (256 - fx) + row1[x1 * 4 + c] * fx + 128) >> 8;
+			out |= ((top * (256 - fy) + bot * fy + 128) >> 8) << (c * 8);
+		}
+		return out;
+	}
+
+	static void s_rasterRowScalar(const Triangle &t, const int edge[3], const int step[3], int x, int xEnd, int y, unsigned *color, float *depth)
+	{
+		int e0 = edge[0], e1 = edge[1], e2 = edge[2];
+		const float dy = static_cast<float>(y - t.minY) + 0.5f;
+		for (; x < xEnd; x++, e0 += step[0], e1 += step[1], e2 += step[2])
+		{
+			if ((e0 | e1 | e2) < 0)
+				continue;
+
+			const float dx = static_cast<float>(x - t.minX) + 0.5f;
+			const float z = (t.z[0] + t.z[1] * dx) + t.z[2] * dy;
+			if (!(z < depth[x]))
+				continue;
+
+			const float invW = (t.invW[0] + t.invW[1] * dx) + t.invW[2] * dy;
+			const float u = ((t.uOverW[0] + t.uOverW[1] * dx) + t.uOverW[2] * dy) / invW;
+			const float v = ((t.vOverW[0] + t.vOverW[1] * dx) + t.vOverW[2] * dy) / invW;
+			color[x] = s_sample(*t.texture, u, v);
+			depth[x] = z;
+		}
+	}
+
+#if SIMD_X86
+	static inline __m128i s_lerp8(__m128i a, __m128i b, __m128i w)
+	{
+		const __m128i one = _mm_set1_epi16(256);
+		const __m128i half = _mm_set1_epi16(128);
+		__m128i v = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(one, w)), _mm_mullo_epi16(b, w));
+		return _mm_srli_epi16(_mm_add_epi16(v, half), 8);
+	}
+
+	// Texel index and 8 bit fraction of 4 coordinates, see s_texel
+	static inline void s_texel4(__m128 f, int size, int index[4], int weight[4])
+	{
+		f = _mm_min_ps(f, _mm_set1_ps(COORD_LIMIT));
+		f = _mm_max_ps(f, _mm_set1_ps(-COORD_LIMIT));
+		__m128i i = _mm_cvttps_epi32(f);
+		i = _mm_add_epi32(i, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), f)));
+		const __m128i w = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(f, _mm_cvtepi32_ps(i)), _mm_set1_ps(256.0f)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(index), i);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(weight), w);
+		for (int l = 0; l < 4; l++)
+		{
+			index[l] %= size;
+			if (index[l] < 0)
+				index[l] += size;
+		}
+	}
+
+	static inline __m128i s_sample4(const SoftwareTexture &tex, __m128 u, __m128 v)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		int x0[4], y0[4], fx[4], fy[4];
+		s_texel4(_mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps(static_cast<float>(tex.width))), _mm_set1_ps(0.5f)), tex.width, x0, fx);
+		s_texel4(_mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(static_cast<float>(tex.height))), _mm_set1_ps(0.5f)), tex.height, y0, fy);
+
+		// no gather before AVX2, fetch the 4x4 texels one by one
+		int tl[4], tr[4], bl[4], br[4];
+		const int *texels = reinterpret_cast<const int*>(&tex.texels[0]);
+		for (int l = 0; l < 4; l++)
+		{
+			const int x1 = x0[l] + 1 == tex.width ? 0 : x0[l] + 1;
+			const int y1 = y0[l] + 1 == tex.height ? 0 : y0[l] + 1;
+			tl[l] = texels[y0[l] * tex.width + x0[l]];
+			tr[l] = texels[y0[l] * tex.width + x1];
+			bl[l] = texels[y1 * tex.width + x0[l]];
+			br[l] = texels[y1 * tex.width + x1];
+		}
+		const __m128i vtl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tl));
+		const __m128i vtr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tr));
+		const __m128i vbl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bl));
+		const __m128i vbr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(br));
+
+		// weights in both 16 bit halves of each pixel
+		__m128i wx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fx));
+		__m128i wy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fy));
+		wx = _mm_or_si128(wx, _mm_slli_epi32(wx, 16));
+		wy = _mm_or_si128(wy, _mm_slli_epi32(wy, 16));
+		const __m128i wxLo = _mm_unpacklo_epi32(wx, wx), wxHi = _mm_unpackhi_epi32(wx, wx);
+		const __m128i wyLo = _mm_unpacklo_epi32(wy, wy), wyHi = _mm_unpackhi_epi32(wy, wy);
+
+		const __m128i lo = s_lerp8(
+			s_lerp8(_mm_unpacklo_epi8(vtl, zero), _mm_unpacklo_epi8(vtr, zero), wxLo),
+			s_lerp8(_mm_unpacklo_epi8(vbl, zero), _mm_unpacklo_epi8(vbr, zero), wxLo), wyLo);
+		const __m128i hi = s_lerp8(
+			s_lerp8(_mm_unpackhi_epi8(vtl, zero), _mm_unpackhi_epi8(vtr, zero), wxHi),
+			s_lerp8(_mm_unpackhi_epi8(vbl, zero), _mm_unpackhi_epi8(vbr, zero), wxHi), wyHi);
+		return _mm_packus_epi16(lo, hi);
+	}
+
+	static inline __m128 s_plane4(const float p[3], __m128 dx, __m128 dy)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_set1_ps(p[0]), _mm_mul_ps(_mm_set1_ps(p[1]), dx)), _mm_mul_ps(_mm_set1_ps(p[2]), dy));
+	}
+
+	// 4 pixels at a time: edge functions, depth test and sampling
+	static void s_rasterRowSSE2(const Triangle &t, const int edge[3], const int step[3], int x, int xEnd, int y, unsigned *color, float *depth)
+	{
+		const int xStart = x;
+		__m128i e[3], e4[3];
+		for (int i = 0; i < 3; i++)
+		{
+			e[i] = _mm_setr_epi32(edge[i], edge[i] + step[i], edge[i] + 2 * step[i], edge[i] + 3 * step[i]);
+			e4[i] = _mm_set1_epi32(4 * step[i]);
+		}
+		const __m128i minusOne = _mm_set1_epi32(-1);
+		const __m128 dy = _mm_set1_ps(static_cast<float>(y - t.minY) + 0.5f);
+		__m128 dx = _mm_add_ps(_mm_cvtepi32_ps(_mm_setr_epi32(x - t.minX, x - t.minX + 1, x - t.minX + 2, x - t.minX + 3)), _mm_set1_ps(0.5f));
+		const __m128 four = _mm_set1_ps(4.0f);
+
+		for (; x + 4 <= xEnd; x += 4)
+		{
+			const __m128i inside = _mm_and_si128(_mm_cmpgt_epi32(e[0], minusOne),
+				_mm_and_si128(_mm_cmpgt_epi32(e[1], minusOne), _mm_cmpgt_epi32(e[2], minusOne)));
+			if (_mm_movemask_epi8(inside) != 0)
+			{
+				const __m128 z = s_plane4(t.z, dx, dy);
+				const __m128 d = _mm_loadu_ps(depth + x);
+				const __m128 pass = _mm_and_ps(_mm_castsi128_ps(inside), _mm_cmplt_ps(z, d));
+				if (_mm_movemask_ps(pass) != 0)
+				{
+					const __m128 invW = s_plane4(t.invW, dx, dy);
+					const __m128 u = _mm_div_ps(s_plane4(t.uOverW, dx, dy), invW);
+					const __m128 v = _mm_div_ps(s_plane4(t.vOverW, dx, dy), invW);
+					const __m128i c = s_sample4(*t.texture, u, v);
+
+					const __m128i passi = _mm_castps_si128(pass);
+					__m128i *dst = reinterpret_cast<__m128i*>(color + x);
+					_mm_storeu_si128(dst, _mm_or_si128(_mm_and_si128(passi, c), _mm_andnot_si128(passi, _mm_loadu_si128(dst))));
+					_mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, d)));
+				}
+			}
+			for (int i = 0; i < 3; i++)
+				e[i] = _mm_add_epi32(e[i], e4[i]);
+			dx = _mm_add_ps(dx, four);
+		}
+
+		int tail[3];
+		for (int i = 0; i < 3; i++)
+			tail[i] = edge[i] + (x - xStart) * step[i];
+		s_rasterRowScalar(t, tail, step, x, xEnd, y, color, depth);
+	}
+#endif
+
+	static RasterRowFn s_pickRow(eSimdLevel level)
+	{
+#if SIMD_X86
+		// the row is bound by texel fetches, AVX2 gains nothing over SSE2 here
+		if (level == SIMD_SSE2 || level == SIMD_AVX2)
+			return s_rasterRowSSE2;
+#endif
+		(void)level;
+		return s_rasterRowScalar;
+	}
+
+//------------------------------------------------------------------
+
+	void SoftwareTexture::Allocate(int w, int h)
+	{
+		width = w;
+		height = h;
+		texels.assign(w * h * 4, 0);
+	}
+
+	SoftwareRenderDevice::SoftwareRenderDevice(int width, int height, int cameraWidth, int cameraHeight, ThreadPool *pool) :
+		m_width(width), m_height(height), m_pool(pool), m_ring(MaxDraws * DrawConstants, DrawConstants),
+		m_instanceRing(MaxInstances * sizeof(OverlayInstance), 4), m_texture(TEXTURE_OVERLAY_OUT)
+	{
+		// rows padded to 4 pixels so a row of 4 never runs past the end
+		m_pitch = (width + 3) & ~3;
+		m_color.assign(m_pitch * height * 4, 0);
+		m_depth.assign(m_pitch * height, 1.0f);
+		m_tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		m_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		m_bins.resize(m_tilesX * m_tilesY);
+
+		// unset textures sample as transparent black, like a null view
+		for (int i = 0; i < TEXTURE_COUNT; i++)
+			m_textures[i].Allocate(1, 1);
+		m_textures[TEXTURE_CAMERA_LEFT].Allocate(cameraWidth, cameraHeight);
+		m_textures[TEXTURE_CAMERA_RIGHT].Allocate(cameraWidth, cameraHeight);
+
+		memset(m_mvp, 0, sizeof(m_mvp));
+		m_viewport.Pos.x = 0;
+		m_viewport.Pos.y = 0;
+		m_viewport.Size.w = width;
+		m_viewport.Size.h = height;
+	}
+
+	void SoftwareRenderDevice::SetTextureImage(eSceneTexture texture, const unsigned char *rgba, int width, int height, int pitch)
+	{
+		SoftwareTexture &tex = m_textures[texture];
+		tex.Allocate(width, height);
+		for (int y = 0; y < height; y++)
+			memcpy(&tex.texels[y * width * 4], rgba + y * pitch, width * 4);
+	}
+
+	bool SoftwareRenderDevice::BeginTexture(eSceneTexture texture, bool overlay, eTextureFormat format, int width, int height, int)
+	{
+		// the rasterizer samples RGBA texels only
+		if (format != FORMAT_RGBA8)
+			return false;
+		if (!overlay)
+			m_pending[texture].Allocate(width, height);
+		return true;
+	}
+
+	void SoftwareRenderDevice::UploadTextureRows(eSceneTexture texture, bool overlay, int level, int y, int height, const unsigned char *data, int pitch, size_t bytes)
+	{
+		m_counters.textureUploads++;
+		m_counters.textureBytes += bytes;
+		if (overlay || level != 0)
+			return;
+		SoftwareTexture &tex = m_pending[texture];
+		for (int row = 0; row < height && y + row < tex.height; row++)
+			memcpy(&tex.texels[(y + row) * tex.width * 4], data + row * pitch, tex.width * 4);
+	}
+
+	void SoftwareRenderDevice::EndTexture(eSceneTexture texture, bool overlay)
+	{
+		if (overlay)
+			return;
+		SoftwareTexture &tex = m_textures[texture], &pending = m_pending[texture];
+		tex.width = pending.width;
+		tex.height = pending.height;
+		tex.texels.swap(pending.texels);
+		pending.width = pending.height = 0;
+		std::vector<unsigned char>().swap(pending.texels);
+	}
+
+	void SoftwareRenderDevice::BeginFrame()
+	{
+		// the clear happens tile by tile in EndFrame
+		m_ring.Reset();
+		m_instanceRing.Reset();
+		m_triangles.clear();
+		for (size_t i = 0; i < m_bins.size(); i++)
+			m_bins[i].clear();
+	}
+
+	void SoftwareRenderDevice::SetViewport(const ovrRecti &viewport)
+	{
+		m_viewport = viewport;
+	}
+
+	int SoftwareRenderDevice::AllocateConstants(unsigned count, void **data)
+	{
+		if (count == 0 || count > MaxDraws)
+			return -1;
+		// draws are set up right away, a full ring can start over at once
+		int offset = m_ring.Allocate(count * DrawConstants);
+		if (offset < 0)
+		{
+			m_ring.Reset();
+			offset = m_ring.Allocate(count * DrawConstants);
+		}
+		*data = m_ring.At(offset);
+		m_counters.constantWrites += count;
+		return offset / static_cast<int>(DrawConstants);
+	}
+
+	void SoftwareRenderDevice::UseConstants(int slot)
+	{
+		memcpy(m_mvp, m_ring.At(slot * DrawConstants), sizeof(m_mvp));
+	}
+
+	void SoftwareRenderDevice::SetTexture(eSceneTexture texture)
+	{
+		m_texture = texture;
+		m_counters.textureBinds++;
+	}
+
+	unsigned char *SoftwareRenderDevice::MapCameraTexture(int eye, int *pitch)
+	{
+		SoftwareTexture &tex = m_textures[eye == 0 ? TEXTURE_CAMERA_LEFT : TEXTURE_CAMERA_RIGHT];
+		if (tex.texels.empty())
+			return nullptr;
+		m_counters.cameraUploads++;
+		*pitch = tex.width * 4;
+		return &tex.texels[0];
+	}
+
+	void SoftwareRenderDevice::DrawQuad()
+	{
+		m_counters.draws++;
+		static const float fullRect[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+		m_drawQuad(m_mvp, &m_textures[m_texture], fullRect);
+	}
+
+	int SoftwareRenderDevice::AllocateInstances(unsigned count, OverlayInstance **data)
+	{
+		if (count == 0 || count > MaxInstances)
+			return -1;
+		int offset = m_instanceRing.Allocate(count * sizeof(OverlayInstance));
+		if (offset < 0)
+		{
+			m_instanceRing.Reset();
+			offset = m_instanceRing.Allocate(count * sizeof(OverlayInstance));
+		}
+		*data = static_cast<OverlayInstance*>(m_instanceRing.At(offset));
+		return offset / static_cast<int>(sizeof(OverlayInstance));
+	}
+
+	void SoftwareRenderDevice::DrawInstances(int first, unsigned count)
+	{
+		m_counters.draws++;
+		m_counters.instances += count;
+		const OverlayInstance *instances = static_cast<const OverlayInstance*>(m_instanceRing.At(first * sizeof(OverlayInstance)));
+		for (unsigned i = 0; i < count; i++)
+		{
+			const OverlayInstance &instance = instances[i];
+			if (instance.slice >= OverlaySlices)
+				continue;
+			float rect[4];
+			for (int c = 0; c < 4; c++)
+				rect[c] = OverlayInstanceBuilder::Unpack(instance.uvRect[c]);
+			// slice s holds the image of eSceneTexture s
+			m_drawQuad(instance.mvp, &m_textures[instance.slice], rect);
+		}
+	}
+
+	void SoftwareRenderDevice::m_drawQuad(const float mvp[16], const SoftwareTexture *texture, const float uvRect[4])
+	{
+		// Vertex shader: mvp arrives transposed, i.e. column-major like HLSL reads it
+		Vertex clip[4];
+		for (int i = 0; i < 4; i++)
+		{
+			const float *p = s_quadVertices[i];
+			float out[4];
+			for (int r = 0; r < 4; r++)
+				out[r] = mvp[r] * p[0] + mvp[4 + r] * p[1] + mvp[8 + r] * p[2] + mvp[12 + r];
+			clip[i].x = out[0];
+			clip[i].y = out[1];
+			clip[i].z = out[2];
+			clip[i].w = out[3];
+			clip[i].u = uvRect[0] + p[3] * (uvRect[2] - uvRect[0]);
+			clip[i].v = uvRect[1] + p[4] * (uvRect[3] - uvRect[1]);
+		}
+
+		const float vpX = static_cast<float>(m_viewport.Pos.x);
+		const float vpY = static_cast<float>(m_viewport.Pos.y);
+		const float vpW = static_cast<float>(m_viewport.Size.w);
+		const float vpH = static_cast<float>(m_viewport.Size.h);
+		const float guardX = 1.0f + 2.0f * GUARD_BAND / vpW;
+		const float guardY = 1.0f + 2.0f * GUARD_BAND / vpH;
+
+		for (int tri = 0; tri < 2; tri++)
+		{
+			// Clip against 0 <= z <= w and the guard band
+			Vertex poly[2][12];
+			int count = 3;
+			for (int i = 0; i < 3; i++)
+				poly[0][i] = clip[s_quadIndices[tri * 3 + i]];
+
+			int src = 0;
+			for (int plane = 0; plane < 7 && count >= 3; plane++)
+			{
+				const Vertex *in = poly[src];
+				Vertex *out = poly[src ^ 1];
+				int outCount = 0;
+				for (int i = 0; i < count; i++)
+				{
+					const Vertex &a = in[i];
+					const Vertex &b = in[(i + 1) % count];
+					float da, db;
+					switch (plane)
+					{
+					case 0: da = a.z; db = b.z; break;
+					case 1: da = a.w - a.z; db = b.w - b.z; break;
+					case 2: da = guardX * a.w + a.x; db = guardX * b.w + b.x; break;
+					case 3: da = guardX * a.w - a.x; db = guardX * b.w - b.x; break;
+					case 4: da = guardY * a.w + a.y; db = guardY * b.w + b.y; break;
+					case 5: da = guardY * a.w - a.y; db = guardY * b.w - b.y; break;
+					default: da = a.w - 1e-6f; db = b.w - 1e-6f; break;
+					}
+					if (da >= 0.0f)
+						out[outCount++] = a;
+					if ((da >= 0.0f) != (db >= 0.0f))
+					{
+						const float t = da / (da - db);
+						Vertex &v = out[outCount++];
+						v.x = a.x + (b.x - a.x) * t;
+						v.y = a.y + (b.y - a.y) * t;
+						v.z = a.z + (b.z - a.z) * t;
+						v.w = a.w + (b.w - a.w) * t;
+						v.u = a.u + (b.u - a.u) * t;
+						v.v = a.v + (b.v - a.v) * t;
+					}
+				}
+				count = outCount;
+				src ^= 1;
+			}
+			if (count < 3)
+				continue;
+
+			// Perspective divide and viewport transform, attributes divided by w
+			Vertex screen[12];
+			for (int i = 0; i < count; i++)
+			{
+				const Vertex &v = poly[src][i];
+				const float invW = 1.0f / v.w;
+				screen[i].x = vpX + (v.x * invW + 1.0f) * 0.5f * vpW;
+				screen[i].y = vpY + (1.0f - v.y * invW) * 0.5f * vpH;
+				screen[i].z = v.z * invW;
+				screen[i].w = invW;
+				screen[i].u = v.u * invW;
+				screen[i].v = v.v * invW;
+			}
+			for (int i = 1; i + 1 < count; i++)
+				m_setup(screen[0], screen[i], screen[i + 1], texture);
+		}
+	}
+
+	void SoftwareRenderDevice::m_setup(const Vertex &v0, const Vertex &v1, const Vertex &v2, const SoftwareTexture *texture)
+	{
+		const Vertex *v[3] = { &v0, &v1, &v2 };
+
+		// 28.4 fixed point, pixel centers at +8
+		int X[3], Y[3];
+		for (int i = 0; i < 3; i++)
+		{
+			X[i] = static_cast<int>(std::floor(v[i]->x * 16.0f + 0.5f));
+			Y[i] = static_cast<int>(std::floor(v[i]->y * 16.0f + 0.5f));
+		}
+
+		// Clockwise on screen is front facing, the rest is culled like the default rasterizer state does
+		const long long area = static_cast<long long>(X[1] - X[0]) * (Y[2] - Y[0]) - static_cast<long long>(X[2] - X[0]) * (Y[1] - Y[0]);
+		if (area <= 0)
+			return;
+
+		Triangle t;
+		for (int i = 0; i < 3; i++)
+		{
+			const int j = (i + 1) % 3;
+			t.a[i] = Y[i] - Y[j];
+			t.b[i] = X[j] - X[i];
+			t.c[i] = -(static_cast<long long>(t.a[i]) * X[i] + static_cast<long long>(t.b[i]) * Y[i]);
+			// Top-left fill rule: pixels exactly on other edges belong to the neighbour
+			const bool topLeft = t.a[i] > 0 || (t.a[i] == 0 && t.b[i] > 0);
+			if (!topLeft)
+				t.c[i] -= 1;
+		}
+
+		const int minXs = std::min(X[0], std::min(X[1], X[2]));
+		const int maxXs = std::max(X[0], std::max(X[1], X[2]));
+		const int minYs = std::min(Y[0], std::min(Y[1], Y[2]));
+		const int maxYs = std::max(Y[0], std::max(Y[1], Y[2]));
+		t.minX = std::max(s_floorDiv(minXs - 8 + 15, 16), std::max(m_viewport.Pos.x, 0));
+		t.maxX = std::min(s_floorDiv(maxXs - 8, 16), std::min(m_viewport.Pos.x + m_viewport.Size.w, m_width) - 1);
+		t.minY = std::max(s_floorDiv(minYs - 8 + 15, 16), std::max(m_viewport.Pos.y, 0));
+		t.maxY = std::min(s_floorDiv(maxYs - 8, 16), std::min(m_viewport.Pos.y + m_viewport.Size.h, m_height) - 1);
+		if (t.minX > t.maxX || t.minY > t.maxY)
+			return;
+
+		// Attribute planes from the snapped positions
+		const double x0 = X[0] / 16.0 - t.minX, y0 = Y[0] / 16.0 - t.minY;
+		const double x1 = X[1] / 16.0 - t.minX, y1 = Y[1] / 16.0 - t.minY;
+		const double x2 = X[2] / 16.0 - t.minX, y2 = Y[2] / 16.0 - t.minY;
+		const double det = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+		auto plane = [&](float a0, float a1, float a2, float p[3])
+		{
+			const double dadx = ((a1 - a0) * (y2 - y0) - (a2 - a0) * (y1 - y0)) / det;
+			const double dady = ((a2 - a0) * (x1 - x0) - (a1 - a0) * (x2 - x0)) / det;
+			p[0] = static_cast<float>(a0 - dadx * x0 - dady * y0);
+			p[1] = static_cast<float>(dadx);
+			p[2] = static_cast<float>(dady);
+		};
+		plane(v0.z, v1.z, v2.z, t.z);
+		plane(v0.w, v1.w, v2.w, t.invW);
+		plane(v0.u, v1.u, v2.u, t.uOverW);
+		plane(v0.v, v1.v, v2.v, t.vOverW);
+		t.texture = texture;
+
+		const unsigned index = static_cast<unsigned>(m_triangles.size());
+		m_triangles.push_back(t);
+		for (int ty = t.minY / TILE_SIZE; ty <= t.maxY / TILE_SIZE; ty++)
+			for (int tx = t.minX / TILE_SIZE; tx <= t.maxX / TILE_SIZE; tx++)
+				m_bins[ty * m_tilesX + tx].push_back(index);
+	}
+
+	void SoftwareRenderDevice::m_renderTiles(int begin, int end)
+	{
+		const RasterRowFn row = s_pickRow(Simd::Level());
+		unsigned *color = reinterpret_cast<unsigned*>(&m_color[0]);
+		float *depth = &m_depth[0];
+
+		for (int tile = begin; tile < end; tile++)
+		{
+			const int tileX0 = (tile % m_tilesX) * TILE_SIZE;
+			const int tileY0 = (tile / m_tilesX) * TILE_SIZE;
+			const int tileX1 = std::min(tileX0 + TILE_SIZE, m_width) - 1;
+			const int tileY1 = std::min(tileY0 + TILE_SIZE, m_height) - 1;
+
+			for (int y = tileY0; y <= tileY1; y++)
+			{
+				std::fill(color + y * m_pitch + tileX0, color + y * m_pitch + tileX1 + 1, CLEAR_COLOR);
+				std::fill(depth + y * m_pitch + tileX0, depth + y * m_pitch + tileX1 + 1, 1.0f);
+			}
+
+			const std::vector<unsigned> &bin = m_bins[tile];
+			for (size_t i = 0; i < bin.size(); i++)
+			{
+				const Triangle &t = m_triangles[bin[i]];
+				const int x0 = std::max(tileX0, t.minX);
+				const int x1 = std::min(tileX1, t.maxX);
+				const int y0 = std::max(tileY0, t.minY);
+				const int y1 = std::min(tileY1, t.maxY);
+				if (x0 > x1 || y0 > y1)
+					continue;
+
+				// Edges covering the whole rectangle drop out, the others are
+				// small enough here to step in 32 bits
+				int edge[3], stepX[3], stepY[3];
+				bool outside = false;
+				for (int e = 0; e < 3 && !outside; e++)
+				{
+					const long long corner = t.a[e] * (x0 * 16LL + 8) + t.b[e] * (y0 * 16LL + 8) + t.c[e];
+					const long long dx = t.a[e] * 16LL * (x1 - x0);
+					const long long dy = t.b[e] * 16LL * (y1 - y0);
+					const long long lo = corner + std::min(dx, 0LL) + std::min(dy, 0LL);
+					const long long hi = corner + std::max(dx, 0LL) + std::max(dy, 0LL);
+					if (hi < 0)
+						outside = true;
+					else if (lo >= 0)
+						edge[e] = stepX[e] = stepY[e] = 0;
+					else
+					{
+						edge[e] = static_cast<int>(corner);
+						stepX[e] = t.a[e] * 16;
+						stepY[e] = t.b[e] * 16;
+					}
+				}
+				if (outside)
+					continue;
+
+				for (int y = y0; y <= y1; y++)
+				{
+					row(t, edge, stepX, x0, x1 + 1, y, color + y * m_pitch, depth + y * m_pitch);
+					for (int e = 0; e < 3; e++)
+						edge[e] += stepY[e];
+				}
+			}
+		}
+	}
+
+	void SoftwareRenderDevice::EndFrame()
+	{
+		const int tiles = m_tilesX * m_tilesY;
+		if (m_pool)
+			m_pool->ParallelFor(tiles, 4, [this](int begin, int end) { m_renderTiles(begin, end); });
+		else
+			m_renderTiles(0, tiles);
+
+		if (m_present)
+			m_present(&m_color[0], Pitch());
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "RenderDevice.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class ThreadPool;
+
+	// RGBA image the software renderer samples from, rows packed
+	struct SoftwareTexture
+	{
+		int width;
+		int height;
+		std::vector<unsigned char> texels;
+
+		SoftwareTexture() : width(0), height(0) {}
+		void Allocate(int w, int h);
+	};
+
+	// Renders the scene of SetupScene on the CPU: the textured quad
+	// transformed by the mvp constant like shader.hlsl, depth tested,
+	// back faces culled and sampled with the bilinear wrap sampler into one
+	// RGBA target holding both eyes. Single sample and mip 0 only; streamed
+	// textures keep their top level and have to be RGBA8, and instanced
+	// overlays sample the scene textures instead of an array.
+	//
+	// Draws are clipped, set up and binned into tiles as they come in;
+	// EndFrame rasterizes the tiles across the thread pool. Every tile
+	// draws its triangles in submission order, so the image does not depend
+	// on the thread count or the SIMD level.
+	class SoftwareRenderDevice : public RenderDevice
+	{
+	public:
+		// pool may be null to render on the calling thread only
+		SoftwareRenderDevice(int width, int height, int cameraWidth, int cameraHeight, ThreadPool *pool = nullptr);
+
+		void SetPool(ThreadPool *pool) { m_pool = pool; }
+		// Copies an RGBA image into one of the scene textures
+		void SetTextureImage(eSceneTexture texture, const unsigned char *rgba, int width, int height, int pitch);
+		// Called at the end of EndFrame with the finished image
+		void SetPresent(const std::function<void(const unsigned char *rgba, int pitch)> &present) { m_present = present; }
+
+		void BeginFrame();
+		void SetViewport(const ovrRecti &viewport);
+		int AllocateConstants(unsigned count, void **data);
+		void UseConstants(int slot);
+		void SetTexture(eSceneTexture texture);
+		void DrawQuad();
+		int AllocateInstances(unsigned count, OverlayInstance **data);
+		void DrawInstances(int first, unsigned count);
+		unsigned char *MapCameraTexture(int eye, int *pitch);
+		void UnmapCameraTexture(int) {}
+		bool BeginTexture(eSceneTexture texture, bool overlay, eTextureFormat format, int width, int height, int levels);
+		void UploadTextureRows(eSceneTexture texture, bool overlay, int level, int y, int height, const unsigned char *data, int pitch, size_t bytes);
+		void EndTexture(eSceneTexture texture, bool overlay);
+		int OverlaySize() const { return 0; }
+		void EndFrame();
+
+		int Width() const { return m_width; }
+		int Height() const { return m_height; }
+		int Pitch() const { return m_pitch * 4; }
+		// Rendered image, RGBA
+		const unsigned char *Image() const { return &m_color[0]; }
+
+		// Triangle after clipping and setup, in render target pixels
+		struct Triangle
+		{
+			// Edge functions a * x + b * y + c in 1/16 pixel units, >= 0 inside
+			int a[3];
+			int b[3];
+			long long c[3];
+			// Pixel bounds, inclusive, clipped to the viewport
+			int minX, minY, maxX, maxY;
+			// Planes p[0] + p[1] * (x - minX) + p[2] * (y - minY) at pixel centers
+			float z[3];
+			float invW[3];
+			float uOverW[3];
+			float vOverW[3];
+			const SoftwareTexture *texture;
+		};
+
+	private:
+		struct Vertex
+		{
+			float x, y, z, w, u, v;
+		};
+
+		void m_drawQuad(const float mvp[16], const SoftwareTexture *texture, const float uvRect[4]);
+		void m_setup(const Vertex &v0, const Vertex &v1, const Vertex &v2, const SoftwareTexture *texture);
+		void m_renderTiles(int begin, int end);
+
+		int m_width;
+		int m_height;
+		int m_pitch;
+		int m_tilesX;
+		int m_tilesY;
+		std::vector<unsigned char> m_color;
+		std::vector<float> m_depth;
+
+		ThreadPool *m_pool;
+		std::function<void(const unsigned char*, int)> m_present;
+
+		SoftwareTexture m_textures[TEXTURE_COUNT];
+		// streamed images until their EndTexture
+		SoftwareTexture m_pending[TEXTURE_COUNT];
+		ConstantRing m_ring;
+		ConstantRing m_instanceRing;
+		float m_mvp[16];
+		ovrRecti m_viewport;
+		eSceneTexture m_texture;
+
+		std::vector<Triangle> m_triangles;
+		std::vector<std::vector<unsigned> > m_bins;
+	};
+
+//------------------------------------------------------------------
+}
@@ -60,11 +60,32 @@ least with mirroring enabled.
 #include <ovrvision.h>        //Ovrvision SDK
 
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <vector>
 #include <xnamath.h>
 #include "Log.h"
 #include "InputMgr.h"
+#include "InputRecorder.h"
 #include "MyInput.h"
+#include "CameraThread.h"
+#include "OvrvisionSource.h"
+#include "ColorConvert.h"
+#include "Undistort.h"
+#include "ThreadPool.h"
+#include "Benchmark.h"
+#include "Capture.h"
+#include "Clock.h"
+#include "OvrHmdDevice.h"
+#include "D3D11RenderDevice.h"
+#include "FrameLoop.h"
+#include "SoftwareRenderDevice.h"
+#include "PoseHistory.h"
+#include "TextureStreamer.h"
+#include "BlockCompress.h"
+#include "TextureAtlas.h"
+#include "ShaderCache.h"
+#include "StartupGraph.h"
 using namespace D3D11Framework;
 
 const LPWSTR ClassName = L"SimpleOVR_D3D11";
@@ -104,11 +125,21 @@ float eye_scale = 0.9f;
 int processer_quality = OVR::OV_PSQT_HIGH;
 //use AR
 bool useOvrvisionAR = false;
+//Feed the camera pipeline with a test pattern instead of the Ovrvision
+bool useSyntheticCamera = false;
+//Rasterize the eye texture on the CPU ("--software") and only upload the result
+bool useSoftwareRenderer = false;
+
+// Session recording ("--record <file>"), written from the camera thread, the window procedure
+// and the render loop.
+CaptureWriter *captureWriter = nullptr;
 
 InputMgr *inputMgr = nullptr;
+// Input stream recording ("--record-input <file>") and replay ("--replay-input <file>"). While
+// replaying, the input of the window is ignored.
+InputRecorder *inputRecorder = nullptr;
+InputReplay *inputReplay = nullptr;
 MyInput *input = nullptr;
-float scaleAmount = 1.0f;
-OVR::Vector3f translateAmount = OVR::Vector3f(0.0f, 0.0f, 0.0f);
 /*
 Number of rendered pixels per display pixel. Generally you want this set at 1.0, but you
 can gain some performance by setting it lower in exchange for a more blurry result.
@@ -116,39 +147,69 @@ can gain some performance by setting it lower in exchange for a more blurry resu
 const float PixelsPerDisplayPixel = 1.0f;
 const int MultisampleCount = 4; // Set to 1 to disable multisampling
 
-// Commonly used vectors.
-const OVR::Vector3f RightVector(1.0f, 0.0f, 0.0f);
-const OVR::Vector3f UpVector(0.0f, 1.0f, 0.0f);
-const OVR::Vector3f ForwardVector(0.0f, 0.0f, -1.0f);
-
+// Overlay images, streamed in after startup in eSceneTexture order. Until they are ready the
+// overlays show the placeholder colour.
+const char* OverlayFiles[RenderDevice::OverlaySlices] = { "D:\\texture_out.png", "D:\\texture_in.jpg" };
+// Names of the overlay images in an atlas ("--atlas <name>"). The atlas pages then take the
+// slices of the overlay array and each overlay draws its own rectangle of them.
+const char* OverlayNames[RenderDevice::OverlaySlices] = { "texture_out", "texture_in" };
+const unsigned char PlaceholderColor[4] = { 96, 96, 96, 255 };
+// Edge length of the overlay array slices, the images are scaled to it when loading
+const UINT OverlayArraySize = 1024;
+// The overlay array and the streamed textures are block compressed on the GPU. The encoded
+// levels are kept in the cache directory, so they are only encoded again when a file changes.
+const eTextureFormat OverlayFormat = FORMAT_BC7;
+const eCompressQuality OverlayQuality = COMPRESS_NORMAL;
+const char* TextureCacheDirectory = "TextureCache";
+// Compiled shaders, see ShaderCache
+const char* ShaderArchivePath = "shaders.cache";
+// Workers of the startup tasks, see main
+const int StartupThreads = 4;
+// Bytes of texture levels uploaded per frame at most, about one 1024x1024 level
+const size_t TextureUploadBudget = 4 << 20;
 
 ID3D11ShaderResourceView *m_pTextureRV = nullptr;
 ID3D11ShaderResourceView *m_pTextureRV2 = nullptr;
 
 ID3D11SamplerState *m_pSamplerLinear = nullptr;
 
-// Position and angle of the player's body. In a real project these are probably not constant,
-// but we're keeping things simple here.
-const OVR::Vector3f BodyPosition{ 0.5f, 0.5f, 0 };
-const OVR::Anglef BodyYaw{ 0.9f };
 
-
-ID3D11Buffer* SetupScene(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContext);
+static bool CompileShader(const ShaderRequest& request, const unsigned char* source, size_t size, std::vector<unsigned char>& blob, std::string& errors);
+std::vector<ShaderRequest> SceneShaderRequests();
+ID3D11Buffer* SetupScene(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContext, const ShaderCache& shaderCache);
+void SetupInstancing(D3D11RenderDevice* renderDevice);
 void DestroyScene();
 
+// Releases a COM object that may not have been created, and forgets it
+template <class T> void SafeRelease(T*& object) {
+	if (object != nullptr) {
+		object->Release();
+		object = nullptr;
+	}
+}
+
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 	switch (msg) {
 	case WM_CLOSE:
 	case WM_DESTROY:
 		PostQuitMessage(0);
 		break;
-	case WM_MOUSEMOVE: case WM_LBUTTONUP: case WM_LBUTTONDOWN: case WM_MBUTTONUP: case WM_MBUTTONDOWN: case WM_RBUTTONUP: case WM_RBUTTONDOWN: case WM_MOUSEWHEEL: case WM_KEYDOWN: case WM_KEYUP:
-		if (inputMgr)
+	case WM_MOUSEMOVE: case WM_LBUTTONUP: case WM_LBUTTONDOWN: case WM_MBUTTONUP: case WM_MBUTTONDOWN: case WM_RBUTTONUP: case WM_RBUTTONDOWN: case WM_MOUSEWHEEL: case WM_KEYDOWN: case WM_KEYUP: case WM_KILLFOCUS:
+		if (captureWriter) {
+			InputRecord record = { Clock::Now(), msg, static_cast<unsigned long long>(wParam), static_cast<long long>(lParam) };
+			captureWriter->WriteInput(record);
+		}
+		// only queued here, the frame loop hands it to the listeners
+		if (inputMgr && !inputReplay)
 			inputMgr->Run(msg, wParam, lParam);
-		scaleAmount = input->getScale();
-		translateAmount = input->translate;
 
 		return 0;
+	case WM_INPUT:
+		// Raw mouse motion. Not recorded, the data behind lParam is gone after this call; a replay
+		// takes the motion from the recorded WM_MOUSEMOVE instead.
+		if (inputMgr && !inputReplay)
+			inputMgr->Run(msg, wParam, lParam);
+		break;
 	}
 
 	return DefWindowProc(hwnd, msg, wParam, lParam);
@@ -158,7 +219,115 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 INTERESTING PART BEGINS HERE
 */
 
-int main() {
+int main(int argc, char* argv[]) {
+	// "OculusAR --bench [name] [args]" runs the headless benchmarks instead of the application,
+	// e.g. "--bench frameloop 5000 session.oarc".
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		return Benchmark::Run(argc > 2 ? argv[2] : "all", argc > 3 ? argc - 3 : 0, argv + 3) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	// "OculusAR --decode-log log.bin [log.txt]" turns a binary log into the text one.
+	if (argc > 2 && strcmp(argv[1], "--decode-log") == 0) {
+		return Log::Decode(argv[2], argc > 3 ? argv[3] : "log.txt") ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	// "OculusAR --compress [files]" encodes the overlay images, or the given ones, into the
+	// texture cache ahead of time, so the first launch does not have to.
+	if (argc > 1 && strcmp(argv[1], "--compress") == 0) {
+		Log log(nullptr, true);
+		ThreadPool pool;
+		NullRenderDevice device(0, 0);
+		device.SetOverlaySize(OverlayArraySize);
+		TextureStreamer streamer(&pool);
+		streamer.SetCompression(OverlayFormat, OverlayQuality, TextureCacheDirectory);
+		std::vector<int> ids;
+		for (int i = 2; i < argc; i++)
+			ids.push_back(streamer.Request(argv[i], TEXTURE_OVERLAY_OUT, OverlayArraySize));
+		if (argc == 2)
+			for (UINT slice = 0; slice < RenderDevice::OverlaySlices; slice++)
+				ids.push_back(streamer.Request(OverlayFiles[slice], TEXTURE_OVERLAY_OUT, OverlayArraySize));
+		while (!streamer.Idle())
+			if (streamer.Update(device, TextureUploadBudget) == 0)
+				Sleep(1);
+		bool ok = true;
+		for (size_t i = 0; i < ids.size(); i++)
+			ok = ok && streamer.State(ids[i]) == TEXTURE_READY;
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// "OculusAR --build-atlas <name> <files>" packs the images into the atlas pages <name>.0.png,
+	// <name>.1.png, ... sized for the overlay array, and their index <name>.atlas.
+	if (argc > 3 && strcmp(argv[1], "--build-atlas") == 0) {
+		Log log(nullptr, true);
+		ThreadPool pool;
+		const std::vector<std::string> files(argv + 3, argv + argc);
+		return AtlasPacker::Build(argv[2], files, OverlayArraySize, &pool) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// "--record <file>" saves camera frames, poses, input and frame timings of the session.
+	// "--replay <file>" plays such a recording back instead of the live tracking and camera.
+	// "--bindings <file>" reads the key bindings, see MYINPUT_BINDINGS for the format.
+	// "--record-input <file>" saves the input events as dispatched, "--replay-input <file>"
+	// hands them on again frame by frame with the recorded frame times and quits at the end.
+	// "--atlas <name>" takes the overlay images out of an atlas built with "--build-atlas".
+	const char* recordPath = nullptr;
+	const char* replayPath = nullptr;
+	const char* bindingsPath = nullptr;
+	const char* recordInputPath = nullptr;
+	const char* replayInputPath = nullptr;
+	const char* atlasName = nullptr;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--record") == 0)
+			recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0)
+			replayPath = argv[++i];
+		else if (strcmp(argv[i], "--bindings") == 0)
+			bindingsPath = argv[++i];
+		else if (strcmp(argv[i], "--record-input") == 0)
+			recordInputPath = argv[++i];
+		else if (strcmp(argv[i], "--replay-input") == 0)
+			replayInputPath = argv[++i];
+		else if (strcmp(argv[i], "--atlas") == 0)
+			atlasName = argv[++i];
+	}
+	bool binaryLog = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--software") == 0)
+			useSoftwareRenderer = true;
+		else if (strcmp(argv[i], "--binary-log") == 0)
+			binaryLog = true;
+	}
+	// log.txt, or log.bin with "--binary-log"
+	Log log(nullptr, true, binaryLog);
+
+	CaptureReader* replay = nullptr;
+	if (replayPath != nullptr) {
+		replay = new CaptureReader();
+		if (!replay->Open(replayPath)) {
+			MessageBoxA(nullptr, replayPath, "Failed opening recording", MB_OK);
+			return EXIT_FAILURE;
+		}
+	}
+	if (recordPath != nullptr) {
+		captureWriter = new CaptureWriter();
+		if (!captureWriter->Open(recordPath)) {
+			MessageBoxA(nullptr, recordPath, "Failed creating recording", MB_OK);
+			return EXIT_FAILURE;
+		}
+	}
+	if (replayInputPath != nullptr) {
+		inputReplay = new InputReplay();
+		if (!inputReplay->Open(replayInputPath)) {
+			MessageBoxA(nullptr, replayInputPath, "Failed opening input recording", MB_OK);
+			return EXIT_FAILURE;
+		}
+	}
+	if (recordInputPath != nullptr) {
+		inputRecorder = new InputRecorder();
+		if (!inputRecorder->Open(recordInputPath)) {
+			MessageBoxA(nullptr, recordInputPath, "Failed creating input recording", MB_OK);
+			return EXIT_FAILURE;
+		}
+	}
+
 	ovrEyeRenderDesc vrEyeRenderDesc[2];
 	ovrRecti vrEyeRenderViewport[2];
 	ovrHmd vrHmd = nullptr;
@@ -203,86 +372,131 @@ int main() {
 
 
 	inputMgr = new InputMgr();
+	inputMgr->Init();
+	inputMgr->RecordTo(inputRecorder);
 	input = new MyInput();
-	inputMgr->AddListener(input);
+	if (bindingsPath != nullptr && !input->LoadBindings(bindingsPath))
+		Log::Get()->Err("Cannot read the bindings %s", bindingsPath);
+
+	// Decoding, encoding and the camera image share these workers.
+	ThreadPool* workerPool = new ThreadPool();
+
+	/*
+	Startup runs as a graph of init tasks, see StartupGraph. Opening the camera, loading the
+	shaders, building the undistortion tables and decoding the overlay images do not wait on each
+	other and run on the pool, while this thread brings up LibOVR, the window and the device.
+	What has to stay here does: the window belongs to the thread that pumps its messages, the
+	swap chain to the thread of its window, and LibOVR and the immediate context are not thread
+	safe. Creating resources on the device is, so the render targets and camera textures are
+	pool tasks once the device is there.
+	The startup tasks mostly wait on drivers, devices and files, so they get their own workers,
+	more than there are cores.
+	*/
+	const double startupBegin = Clock::Now();
+	ThreadPool* startupPool = new ThreadPool(StartupThreads);
+	StartupGraph startup;
 
 	/*
 	LibOVR Initialization part.
 	Beware, LibOVR may be a bit picky about when you perform the various steps. ovr_Initialize
 	must be called before you start initializing Direct3D.
 	*/
+	const int hmdTask = startup.Add("hmd", [&]() {
+		ovr_Initialize();
+
+		vrHmd = ovrHmd_Create(0);
+		if (vrHmd == nullptr) {
+			// Forgetting to turn on the HMD is fairly common so we make an exception here and actually
+			// add some error handling.
+			MessageBox(nullptr, L"Failed initializing HMD, make sure it is connected and turned on.", L"LibOVR error", MB_OK);
+			ovr_Shutdown();
+			return false;
+		}
 
-	ovr_Initialize();
-
-	vrHmd = ovrHmd_Create(0);
-	if (vrHmd == nullptr) {
-		// Forgetting to turn on the HMD is fairly common so we make an exception here and actually
-		// add some error handling.
-		MessageBox(nullptr, L"Failed initializing HMD, make sure it is connected and turned on.", L"LibOVR error", MB_OK);
-		ovr_Shutdown();
-		return EXIT_FAILURE;
-	}
-
-	// We'll request orientation and position tracking, but not require either. Adjust according to your needs.
-	ovrHmd_ConfigureTracking(vrHmd, ovrTrackingCap_Orientation | ovrTrackingCap_Position, 0);
-
-	// Fetch the texture sizes needed for the eye buffers.
-	// We'll be using a single texture for both eyes, so we'll figure out how large that texture needs to be.
-	auto ovrEyeDimsLeft = ovrHmd_GetFovTextureSize(vrHmd, ovrEye_Left, vrHmd->DefaultEyeFov[0], PixelsPerDisplayPixel);
-	auto ovrEyeDimsRight = ovrHmd_GetFovTextureSize(vrHmd, ovrEye_Right, vrHmd->DefaultEyeFov[0], PixelsPerDisplayPixel);
+		// We'll request orientation and position tracking, but not require either. Adjust according to your needs.
+		ovrHmd_ConfigureTracking(vrHmd, ovrTrackingCap_Orientation | ovrTrackingCap_Position, 0);
 
-	// We ARE making an assumption here that both eye buffers have the same width, as this is the case for DK2.
-	renderTargetSize.w = ovrEyeDimsLeft.w + ovrEyeDimsRight.w;
-	renderTargetSize.h = std::max(ovrEyeDimsLeft.h, ovrEyeDimsRight.h);
+		// Fetch the texture sizes needed for the eye buffers.
+		// We'll be using a single texture for both eyes, so we'll figure out how large that texture needs to be.
+		auto ovrEyeDimsLeft = ovrHmd_GetFovTextureSize(vrHmd, ovrEye_Left, vrHmd->DefaultEyeFov[0], PixelsPerDisplayPixel);
+		auto ovrEyeDimsRight = ovrHmd_GetFovTextureSize(vrHmd, ovrEye_Right, vrHmd->DefaultEyeFov[0], PixelsPerDisplayPixel);
 
-	// View ports for each eye. We'll be using a single a single render target and allocate half of it to each eye.
-	vrEyeRenderViewport[0].Pos = { 0, 0 };
-	vrEyeRenderViewport[0].Size = { renderTargetSize.w / 2, renderTargetSize.h };
-	vrEyeRenderViewport[1].Pos = { (renderTargetSize.w + 1) / 2, 0 };
-	vrEyeRenderViewport[1].Size = vrEyeRenderViewport[0].Size;
+		// We ARE making an assumption here that both eye buffers have the same width, as this is the case for DK2.
+		renderTargetSize.w = ovrEyeDimsLeft.w + ovrEyeDimsRight.w;
+		renderTargetSize.h = std::max(ovrEyeDimsLeft.h, ovrEyeDimsRight.h);
 
+		// View ports for each eye. We'll be using a single a single render target and allocate half of it to each eye.
+		vrEyeRenderViewport[0].Pos = { 0, 0 };
+		vrEyeRenderViewport[0].Size = { renderTargetSize.w / 2, renderTargetSize.h };
+		vrEyeRenderViewport[1].Pos = { (renderTargetSize.w + 1) / 2, 0 };
+		vrEyeRenderViewport[1].Size = vrEyeRenderViewport[0].Size;
 
-	// FOV for each eye.
-	vrEyeFov[0] = vrHmd->DefaultEyeFov[0];
-	vrEyeFov[1] = vrHmd->DefaultEyeFov[1];
 
+		// FOV for each eye.
+		vrEyeFov[0] = vrHmd->DefaultEyeFov[0];
+		vrEyeFov[1] = vrHmd->DefaultEyeFov[1];
+		return true;
+	}, true);
 
 	// Windows-specific initialization part.
-	WNDCLASSEX wcx;
-	ZeroMemory(&wcx, sizeof(wcx));
-	wcx.cbSize = sizeof(wcx);
-	wcx.lpszClassName = ClassName;
-	wcx.hCursor = LoadCursor(nullptr, IDC_ARROW);
-	wcx.hInstance = GetModuleHandle(nullptr); // Tip: GetModuleHandle(nullptr) works just as well.
-	wcx.lpfnWndProc = WndProc;
-
-	RegisterClassEx(&wcx);
-
-	/*
-	The dimensions of the window does not need to match the dimensions of the actual HMD
-	output.
-	*/
-	auto hwnd = CreateWindowW(
-		ClassName,
-		L"SimpleOVR - D3D11",
-		WS_OVERLAPPEDWINDOW | WS_VISIBLE,
-		0, 0,
-		1280, 720,
-		nullptr,
-		nullptr,
-		nullptr,
-		nullptr);
+	HWND hwnd = nullptr;
+	const int windowTask = startup.Add("window", [&]() {
+		WNDCLASSEX wcx;
+		ZeroMemory(&wcx, sizeof(wcx));
+		wcx.cbSize = sizeof(wcx);
+		wcx.lpszClassName = ClassName;
+		wcx.hCursor = LoadCursor(nullptr, IDC_ARROW);
+		wcx.hInstance = GetModuleHandle(nullptr); // Tip: GetModuleHandle(nullptr) works just as well.
+		wcx.lpfnWndProc = WndProc;
+
+		RegisterClassEx(&wcx);
 
+		/*
+		The dimensions of the window does not need to match the dimensions of the actual HMD
+		output.
+		*/
+		hwnd = CreateWindowW(
+			ClassName,
+			L"SimpleOVR - D3D11",
+			WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+			0, 0,
+			1280, 720,
+			nullptr,
+			nullptr,
+			nullptr,
+			nullptr);
+		return hwnd != nullptr;
+	}, true);
+
+	// Opening the Ovrvision takes the longest of all, it only needs to know the HMD.
 	//Create ovrvision object
 	g_pOvrvision = new OVR::Ovrvision();
-	if (vrHmd->Type == ovrHmd_DK2) {
-		//Rift DK2
-		g_pOvrvision->Open(0, OVR::OV_CAMVGA_FULL);  //Open
-	}
-	else {
-		//Rift DK1
-		g_pOvrvision->Open(0, OVR::OV_CAMVGA_FULL, OVR::OV_HMD_OCULUS_DK1);  //Open
-	}
+	CameraSource* cameraSource = nullptr;
+	CameraSource* recordingSource = nullptr;
+	CameraThread* cameraThread = new CameraThread();
+	startup.Add("camera", [&]() {
+		if (vrHmd->Type == ovrHmd_DK2) {
+			//Rift DK2
+			g_pOvrvision->Open(0, OVR::OV_CAMVGA_FULL);  //Open
+		}
+		else {
+			//Rift DK1
+			g_pOvrvision->Open(0, OVR::OV_CAMVGA_FULL, OVR::OV_HMD_OCULUS_DK1);  //Open
+		}
+
+		// Camera frames are pulled on their own thread; the render loop only ever takes the newest
+		// complete one. Without a camera we fall back to a synthetic pattern at the same size.
+		if (replay != nullptr)
+			cameraSource = new ReplayCameraSource(replay, true, true);
+		else if (!useSyntheticCamera && g_pOvrvision->isOpen())
+			cameraSource = new OvrvisionSource(g_pOvrvision, processer_quality);
+		else
+			cameraSource = new SyntheticCameraSource(CAM_WIDTH, CAM_HEIGHT, 60.0);
+		if (captureWriter != nullptr)
+			recordingSource = new RecordingCameraSource(cameraSource, captureWriter);
+		cameraThread->Start(recordingSource != nullptr ? recordingSource : cameraSource);
+		return true;
+	}, false, hmdTask);
 
 	/*
 	D3D11 initialization.
@@ -290,98 +504,87 @@ int main() {
 	If you attempt to target anything less you might start getting crashes in LibOVR or various
 	D3D-related errors.
 	*/
-	D3D_FEATURE_LEVEL requestedLevels[] = { D3D_FEATURE_LEVEL_11_0, D3D_FEATURE_LEVEL_10_1 };
-	D3D_FEATURE_LEVEL obtainedLevel;
 	ID3D11Device* d3dDevice = nullptr;
 	ID3D11DeviceContext* d3dContext = nullptr;
-
-	DXGI_SWAP_CHAIN_DESC scd;
-	ZeroMemory(&scd, sizeof(scd));
-	scd.BufferCount = 1;
-	scd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	scd.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-	scd.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-	scd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-
-	scd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
-	scd.OutputWindow = hwnd;
-	scd.SampleDesc.Count = MultisampleCount;
-	scd.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
-	scd.Windowed = false;
-
-	// NOTE: LibOVR 0.4.3 requires that the width and height for the backbuffer is set even if
-	// you use windowed mode, despite being optional according to the D3D11 documentation.
-	scd.BufferDesc.Width = vrHmd->Resolution.w;
-	scd.BufferDesc.Height = vrHmd->Resolution.h;
-	scd.BufferDesc.RefreshRate.Numerator = 0;
-	scd.BufferDesc.RefreshRate.Denominator = 1;
-
-	UINT createFlags = 0;
+	IDXGISwapChain* d3dSwapChain = 0;
+	const int deviceTask = startup.Add("device", [&]() {
+		D3D_FEATURE_LEVEL requestedLevels[] = { D3D_FEATURE_LEVEL_11_0, D3D_FEATURE_LEVEL_10_1 };
+		D3D_FEATURE_LEVEL obtainedLevel;
+
+		DXGI_SWAP_CHAIN_DESC scd;
+		ZeroMemory(&scd, sizeof(scd));
+		scd.BufferCount = 1;
+		scd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		scd.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
+		scd.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
+		scd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+
+		scd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+		scd.OutputWindow = hwnd;
+		scd.SampleDesc.Count = MultisampleCount;
+		scd.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+		scd.Windowed = false;
+
+		// NOTE: LibOVR 0.4.3 requires that the width and height for the backbuffer is set even if
+		// you use windowed mode, despite being optional according to the D3D11 documentation.
+		scd.BufferDesc.Width = vrHmd->Resolution.w;
+		scd.BufferDesc.Height = vrHmd->Resolution.h;
+		scd.BufferDesc.RefreshRate.Numerator = 0;
+		scd.BufferDesc.RefreshRate.Denominator = 1;
+
+		UINT createFlags = 0;
 #ifdef _DEBUG
-	// This flag gives you some quite wonderful debug text. Not wonderful for performance, though!
-	createFlags |= D3D11_CREATE_DEVICE_DEBUG;
+		// This flag gives you some quite wonderful debug text. Not wonderful for performance, though!
+		createFlags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif
 
-	IDXGISwapChain* d3dSwapChain = 0;
-
-	D3D11CreateDeviceAndSwapChain(
-		nullptr,
-		D3D_DRIVER_TYPE_HARDWARE,
-		nullptr,
-		createFlags,
-		requestedLevels,
-		sizeof(requestedLevels) / sizeof(D3D_FEATURE_LEVEL),
-		D3D11_SDK_VERSION,
-		&scd,
-		&d3dSwapChain,
-		&d3dDevice,
-		&obtainedLevel,
-		&d3dContext);
-
-	// Create a render target view for the backbuffer. This will be used during rendering when we
-	// actually render the eye buffers to the HMD.
-	ID3D11Texture2D* pBackBuffer = nullptr;
-	d3dSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&pBackBuffer);
-	d3dDevice->CreateRenderTargetView(pBackBuffer, nullptr, &d3dBackBufferRenderTargetView);
-	pBackBuffer->Release();
-
-	// We don't get a depth buffer by default, and you'll probably want one of those.
-	D3D11_TEXTURE2D_DESC descDepth;
-	ZeroMemory(&descDepth, sizeof(descDepth));
-	descDepth.Width = renderTargetSize.w;
-	descDepth.Height = renderTargetSize.h;
-	descDepth.MipLevels = 1;
-	descDepth.ArraySize = 1;
-	descDepth.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-	descDepth.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-	descDepth.SampleDesc.Count = MultisampleCount;
-	d3dDevice->CreateTexture2D(&descDepth, nullptr, &d3dDepthStencilTexture);
-
-	D3D11_DEPTH_STENCIL_VIEW_DESC descStencilView;
-	ZeroMemory(&descStencilView, sizeof(descStencilView));
-	descStencilView.Format = descDepth.Format;
-	descStencilView.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DMS;
-
-	d3dDevice->CreateDepthStencilView(d3dDepthStencilTexture, &descStencilView, &d3dDepthStencilView);
-
-	// Allocate a texture that will hold both (undistorted) eye views. Later we'll let LibOVR use this texture
-	// to render the final distorted view to the HMD.
-	D3D11_TEXTURE2D_DESC texdesc;
-	ZeroMemory(&texdesc, sizeof(texdesc));
-	texdesc.Width = renderTargetSize.w;
-	texdesc.Height = renderTargetSize.h;
-	texdesc.MipLevels = 1;
-	texdesc.ArraySize = 1;
-	texdesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texdesc.SampleDesc.Count = MultisampleCount;
-	texdesc.Usage = D3D11_USAGE_DEFAULT;
-	texdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-	d3dDevice->CreateTexture2D(&texdesc, nullptr, &d3dEyeTexture);
-	d3dDevice->CreateShaderResourceView(d3dEyeTexture, nullptr, &d3dEyeTextureShaderResourceView);
-	d3dDevice->CreateRenderTargetView(d3dEyeTexture, nullptr, &d3dEyeTextureRenderTargetView);
-
-	if (MultisampleCount > 1) {
-		// This render target is ONLY used for multisampling. More comments up at the variable declarations.
+		HRESULT hr = D3D11CreateDeviceAndSwapChain(
+			nullptr,
+			D3D_DRIVER_TYPE_HARDWARE,
+			nullptr,
+			createFlags,
+			requestedLevels,
+			sizeof(requestedLevels) / sizeof(D3D_FEATURE_LEVEL),
+			D3D11_SDK_VERSION,
+			&scd,
+			&d3dSwapChain,
+			&d3dDevice,
+			&obtainedLevel,
+			&d3dContext);
+		if (FAILED(hr))
+			return false;
+
+		// Create a render target view for the backbuffer. This will be used during rendering when we
+		// actually render the eye buffers to the HMD.
+		ID3D11Texture2D* pBackBuffer = nullptr;
+		d3dSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&pBackBuffer);
+		d3dDevice->CreateRenderTargetView(pBackBuffer, nullptr, &d3dBackBufferRenderTargetView);
+		pBackBuffer->Release();
+		return true;
+	}, true, hmdTask, windowTask);
+
+	const int targetsTask = startup.Add("render targets", [&]() {
+		// We don't get a depth buffer by default, and you'll probably want one of those.
+		D3D11_TEXTURE2D_DESC descDepth;
+		ZeroMemory(&descDepth, sizeof(descDepth));
+		descDepth.Width = renderTargetSize.w;
+		descDepth.Height = renderTargetSize.h;
+		descDepth.MipLevels = 1;
+		descDepth.ArraySize = 1;
+		descDepth.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		descDepth.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+		descDepth.SampleDesc.Count = MultisampleCount;
+		d3dDevice->CreateTexture2D(&descDepth, nullptr, &d3dDepthStencilTexture);
+
+		D3D11_DEPTH_STENCIL_VIEW_DESC descStencilView;
+		ZeroMemory(&descStencilView, sizeof(descStencilView));
+		descStencilView.Format = descDepth.Format;
+		descStencilView.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DMS;
+
+		d3dDevice->CreateDepthStencilView(d3dDepthStencilTexture, &descStencilView, &d3dDepthStencilView);
+
+		// Allocate a texture that will hold both (undistorted) eye views. Later we'll let LibOVR use this texture
+		// to render the final distorted view to the HMD.
 		D3D11_TEXTURE2D_DESC texdesc;
 		ZeroMemory(&texdesc, sizeof(texdesc));
 		texdesc.Width = renderTargetSize.w;
@@ -389,229 +592,347 @@ int main() {
 		texdesc.MipLevels = 1;
 		texdesc.ArraySize = 1;
 		texdesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-		texdesc.SampleDesc.Count = 1; // NOT multisampled. We resolve the multisampled rendertarget to this one.
-		texdesc.SampleDesc.Quality = 0;
+		texdesc.SampleDesc.Count = MultisampleCount;
 		texdesc.Usage = D3D11_USAGE_DEFAULT;
 		texdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-		texdesc.CPUAccessFlags = 0;
-		texdesc.MiscFlags = 0;
-		d3dDevice->CreateTexture2D(&texdesc, nullptr, &d3dIntermediaryTexture);
-		d3dDevice->CreateShaderResourceView(d3dIntermediaryTexture, nullptr, &d3dIntermediaryTextureShaderResourceView);
-		d3dDevice->CreateRenderTargetView(d3dIntermediaryTexture, nullptr, &d3dIntermediaryTextureRenderTargetView);
-	}
+		d3dDevice->CreateTexture2D(&texdesc, nullptr, &d3dEyeTexture);
+		d3dDevice->CreateShaderResourceView(d3dEyeTexture, nullptr, &d3dEyeTextureShaderResourceView);
+		d3dDevice->CreateRenderTargetView(d3dEyeTexture, nullptr, &d3dEyeTextureRenderTargetView);
 
-	// We'll let LibOVR take care of the distortion rendering for us, so we'll let it know where it
-	// can find the undistorted eye buffers. We are sharing a single texture between both eyes.
-	vrEyeTexture[0].D3D11.Header.API = ovrRenderAPI_D3D11;
-	vrEyeTexture[0].D3D11.Header.TextureSize = renderTargetSize;
-	vrEyeTexture[0].D3D11.Header.RenderViewport = vrEyeRenderViewport[0];
+		if (MultisampleCount > 1) {
+			// This render target is ONLY used for multisampling. More comments up at the variable declarations.
+			D3D11_TEXTURE2D_DESC texdesc;
+			ZeroMemory(&texdesc, sizeof(texdesc));
+			texdesc.Width = renderTargetSize.w;
+			texdesc.Height = renderTargetSize.h;
+			texdesc.MipLevels = 1;
+			texdesc.ArraySize = 1;
+			texdesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			texdesc.SampleDesc.Count = 1; // NOT multisampled. We resolve the multisampled rendertarget to this one.
+			texdesc.SampleDesc.Quality = 0;
+			texdesc.Usage = D3D11_USAGE_DEFAULT;
+			texdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+			texdesc.CPUAccessFlags = 0;
+			texdesc.MiscFlags = 0;
+			d3dDevice->CreateTexture2D(&texdesc, nullptr, &d3dIntermediaryTexture);
+			d3dDevice->CreateShaderResourceView(d3dIntermediaryTexture, nullptr, &d3dIntermediaryTextureShaderResourceView);
+			d3dDevice->CreateRenderTargetView(d3dIntermediaryTexture, nullptr, &d3dIntermediaryTextureRenderTargetView);
+		}
+		return d3dEyeTexture != nullptr && d3dDepthStencilView != nullptr;
+	}, false, deviceTask);
 
-	// If we use multisampling we're actually rendering from the intermediary texture instead
-	if (MultisampleCount > 1) {
-		vrEyeTexture[0].D3D11.pSRView = d3dIntermediaryTextureShaderResourceView;
-		vrEyeTexture[0].D3D11.pTexture = d3dIntermediaryTexture;
-	}
-	else {
-		vrEyeTexture[0].D3D11.pSRView = d3dEyeTextureShaderResourceView;
-		vrEyeTexture[0].D3D11.pTexture = d3dEyeTexture;
-	}
+	startup.Add("rendering", [&]() {
+		// We'll let LibOVR take care of the distortion rendering for us, so we'll let it know where it
+		// can find the undistorted eye buffers. We are sharing a single texture between both eyes.
+		vrEyeTexture[0].D3D11.Header.API = ovrRenderAPI_D3D11;
+		vrEyeTexture[0].D3D11.Header.TextureSize = renderTargetSize;
+		vrEyeTexture[0].D3D11.Header.RenderViewport = vrEyeRenderViewport[0];
 
-	// Right eye uses the same texture, but different rendering viewport.
-	vrEyeTexture[1] = vrEyeTexture[0];
-	vrEyeTexture[1].D3D11.Header.RenderViewport = vrEyeRenderViewport[1];
+		// If we use multisampling we're actually rendering from the intermediary texture instead
+		if (MultisampleCount > 1) {
+			vrEyeTexture[0].D3D11.pSRView = d3dIntermediaryTextureShaderResourceView;
+			vrEyeTexture[0].D3D11.pTexture = d3dIntermediaryTexture;
+		}
+		else {
+			vrEyeTexture[0].D3D11.pSRView = d3dEyeTextureShaderResourceView;
+			vrEyeTexture[0].D3D11.pTexture = d3dEyeTexture;
+		}
 
+		// Right eye uses the same texture, but different rendering viewport.
+		vrEyeTexture[1] = vrEyeTexture[0];
+		vrEyeTexture[1].D3D11.Header.RenderViewport = vrEyeRenderViewport[1];
 
-	vrRenderConfiguration.D3D11.Header.API = ovrRenderAPI_D3D11;
-	vrRenderConfiguration.D3D11.Header.RTSize = vrHmd->Resolution;
-	vrRenderConfiguration.D3D11.pDevice = d3dDevice;
-	vrRenderConfiguration.D3D11.pDeviceContext = d3dContext;
-	vrRenderConfiguration.D3D11.pSwapChain = d3dSwapChain;
-	vrRenderConfiguration.D3D11.pBackBufferRT = d3dBackBufferRenderTargetView;
-	// NOTE: Header.Multisample does not seem to be used as of 0.4.3, so feel free to ignore it for now.
-	vrRenderConfiguration.D3D11.Header.Multisample = MultisampleCount;
 
-	ovrHmd_ConfigureRendering(vrHmd, &vrRenderConfiguration.Config, ovrDistortionCap_Chromatic | ovrDistortionCap_TimeWarp | ovrDistortionCap_Overdrive | ovrDistortionCap_Vignette, vrEyeFov, vrEyeRenderDesc);
+		vrRenderConfiguration.D3D11.Header.API = ovrRenderAPI_D3D11;
+		vrRenderConfiguration.D3D11.Header.RTSize = vrHmd->Resolution;
+		vrRenderConfiguration.D3D11.pDevice = d3dDevice;
+		vrRenderConfiguration.D3D11.pDeviceContext = d3dContext;
+		vrRenderConfiguration.D3D11.pSwapChain = d3dSwapChain;
+		vrRenderConfiguration.D3D11.pBackBufferRT = d3dBackBufferRenderTargetView;
+		// NOTE: Header.Multisample does not seem to be used as of 0.4.3, so feel free to ignore it for now.
+		vrRenderConfiguration.D3D11.Header.Multisample = MultisampleCount;
 
-	// This line can be skipped if the defaults are good enough for you.
-	ovrHmd_SetEnabledCaps(vrHmd, ovrHmdCap_LowPersistence | ovrHmdCap_DynamicPrediction | ovrHmdCap_NoMirrorToWindow);
+		ovrHmd_ConfigureRendering(vrHmd, &vrRenderConfiguration.Config, ovrDistortionCap_Chromatic | ovrDistortionCap_TimeWarp | ovrDistortionCap_Overdrive | ovrDistortionCap_Vignette, vrEyeFov, vrEyeRenderDesc);
 
-	// This is the magic part that enabled Direct HMD Access mode. Currently (0.4.3) it only works on Windows.
-	ovrHmd_AttachToWindow(vrHmd, hwnd, nullptr, nullptr);
+		// This line can be skipped if the defaults are good enough for you.
+		ovrHmd_SetEnabledCaps(vrHmd, ovrHmdCap_LowPersistence | ovrHmdCap_DynamicPrediction | ovrHmdCap_NoMirrorToWindow);
 
-	ovrVector3f vrHmdToEyeViewOffset[2] = {
-		vrEyeRenderDesc[0].HmdToEyeViewOffset,
-		vrEyeRenderDesc[1].HmdToEyeViewOffset
-	};
+		// This is the magic part that enabled Direct HMD Access mode. Currently (0.4.3) it only works on Windows.
+		ovrHmd_AttachToWindow(vrHmd, hwnd, nullptr, nullptr);
+		return true;
+	}, true, targetsTask);
+
+	// The shaders only need their files. The ones that changed are compiled all at once on the
+	// worker pool.
+	ShaderCache shaderCache(ShaderArchivePath, CompileShader, D3D_COMPILER_VERSION);
+	const int shadersTask = startup.Add("shaders", [&]() {
+		return shaderCache.Load(SceneShaderRequests(), workerPool);
+	}, false);
 
 	// Finally we'll create everything we need for a very simple scene. This is probably not very
 	// interesting so I have hidden it in a separate function.
-	auto d3dConstantBuffer = SetupScene(d3dDevice, d3dContext);
+	ID3D11Buffer* d3dConstantBuffer = nullptr;
+	startup.Add("scene", [&]() {
+		d3dConstantBuffer = SetupScene(d3dDevice, d3dContext, shaderCache);
+		return d3dConstantBuffer != nullptr;
+	}, true, deviceTask, shadersTask);
+
+	// One texture per eye for the camera image. The CPU converts every new camera frame straight
+	// into the mapped texture memory.
+	ID3D11Texture2D* d3dCameraTexture[2] = { nullptr, nullptr };
+	ID3D11ShaderResourceView* d3dCameraTextureShaderResourceView[2] = { nullptr, nullptr };
+	startup.Add("camera textures", [&]() {
+		for (int eye = 0; eye < 2; eye++) {
+			D3D11_TEXTURE2D_DESC camdesc;
+			ZeroMemory(&camdesc, sizeof(camdesc));
+			camdesc.Width = CAM_WIDTH;
+			camdesc.Height = CAM_HEIGHT;
+			camdesc.MipLevels = 1;
+			camdesc.ArraySize = 1;
+			camdesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			camdesc.SampleDesc.Count = 1;
+			camdesc.Usage = D3D11_USAGE_DYNAMIC;
+			camdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			camdesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			d3dDevice->CreateTexture2D(&camdesc, nullptr, &d3dCameraTexture[eye]);
+			d3dDevice->CreateShaderResourceView(d3dCameraTexture[eye], nullptr, &d3dCameraTextureShaderResourceView[eye]);
+		}
+		return d3dCameraTextureShaderResourceView[0] != nullptr && d3dCameraTextureShaderResourceView[1] != nullptr;
+	}, false, deviceTask);
+
+	// Lens undistortion tables for the camera. They only depend on the calibration, so they are
+	// cached on disk and only the first run pays for building them.
+	CameraCalibration cameraCalibration[2];
+	UndistortMap* cameraUndistort = new UndistortMap();
+	startup.Add("undistort", [&]() {
+		cameraUndistort->Init(CAM_WIDTH, CAM_HEIGHT, cameraCalibration, eye_interocular, eye_scale);
+		return true;
+	}, false);
+
+	// The overlay images are decoded and mipmapped on the worker pool while the device is still
+	// coming up and the first frames already run, and go up a few levels per frame. They are
+	// sized for the overlay array, the software renderer takes them as they are. The streamer is
+	// only requested from here until Run returns, the render loop has it after that.
+	TextureStreamer* textureStreamer = new TextureStreamer(workerPool);
+	TextureAtlas atlas;
+	startup.Add("textures", [&]() {
+		if (!useSoftwareRenderer)
+			textureStreamer->SetCompression(OverlayFormat, OverlayQuality, TextureCacheDirectory);
+		if (atlasName != nullptr && !atlas.Open(atlasName)) {
+			Log::Get()->Err("Cannot open the atlas %s", atlasName);
+			return false;
+		}
+		const int overlaySize = useSoftwareRenderer ? 0 : static_cast<int>(OverlayArraySize);
+		for (UINT slice = 0; slice < RenderDevice::OverlaySlices; slice++) {
+			if (atlasName == nullptr)
+				textureStreamer->Request(OverlayFiles[slice], static_cast<eSceneTexture>(slice), overlaySize);
+			else if (slice < atlas.Pages())
+				textureStreamer->Request(atlas.PagePath(slice).c_str(), static_cast<eSceneTexture>(slice), overlaySize);
+		}
+		return true;
+	}, false);
+
+	// Undoes what the startup tasks did, as far as they got. Normal shutdown ends with it too.
+	auto shutdown = [&]() {
+		delete textureStreamer;
+		DestroyScene();
+		delete workerPool;
+		delete cameraUndistort;
+		for (int eye = 0; eye < 2; eye++) {
+			SafeRelease(d3dCameraTextureShaderResourceView[eye]);
+			SafeRelease(d3dCameraTexture[eye]);
+		}
+		SafeRelease(d3dIntermediaryTextureShaderResourceView);
+		SafeRelease(d3dIntermediaryTextureRenderTargetView);
+		SafeRelease(d3dIntermediaryTexture);
+
+		// Stop capturing before the device goes away.
+		cameraThread->Stop();
+		delete cameraThread;
+		delete recordingSource;
+		delete cameraSource;
+		if (captureWriter != nullptr) {
+			captureWriter->Close();
+			delete captureWriter;
+			captureWriter = nullptr;
+		}
+		delete replay;
+		inputMgr->RecordTo(nullptr);
+		delete inputRecorder;
+		inputRecorder = nullptr;
+		delete inputReplay;
+		inputReplay = nullptr;
+
+		//Clean up Wizapply library
+		delete g_pOvrvision;
+
+
+		/*------------------------------------------------------------------*/
+
+		SafeRelease(d3dDepthStencilView);
+		SafeRelease(d3dDepthStencilTexture);
+		SafeRelease(d3dEyeTextureRenderTargetView);
+		SafeRelease(d3dEyeTextureShaderResourceView);
+		SafeRelease(d3dEyeTexture);
+		SafeRelease(d3dBackBufferRenderTargetView);
+		SafeRelease(d3dSwapChain);
+		SafeRelease(d3dContext);
+		SafeRelease(d3dDevice);
+		// a failed hmd task has shut LibOVR down already
+		if (vrHmd != nullptr) {
+			ovrHmd_Destroy(vrHmd);
+			ovr_Shutdown();
+		}
+	};
+
+	const bool started = startup.Run(startupPool);
+	delete startupPool;
+	Log::Get()->Print("Startup took %.1f ms:", startup.Elapsed() * 1000.0);
+	startup.Timeline([](const char* line) { Log::Get()->Print("  %s", line); });
+	if (!started) {
+		// a missing HMD has its own message
+		if (startup.State(hmdTask) != STARTUP_FAILED)
+			MessageBoxA(nullptr, "See the log", "Failed starting up", MB_OK);
+		shutdown();
+		return EXIT_FAILURE;
+	}
 
+	// The frame itself only talks to the HMD and the renderer through these, the same frame
+	// runs headless in the benchmark. Replays take the eye poses from the recording, on its
+	// clock and looping at the end.
+	OvrHmdDevice ovrDevice(vrHmd, vrEyeRenderDesc, vrEyeRenderViewport, &vrEyeTexture[0].Texture);
+	ReplayHmdDevice* replayDevice = nullptr;
+	if (replay != nullptr)
+		replayDevice = new ReplayHmdDevice(&ovrDevice, replay, true);
+	HmdDevice* hmdDevice = replayDevice != nullptr ? static_cast<HmdDevice*>(replayDevice) : &ovrDevice;
+
+	D3D11RenderDevice renderDevice(d3dContext, d3dEyeTextureRenderTargetView, d3dDepthStencilView, d3dEyeTexture,
+		MultisampleCount > 1 ? d3dIntermediaryTexture : nullptr, d3dConstantBuffer, m_pSamplerLinear);
+	renderDevice.SetTexture(TEXTURE_OVERLAY_OUT, m_pTextureRV);
+	renderDevice.SetTexture(TEXTURE_OVERLAY_IN, m_pTextureRV2);
+	renderDevice.SetTexture(TEXTURE_CAMERA_LEFT, d3dCameraTextureShaderResourceView[0]);
+	renderDevice.SetTexture(TEXTURE_CAMERA_RIGHT, d3dCameraTextureShaderResourceView[1]);
+	renderDevice.SetCameraTextures(d3dCameraTexture[0], d3dCameraTexture[1]);
+	SetupInstancing(&renderDevice);
+
+	// The software renderer draws the same scene into system memory and hands the finished eye
+	// texture to D3D, which then only does the distortion pass through LibOVR.
+	SoftwareRenderDevice* softwareDevice = nullptr;
+	if (useSoftwareRenderer) {
+		softwareDevice = new SoftwareRenderDevice(renderTargetSize.w, renderTargetSize.h, CAM_WIDTH, CAM_HEIGHT, workerPool);
+		softwareDevice->SetTextureImage(TEXTURE_OVERLAY_OUT, PlaceholderColor, 1, 1, 4);
+		softwareDevice->SetTextureImage(TEXTURE_OVERLAY_IN, PlaceholderColor, 1, 1, 4);
+		ID3D11Texture2D* presentTexture = MultisampleCount > 1 ? d3dIntermediaryTexture : d3dEyeTexture;
+		softwareDevice->SetPresent([=](const unsigned char* rgba, int pitch) {
+			d3dContext->UpdateSubresource(presentTexture, 0, nullptr, rgba, pitch, 0);
+		});
+	}
+
+	RenderDevice* frameDevice = softwareDevice != nullptr ? static_cast<RenderDevice*>(softwareDevice) : &renderDevice;
+
+	FrameLoop frameLoop(hmdDevice, frameDevice);
+	for (UINT overlay = 0; atlasName != nullptr && overlay < RenderDevice::OverlaySlices; overlay++) {
+		AtlasRect rect;
+		if (atlas.Find(OverlayNames[overlay], rect) && rect.page < RenderDevice::OverlaySlices)
+			frameLoop.SetOverlayTexture(static_cast<eSceneTexture>(overlay), rect.page, rect.u0, rect.v0, rect.u1, rect.v1);
+		else
+			Log::Get()->Err("Overlay image %s is not on the first %u pages of atlas %s", OverlayNames[overlay], RenderDevice::OverlaySlices, atlasName);
+	}
+	frameLoop.SetCamera(cameraThread, cameraUndistort, workerPool);
+	frameLoop.SetTextureStreamer(textureStreamer, TextureUploadBudget);
+	frameLoop.SetShowCamera(useOvrvisionAR);
+
+	// Head poses at 1 kHz on their own thread, so every camera frame can be matched with the pose
+	// at its capture time. Replays have their poses in the recording and leave it empty.
+	PoseHistory* poseHistory = new PoseHistory();
+	PoseSampler* poseSampler = new PoseSampler();
+	if (replayDevice == nullptr) {
+		if (inputReplay == nullptr)
+			inputMgr->UseRawMouse(hwnd);
+		poseSampler->Start(&ovrDevice, poseHistory);
+		frameLoop.SetPoseHistory(poseHistory);
+		frameLoop.SetReprojectCamera(true);
+	}
 
+	static_assert(sizeof(CapturePose) == sizeof(ovrPosef), "CapturePose must match ovrPosef");
+	size_t replayInput = 0;
 
+	double previousInputTime = 0.0;
 	bool keepRunning = true;
 	while (keepRunning) {
+		const double frameStart = Clock::Now();
 		MSG msg;
 		while (PeekMessage(&msg, 0, 0, 0, PM_REMOVE)) {
 			if (msg.message == WM_QUIT) {
 				keepRunning = false;
 			}
 
-			// Pressing a key will cause a recenter and attempt to dismiss the health warning.
-			// Many other VR applications use F12 for recentering.
-			if (msg.message == WM_KEYDOWN) {
-				if (input->recenter == true)
-					ovrHmd_RecenterPose(vrHmd);
+			// Pressing a key will attempt to dismiss the health warning.
+			if (msg.message == WM_KEYDOWN)
 				ovrHmd_DismissHSWDisplay(vrHmd);
-			}
 
 			TranslateMessage(&msg);
 			DispatchMessage(&msg);
 		}
 
-		// Rendering part
-		ovrHmd_BeginFrame(vrHmd, 0);
-
-		ovrPosef vrEyeRenderPose[2];
-		ovrTrackingState hmdTrackingState;
-		ovrHmd_GetEyePoses(vrHmd, 0, vrHmdToEyeViewOffset, vrEyeRenderPose, &hmdTrackingState);
-
-		float f[] = { 0.22f, 0.23f, 0.29f, 1 };
-		d3dContext->ClearRenderTargetView(d3dEyeTextureRenderTargetView, f);
-		d3dContext->ClearDepthStencilView(d3dDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1, 0);
-
-		// We use one single render target for both eyes.
-		d3dContext->OMSetRenderTargets(1, &d3dEyeTextureRenderTargetView, d3dDepthStencilView);
-
-		// We'll assume people have at most two eyes.
-		for (int i = 0; i < 2; i++) {
-			// The HMD might want us to render each eye in a specific order for best result.
-			auto eye = vrHmd->EyeRenderOrder[i];
-
-			// Use the viewport for the current eye
-			D3D11_VIEWPORT vp;
-			vp.Width = static_cast<float>(vrEyeRenderViewport[eye].Size.w);
-			vp.Height = static_cast<float>(vrEyeRenderViewport[eye].Size.h);
-			vp.TopLeftX = static_cast<float>(vrEyeRenderViewport[eye].Pos.x);
-			vp.TopLeftY = static_cast<float>(vrEyeRenderViewport[eye].Pos.y);
-			vp.MinDepth = 0.0f;
-			vp.MaxDepth = 1.0f;
-			d3dContext->RSSetViewports(1, &vp);
-
-			// All left now is to render the scene. 
-			/*
-			OVR::Matrix4f scale = OVR::Matrix4f::Scaling(0.3f);
-			OVR::Matrix4f translate = OVR::Matrix4f::Translation(0.0f, 0.0f, -5.0f);
-			OVR::Matrix4f result = scale*translate;
-			ovrMatrix4f transposedScaling = result.Transposed();
-			D3D11_MAPPED_SUBRESOURCE d3dMappedStatus2;
-			auto ms2 = d3dContext->Map(d3dConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &d3dMappedStatus2);
-			std::memcpy(d3dMappedStatus2.pData, &transposedScaling, sizeof(float)* 16);
-			d3dContext->Unmap(d3dConstantBuffer, 0);
-			*/
-
-
-
-			// Calculate projection and view for the current eye. You'll probably replace all of this in
-			// your own project.
-			OVR::Posef currentEyePose = vrEyeRenderPose[eye];
-			OVR::Matrix4f projection = ovrMatrix4f_Projection(vrEyeRenderDesc[eye].Fov, 0.01f, 10000.0f, true);
-			OVR::Quatf quatBodyRotation = OVR::Quatf(UpVector, BodyYaw.Get());
-			auto worldPose = OVR::Posef(
-				quatBodyRotation * currentEyePose.Rotation, // Final rotation (body AND head)
-				BodyPosition + quatBodyRotation.Rotate(currentEyePose.Translation) // Final position (body AND eye)
-				);
-
-			OVR::Matrix4f scale = OVR::Matrix4f::Scaling(scaleAmount);
-			OVR::Matrix4f translate = OVR::Matrix4f::Translation(translateAmount);
-			OVR::Matrix4f rotate = OVR::Matrix4f::RotationY(0);
-			OVR::Matrix4f cubeFinalTransform = translate*scale*rotate;
-
-			d3dContext->PSSetShaderResources(0, 1, &m_pTextureRV);
-			d3dContext->PSSetSamplers(0, 1, &m_pSamplerLinear);
-
-
-			auto up = worldPose.Rotation.Rotate(UpVector);
-			auto forward = worldPose.Rotation.Rotate(ForwardVector);
-
-			OVR::Matrix4f view = OVR::Matrix4f::LookAtRH(worldPose.Translation, worldPose.Translation + forward, up);
-			//view = OVR::Matrix4f::Identity();
-			OVR::Matrix4f matrixViewProjection = projection  * cubeFinalTransform;
-			//OVR::Matrix4f matrixViewProjection = projection * view * cubeFinalTransform;
-
-			//ovrMatrix4f scale = 
-			// Send the View-Projection matrix to the Vertex Shader.
-			// The shader only expects the matrix so we're taking the quick and dirty approach.
-			ovrMatrix4f transposedMvp = matrixViewProjection.Transposed();
-			D3D11_MAPPED_SUBRESOURCE d3dMappedStatus;
-			auto ms = d3dContext->Map(d3dConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &d3dMappedStatus);
-			std::memcpy(d3dMappedStatus.pData, &transposedMvp, sizeof(float)* 16);
-			d3dContext->Unmap(d3dConstantBuffer, 0);
-
-			d3dContext->DrawIndexed(6, 0, 0);
-
-			translate = OVR::Matrix4f::Translation(0.0f, 0.0f, -2.0f);
-			scale = OVR::Matrix4f::Scaling(scaleAmount);
-			rotate = OVR::Matrix4f::RotationY(0);
-
-			d3dContext->PSSetShaderResources(0, 1, &m_pTextureRV2);
-			d3dContext->PSSetSamplers(0, 1, &m_pSamplerLinear);
-
-			cubeFinalTransform = translate*scale*rotate;
-
-
-			matrixViewProjection = projection * view * cubeFinalTransform;
-			transposedMvp = matrixViewProjection.Transposed();
-			ms = d3dContext->Map(d3dConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &d3dMappedStatus);
-			std::memcpy(d3dMappedStatus.pData, &transposedMvp, sizeof(float)* 16);
-			d3dContext->Unmap(d3dConstantBuffer, 0);
-
-			d3dContext->DrawIndexed(6, 0, 0);
+		// All input of the frame is handled here, before anything reads the input state.
+		// Space recenters by default; many other VR applications use F12 for recentering.
+		// A replay hands on the events of the next recorded frame, at its recorded time, so held
+		// keys move the overlay exactly as they did.
+		double inputTime = frameStart;
+		if (inputReplay != nullptr && !inputReplay->NextFrame(*inputMgr, inputTime))
+			keepRunning = false;
+		inputMgr->Dispatch(inputTime);
+		// held keys act by time; a stall, e.g. moving the window, does not count
+		const double frameTime = previousInputTime > 0.0 ? std::min(inputTime - previousInputTime, 0.1) : 0.0;
+		previousInputTime = inputTime;
+		input->Update(*inputMgr, frameTime);
+		if (input->recenter) {
+			hmdDevice->Recenter();
+			input->recenter = false;
 		}
-
-		if (MultisampleCount > 1) {
-			d3dContext->ResolveSubresource(d3dIntermediaryTexture, 0, d3dEyeTexture, 0, DXGI_FORMAT_R8G8B8A8_UNORM);
+		frameLoop.SetOverlay(input->getScale(), input->translate);
+		frameLoop.RunFrame();
+		if (frameLoop.FrameIndex() == 1)
+			Log::Get()->Print("First frame %.1f ms after startup began", (Clock::Now() - startupBegin) * 1000.0);
+
+		if (replayDevice != nullptr) {
+			// Recorded input goes through the same path as live window messages and takes effect
+			// from the next frame on. An input recording replayed with it takes its place.
+			if (replayDevice->Looped())
+				replayInput = 0;
+			while (inputReplay == nullptr && replayInput < replay->InputCount() && replay->Input(replayInput).time <= replayDevice->Time()) {
+				const InputRecord& record = replay->Input(replayInput++);
+				inputMgr->Run(record.msg, static_cast<WPARAM>(record.wParam), static_cast<LPARAM>(record.lParam));
+			}
+		}
+		else if (captureWriter != nullptr) {
+			const ovrTrackingState& tracking = frameLoop.Tracking();
+			PoseRecord record;
+			record.time = frameStart;
+			record.statusFlags = tracking.StatusFlags;
+			std::memcpy(&record.head, &tracking.HeadPose.ThePose, sizeof(ovrPosef));
+			std::memcpy(&record.eye[0], &frameLoop.EyePoses()[0], sizeof(ovrPosef));
+			std::memcpy(&record.eye[1], &frameLoop.EyePoses()[1], sizeof(ovrPosef));
+			captureWriter->WritePose(record);
 		}
 
-		/*
-		Finish the current frame and send it to the HMD. swapChain->Present is called
-		automatically inside this function.
-		*/
-		ovrHmd_EndFrame(vrHmd, vrEyeRenderPose, &vrEyeTexture[0].Texture);
+		if (captureWriter != nullptr) {
+			TimingRecord timing = { frameStart, Clock::Now(), frameLoop.FrameIndex() - 1 };
+			captureWriter->WriteTiming(timing);
+		}
 	}
 
 
 	/*
 	Cleanup part.
 	*/
-	DestroyScene();
-	if (d3dIntermediaryTextureShaderResourceView != nullptr) {
-		d3dIntermediaryTextureShaderResourceView->Release();
-	}
-	if (d3dIntermediaryTextureRenderTargetView != nullptr) {
-		d3dIntermediaryTextureRenderTargetView->Release();
-	}
-	if (d3dIntermediaryTexture != nullptr) {
-		d3dIntermediaryTexture->Release();
-	}
-
-	//Clean up Wizapply library
-	delete g_pOvrvision;
-
-
-	/*------------------------------------------------------------------*/
-
-	d3dDepthStencilView->Release();
-	d3dDepthStencilTexture->Release();
-	d3dEyeTextureRenderTargetView->Release();
-	d3dEyeTextureShaderResourceView->Release();
-	d3dEyeTexture->Release();
-	d3dBackBufferRenderTargetView->Release();
-	d3dSwapChain->Release();
-	d3dContext->Release();
-	d3dDevice->Release();
-	ovrHmd_Destroy(vrHmd);
-	ovr_Shutdown();
+	poseSampler->Stop();
+	delete poseSampler;
+	delete poseHistory;
+	delete softwareDevice;
+	delete replayDevice;
+	shutdown();
 
 	return EXIT_SUCCESS;
 }
@@ -621,33 +942,6 @@ Below is a bunch of code that prepares the scene. It has very little to do with
 but this example would be fairly boring without anything to look at.
 */
 
-const char* VertexShaderCode =
-"cbuffer Constants {"
-"   float4x4 mvp;"
-"};"
-"struct VS_OUTPUT"
-"{"
-"   float4 Pos : SV_POSITION; "
-"   float4 Color : COLOR0;"
-"};"
-"VS_OUTPUT main(float4 Pos : POSITION, float4 Color : Color) {"
-"   VS_OUTPUT output = (VS_OUTPUT)0;"
-"   output.Pos = mul(mvp, Pos);"
-"   output.Color = Color;"
-"   return output;"
-"}";
-
-const char* PixelShaderCode =
-"struct VS_OUTPUT"
-"{"
-"float4 Pos : SV_POSITION; "
-"   float4 Color : COLOR0;"
-"}; "
-"float4 main(VS_OUTPUT input) : SV_Target"
-"{"
-"   return input.Color;"
-"}";
-
 /*
 struct Vertex {
 float Position[3];
@@ -664,12 +958,56 @@ ID3D11VertexShader* d3dVertexShader = nullptr;
 ID3D11PixelShader* d3dPixelShader = nullptr;
 ID3D11Buffer* d3dConstantBuffer = nullptr;
 ID3D11Buffer* d3dVertexBuffer = nullptr;
+ID3D11Buffer* d3dDrawIndexBuffer = nullptr;
+// Instanced overlays: their pipeline, the instance buffer and the overlay images as one texture array
+ID3D11InputLayout* d3dInstancedInputLayout = nullptr;
+ID3D11VertexShader* d3dInstancedVertexShader = nullptr;
+ID3D11PixelShader* d3dInstancedPixelShader = nullptr;
+ID3D11Buffer* d3dInstanceBuffer = nullptr;
+ID3D11Texture2D* d3dOverlayArray = nullptr;
+ID3D11ShaderResourceView* d3dOverlayArrayView = nullptr;
+
+
+
+// Compiles for the ShaderCache with the D3DCompiler of the SDK
+static bool CompileShader(const ShaderRequest& request, const unsigned char* source, size_t size, std::vector<unsigned char>& blob, std::string& errors) {
+	ID3D10Blob* code = nullptr;
+	ID3D10Blob* messages = nullptr;
+	HRESULT hr = D3DCompile(source, size, request.path.c_str(), nullptr, nullptr, request.entry.c_str(), request.profile.c_str(), request.flags, 0, &code, &messages);
+	if (messages != nullptr) {
+		errors.assign(static_cast<const char*>(messages->GetBufferPointer()), messages->GetBufferSize());
+		messages->Release();
+	}
+	if (FAILED(hr) || code == nullptr)
+		return false;
+	const unsigned char* bytes = static_cast<const unsigned char*>(code->GetBufferPointer());
+	blob.assign(bytes, bytes + code->GetBufferSize());
+	code->Release();
+	return true;
+}
 
+// The shaders of the scene in eSceneShader order. The compiled shaders of the last launch are
+// kept in one archive; only shaders whose file changed are compiled again.
+enum eSceneShader { SHADER_VS = 0, SHADER_PS, SHADER_VS_INSTANCED, SHADER_PS_INSTANCED, SHADER_COUNT };
+std::vector<ShaderRequest> SceneShaderRequests() {
+	DWORD ShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
+#if defined( DEBUG ) || defined( _DEBUG )
+	ShaderFlags |= D3DCOMPILE_DEBUG;
+#endif
 
+	const char* entries[SHADER_COUNT][2] = { { "VS", "vs_4_0" }, { "PS", "ps_4_0" }, { "VSInstanced", "vs_4_0" }, { "PSInstanced", "ps_4_0" } };
+	std::vector<ShaderRequest> shaderRequests(SHADER_COUNT);
+	for (int i = 0; i < SHADER_COUNT; i++) {
+		shaderRequests[i].path = "shader.hlsl";
+		shaderRequests[i].entry = entries[i][0];
+		shaderRequests[i].profile = entries[i][1];
+		shaderRequests[i].flags = ShaderFlags;
+	}
+	return shaderRequests;
+}
 
-ID3D11Buffer* SetupScene(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContext) {
-	ID3D10Blob* d3dBlobVertexShader = nullptr;
-	ID3D10Blob* d3dBlobPixelShader = nullptr;
+// Needs the shaders of SceneShaderRequests loaded into shaderCache
+ID3D11Buffer* SetupScene(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContext, const ShaderCache& shaderCache) {
 
 	// The vertices of our scene. Perhaps not very exciting.
 	/*std::vector<Vertex> vertices = {
@@ -763,42 +1101,42 @@ ID3D11Buffer* SetupScene(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContex
 	};
 
 	HRESULT hr = S_OK;
-	DWORD ShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if defined( DEBUG ) || defined( _DEBUG )
-	ShaderFlags |= D3DCOMPILE_DEBUG;
-#endif
-
-	ID3D10Blob* pErrorBlob = nullptr;
-	hr = D3DX11CompileFromFile(L"shader.hlsl", NULL, NULL, "VS", "vs_4_0", ShaderFlags, 0, NULL, &d3dBlobVertexShader, &pErrorBlob, NULL);
-	if (FAILED(hr) && pErrorBlob != NULL) {
-		OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-		pErrorBlob->Release();
-	}
-
-	d3dDevice->CreateVertexShader(d3dBlobVertexShader->GetBufferPointer(), d3dBlobVertexShader->GetBufferSize(), nullptr, &d3dVertexShader);
-
-	pErrorBlob = nullptr;
-	hr = D3DX11CompileFromFile(L"shader.hlsl", NULL, NULL, "PS", "ps_4_0", ShaderFlags, 0, NULL, &d3dBlobPixelShader, &pErrorBlob, NULL);
-	if (FAILED(hr) && pErrorBlob != NULL) {
-		OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-		pErrorBlob->Release();
-	}
-
-	d3dDevice->CreatePixelShader(d3dBlobPixelShader->GetBufferPointer(), d3dBlobPixelShader->GetBufferSize(), nullptr, &d3dPixelShader);
 
+	const ShaderBlob& vertexShader = shaderCache.Blob(SHADER_VS);
+	const ShaderBlob& instancedVertexShader = shaderCache.Blob(SHADER_VS_INSTANCED);
+	d3dDevice->CreateVertexShader(vertexShader.data, vertexShader.size, nullptr, &d3dVertexShader);
+	d3dDevice->CreatePixelShader(shaderCache.Blob(SHADER_PS).data, shaderCache.Blob(SHADER_PS).size, nullptr, &d3dPixelShader);
+	d3dDevice->CreateVertexShader(instancedVertexShader.data, instancedVertexShader.size, nullptr, &d3dInstancedVertexShader);
+	d3dDevice->CreatePixelShader(shaderCache.Blob(SHADER_PS_INSTANCED).data, shaderCache.Blob(SHADER_PS_INSTANCED).size, nullptr, &d3dInstancedPixelShader);
 
 	// This code tells Direct3D how to read the block of data in memory.
 	//For this we create InputLayout. We are telling what the first entry will be vertex position and the second  Texture Coordinates. 
 	D3D11_INPUT_ELEMENT_DESC inputElements[] = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "DRAWINDEX", 0, DXGI_FORMAT_R32_UINT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
 	};
 	UINT numElements = ARRAYSIZE(inputElements);
 	//HRESULT hr = S_OK;
-	hr = d3dDevice->CreateInputLayout(inputElements, numElements, d3dBlobVertexShader->GetBufferPointer(), d3dBlobVertexShader->GetBufferSize(), &d3dInputLayout);
+	hr = d3dDevice->CreateInputLayout(inputElements, numElements, vertexShader.data, vertexShader.size, &d3dInputLayout);
 	if FAILED(hr)
 		return false;
 	d3dContext->IASetInputLayout(d3dInputLayout);
+
+	// The instanced overlays read the quad from slot 0 and one OverlayInstance per quad from slot 2.
+	D3D11_INPUT_ELEMENT_DESC instancedElements[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "INSTANCEMVP", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 2, offsetof(OverlayInstance, mvp), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCEMVP", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 2, offsetof(OverlayInstance, mvp) + 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCEMVP", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 2, offsetof(OverlayInstance, mvp) + 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCEMVP", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 2, offsetof(OverlayInstance, mvp) + 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "UVRECT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 2, offsetof(OverlayInstance, uvRect), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "SLICE", 0, DXGI_FORMAT_R32_UINT, 2, offsetof(OverlayInstance, slice), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+	hr = d3dDevice->CreateInputLayout(instancedElements, ARRAYSIZE(instancedElements), instancedVertexShader.data, instancedVertexShader.size, &d3dInstancedInputLayout);
+	if FAILED(hr)
+		return false;
 	D3D11_BUFFER_DESC vbDesc;
 	ZeroMemory(&vbDesc, sizeof(vbDesc));
 	vbDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
@@ -819,6 +1157,24 @@ ID3D11Buffer* SetupScene(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContex
 	UINT offset = 0;
 	d3dContext->IASetVertexBuffers(0, 1, &d3dVertexBuffer, &stride, &offset);
 
+	// Draw indices 0 .. MaxDraws-1. A draw picks its matrix from the constant buffer by starting
+	// its instance at that index, the constants of a whole frame are uploaded with one map.
+	std::vector<UINT> drawIndices(RenderDevice::MaxDraws);
+	for (UINT i = 0; i < RenderDevice::MaxDraws; i++)
+		drawIndices[i] = i;
+	vbDesc.ByteWidth = sizeof(UINT)* RenderDevice::MaxDraws;
+	initialData.pSysMem = &drawIndices[0];
+	initialData.SysMemPitch = 0;
+	d3dDevice->CreateBuffer(&vbDesc, &initialData, &d3dDrawIndexBuffer);
+	stride = sizeof(UINT);
+	d3dContext->IASetVertexBuffers(1, 1, &d3dDrawIndexBuffer, &stride, &offset);
+
+	// Overlay instances of a frame, rewritten with one map per frame. D3D11RenderDevice binds it to slot 2.
+	vbDesc.ByteWidth = sizeof(OverlayInstance)* RenderDevice::MaxInstances;
+	vbDesc.Usage = D3D11_USAGE_DYNAMIC;
+	vbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	d3dDevice->CreateBuffer(&vbDesc, nullptr, &d3dInstanceBuffer);
+
 	ID3D11Buffer *m_pIndexBuffer = nullptr;
 	vbDesc.Usage = D3D11_USAGE_DEFAULT;
 	vbDesc.ByteWidth = sizeof(WORD)* 36;
@@ -836,12 +1192,64 @@ ID3D11Buffer* SetupScene(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContex
 	cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 	cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	cbDesc.Usage = D3D11_USAGE_DYNAMIC;
-	cbDesc.ByteWidth = sizeof(float)* 16;
-
-	hr = D3DX11CreateShaderResourceViewFromFile(d3dDevice, L"D:\\texture_out.png", NULL, NULL, &m_pTextureRV, NULL);
+	cbDesc.ByteWidth = RenderDevice::MaxDraws * RenderDevice::DrawConstants;
+
+	// The overlay textures start out as the placeholder colour, the TextureStreamer replaces
+	// them once their files are loaded. A missing file only leaves the placeholder.
+	// A flat colour encodes to the same block everywhere, so one block is encoded and repeated.
+	ImageRgba placeholderBlock;
+	placeholderBlock.Allocate(4, 4);
+	for (size_t i = 0; i < placeholderBlock.pixels.size(); i += 4)
+		std::memcpy(&placeholderBlock.pixels[i], PlaceholderColor, 4);
+	std::vector<unsigned char> block;
+	BlockCompress::Encode(placeholderBlock, OverlayFormat, OverlayQuality, block);
+	std::vector<unsigned char> placeholder(BlockCompress::LevelBytes(OverlayFormat, OverlayArraySize, OverlayArraySize));
+	for (size_t i = 0; i < placeholder.size(); i += block.size())
+		std::memcpy(&placeholder[i], &block[0], block.size());
+	D3D11_TEXTURE2D_DESC placeholderDesc;
+	ZeroMemory(&placeholderDesc, sizeof(placeholderDesc));
+	placeholderDesc.Width = 1;
+	placeholderDesc.Height = 1;
+	placeholderDesc.MipLevels = 1;
+	placeholderDesc.ArraySize = 1;
+	placeholderDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	placeholderDesc.SampleDesc.Count = 1;
+	placeholderDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	placeholderDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA placeholderData = { PlaceholderColor, 4, 0 };
+	ID3D11Texture2D* placeholderTexture = nullptr;
+	hr = d3dDevice->CreateTexture2D(&placeholderDesc, &placeholderData, &placeholderTexture);
 	if (FAILED(hr))
 		return false;
-	hr = D3DX11CreateShaderResourceViewFromFile(d3dDevice, L"D:\\texture_in.jpg", NULL, NULL, &m_pTextureRV2, NULL);
+	d3dDevice->CreateShaderResourceView(placeholderTexture, nullptr, &m_pTextureRV);
+	d3dDevice->CreateShaderResourceView(placeholderTexture, nullptr, &m_pTextureRV2);
+	placeholderTexture->Release();
+
+	// The slices of the overlay array, one per overlay image in eSceneTexture order with every
+	// mip level. Streamed images are copied in, so it has default usage.
+	D3D11_TEXTURE2D_DESC arrayDesc;
+	ZeroMemory(&arrayDesc, sizeof(arrayDesc));
+	arrayDesc.Width = OverlayArraySize;
+	arrayDesc.Height = OverlayArraySize;
+	arrayDesc.MipLevels = MipChain::LevelCount(OverlayArraySize, OverlayArraySize);
+	arrayDesc.ArraySize = RenderDevice::OverlaySlices;
+	arrayDesc.Format = D3D11RenderDevice::DxgiFormat(OverlayFormat);
+	arrayDesc.SampleDesc.Count = 1;
+	arrayDesc.Usage = D3D11_USAGE_DEFAULT;
+	arrayDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	std::vector<D3D11_SUBRESOURCE_DATA> arrayData(arrayDesc.MipLevels * arrayDesc.ArraySize);
+	for (UINT slice = 0; slice < arrayDesc.ArraySize; slice++) {
+		for (UINT level = 0; level < arrayDesc.MipLevels; level++) {
+			D3D11_SUBRESOURCE_DATA& data = arrayData[D3D11CalcSubresource(level, slice, arrayDesc.MipLevels)];
+			data.pSysMem = &placeholder[0];
+			data.SysMemPitch = BlockCompress::Pitch(OverlayFormat, std::max(1, static_cast<int>(OverlayArraySize >> level)));
+			data.SysMemSlicePitch = 0;
+		}
+	}
+	hr = d3dDevice->CreateTexture2D(&arrayDesc, &arrayData[0], &d3dOverlayArray);
+	if (FAILED(hr))
+		return false;
+	hr = d3dDevice->CreateShaderResourceView(d3dOverlayArray, nullptr, &d3dOverlayArrayView);
 	if (FAILED(hr))
 		return false;
 
@@ -878,18 +1286,30 @@ ID3D11Buffer* SetupScene(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContex
 
 
 
-	d3dBlobPixelShader->Release();
-	d3dBlobVertexShader->Release();
-
 	return d3dConstantBuffer;
 }
 
+// Hands the instanced overlay pipeline of the scene to the render device.
+void SetupInstancing(D3D11RenderDevice* renderDevice) {
+	D3D11Pipeline quadPipeline = { d3dInputLayout, d3dVertexShader, d3dPixelShader };
+	D3D11Pipeline instancedPipeline = { d3dInstancedInputLayout, d3dInstancedVertexShader, d3dInstancedPixelShader };
+	renderDevice->SetInstancing(d3dInstanceBuffer, d3dOverlayArrayView, quadPipeline, instancedPipeline);
+}
+
 void DestroyScene() {
-	d3dConstantBuffer->Release();
-	d3dVertexBuffer->Release();
-	d3dInputLayout->Release();
-	d3dVertexShader->Release();
-	d3dPixelShader->Release();
-	m_pSamplerLinear->Release();
-	m_pTextureRV->Release();
+	SafeRelease(d3dConstantBuffer);
+	SafeRelease(d3dVertexBuffer);
+	SafeRelease(d3dDrawIndexBuffer);
+	SafeRelease(d3dInstanceBuffer);
+	SafeRelease(d3dInstancedInputLayout);
+	SafeRelease(d3dInstancedVertexShader);
+	SafeRelease(d3dInstancedPixelShader);
+	SafeRelease(d3dOverlayArrayView);
+	SafeRelease(d3dOverlayArray);
+	SafeRelease(d3dInputLayout);
+	SafeRelease(d3dVertexShader);
+	SafeRelease(d3dPixelShader);
+	SafeRelease(m_pSamplerLinear);
+	SafeRelease(m_pTextureRV);
+	SafeRelease(m_pTextureRV2);
 }
\ No newline at end of file
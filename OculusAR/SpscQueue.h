@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Lock-free single producer / single consumer FIFO of Capacity values,
+	// a power of two. Unlike TripleBuffer every value is kept until the
+	// reader takes it; when the ring is full Push fails instead.
+	template<typename T, unsigned Capacity>
+	class SpscQueue
+	{
+		static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+	public:
+		SpscQueue() : m_tail(0), m_headCache(0), m_head(0), m_tailCache(0) {}
+
+		// --- writer side ---
+
+		// Appends a copy of value. Returns false if the queue is full.
+		bool Push(const T &value)
+		{
+			const unsigned tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_headCache == Capacity)
+			{
+				m_headCache = m_head.load(std::memory_order_acquire);
+				if (tail - m_headCache == Capacity)
+					return false;
+			}
+			m_values[tail & (Capacity - 1)] = value;
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// --- reader side ---
+
+		// Values pushed and not taken yet
+		unsigned Size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_relaxed); }
+
+		// Takes the oldest value. Returns false if the queue is empty.
+		bool Pop(T &value)
+		{
+			const unsigned head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tailCache)
+			{
+				m_tailCache = m_tail.load(std::memory_order_acquire);
+				if (head == m_tailCache)
+					return false;
+			}
+			value = m_values[head & (Capacity - 1)];
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		SpscQueue(const SpscQueue&);
+		SpscQueue &operator=(const SpscQueue&);
+
+		T m_values[Capacity];
+
+		// writer and reader state on separate cache lines; each side keeps
+		// the last index of the other it saw to touch the shared line less
+		char m_pad0[64];
+		std::atomic<unsigned> m_tail;
+		unsigned m_headCache;
+		char m_pad1[64];
+		std::atomic<unsigned> m_head;
+		unsigned m_tailCache;
+	};
+
+//------------------------------------------------------------------
+}
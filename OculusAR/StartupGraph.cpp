@@ -0,0 +1,184 @@
+#include "StartupGraph.h"
+#include "Clock.h"
+#include "Log.h"
+#include "ThreadPool.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	StartupGraph::StartupGraph() : m_begin(0.0), m_elapsed(0.0)
+	{
+	}
+
+	int StartupGraph::Add(const char *name, const Task &task, bool mainThread, int dep0, int dep1, int dep2, int dep3)
+	{
+		const int index = static_cast<int>(m_tasks.size());
+		Node node;
+		node.name = name;
+		node.task = task;
+		node.mainThread = mainThread;
+		const int deps[4] = { dep0, dep1, dep2, dep3 };
+		for (int i = 0; i < 4; i++)
+		{
+			if (deps[i] < 0)
+				continue;
+			if (deps[i] >= index)
+			{
+				Log::Get()->Err("Startup task %s depends on a task added after it", name);
+				continue;
+			}
+			node.deps.push_back(deps[i]);
+			m_tasks[deps[i]].dependents.push_back(index);
+		}
+		node.waiting = 0;
+		node.blocked = false;
+		node.state = STARTUP_PENDING;
+		node.start = 0.0;
+		node.end = 0.0;
+		node.ranOnMain = false;
+		m_tasks.push_back(node);
+		return index;
+	}
+
+	void StartupGraph::m_execute(int task, bool onMain)
+	{
+		Node &node = m_tasks[task];
+		node.ranOnMain = onMain;
+		node.start = Clock::Now() - m_begin;
+		const bool ok = node.task();
+		node.end = Clock::Now() - m_begin;
+		node.state = ok ? STARTUP_DONE : STARTUP_FAILED;
+		if (!ok)
+			Log::Get()->Err("Startup task %s failed", node.name.c_str());
+	}
+
+	bool StartupGraph::Run(ThreadPool *pool)
+	{
+		const int count = Count();
+		for (int i = 0; i < count; i++)
+		{
+			Node &node = m_tasks[i];
+			node.waiting = static_cast<int>(node.deps.size());
+			node.blocked = false;
+			node.state = STARTUP_PENDING;
+			node.start = node.end = 0.0;
+		}
+		m_begin = Clock::Now();
+
+		if (!pool)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				Node &node = m_tasks[i];
+				for (size_t d = 0; d < node.deps.size(); d++)
+					node.blocked = node.blocked || m_tasks[node.deps[d]].state != STARTUP_DONE;
+				if (node.blocked)
+					node.state = STARTUP_SKIPPED;
+				else
+					m_execute(i, true);
+			}
+		}
+		else
+		{
+			std::mutex mutex;
+			std::condition_variable changed;
+			std::deque<int> mainReady;
+			int finished = 0;
+
+			// both with the mutex held
+			std::function<void(int)> ready;
+			std::function<void(int)> finish = [&](int task) {
+				finished++;
+				const Node &node = m_tasks[task];
+				for (size_t i = 0; i < node.dependents.size(); i++)
+				{
+					Node &dependent = m_tasks[node.dependents[i]];
+					dependent.blocked = dependent.blocked || node.state != STARTUP_DONE;
+					if (--dependent.waiting == 0)
+						ready(node.dependents[i]);
+				}
+			};
+			ready = [&](int task) {
+				Node &node = m_tasks[task];
+				if (node.blocked)
+				{
+					node.state = STARTUP_SKIPPED;
+					finish(task);
+				}
+				else if (node.mainThread)
+					mainReady.push_back(task);
+				else
+				{
+					pool->Submit([&, task]() {
+						m_execute(task, false);
+						// notified under the lock, Run may return as soon as it is released
+						std::lock_guard<std::mutex> lock(mutex);
+						finish(task);
+						changed.notify_all();
+					});
+				}
+			};
+
+			std::unique_lock<std::mutex> lock(mutex);
+			for (int i = 0; i < count; i++)
+				if (m_tasks[i].waiting == 0)
+					ready(i);
+			while (finished < count)
+			{
+				if (mainReady.empty())
+				{
+					changed.wait(lock);
+					continue;
+				}
+				const int task = mainReady.front();
+				mainReady.pop_front();
+				lock.unlock();
+				m_execute(task, true);
+				lock.lock();
+				finish(task);
+			}
+		}
+
+		m_elapsed = Clock::Now() - m_begin;
+		bool ok = true;
+		for (int i = 0; i < count; i++)
+			ok = ok && m_tasks[i].state == STARTUP_DONE;
+		return ok;
+	}
+
+	void StartupGraph::Timeline(const std::function<void(const char *line)> &out, int columns) const
+	{
+		if (columns < 1)
+			columns = 1;
+		std::vector<char> bar(columns + 1);
+		char line[256];
+		for (int i = 0; i < Count(); i++)
+		{
+			const Node &node = m_tasks[i];
+			if (node.state == STARTUP_SKIPPED || node.state == STARTUP_PENDING)
+			{
+				snprintf(line, sizeof(line), "%-16s %-4s %s", node.name.c_str(), node.mainThread ? "main" : "pool",
+					node.state == STARTUP_SKIPPED ? "skipped" : "not run");
+				out(line);
+				continue;
+			}
+			int first = m_elapsed > 0.0 ? static_cast<int>(node.start / m_elapsed * columns) : 0;
+			int last = m_elapsed > 0.0 ? static_cast<int>(node.end / m_elapsed * columns) : 0;
+			first = first < columns ? first : columns - 1;
+			last = last < columns ? last : columns - 1;
+			for (int c = 0; c < columns; c++)
+				bar[c] = c >= first && c <= last ? '#' : ' ';
+			bar[columns] = 0;
+			snprintf(line, sizeof(line), "%-16s %-4s %8.1f ms +%8.1f ms |%s|%s", node.name.c_str(), node.ranOnMain ? "main" : "pool",
+				node.start * 1000.0, (node.end - node.start) * 1000.0, &bar[0], node.state == STARTUP_FAILED ? " failed" : "");
+			out(line);
+		}
+	}
+
+//------------------------------------------------------------------
+}
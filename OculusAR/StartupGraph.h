@@ -0,0 +1,92 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class ThreadPool;
+
+	enum eStartupState
+	{
+		STARTUP_PENDING = 0,
+		STARTUP_DONE,
+		STARTUP_FAILED,
+		// Not run because a task it depends on failed or was skipped
+		STARTUP_SKIPPED
+	};
+
+	// Startup as a graph of init tasks. A task runs once every task it
+	// depends on is done, so everything that does not wait on each other
+	// overlaps: opening the camera, loading shaders and decoding textures
+	// run on the pool while the thread calling Run creates the window and
+	// the device. Tasks that have to stay on that thread (the window, the
+	// swap chain, the immediate context) are added as main thread tasks.
+	//
+	// A task that returns false fails, the tasks after it are skipped and
+	// the others still run. When and where each task ran is kept for the
+	// timeline.
+	class StartupGraph
+	{
+	public:
+		typedef std::function<bool()> Task;
+
+		StartupGraph();
+
+		// Index of the task. A task can only depend on tasks added before
+		// it, so there are no cycles; -1 is no dependency.
+		int Add(const char *name, const Task &task, bool mainThread, int dep0 = -1, int dep1 = -1, int dep2 = -1, int dep3 = -1);
+
+		// Runs all tasks and returns once none is left, false if one of them
+		// failed. Without a pool every task runs on this thread in the order
+		// they were added, which is how the serial startup looked.
+		bool Run(ThreadPool *pool);
+
+		int Count() const { return static_cast<int>(m_tasks.size()); }
+		const char *Name(int task) const { return m_tasks[task].name.c_str(); }
+		eStartupState State(int task) const { return m_tasks[task].state; }
+		const std::vector<int> &Dependencies(int task) const { return m_tasks[task].deps; }
+		// Seconds since Run started
+		double Start(int task) const { return m_tasks[task].start; }
+		double End(int task) const { return m_tasks[task].end; }
+		bool OnMainThread(int task) const { return m_tasks[task].ranOnMain; }
+		// Seconds Run took
+		double Elapsed() const { return m_elapsed; }
+
+		// One line per task: where it ran, its start and duration and a bar
+		// of columns characters over the whole run
+		void Timeline(const std::function<void(const char *line)> &out, int columns = 40) const;
+
+	private:
+		StartupGraph(const StartupGraph&);
+		StartupGraph &operator=(const StartupGraph&);
+
+		struct Node
+		{
+			std::string name;
+			Task task;
+			bool mainThread;
+			std::vector<int> deps;
+			std::vector<int> dependents;
+			// Dependencies not finished yet, and whether one of them did not succeed
+			int waiting;
+			bool blocked;
+			eStartupState state;
+			double start;
+			double end;
+			bool ranOnMain;
+		};
+
+		// Runs the task on the calling thread and records it
+		void m_execute(int task, bool onMain);
+
+		std::vector<Node> m_tasks;
+		double m_begin;
+		double m_elapsed;
+	};
+
+//------------------------------------------------------------------
+}
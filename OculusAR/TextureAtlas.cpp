@@ -0,0 +1,384 @@
+#include "TextureAtlas.h"
+#include "Hash.h"
+#include "ImageEncode.h"
+#include "Log.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static const unsigned ATLAS_MAGIC = 0x4C54414F;	// "OATL"
+	static const unsigned ATLAS_VERSION = 1;
+
+	// A run of the skyline: the pages are taken below y from x to x + width
+	struct SkylineSegment
+	{
+		int x;
+		int y;
+		int width;
+	};
+
+	// Top of a cell of width w starting at segment i, false if it runs
+	// off the page
+	static bool s_skylineFit(const std::vector<SkylineSegment> &line, size_t i, int w, int h, int size, int &y)
+	{
+		if (line[i].x + w > size)
+			return false;
+		y = 0;
+		for (int left = w; left > 0; i++)
+		{
+			y = std::max(y, line[i].y);
+			if (y + h > size)
+				return false;
+			left -= line[i].width;
+		}
+		return true;
+	}
+
+	static void s_skylineAdd(std::vector<SkylineSegment> &line, size_t i, int w, int y)
+	{
+		const SkylineSegment segment = { line[i].x, y, w };
+		line.insert(line.begin() + i, segment);
+		const int right = segment.x + w;
+		while (i + 1 < line.size() && line[i + 1].x < right)
+		{
+			SkylineSegment &next = line[i + 1];
+			const int covered = std::min(right - next.x, next.width);
+			next.x += covered;
+			next.width -= covered;
+			if (next.width > 0)
+				break;
+			line.erase(line.begin() + i + 1);
+		}
+		for (size_t j = 0; j + 1 < line.size();)
+		{
+			if (line[j].y == line[j + 1].y)
+			{
+				line[j].width += line[j + 1].width;
+				line.erase(line.begin() + j + 1);
+			}
+			else
+				j++;
+		}
+	}
+
+	AtlasPacker::AtlasPacker(int pageSize, int padding, int alignment) :
+		m_pageSize(pageSize), m_padding(padding), m_alignment(std::max(alignment, 1)), m_pages(0), m_used(0)
+	{
+	}
+
+	int AtlasPacker::m_cell(int size) const
+	{
+		return (size + 2 * m_padding + m_alignment - 1) / m_alignment * m_alignment;
+	}
+
+	bool AtlasPacker::Pack(std::vector<AtlasItem> &items)
+	{
+		// tallest first, then widest; the index keeps it stable
+		std::vector<int> order(items.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = static_cast<int>(i);
+		std::sort(order.begin(), order.end(), [&](int a, int b) {
+			const AtlasItem &ia = items[a], &ib = items[b];
+			return ia.height != ib.height ? ia.height > ib.height : ia.width != ib.width ? ia.width > ib.width : a < b;
+		});
+
+		std::vector<std::vector<SkylineSegment> > pages;
+		// lowest point of each skyline, pages with less room above it are skipped
+		std::vector<int> lowest;
+		bool ok = true;
+		for (size_t o = 0; o < order.size(); o++)
+		{
+			AtlasItem &item = items[order[o]];
+			const int w = m_cell(item.width), h = m_cell(item.height);
+			item.page = -1;
+			if (item.width <= 0 || item.height <= 0 || w > m_pageSize || h > m_pageSize)
+			{
+				ok = false;
+				continue;
+			}
+			for (size_t p = 0; item.page < 0; p++)
+			{
+				if (p == pages.size())
+				{
+					const SkylineSegment empty = { 0, 0, m_pageSize };
+					pages.push_back(std::vector<SkylineSegment>(1, empty));
+					lowest.push_back(0);
+				}
+				if (lowest[p] + h > m_pageSize)
+					continue;
+
+				std::vector<SkylineSegment> &line = pages[p];
+				size_t best = line.size();
+				int bestTop = m_pageSize + 1, bestX = 0;
+				for (size_t i = 0; i < line.size(); i++)
+				{
+					int y;
+					if (s_skylineFit(line, i, w, h, m_pageSize, y) && (y + h < bestTop || (y + h == bestTop && line[i].x < bestX)))
+					{
+						best = i;
+						bestTop = y + h;
+						bestX = line[i].x;
+					}
+				}
+				if (best == line.size())
+					continue;
+
+				item.page = static_cast<int>(p);
+				item.x = bestX + m_padding;
+				item.y = bestTop - h + m_padding;
+				s_skylineAdd(line, best, w, bestTop);
+				lowest[p] = m_pageSize;
+				for (size_t i = 0; i < line.size(); i++)
+					lowest[p] = std::min(lowest[p], line[i].y);
+			}
+		}
+
+		m_pages = static_cast<int>(pages.size());
+		m_used = 0;
+		for (size_t p = 0; p < pages.size(); p++)
+			for (size_t i = 0; i < pages[p].size(); i++)
+				m_used += static_cast<size_t>(pages[p][i].y) * pages[p][i].width;
+		return ok;
+	}
+
+	void AtlasPacker::Compose(const std::vector<AtlasItem> &items, const std::vector<ImageRgba> &images, int page, ImageRgba &out) const
+	{
+		out.Allocate(m_pageSize, m_pageSize);
+		std::fill(out.pixels.begin(), out.pixels.end(), static_cast<unsigned char>(0));
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			const AtlasItem &item = items[i];
+			const ImageRgba &image = images[i];
+			if (item.page != page || image.width != item.width || image.height != item.height)
+				continue;
+			const int cellX = item.x - m_padding, cellY = item.y - m_padding;
+			const int w = m_cell(item.width), h = m_cell(item.height);
+			for (int y = 0; y < h; y++)
+			{
+				// the nearest texel of the image, so the edges run on to the end of the cell
+				const int sy = std::min(std::max(cellY + y - item.y, 0), item.height - 1);
+				const unsigned char *source = image.Row(sy);
+				unsigned char *row = out.Row(cellY + y) + cellX * 4;
+				for (int x = 0; x < m_padding; x++)
+					memcpy(row + x * 4, source, 4);
+				memcpy(row + m_padding * 4, source, item.width * 4);
+				for (int x = m_padding + item.width; x < w; x++)
+					memcpy(row + x * 4, source + (item.width - 1) * 4, 4);
+			}
+		}
+	}
+
+	bool AtlasPacker::WriteIndex(const char *path, const std::vector<std::string> &names, const std::vector<AtlasItem> &items) const
+	{
+		std::vector<AtlasEntry> entries(items.size());
+		std::vector<char> strings;
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			const AtlasItem &item = items[i];
+			AtlasEntry &entry = entries[i];
+			memset(&entry, 0, sizeof(entry));
+			entry.nameHash = HashBytes(names[i].c_str(), names[i].size());
+			entry.nameOffset = static_cast<unsigned>(strings.size());
+			entry.page = static_cast<unsigned>(item.page);
+			entry.uvRect[0] = static_cast<float>(item.x) / m_pageSize;
+			entry.uvRect[1] = static_cast<float>(item.y) / m_pageSize;
+			entry.uvRect[2] = static_cast<float>(item.x + item.width) / m_pageSize;
+			entry.uvRect[3] = static_cast<float>(item.y + item.height) / m_pageSize;
+			entry.x = static_cast<unsigned short>(item.x);
+			entry.y = static_cast<unsigned short>(item.y);
+			entry.width = static_cast<unsigned short>(item.width);
+			entry.height = static_cast<unsigned short>(item.height);
+			strings.insert(strings.end(), names[i].c_str(), names[i].c_str() + names[i].size() + 1);
+		}
+		std::sort(entries.begin(), entries.end(), [&](const AtlasEntry &a, const AtlasEntry &b) {
+			return a.nameHash != b.nameHash ? a.nameHash < b.nameHash : strcmp(&strings[a.nameOffset], &strings[b.nameOffset]) < 0;
+		});
+		for (size_t i = 1; i < entries.size(); i++)
+			if (entries[i].nameHash == entries[i - 1].nameHash && strcmp(&strings[entries[i].nameOffset], &strings[entries[i - 1].nameOffset]) == 0)
+			{
+				Log::Get()->Err("Atlas %s has two images named %s", path, &strings[entries[i].nameOffset]);
+				return false;
+			}
+
+		FILE *file = fopen(path, "wb");
+		if (!file)
+			return false;
+		const AtlasHeader header = { ATLAS_MAGIC, ATLAS_VERSION, static_cast<unsigned>(m_pages), static_cast<unsigned>(entries.size()),
+			static_cast<unsigned>(m_pageSize), static_cast<unsigned>(strings.size()) };
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		ok = ok && (entries.empty() || fwrite(&entries[0], sizeof(AtlasEntry), entries.size(), file) == entries.size());
+		ok = ok && (strings.empty() || fwrite(&strings[0], 1, strings.size(), file) == strings.size());
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+			remove(path);
+		return ok;
+	}
+
+	// File name without directory and extension
+	static std::string s_imageName(const std::string &path)
+	{
+		const size_t slash = path.find_last_of("/\\");
+		const std::string file = slash == std::string::npos ? path : path.substr(slash + 1);
+		const size_t dot = file.rfind('.');
+		return dot == std::string::npos || dot == 0 ? file : file.substr(0, dot);
+	}
+
+	bool AtlasPacker::Build(const char *name, const std::vector<std::string> &files, int pageSize, ThreadPool *pool)
+	{
+		const int count = static_cast<int>(files.size());
+		std::vector<ImageRgba> images(count);
+		std::vector<char> loaded(count, 0);
+		auto load = [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				loaded[i] = ImageDecode::Load(files[i].c_str(), images[i]) ? 1 : 0;
+		};
+		if (pool)
+			pool->ParallelFor(count, 16, load);
+		else
+			load(0, count);
+
+		bool ok = true;
+		std::vector<AtlasItem> items(count);
+		std::vector<std::string> names(count);
+		for (int i = 0; i < count; i++)
+		{
+			if (!loaded[i])
+			{
+				Log::Get()->Err("Could not load atlas image %s", files[i].c_str());
+				ok = false;
+			}
+			items[i].width = images[i].width;
+			items[i].height = images[i].height;
+			names[i] = s_imageName(files[i]);
+		}
+		if (!ok)
+			return false;
+
+		AtlasPacker packer(pageSize);
+		if (!packer.Pack(items))
+		{
+			for (int i = 0; i < count; i++)
+				if (items[i].page < 0)
+					Log::Get()->Err("Atlas image %s is larger than a %dx%d page", files[i].c_str(), pageSize, pageSize);
+			return false;
+		}
+
+		std::vector<char> written(packer.Pages(), 0);
+		auto compose = [&](int begin, int end) {
+			ImageRgba page;
+			std::vector<unsigned char> png;
+			for (int p = begin; p < end; p++)
+			{
+				packer.Compose(items, images, p, page);
+				// build output the texture cache keeps block compressed, not worth compressing
+				ImageEncode::Png(page, PNG_STORED, png);
+				const std::string path = TextureAtlas::PagePath(name, p);
+				FILE *file = fopen(path.c_str(), "wb");
+				written[p] = file && fwrite(&png[0], 1, png.size(), file) == png.size() ? 1 : 0;
+				if (file && fclose(file) != 0)
+					written[p] = 0;
+			}
+		};
+		if (pool)
+			pool->ParallelFor(packer.Pages(), 1, compose);
+		else
+			compose(0, packer.Pages());
+		for (int p = 0; p < packer.Pages(); p++)
+			if (!written[p])
+			{
+				Log::Get()->Err("Could not write atlas page %s", TextureAtlas::PagePath(name, p).c_str());
+				ok = false;
+			}
+
+		const std::string index = TextureAtlas::IndexPath(name);
+		if (ok && !packer.WriteIndex(index.c_str(), names, items))
+		{
+			Log::Get()->Err("Could not write atlas index %s", index.c_str());
+			ok = false;
+		}
+		return ok;
+	}
+
+	TextureAtlas::TextureAtlas() : m_header(nullptr), m_entries(nullptr), m_names(nullptr)
+	{
+	}
+
+	bool TextureAtlas::Open(const char *name)
+	{
+		Close();
+		if (!m_file.Open(IndexPath(name).c_str()))
+			return false;
+
+		const unsigned char *data = m_file.Data();
+		const size_t size = m_file.Size();
+		const AtlasHeader *header = reinterpret_cast<const AtlasHeader*>(data);
+		if (size < sizeof(AtlasHeader) || header->magic != ATLAS_MAGIC || header->version != ATLAS_VERSION ||
+			(size - sizeof(AtlasHeader)) / sizeof(AtlasEntry) < header->entries ||
+			size - sizeof(AtlasHeader) - header->entries * sizeof(AtlasEntry) != header->nameBytes ||
+			(header->nameBytes > 0 && data[size - 1] != 0))
+		{
+			m_file.Close();
+			return false;
+		}
+		const AtlasEntry *entries = reinterpret_cast<const AtlasEntry*>(data + sizeof(AtlasHeader));
+		for (unsigned i = 0; i < header->entries; i++)
+			if (entries[i].nameOffset >= header->nameBytes || entries[i].page >= header->pages)
+			{
+				m_file.Close();
+				return false;
+			}
+
+		m_name = name;
+		m_header = header;
+		m_entries = entries;
+		m_names = reinterpret_cast<const char*>(data + sizeof(AtlasHeader) + header->entries * sizeof(AtlasEntry));
+		return true;
+	}
+
+	void TextureAtlas::Close()
+	{
+		m_file.Close();
+		m_header = nullptr;
+		m_entries = nullptr;
+		m_names = nullptr;
+	}
+
+	bool TextureAtlas::Find(const char *name, AtlasRect &rect) const
+	{
+		if (!m_header)
+			return false;
+		const unsigned long long hash = HashBytes(name, strlen(name));
+		const AtlasEntry *end = m_entries + m_header->entries;
+		const AtlasEntry *entry = std::lower_bound(m_entries, end, hash, [](const AtlasEntry &e, unsigned long long h) { return e.nameHash < h; });
+		for (; entry != end && entry->nameHash == hash; entry++)
+			if (strcmp(m_names + entry->nameOffset, name) == 0)
+			{
+				rect.page = entry->page;
+				rect.u0 = entry->uvRect[0];
+				rect.v0 = entry->uvRect[1];
+				rect.u1 = entry->uvRect[2];
+				rect.v1 = entry->uvRect[3];
+				return true;
+			}
+		return false;
+	}
+
+	std::string TextureAtlas::IndexPath(const char *name)
+	{
+		return std::string(name) + ".atlas";
+	}
+
+	std::string TextureAtlas::PagePath(const char *name, unsigned page)
+	{
+		char suffix[32];
+		sprintf(suffix, ".%u.png", page);
+		return std::string(name) + suffix;
+	}
+
+//------------------------------------------------------------------
+}
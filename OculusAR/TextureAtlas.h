@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "ImageDecode.h"
+#include "MappedFile.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class ThreadPool;
+
+	// Where an image is in an atlas: its page, which is a slice of the
+	// overlay array, and its rectangle on it in texture coordinates
+	struct AtlasRect
+	{
+		unsigned page;
+		float u0;
+		float v0;
+		float u1;
+		float v1;
+	};
+
+	// Layout of an atlas index, read in place from the mapped file:
+	//   AtlasHeader
+	//   AtlasEntry of each image, ascending by name hash
+	//   the names, each ending with a 0
+	struct AtlasHeader
+	{
+		unsigned magic;
+		unsigned version;
+		unsigned pages;
+		unsigned entries;
+		unsigned pageSize;
+		unsigned nameBytes;
+	};
+
+	struct AtlasEntry
+	{
+		unsigned long long nameHash;
+		unsigned nameOffset;
+		unsigned page;
+		// u0, v0, u1, v1
+		float uvRect[4];
+		// Texels of the image on its page, without the padding
+		unsigned short x;
+		unsigned short y;
+		unsigned short width;
+		unsigned short height;
+	};
+
+	// One image to pack: its size in, its page and where it starts on it out
+	struct AtlasItem
+	{
+		int width;
+		int height;
+		int page;
+		int x;
+		int y;
+	};
+
+	// Packs many small images onto a few square pages, the build step of
+	// the overlay atlases. Overlays on the same page draw from the same
+	// slice of the overlay array with their own rectangle, so they go out
+	// in one instanced draw however many images there are.
+	//
+	// Every image gets a cell: the image with padding texels on each side,
+	// rounded up to a multiple of alignment, and the image's edge texels
+	// are extruded over the rest of the cell. Cells start on multiples of
+	// alignment, so no BC block and no texel of the first log2(alignment)
+	// box filtered mip levels mixes two images, and the filtering of the
+	// levels below only reaches into the padding at first.
+	//
+	// Cells go onto a skyline per page, tallest first, each at the place
+	// that leaves its top lowest.
+	class AtlasPacker
+	{
+	public:
+		// pageSize has to be a multiple of alignment
+		AtlasPacker(int pageSize, int padding = 2, int alignment = 4);
+
+		// Sets page, x and y of every item. False if one of them does not
+		// fit on a page at all, its page is -1 then.
+		bool Pack(std::vector<AtlasItem> &items);
+		int Pages() const { return m_pages; }
+		// Texels of the pages below their skylines, taken or wasted
+		size_t UsedTexels() const { return m_used; }
+
+		// One page of packed images, images in the order of items. Texels
+		// in no cell are transparent black.
+		void Compose(const std::vector<AtlasItem> &items, const std::vector<ImageRgba> &images, int page, ImageRgba &out) const;
+		bool WriteIndex(const char *path, const std::vector<std::string> &names, const std::vector<AtlasItem> &items) const;
+
+		// Decodes the files, packs them and writes the pages and the index
+		// of the atlas name, see TextureAtlas. An image is named by its file
+		// name without directory and extension.
+		static bool Build(const char *name, const std::vector<std::string> &files, int pageSize, ThreadPool *pool);
+
+	private:
+		// Side of the cell of an image side of size texels
+		int m_cell(int size) const;
+
+		int m_pageSize;
+		int m_padding;
+		int m_alignment;
+		int m_pages;
+		size_t m_used;
+	};
+
+	// An atlas as AtlasPacker::Build writes it: the index <name>.atlas and
+	// the pages <name>.0.png, <name>.1.png, ... The index stays mapped,
+	// lookups binary search its entries by name hash.
+	class TextureAtlas
+	{
+	public:
+		TextureAtlas();
+
+		bool Open(const char *name);
+		void Close();
+
+		unsigned Pages() const { return m_header ? m_header->pages : 0; }
+		unsigned Count() const { return m_header ? m_header->entries : 0; }
+		unsigned PageSize() const { return m_header ? m_header->pageSize : 0; }
+		std::string PagePath(unsigned page) const { return PagePath(m_name.c_str(), page); }
+
+		bool Find(const char *name, AtlasRect &rect) const;
+
+		static std::string IndexPath(const char *name);
+		static std::string PagePath(const char *name, unsigned page);
+
+	private:
+		MappedFile m_file;
+		std::string m_name;
+		const AtlasHeader *m_header;
+		const AtlasEntry *m_entries;
+		const char *m_names;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,153 @@
+#include "TextureCache.h"
+#include "Hash.h"
+#include "MappedFile.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#	include <direct.h>
+#else
+#	include <sys/stat.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static const unsigned TEXTURE_CACHE_MAGIC = 0x5452414F;	// "OART"
+	static const unsigned TEXTURE_CACHE_VERSION = 1;
+	// more would be a broken file
+	static const unsigned TEXTURE_CACHE_MAX_CHAINS = 16;
+	static const unsigned TEXTURE_CACHE_MAX_LEVELS = 32;
+
+	TextureCache::TextureCache(const char *directory) : m_directory(directory)
+	{
+#ifdef _WIN32
+		_mkdir(directory);
+#else
+		mkdir(directory, 0755);
+#endif
+	}
+
+	unsigned long long TextureCache::Key(const unsigned char *source, size_t size, eTextureFormat format, eCompressQuality quality, eMipFilter filter, int overlaySize)
+	{
+		const unsigned settings[] = { static_cast<unsigned>(format), static_cast<unsigned>(quality), static_cast<unsigned>(filter),
+			static_cast<unsigned>(overlaySize), BlockCompress::Version, TEXTURE_CACHE_VERSION };
+		return HashBytes(settings, sizeof(settings), HashBytes(source, size));
+	}
+
+	std::string TextureCache::Path(unsigned long long key) const
+	{
+		char name[32];
+		sprintf(name, "/%016llx.tex", key);
+		return m_directory + name;
+	}
+
+	bool TextureCache::Load(unsigned long long key, MappedFile &file, std::vector<TextureChain> &chains) const
+	{
+		if (!file.Open(Path(key).c_str()))
+			return false;
+
+		const unsigned char *data = file.Data();
+		const size_t size = file.Size();
+		const TextureCacheHeader *header = reinterpret_cast<const TextureCacheHeader*>(data);
+		if (size < sizeof(TextureCacheHeader) || header->magic != TEXTURE_CACHE_MAGIC || header->version != TEXTURE_CACHE_VERSION ||
+			header->key != key || header->chains > TEXTURE_CACHE_MAX_CHAINS ||
+			sizeof(TextureCacheHeader) + header->chains * sizeof(TextureCacheChain) > size)
+		{
+			file.Close();
+			return false;
+		}
+
+		const TextureCacheChain *chainTable = reinterpret_cast<const TextureCacheChain*>(data + sizeof(TextureCacheHeader));
+		size_t offset = sizeof(TextureCacheHeader) + header->chains * sizeof(TextureCacheChain);
+		chains.assign(header->chains, TextureChain());
+		for (unsigned c = 0; c < header->chains; c++)
+		{
+			const TextureCacheChain &entry = chainTable[c];
+			if (entry.format > FORMAT_BC7 || entry.levels > TEXTURE_CACHE_MAX_LEVELS || offset + entry.levels * sizeof(TextureCacheLevel) > size)
+			{
+				file.Close();
+				return false;
+			}
+			const eTextureFormat format = static_cast<eTextureFormat>(entry.format);
+			const TextureCacheLevel *levels = reinterpret_cast<const TextureCacheLevel*>(data + offset);
+			offset += entry.levels * sizeof(TextureCacheLevel);
+			chains[c].format = format;
+			chains[c].levels.resize(entry.levels);
+			for (unsigned l = 0; l < entry.levels; l++)
+			{
+				const TextureCacheLevel &level = levels[l];
+				if (level.width <= 0 || level.height <= 0 || level.width > ImageDecode::MaxSize || level.height > ImageDecode::MaxSize ||
+					level.pitch != BlockCompress::Pitch(format, level.width) || level.bytes != BlockCompress::LevelBytes(format, level.width, level.height) ||
+					level.offset > size || level.bytes > size - level.offset)
+				{
+					file.Close();
+					return false;
+				}
+				TextureLevel &out = chains[c].levels[l];
+				out.width = level.width;
+				out.height = level.height;
+				out.pitch = level.pitch;
+				out.data = data + level.offset;
+				out.bytes = static_cast<size_t>(level.bytes);
+			}
+		}
+		return true;
+	}
+
+	bool TextureCache::Store(unsigned long long key, const std::vector<TextureChain> &chains) const
+	{
+		const std::string path = Path(key);
+		const std::string temporary = path + ".tmp";
+		FILE *file = fopen(temporary.c_str(), "wb");
+		if (!file)
+			return false;
+
+		TextureCacheHeader header = { TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, key, static_cast<unsigned>(chains.size()), 0 };
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		size_t levelCount = 0;
+		for (size_t c = 0; c < chains.size(); c++)
+		{
+			const TextureCacheChain entry = { static_cast<unsigned>(chains[c].format), static_cast<unsigned>(chains[c].levels.size()) };
+			ok = ok && fwrite(&entry, sizeof(entry), 1, file) == 1;
+			levelCount += chains[c].levels.size();
+		}
+
+		unsigned long long position = sizeof(header) + chains.size() * sizeof(TextureCacheChain) + levelCount * sizeof(TextureCacheLevel);
+		unsigned long long offset = Align16(position);
+		for (size_t c = 0; c < chains.size(); c++)
+			for (size_t l = 0; l < chains[c].levels.size(); l++)
+			{
+				const TextureLevel &level = chains[c].levels[l];
+				const TextureCacheLevel entry = { offset, level.bytes, level.width, level.height, level.pitch, 0 };
+				ok = ok && fwrite(&entry, sizeof(entry), 1, file) == 1;
+				offset = Align16(offset + level.bytes);
+			}
+
+		static const unsigned char padding[16] = {};
+		for (size_t c = 0; c < chains.size(); c++)
+			for (size_t l = 0; l < chains[c].levels.size(); l++)
+			{
+				const TextureLevel &level = chains[c].levels[l];
+				const size_t pad = static_cast<size_t>(Align16(position) - position);
+				ok = ok && fwrite(padding, 1, pad, file) == pad && fwrite(level.data, 1, level.bytes, file) == level.bytes;
+				position += pad + level.bytes;
+			}
+		ok = fclose(file) == 0 && ok;
+
+		if (ok)
+		{
+			// rename does not replace an existing file everywhere
+			remove(path.c_str());
+			ok = rename(temporary.c_str(), path.c_str()) == 0;
+		}
+		if (!ok)
+		{
+			remove(temporary.c_str());
+			return false;
+		}
+		return true;
+	}
+
+//------------------------------------------------------------------
+}
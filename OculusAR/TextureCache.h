@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "BlockCompress.h"
+#include "MipChain.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class MappedFile;
+
+	// One mip level as the device takes it: rows of texels, or of 4x4 blocks
+	struct TextureLevel
+	{
+		int width;
+		int height;
+		int pitch;
+		const unsigned char *data;
+		size_t bytes;
+	};
+
+	// The levels of a texture, largest first
+	struct TextureChain
+	{
+		TextureChain() : format(FORMAT_RGBA8) {}
+
+		eTextureFormat format;
+		std::vector<TextureLevel> levels;
+	};
+
+	// Layout of a cache entry:
+	//   TextureCacheHeader
+	//   TextureCacheChain of each chain
+	//   TextureCacheLevel of each level, chain after chain
+	//   the levels' data, each starting at a multiple of 16 bytes
+	struct TextureCacheHeader
+	{
+		unsigned magic;
+		unsigned version;
+		unsigned long long key;
+		unsigned chains;
+		unsigned reserved;
+	};
+
+	struct TextureCacheChain
+	{
+		unsigned format;
+		unsigned levels;
+	};
+
+	struct TextureCacheLevel
+	{
+		unsigned long long offset;
+		unsigned long long bytes;
+		int width;
+		int height;
+		int pitch;
+		unsigned reserved;
+	};
+
+	// Encoded textures on disk, one file per key. The key hashes the
+	// source file's bytes and everything else the encoded levels depend
+	// on, so an edited image, other settings or a new encoder miss and are
+	// encoded again. A hit maps the file and the levels point into it: the
+	// device gets them without decoding, filtering, encoding or copying.
+	//
+	// Entries are written under a temporary name and renamed, so a crash
+	// never leaves half an entry under the real name. Entries that do not
+	// check out are misses and get overwritten.
+	class TextureCache
+	{
+	public:
+		// Creates the directory if it is not there
+		explicit TextureCache(const char *directory);
+
+		static unsigned long long Key(const unsigned char *source, size_t size, eTextureFormat format, eCompressQuality quality, eMipFilter filter, int overlaySize);
+		std::string Path(unsigned long long key) const;
+
+		// On a hit maps the entry into file and fills chains with levels
+		// pointing into it, valid while file stays open
+		bool Load(unsigned long long key, MappedFile &file, std::vector<TextureChain> &chains) const;
+		bool Store(unsigned long long key, const std::vector<TextureChain> &chains) const;
+
+	private:
+		std::string m_directory;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,340 @@
+#include "TextureStreamer.h"
+#include "Clock.h"
+#include "ImageDecode.h"
+#include "Log.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Rows of blocks one encode task takes, 64 texel rows
+	static const int ENCODE_ROWS = 16;
+
+	TextureStreamer::TextureStreamer(ThreadPool *pool, eMipFilter filter) :
+		m_pool(pool), m_filter(filter), m_format(FORMAT_RGBA8), m_quality(COMPRESS_NORMAL), m_cache(nullptr), m_inFlight(0)
+	{
+	}
+
+	TextureStreamer::~TextureStreamer()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (m_inFlight > 0)
+				m_done.wait(lock);
+		}
+		for (size_t i = 0; i < m_requests.size(); i++)
+			delete m_requests[i];
+		delete m_cache;
+	}
+
+	void TextureStreamer::SetCompression(eTextureFormat format, eCompressQuality quality, const char *cacheDirectory)
+	{
+		m_format = format;
+		m_quality = quality;
+		delete m_cache;
+		m_cache = cacheDirectory ? new TextureCache(cacheDirectory) : nullptr;
+	}
+
+	int TextureStreamer::Request(const char *path, eSceneTexture texture, int overlaySize)
+	{
+		Texture *request = new Texture();
+		request->path = path;
+		request->texture = texture;
+		request->overlaySize = texture < static_cast<int>(RenderDevice::OverlaySlices) ? overlaySize : 0;
+		request->state = TEXTURE_PENDING;
+		request->requested = Clock::Now();
+		request->decoded = 0.0;
+		request->ready = 0.0;
+		request->cached = false;
+		request->key = 0;
+		request->encoding = 0;
+		request->chain = 0;
+		request->level = -1;
+		request->row = 0;
+
+		int id;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			id = static_cast<int>(m_requests.size());
+			m_requests.push_back(request);
+			m_inFlight++;
+		}
+		if (m_pool)
+			m_pool->Submit([this, request]() { m_decode(request); });
+		else
+			m_decode(request);
+		return id;
+	}
+
+	void TextureStreamer::m_decode(Texture *request)
+	{
+		MappedFile source;
+		std::vector<ImageRgba> levels(1);
+		std::vector<ImageRgba> overlay;
+		bool loaded = source.Open(request->path.c_str());
+		if (loaded && m_cache)
+		{
+			request->key = TextureCache::Key(source.Data(), source.Size(), m_format, m_quality, m_filter, request->overlaySize);
+			if (m_cache->Load(request->key, request->entry, request->chains) && request->chains.size() == 2 && !request->chains[0].levels.empty())
+			{
+				request->cached = true;
+				m_finish(request);
+				return;
+			}
+			request->entry.Close();
+			request->chains.clear();
+		}
+
+		loaded = loaded && ImageDecode::Decode(source.Data(), source.Size(), levels[0]);
+		source.Close();
+		if (loaded)
+		{
+			MipChain::Build(levels, m_filter);
+			if (request->overlaySize > 0)
+			{
+				// straight from the full image, not from a level of the chain
+				overlay.resize(1);
+				overlay[0].Allocate(request->overlaySize, request->overlaySize);
+				MipChain::Resample(levels[0], overlay[0]);
+				MipChain::Build(overlay, m_filter);
+			}
+		}
+		else
+			levels.clear();
+		request->images[0].swap(levels);
+		request->images[1].swap(overlay);
+
+		// the levels, and the room for their blocks
+		request->chains.resize(2);
+		size_t blockBytes = 0;
+		for (int c = 0; c < 2; c++)
+		{
+			const std::vector<ImageRgba> &images = request->images[c];
+			TextureChain &chain = request->chains[c];
+			chain.format = images.empty() || images[0].width % 4 != 0 || images[0].height % 4 != 0 ? FORMAT_RGBA8 : m_format;
+			chain.levels.resize(images.size());
+			for (size_t l = 0; l < images.size(); l++)
+			{
+				TextureLevel &level = chain.levels[l];
+				level.width = images[l].width;
+				level.height = images[l].height;
+				level.pitch = BlockCompress::Pitch(chain.format, level.width);
+				level.bytes = BlockCompress::LevelBytes(chain.format, level.width, level.height);
+				level.data = chain.format == FORMAT_RGBA8 ? &images[l].pixels[0] : nullptr;
+				if (chain.format != FORMAT_RGBA8)
+					blockBytes += level.bytes;
+			}
+		}
+		if (blockBytes == 0)
+		{
+			m_finish(request);
+			return;
+		}
+
+		// a task per few rows of blocks, the last one to finish goes on
+		struct EncodeTask
+		{
+			const ImageRgba *image;
+			int begin;
+			int end;
+			unsigned char *blocks;
+		};
+		std::vector<EncodeTask> tasks;
+		request->blocks.resize(blockBytes);
+		size_t offset = 0;
+		for (int c = 0; c < 2; c++)
+		{
+			TextureChain &chain = request->chains[c];
+			if (chain.format == FORMAT_RGBA8)
+				continue;
+			for (size_t l = 0; l < chain.levels.size(); l++)
+			{
+				TextureLevel &level = chain.levels[l];
+				unsigned char *blocks = &request->blocks[offset];
+				level.data = blocks;
+				offset += level.bytes;
+				const int rows = BlockCompress::Rows(chain.format, level.height);
+				for (int begin = 0; begin < rows; begin += ENCODE_ROWS)
+				{
+					const EncodeTask task = { &request->images[c][l], begin, std::min(begin + ENCODE_ROWS, rows), blocks };
+					tasks.push_back(task);
+				}
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			request->encoding = static_cast<int>(tasks.size());
+		}
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			const EncodeTask task = tasks[i];
+			if (m_pool)
+				m_pool->Submit([this, request, task]() { m_encode(request, task.image, task.begin, task.end, task.blocks); });
+			else
+				m_encode(request, task.image, task.begin, task.end, task.blocks);
+		}
+	}
+
+	void TextureStreamer::m_encode(Texture *request, const ImageRgba *image, int begin, int end, unsigned char *blocks)
+	{
+		BlockCompress::EncodeRows(*image, m_format, m_quality, begin, end, blocks);
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			last = --request->encoding == 0;
+		}
+		if (last)
+			m_finish(request);
+	}
+
+	void TextureStreamer::m_finish(Texture *request)
+	{
+		if (!request->cached)
+		{
+			for (int c = 0; c < 2; c++)
+				if (request->chains[c].format != FORMAT_RGBA8)
+					std::vector<ImageRgba>().swap(request->images[c]);
+			if (m_cache && !request->chains[0].levels.empty() && !m_cache->Store(request->key, request->chains))
+				Log::Get()->Err("Could not write the texture cache entry for %s", request->path.c_str());
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		request->decoded = Clock::Now() - request->requested;
+		m_decoded.push_back(request);
+		m_inFlight--;
+		m_done.notify_all();
+	}
+
+	size_t TextureStreamer::Update(RenderDevice &device, size_t budgetBytes)
+	{
+		std::vector<Texture*> decoded;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			decoded.swap(m_decoded);
+		}
+		for (size_t i = 0; i < decoded.size(); i++)
+		{
+			Texture *request = decoded[i];
+			if (request->chains[0].levels.empty())
+			{
+				request->state = TEXTURE_FAILED;
+				Log::Get()->Err("Could not load texture %s", request->path.c_str());
+				continue;
+			}
+			request->state = TEXTURE_UPLOADING;
+			m_uploads.push_back(request);
+		}
+
+		size_t bytes = 0;
+		while (!m_uploads.empty() && m_upload(device, bytes, budgetBytes))
+		{
+		}
+		return bytes;
+	}
+
+	bool TextureStreamer::m_upload(RenderDevice &device, size_t &bytes, size_t budgetBytes)
+	{
+		Texture *request = m_uploads.front();
+		TextureChain &chain = request->chains[request->chain];
+		const bool overlay = request->chain == 1;
+		if (!chain.levels.empty())
+		{
+			if (request->level < 0)
+			{
+				const int count = static_cast<int>(chain.levels.size());
+				if (!device.BeginTexture(request->texture, overlay, chain.format, chain.levels[0].width, chain.levels[0].height, count))
+				{
+					request->state = TEXTURE_FAILED;
+					Log::Get()->Err("Could not create texture for %s", request->path.c_str());
+					for (int c = 0; c < 2; c++)
+						std::vector<ImageRgba>().swap(request->images[c]);
+					std::vector<TextureChain>().swap(request->chains);
+					std::vector<unsigned char>().swap(request->blocks);
+					request->entry.Close();
+					m_uploads.pop_front();
+					return true;
+				}
+				request->level = count - 1;
+				request->row = 0;
+			}
+
+			// the rest of the level if it fits, otherwise the rows that do, at least one a frame
+			const TextureLevel &level = chain.levels[request->level];
+			const int rows = BlockCompress::Rows(chain.format, level.height);
+			const size_t room = budgetBytes > bytes ? (budgetBytes - bytes) / level.pitch : 0;
+			int count = rows - request->row;
+			if (room < static_cast<size_t>(count))
+				count = static_cast<int>(room);
+			if (count == 0)
+			{
+				if (bytes > 0)
+					return false;
+				count = 1;
+			}
+			const int texelRows = BlockCompress::BlockBytes(chain.format) > 0 ? 4 : 1;
+			const int y = request->row * texelRows;
+			const int height = std::min(count * texelRows, level.height - y);
+			const size_t size = static_cast<size_t>(count) * level.pitch;
+			device.UploadTextureRows(request->texture, overlay, request->level, y, height, level.data + static_cast<size_t>(request->row) * level.pitch, level.pitch, size);
+			bytes += size;
+			request->row += count;
+			if (request->row < rows)
+				return false;
+			request->row = 0;
+			if (--request->level >= 0)
+				return true;
+
+			device.EndTexture(request->texture, overlay);
+			std::vector<TextureLevel>().swap(chain.levels);
+			std::vector<ImageRgba>().swap(request->images[request->chain]);
+		}
+
+		// next chain, or done
+		request->level = -1;
+		if (++request->chain < 2)
+			return true;
+		std::vector<unsigned char>().swap(request->blocks);
+		request->entry.Close();
+		request->state = TEXTURE_READY;
+		request->ready = Clock::Now() - request->requested;
+		m_uploads.pop_front();
+		return true;
+	}
+
+	eTextureState TextureStreamer::State(int id) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return id >= 0 && id < static_cast<int>(m_requests.size()) ? m_requests[id]->state : TEXTURE_FAILED;
+	}
+
+	bool TextureStreamer::Idle() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < m_requests.size(); i++)
+			if (m_requests[i]->state == TEXTURE_PENDING || m_requests[i]->state == TEXTURE_UPLOADING)
+				return false;
+		return true;
+	}
+
+	double TextureStreamer::DecodeTime(int id) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return id >= 0 && id < static_cast<int>(m_requests.size()) ? m_requests[id]->decoded : 0.0;
+	}
+
+	double TextureStreamer::ReadyTime(int id) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return id >= 0 && id < static_cast<int>(m_requests.size()) ? m_requests[id]->ready : 0.0;
+	}
+
+	bool TextureStreamer::Cached(int id) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return id >= 0 && id < static_cast<int>(m_requests.size()) && m_requests[id]->cached;
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "RenderDevice.h"
+#include "TextureCache.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class ThreadPool;
+
+	enum eTextureState
+	{
+		TEXTURE_PENDING = 0,	// decoding and filtering on the pool
+		TEXTURE_UPLOADING,		// levels going to the device, a few each frame
+		TEXTURE_READY,			// drawn with the new image
+		TEXTURE_FAILED			// the file could not be read; the placeholder stays
+	};
+
+	// Loads scene textures in the background. The pool decodes each file
+	// and builds its mip chain, plus a chain scaled to the overlay array's
+	// slices if the device has one; Update then hands the levels to the
+	// device within a byte budget per frame, smallest level first. A level
+	// larger than what is left of the budget goes up a few rows at a time
+	// over several frames. Until a
+	// texture's last level is up the device keeps drawing the placeholder
+	// it was set up with, so startup does not wait for any file.
+	//
+	// With compression the levels are block encoded on the pool too, a few
+	// rows of blocks per task so one large image spreads over all workers.
+	// With a cache the encoded levels are stored under the hash of the
+	// file, and the next time the file only has to be hashed.
+	//
+	// Request, Update and State are for one thread, the render thread.
+	class TextureStreamer
+	{
+	public:
+		// pool may be null to decode on the calling thread inside Request
+		explicit TextureStreamer(ThreadPool *pool, eMipFilter filter = MIP_KAISER);
+		// Waits for the decodes still running
+		~TextureStreamer();
+
+		// Before the first Request: encodes the levels into format, and with
+		// a cache directory (may be null) keeps them there. Images whose
+		// size is not a multiple of 4 stay RGBA8, the BC formats need whole
+		// blocks at the top level.
+		void SetCompression(eTextureFormat format, eCompressQuality quality, const char *cacheDirectory);
+
+		// Starts loading an image file into texture. overlaySize is the
+		// device's OverlaySize(): above 0 the image also goes to its overlay
+		// array slice. Returns the id State takes.
+		int Request(const char *path, eSceneTexture texture, int overlaySize);
+
+		// Uploads decoded levels to the device, at most budgetBytes of them
+		// but at least one row of texels (of blocks for the BC formats) if
+		// any is waiting. Returns the bytes uploaded.
+		size_t Update(RenderDevice &device, size_t budgetBytes);
+
+		eTextureState State(int id) const;
+		// Nothing pending or uploading
+		bool Idle() const;
+		// Seconds from Request to decoded and to ready, 0 until then
+		double DecodeTime(int id) const;
+		double ReadyTime(int id) const;
+		// The levels came out of the cache
+		bool Cached(int id) const;
+
+	private:
+		TextureStreamer(const TextureStreamer&);
+		TextureStreamer &operator=(const TextureStreamer&);
+
+		struct Texture
+		{
+			std::string path;
+			eSceneTexture texture;
+			int overlaySize;
+			eTextureState state;
+			double requested;
+			double decoded;
+			double ready;
+			bool cached;
+			unsigned long long key;
+			// the texture's and its overlay slice's levels, freed once
+			// uploaded; they point into images, blocks or the cache entry
+			std::vector<TextureChain> chains;
+			std::vector<ImageRgba> images[2];
+			std::vector<unsigned char> blocks;
+			MappedFile entry;
+			// encode tasks still running
+			int encoding;
+			// chain being uploaded, its next level counting down, -1 before
+			// BeginTexture, and the next row of that level as BlockCompress::Rows counts them
+			int chain;
+			int level;
+			int row;
+		};
+
+		void m_decode(Texture *request);
+		void m_encode(Texture *request, const ImageRgba *image, int begin, int end, unsigned char *blocks);
+		// After decoding and encoding: stores the entry and hands the
+		// texture on to Update
+		void m_finish(Texture *request);
+		// Next rows of the front upload that fit the budget, or the step to
+		// its next chain. False once the budget is used up.
+		bool m_upload(RenderDevice &device, size_t &bytes, size_t budgetBytes);
+
+		ThreadPool *m_pool;
+		eMipFilter m_filter;
+		eTextureFormat m_format;
+		eCompressQuality m_quality;
+		TextureCache *m_cache;
+		std::vector<Texture*> m_requests;
+		// decoded by the pool, not yet seen by Update
+		std::vector<Texture*> m_decoded;
+		std::deque<Texture*> m_uploads;
+		int m_inFlight;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_done;
+	};
+
+//------------------------------------------------------------------
+}
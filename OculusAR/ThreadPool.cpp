@@ -0,0 +1,119 @@
+#include "ThreadPool.h"
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	ThreadPool::ThreadPool(int threads) : m_stop(false)
+	{
+		if (threads <= 0)
+		{
+			threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+			if (threads < 1)
+				threads = 1;
+		}
+
+		for (int i = 0; i < threads; i++)
+			m_workers.push_back(std::thread(&ThreadPool::m_run, this));
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		for (size_t i = 0; i < m_workers.size(); i++)
+			m_workers[i].join();
+	}
+
+	void ThreadPool::Submit(const std::function<void()> &task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push_back(task);
+		}
+		m_wake.notify_one();
+	}
+
+	// State of one ParallelFor, shared with its helpers. A helper may only
+	// get to run after the call returned, it then finds no range left.
+	struct ThreadPool::ForJob
+	{
+		std::function<void(int, int)> fn;
+		int count;
+		int grain;
+		int chunks;
+		std::atomic<int> next;
+		std::atomic<int> done;
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		void Work()
+		{
+			for (;;)
+			{
+				int chunk = next.fetch_add(1);
+				if (chunk >= chunks)
+					break;
+				int begin = chunk * grain;
+				int end = begin + grain < count ? begin + grain : count;
+				fn(begin, end);
+				if (done.fetch_add(1) + 1 == chunks)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					finished.notify_all();
+				}
+			}
+		}
+	};
+
+	void ThreadPool::ParallelFor(int count, int grain, const std::function<void(int, int)> &fn)
+	{
+		if (count <= 0)
+			return;
+		if (grain < 1)
+			grain = 1;
+
+		std::shared_ptr<ForJob> job = std::make_shared<ForJob>();
+		job->fn = fn;
+		job->count = count;
+		job->grain = grain;
+		job->chunks = (count + grain - 1) / grain;
+		job->next = 0;
+		job->done = 0;
+
+		// Helpers queued behind other tasks are not waited for: the caller
+		// takes the ranges they have not started, and only ranges someone
+		// is working on hold it up
+		const int helperCount = job->chunks - 1 < Size() ? job->chunks - 1 : Size();
+		for (int i = 0; i < helperCount; i++)
+			Submit([job]() { job->Work(); });
+
+		job->Work();
+		std::unique_lock<std::mutex> lock(job->mutex);
+		while (job->done.load() < job->chunks)
+			job->finished.wait(lock);
+	}
+
+	void ThreadPool::m_run()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while (!m_stop && m_tasks.empty())
+					m_wake.wait(lock);
+				if (m_stop && m_tasks.empty())
+					return;
+				task = m_tasks.front();
+				m_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Fixed set of worker threads taking tasks from a shared queue
+	class ThreadPool
+	{
+	public:
+		// threads <= 0 uses one worker per hardware thread, minus the caller's
+		explicit ThreadPool(int threads = 0);
+		~ThreadPool();
+
+		int Size() const { return static_cast<int>(m_workers.size()); }
+
+		// Queues a task for any worker
+		void Submit(const std::function<void()> &task);
+
+		// Calls fn(begin, end) for consecutive ranges of at most grain items
+		// covering [0, count). The calling thread helps and the call returns
+		// once every range is done. It does not wait for workers busy with
+		// other tasks, it does their ranges itself, so it can be called from
+		// a pool task too.
+		void ParallelFor(int count, int grain, const std::function<void(int, int)> &fn);
+
+	private:
+		ThreadPool(const ThreadPool&);
+		ThreadPool &operator=(const ThreadPool&);
+
+		struct ForJob;
+
+		void m_run();
+
+		std::vector<std::thread> m_workers;
+		std::deque<std::function<void()>> m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		bool m_stop;
+	};
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,285 @@
+#include "TransformBatch.h"
+#include "Simd.h"
+#include <cstring>
+
+#if SIMD_X86
+#	include <emmintrin.h>
+#	include <immintrin.h>
+#endif
+#if SIMD_ARM_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	static const int PAD = 8;
+
+	// r = a * b, row-major, summed left to right like OVR::Matrix4f
+	static void s_multiply(const float *a, const float *b, float *r)
+	{
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				r[i * 4 + j] = a[i * 4 + 0] * b[0 * 4 + j] + a[i * 4 + 1] * b[1 * 4 + j] + a[i * 4 + 2] * b[2 * 4 + j] + a[i * 4 + 3] * b[3 * 4 + j];
+	}
+
+	// Objects [begin, end): out gets transpose(a * model) per object, a is
+	// projection * view, or projection alone for head-locked objects
+	typedef void (*TransformFn)(const float *const model[16], const int *headLocked, const float *view, const float *head,
+		int begin, int end, float *out);
+
+	static void s_transformScalar(const float *const model[16], const int *headLocked, const float *view, const float *head,
+		int begin, int end, float *out)
+	{
+		for (int o = begin; o < end; o++)
+		{
+			const float *a = headLocked[o] ? head : view;
+			float *dst = out + o * 16;
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					dst[j * 4 + i] = a[i * 4 + 0] * model[0 * 4 + j][o] + a[i * 4 + 1] * model[1 * 4 + j][o] +
+						a[i * 4 + 2] * model[2 * 4 + j][o] + a[i * 4 + 3] * model[3 * 4 + j][o];
+		}
+	}
+
+#if SIMD_X86
+	// 4 objects per step: every result element is 4 broadcast multiply-adds
+	// over the model SoA, then one 4x4 transpose per column turns the
+	// per-element vectors into per-object transposed matrices
+	static void s_transformSSE2(const float *const model[16], const int *headLocked, const float *view, const float *head,
+		int begin, int end, float *out)
+	{
+		int o = begin;
+		for (; o + 4 <= end; o += 4)
+		{
+			const __m128 lock = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(headLocked + o)));
+			__m128 m[16];
+			for (int e = 0; e < 16; e++)
+				m[e] = _mm_loadu_ps(model[e] + o);
+
+			__m128 c[4][4];
+			for (int i = 0; i < 4; i++)
+			{
+				__m128 a[4];
+				for (int k = 0; k < 4; k++)
+					a[k] = _mm_or_ps(_mm_and_ps(lock, _mm_set1_ps(head[i * 4 + k])), _mm_andnot_ps(lock, _mm_set1_ps(view[i * 4 + k])));
+				for (int j = 0; j < 4; j++)
+					c[i][j] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], m[0 * 4 + j]), _mm_mul_ps(a[1], m[1 * 4 + j])),
+						_mm_mul_ps(a[2], m[2 * 4 + j])), _mm_mul_ps(a[3], m[3 * 4 + j]));
+			}
+
+			// column j of the four results becomes row j of their transposes
+			for (int j = 0; j < 4; j++)
+			{
+				__m128 r0 = c[0][j], r1 = c[1][j], r2 = c[2][j], r3 = c[3][j];
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(out + (o + 0) * 16 + j * 4, r0);
+				_mm_storeu_ps(out + (o + 1) * 16 + j * 4, r1);
+				_mm_storeu_ps(out + (o + 2) * 16 + j * 4, r2);
+				_mm_storeu_ps(out + (o + 3) * 16 + j * 4, r3);
+			}
+		}
+		s_transformScalar(model, headLocked, view, head, o, end, out);
+	}
+
+	// 8 objects per step, transposed in two 4x4 halves
+	SIMD_TARGET_AVX2 static void s_transformAVX2(const float *const model[16], const int *headLocked, const float *view, const float *head,
+		int begin, int end, float *out)
+	{
+		int o = begin;
+		for (; o + 8 <= end; o += 8)
+		{
+			const __m256 lock = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(headLocked + o)));
+			__m256 m[16];
+			for (int e = 0; e < 16; e++)
+				m[e] = _mm256_loadu_ps(model[e] + o);
+
+			__m256 c[4][4];
+			for (int i = 0; i < 4; i++)
+			{
+				__m256 a[4];
+				for (int k = 0; k < 4; k++)
+					a[k] = _mm256_blendv_ps(_mm256_set1_ps(view[i * 4 + k]), _mm256_set1_ps(head[i * 4 + k]), lock);
+				for (int j = 0; j < 4; j++)
+					c[i][j] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[0], m[0 * 4 + j]), _mm256_mul_ps(a[1], m[1 * 4 + j])),
+						_mm256_mul_ps(a[2], m[2 * 4 + j])), _mm256_mul_ps(a[3], m[3 * 4 + j]));
+			}
+
+			for (int j = 0; j < 4; j++)
+			{
+				for (int half = 0; half < 2; half++)
+				{
+					__m128 r0 = half ? _mm256_extractf128_ps(c[0][j], 1) : _mm256_castps256_ps128(c[0][j]);
+					__m128 r1 = half ? _mm256_extractf128_ps(c[1][j], 1) : _mm256_castps256_ps128(c[1][j]);
+					__m128 r2 = half ? _mm256_extractf128_ps(c[2][j], 1) : _mm256_castps256_ps128(c[2][j]);
+					__m128 r3 = half ? _mm256_extractf128_ps(c[3][j], 1) : _mm256_castps256_ps128(c[3][j]);
+					_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+					float *dst = out + (o + half * 4) * 16 + j * 4;
+					_mm_storeu_ps(dst, r0);
+					_mm_storeu_ps(dst + 16, r1);
+					_mm_storeu_ps(dst + 32, r2);
+					_mm_storeu_ps(dst + 48, r3);
+				}
+			}
+		}
+		s_transformSSE2(model, headLocked, view, head, o, end, out);
+	}
+#endif
+
+#if SIMD_ARM_NEON
+	static void s_transformNEON(const float *const model[16], const int *headLocked, const float *view, const float *head,
+		int begin, int end, float *out)
+	{
+		int o = begin;
+		for (; o + 4 <= end; o += 4)
+		{
+			const uint32x4_t lock = vreinterpretq_u32_s32(vld1q_s32(headLocked + o));
+			float32x4_t m[16];
+			for (int e = 0; e < 16; e++)
+				m[e] = vld1q_f32(model[e] + o);
+
+			float32x4_t c[4][4];
+			for (int i = 0; i < 4; i++)
+			{
+				float32x4_t a[4];
+				for (int k = 0; k < 4; k++)
+					a[k] = vbslq_f32(lock, vdupq_n_f32(head[i * 4 + k]), vdupq_n_f32(view[i * 4 + k]));
+				// separate multiplies and adds, a fused vmla would round differently
+				for (int j = 0; j < 4; j++)
+					c[i][j] = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(a[0], m[0 * 4 + j]), vmulq_f32(a[1], m[1 * 4 + j])),
+						vmulq_f32(a[2], m[2 * 4 + j])), vmulq_f32(a[3], m[3 * 4 + j]));
+			}
+
+			for (int j = 0; j < 4; j++)
+			{
+				float32x4x4_t rows;
+				rows.val[0] = c[0][j];
+				rows.val[1] = c[1][j];
+				rows.val[2] = c[2][j];
+				rows.val[3] = c[3][j];
+				// interleaving store: object l gets c[0..3][j] lane l
+				float tmp[16];
+				vst4q_f32(tmp, rows);
+				for (int l = 0; l < 4; l++)
+					memcpy(out + (o + l) * 16 + j * 4, tmp + l * 4, 4 * sizeof(float));
+			}
+		}
+		s_transformScalar(model, headLocked, view, head, o, end, out);
+	}
+#endif
+
+	static TransformFn s_pickTransform(eSimdLevel level)
+	{
+#if SIMD_X86
+		if (level == SIMD_AVX2)
+			return s_transformAVX2;
+		if (level == SIMD_SSE2)
+			return s_transformSSE2;
+#elif SIMD_ARM_NEON
+		if (level == SIMD_NEON)
+			return s_transformNEON;
+#endif
+		(void)level;
+		return s_transformScalar;
+	}
+
+//------------------------------------------------------------------
+
+	TransformBatch::TransformBatch() : m_count(0), m_projectionBuilds(0)
+	{
+		for (int eye = 0; eye < 2; eye++)
+		{
+			memset(m_projection[eye], 0, sizeof(m_projection[eye]));
+			memset(m_view[eye], 0, sizeof(m_view[eye]));
+			for (int i = 0; i < 4; i++)
+				m_projection[eye][i * 5] = m_view[eye][i * 5] = 1.0f;
+			memset(&m_fov[eye], 0, sizeof(m_fov[eye]));
+			m_znear[eye] = m_zfar[eye] = 0.0f;
+			m_projectionValid[eye] = false;
+		}
+	}
+
+	void TransformBatch::Clear()
+	{
+		m_count = 0;
+		for (int e = 0; e < 16; e++)
+			m_model[e].clear();
+		m_headLocked.clear();
+	}
+
+	int TransformBatch::Add(const float model[16], bool headLocked)
+	{
+		const int index = m_count++;
+		const size_t padded = (m_count + PAD - 1) / PAD * PAD;
+		for (int e = 0; e < 16; e++)
+			m_model[e].resize(padded, 0.0f);
+		m_headLocked.resize(padded, 0);
+		m_headLocked[index] = headLocked ? -1 : 0;
+		SetModel(index, model);
+		return index;
+	}
+
+	void TransformBatch::SetModel(int index, const float model[16])
+	{
+		for (int e = 0; e < 16; e++)
+			m_model[e][index] = model[e];
+	}
+
+	void TransformBatch::SetProjection(int eye, const ovrFovPort &fov, float znear, float zfar)
+	{
+		if (m_projectionValid[eye] && memcmp(&m_fov[eye], &fov, sizeof(fov)) == 0 && m_znear[eye] == znear && m_zfar[eye] == zfar)
+			return;
+		const ovrMatrix4f projection = ovrMatrix4f_Projection(fov, znear, zfar, true);
+		memcpy(m_projection[eye], projection.M, sizeof(m_projection[eye]));
+		m_fov[eye] = fov;
+		m_znear[eye] = znear;
+		m_zfar[eye] = zfar;
+		m_projectionValid[eye] = true;
+		m_projectionBuilds++;
+	}
+
+	void TransformBatch::SetView(int eye, const float view[16])
+	{
+		memcpy(m_view[eye], view, sizeof(m_view[eye]));
+	}
+
+	void TransformBatch::Run(float *out) const
+	{
+		if (m_count == 0)
+			return;
+		const TransformFn transform = s_pickTransform(Simd::Level());
+		const float *model[16];
+		for (int e = 0; e < 16; e++)
+			model[e] = &m_model[e][0];
+
+		for (int eye = 0; eye < 2; eye++)
+		{
+			float viewProjection[16];
+			s_multiply(m_projection[eye], m_view[eye], viewProjection);
+			transform(model, &m_headLocked[0], viewProjection, m_projection[eye], 0, m_count, out + eye * m_count * 16);
+		}
+	}
+
+	void TransformBatch::RunReference(float *out) const
+	{
+		for (int eye = 0; eye < 2; eye++)
+		{
+			float viewProjection[16];
+			s_multiply(m_projection[eye], m_view[eye], viewProjection);
+			for (int o = 0; o < m_count; o++)
+			{
+				float model[16], result[16];
+				for (int e = 0; e < 16; e++)
+					model[e] = m_model[e][o];
+				s_multiply(m_headLocked[o] ? m_projection[eye] : viewProjection, model, result);
+				float *dst = out + (eye * m_count + o) * 16;
+				for (int i = 0; i < 4; i++)
+					for (int j = 0; j < 4; j++)
+						dst[j * 4 + i] = result[i * 4 + j];
+			}
+		}
+	}
+
+//------------------------------------------------------------------
+}
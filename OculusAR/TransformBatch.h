@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <OVR_CAPI.h>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Model matrices of many objects in structure-of-arrays layout, taken
+	// through projection x view (or projection only for head-locked
+	// objects) of both eyes in one vectorized pass. The results come out
+	// transposed the way the vertex shader reads them, 16 floats each,
+	// so they can go straight into constant upload memory.
+	//
+	// Matrices are row-major like OVR::Matrix4f::M. Every path multiplies
+	// in the order OVR::Matrix4f does, (projection * view) * model, so the
+	// SIMD results are bit-identical to the scalar ones.
+	class TransformBatch
+	{
+	public:
+		TransformBatch();
+
+		void Clear();
+		// Returns the index of the object; results are written in this order
+		int Add(const float model[16], bool headLocked);
+		void SetModel(int index, const float model[16]);
+		int Count() const { return m_count; }
+
+		// Right-handed projection of an eye, rebuilt only when its
+		// parameters change
+		void SetProjection(int eye, const ovrFovPort &fov, float znear, float zfar);
+		void SetView(int eye, const float view[16]);
+
+		// Writes 2 * Count() transposed matrices, all of eye 0 first
+		void Run(float *out) const;
+		// Same with one plain 4x4 product per object
+		void RunReference(float *out) const;
+
+		const float *Projection(int eye) const { return m_projection[eye]; }
+		// Times a projection was actually built
+		unsigned ProjectionBuilds() const { return m_projectionBuilds; }
+
+	private:
+		int m_count;
+		// m_model[e][i] is element e (row * 4 + column) of object i, padded
+		// with zeros to a multiple of 8 objects
+		std::vector<float> m_model[16];
+		// All bits set for head-locked objects
+		std::vector<int> m_headLocked;
+
+		float m_projection[2][16];
+		float m_view[2][16];
+		ovrFovPort m_fov[2];
+		float m_znear[2];
+		float m_zfar[2];
+		bool m_projectionValid[2];
+		unsigned m_projectionBuilds;
+	};
+
+//------------------------------------------------------------------
+}
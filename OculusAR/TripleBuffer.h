@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// Lock-free single producer / single consumer triple buffer.
+	// The writer always has a private slot to fill, the reader always has a
+	// private slot to read, and the third slot holds the newest complete
+	// value. Neither side ever waits for the other; values the reader never
+	// picked up are simply overwritten.
+	template<typename T>
+	class TripleBuffer
+	{
+	public:
+		TripleBuffer() : m_back(2), m_middle(1), m_front(0), m_overwritten(0) {}
+
+		// --- writer side ---
+
+		// Slot owned by the writer until Publish()
+		T &WriteSlot() { return m_slots[m_back]; }
+
+		// Makes the write slot the newest value and takes over the old one.
+		void Publish()
+		{
+			unsigned prev = m_middle.exchange(m_back | DIRTY, std::memory_order_acq_rel);
+			if (prev & DIRTY)
+				m_overwritten.fetch_add(1, std::memory_order_relaxed);
+			m_back = prev & INDEX_MASK;
+		}
+
+		// --- reader side ---
+
+		// Swaps in the newest published value. Returns false if nothing
+		// was published since the previous call.
+		bool Update()
+		{
+			if (!(m_middle.load(std::memory_order_relaxed) & DIRTY))
+				return false;
+			unsigned prev = m_middle.exchange(m_front, std::memory_order_acq_rel);
+			m_front = prev & INDEX_MASK;
+			return true;
+		}
+
+		// Slot owned by the reader until the next Update()
+		const T &ReadSlot() const { return m_slots[m_front]; }
+
+		// Number of published values that were replaced before being read
+		unsigned long long Overwritten() const { return m_overwritten.load(std::memory_order_relaxed); }
+
+	private:
+		TripleBuffer(const TripleBuffer&);
+		TripleBuffer &operator=(const TripleBuffer&);
+
+		enum { INDEX_MASK = 3, DIRTY = 4 };
+
+		T m_slots[3];
+
+		// writer, shared and reader state on separate cache lines
+		unsigned m_back;
+		char m_pad0[64];
+		std::atomic<unsigned> m_middle;
+		char m_pad1[64];
+		unsigned m_front;
+		std::atomic<unsigned long long> m_overwritten;
+	};
+
+//------------------------------------------------------------------
+}
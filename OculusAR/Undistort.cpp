@@ -0,0 +1,401 @@
+#include "Undistort.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+#include "Hash.h"
+#include <cstdio>
+#include <cmath>
+
+#if SIMD_X86
+#	include <emmintrin.h>
+#	include <immintrin.h>
+#endif
+#if SIMD_ARM_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	// LUT entries: (y << 16) | x, both unsigned 11.5 fixed point
+	enum { FRAC_BITS = 5, FRAC_ONE = 1 << FRAC_BITS, FRAC_MASK = FRAC_ONE - 1 };
+	static const unsigned LUT_INVALID = 0xFFFFFFFFu;
+	static const unsigned OUTSIDE_PIXEL = 0xFF000000u;	// opaque black
+
+	static const unsigned CACHE_MAGIC = 0x544C4455;	// "UDLT"
+	static const unsigned CACHE_VERSION = 1;
+
+	// Rough values for the Ovrvision VGA lenses
+	CameraCalibration::CameraCalibration() :
+		fx(410.0f), fy(410.0f), cx(320.0f), cy(240.0f),
+		k1(-0.28f), k2(0.08f), k3(0.0f), p1(0.0f), p2(0.0f)
+	{
+	}
+
+	UndistortMap::UndistortMap() : m_width(0), m_height(0), m_fromCache(false)
+	{
+	}
+
+	bool UndistortMap::Init(int width, int height, const CameraCalibration calibration[2],
+		float interocular, float scale, const char *cacheDir)
+	{
+		// x and y have 11 integer bits, the last column is only a bilinear neighbour
+		if (width < 2 || height < 2 || width > 2048 || height > 2048 || scale <= 0.0f)
+			return false;
+
+		m_width = width;
+		m_height = height;
+		m_fromCache = false;
+
+		unsigned long long key = HashBytes(&CACHE_VERSION, sizeof(CACHE_VERSION));
+		key = HashBytes(&width, sizeof(width), key);
+		key = HashBytes(&height, sizeof(height), key);
+		key = HashBytes(calibration, sizeof(CameraCalibration) * 2, key);
+		key = HashBytes(&interocular, sizeof(interocular), key);
+		key = HashBytes(&scale, sizeof(scale), key);
+
+		char path[512] = "";
+		if (cacheDir)
+		{
+			snprintf(path, sizeof(path), "%s/undistort_%016llx.lut", cacheDir, key);
+			if (m_load(path, key))
+			{
+				m_fromCache = true;
+				return true;
+			}
+		}
+
+		m_build(0, calibration[0], interocular * 0.5f, scale);
+		m_build(1, calibration[1], -interocular * 0.5f, scale);
+		if (cacheDir)
+			m_save(path, key);
+		return true;
+	}
+
+	void UndistortMap::m_build(int eye, const CameraCalibration &c, float shift, float scale)
+	{
+		std::vector<unsigned int> &lut = m_lut[eye];
+		lut.resize(m_width * m_height);
+
+		// samples must keep one pixel to the right and below for the bilinear fetch
+		const int maxX = (m_width - 1) * FRAC_ONE - 1;
+		const int maxY = (m_height - 1) * FRAC_ONE - 1;
+
+		for (int v = 0; v < m_height; v++)
+		{
+			for (int u = 0; u < m_width; u++)
+			{
+				// ideal normalized coordinates of the output pixel
+				const float x = (u - c.cx) / (c.fx * scale) - shift;
+				const float y = (v - c.cy) / (c.fy * scale);
+
+				const float r2 = x * x + y * y;
+				const float radial = 1.0f + r2 * (c.k1 + r2 * (c.k2 + r2 * c.k3));
+				const float xd = x * radial + 2.0f * c.p1 * x * y + c.p2 * (r2 + 2.0f * x * x);
+				const float yd = y * radial + c.p1 * (r2 + 2.0f * y * y) + 2.0f * c.p2 * x * y;
+
+				const float sx = c.fx * xd + c.cx;
+				const float sy = c.fy * yd + c.cy;
+
+				unsigned int entry = LUT_INVALID;
+				if (sx >= -0.5f && sy >= -0.5f && sx <= m_width - 0.5f && sy <= m_height - 0.5f)
+				{
+					int fx = static_cast<int>(std::floor(sx * FRAC_ONE + 0.5f));
+					int fy = static_cast<int>(std::floor(sy * FRAC_ONE + 0.5f));
+					fx = fx < 0 ? 0 : (fx > maxX ? maxX : fx);
+					fy = fy < 0 ? 0 : (fy > maxY ? maxY : fy);
+					entry = (static_cast<unsigned>(fy) << 16) | static_cast<unsigned>(fx);
+				}
+				lut[v * m_width + u] = entry;
+			}
+		}
+	}
+
+	bool UndistortMap::m_load(const char *path, unsigned long long key)
+	{
+		FILE *file = fopen(path, "rb");
+		if (!file)
+			return false;
+
+		unsigned header[4];
+		unsigned long long fileKey = 0;
+		bool ok = fread(header, sizeof(header), 1, file) == 1 && fread(&fileKey, sizeof(fileKey), 1, file) == 1 &&
+			header[0] == CACHE_MAGIC && header[1] == CACHE_VERSION &&
+			static_cast<int>(header[2]) == m_width && static_cast<int>(header[3]) == m_height && fileKey == key;
+
+		for (int eye = 0; ok && eye < 2; eye++)
+		{
+			m_lut[eye].resize(m_width * m_height);
+			ok = fread(&m_lut[eye][0], sizeof(unsigned int), m_lut[eye].size(), file) == m_lut[eye].size();
+		}
+		fclose(file);
+		return ok;
+	}
+
+	void UndistortMap::m_save(const char *path, unsigned long long key) const
+	{
+		FILE *file = fopen(path, "wb");
+		if (!file)
+			return;
+
+		unsigned header[4] = { CACHE_MAGIC, CACHE_VERSION, static_cast<unsigned>(m_width), static_cast<unsigned>(m_height) };
+		bool ok = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(&key, sizeof(key), 1, file) == 1;
+		for (int eye = 0; ok && eye < 2; eye++)
+			ok = fwrite(&m_lut[eye][0], sizeof(unsigned int), m_lut[eye].size(), file) == m_lut[eye].size();
+		fclose(file);
+
+		// never leave a truncated table behind
+		if (!ok)
+			remove(path);
+	}
+
+//------------------------------------------------------------------
+// Row kernels
+//
+// Bilinear filtering in two rounded steps, the same in every path:
+//   top = (tl * (32 - fx) + tr * fx + 16) >> 5
+//   bot = (bl * (32 - fx) + br * fx + 16) >> 5
+//   out = (top * (32 - fy) + bot * fy + 16) >> 5
+
+	typedef void (*RemapRowFn)(const unsigned int *lut, const unsigned char *src, int srcPitch, unsigned int *dst, int x, int width);
+
+	static void s_remapRowScalar(const unsigned int *lut, const unsigned char *src, int srcPitch, unsigned int *dst, int x, int width)
+	{
+		for (; x < width; x++)
+		{
+			const unsigned int e = lut[x];
+			if (e == LUT_INVALID)
+			{
+				dst[x] = OUTSIDE_PIXEL;
+				continue;
+			}
+
+			const unsigned xi = e & 0xFFFF;
+			const unsigned yi = e >> 16;
+			const unsigned fx = xi & FRAC_MASK;
+			const unsigned fy = yi & FRAC_MASK;
+			const unsigned char *tl = src + (yi >> FRAC_BITS) * srcPitch + (xi >> FRAC_BITS) * 4;
+			const unsigned char *bl = tl + srcPitch;
+
+			unsigned char out[4];
+			for (int c = 0; c < 4; c++)
+			{
+				const unsigned top = (tl[c] * (FRAC_ONE - fx) + tl[c + 4] * fx + FRAC_ONE / 2) >> FRAC_BITS;
+				const unsigned bot = (bl[c] * (FRAC_ONE - fx) + bl[c + 4] * fx + FRAC_ONE / 2) >> FRAC_BITS;
+				out[c] = static_cast<unsigned char>((top * (FRAC_ONE - fy) + bot * fy + FRAC_ONE / 2) >> FRAC_BITS);
+			}
+			dst[x] = out[0] | (out[1] << 8) | (out[2] << 16) | (static_cast<unsigned>(out[3]) << 24);
+		}
+	}
+
+#if SIMD_X86
+	// Weights of 2 pixels (low 32 bits = pixel 0, next = pixel 1) spread to their 4 channels
+	static inline __m128i s_lerp16(__m128i a, __m128i b, __m128i w)
+	{
+		const __m128i one = _mm_set1_epi16(FRAC_ONE);
+		const __m128i half = _mm_set1_epi16(FRAC_ONE / 2);
+		__m128i v = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(one, w)), _mm_mullo_epi16(b, w));
+		return _mm_srli_epi16(_mm_add_epi16(v, half), FRAC_BITS);
+	}
+
+	static void s_remapRowSSE2(const unsigned int *lut, const unsigned char *src, int srcPitch, unsigned int *dst, int x, int width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i invalid = _mm_set1_epi32(static_cast<int>(LUT_INVALID));
+		const __m128i outside = _mm_set1_epi32(static_cast<int>(OUTSIDE_PIXEL));
+		const __m128i fracMask = _mm_set1_epi32(FRAC_MASK);
+
+		for (; x + 4 <= width; x += 4)
+		{
+			const __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lut + x));
+			const __m128i bad = _mm_cmpeq_epi32(e, invalid);
+
+			// no gather before AVX2, fetch the 4x4 texels one by one
+			int tl[4], tr[4], bl[4], br[4];
+			for (int i = 0; i < 4; i++)
+			{
+				unsigned entry = lut[x + i];
+				if (entry == LUT_INVALID)
+					entry = 0;
+				const unsigned char *p = src + ((entry >> 16) >> FRAC_BITS) * srcPitch + ((entry & 0xFFFF) >> FRAC_BITS) * 4;
+				tl[i] = *reinterpret_cast<const int*>(p);
+				tr[i] = *reinterpret_cast<const int*>(p + 4);
+				bl[i] = *reinterpret_cast<const int*>(p + srcPitch);
+				br[i] = *reinterpret_cast<const int*>(p + srcPitch + 4);
+			}
+			const __m128i vtl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tl));
+			const __m128i vtr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tr));
+			const __m128i vbl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bl));
+			const __m128i vbr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(br));
+
+			// weights in both 16 bit halves of each pixel
+			__m128i fx = _mm_and_si128(e, fracMask);
+			__m128i fy = _mm_and_si128(_mm_srli_epi32(e, 16), fracMask);
+			fx = _mm_or_si128(fx, _mm_slli_epi32(fx, 16));
+			fy = _mm_or_si128(fy, _mm_slli_epi32(fy, 16));
+			const __m128i fxLo = _mm_unpacklo_epi32(fx, fx), fxHi = _mm_unpackhi_epi32(fx, fx);
+			const __m128i fyLo = _mm_unpacklo_epi32(fy, fy), fyHi = _mm_unpackhi_epi32(fy, fy);
+
+			const __m128i lo = s_lerp16(
+				s_lerp16(_mm_unpacklo_epi8(vtl, zero), _mm_unpacklo_epi8(vtr, zero), fxLo),
+				s_lerp16(_mm_unpacklo_epi8(vbl, zero), _mm_unpacklo_epi8(vbr, zero), fxLo), fyLo);
+			const __m128i hi = s_lerp16(
+				s_lerp16(_mm_unpackhi_epi8(vtl, zero), _mm_unpackhi_epi8(vtr, zero), fxHi),
+				s_lerp16(_mm_unpackhi_epi8(vbl, zero), _mm_unpackhi_epi8(vbr, zero), fxHi), fyHi);
+
+			__m128i out = _mm_packus_epi16(lo, hi);
+			out = _mm_or_si128(_mm_and_si128(bad, outside), _mm_andnot_si128(bad, out));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), out);
+		}
+		s_remapRowScalar(lut, src, srcPitch, dst, x, width);
+	}
+
+	SIMD_TARGET_AVX2 static inline __m256i s_lerp16x16(__m256i a, __m256i b, __m256i w)
+	{
+		const __m256i one = _mm256_set1_epi16(FRAC_ONE);
+		const __m256i half = _mm256_set1_epi16(FRAC_ONE / 2);
+		__m256i v = _mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_sub_epi16(one, w)), _mm256_mullo_epi16(b, w));
+		return _mm256_srli_epi16(_mm256_add_epi16(v, half), FRAC_BITS);
+	}
+
+	SIMD_TARGET_AVX2 static void s_remapRowAVX2(const unsigned int *lut, const unsigned char *src, int srcPitch, unsigned int *dst, int x, int width)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i invalid = _mm256_set1_epi32(static_cast<int>(LUT_INVALID));
+		const __m256i outside = _mm256_set1_epi32(static_cast<int>(OUTSIDE_PIXEL));
+		const __m256i fracMask = _mm256_set1_epi32(FRAC_MASK);
+		const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+		const __m256i stride = _mm256_set1_epi32(srcPitch / 4);
+		const __m256i one = _mm256_set1_epi32(1);
+		const int *texels = reinterpret_cast<const int*>(src);
+
+		for (; x + 8 <= width; x += 8)
+		{
+			__m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lut + x));
+			const __m256i bad = _mm256_cmpeq_epi32(e, invalid);
+			e = _mm256_andnot_si256(bad, e);	// invalid entries fetch texel 0
+
+			const __m256i xi = _mm256_and_si256(e, lowMask);
+			const __m256i yi = _mm256_srli_epi32(e, 16);
+			const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(yi, FRAC_BITS), stride),
+				_mm256_srli_epi32(xi, FRAC_BITS));
+
+			const __m256i tl = _mm256_i32gather_epi32(texels, index, 4);
+			const __m256i tr = _mm256_i32gather_epi32(texels, _mm256_add_epi32(index, one), 4);
+			const __m256i bl = _mm256_i32gather_epi32(texels, _mm256_add_epi32(index, stride), 4);
+			const __m256i br = _mm256_i32gather_epi32(texels, _mm256_add_epi32(_mm256_add_epi32(index, stride), one), 4);
+
+			__m256i fx = _mm256_and_si256(xi, fracMask);
+			__m256i fy = _mm256_and_si256(yi, fracMask);
+			fx = _mm256_or_si256(fx, _mm256_slli_epi32(fx, 16));
+			fy = _mm256_or_si256(fy, _mm256_slli_epi32(fy, 16));
+			const __m256i fxLo = _mm256_unpacklo_epi32(fx, fx), fxHi = _mm256_unpackhi_epi32(fx, fx);
+			const __m256i fyLo = _mm256_unpacklo_epi32(fy, fy), fyHi = _mm256_unpackhi_epi32(fy, fy);
+
+			const __m256i lo = s_lerp16x16(
+				s_lerp16x16(_mm256_unpacklo_epi8(tl, zero), _mm256_unpacklo_epi8(tr, zero), fxLo),
+				s_lerp16x16(_mm256_unpacklo_epi8(bl, zero), _mm256_unpacklo_epi8(br, zero), fxLo), fyLo);
+			const __m256i hi = s_lerp16x16(
+				s_lerp16x16(_mm256_unpackhi_epi8(tl, zero), _mm256_unpackhi_epi8(tr, zero), fxHi),
+				s_lerp16x16(_mm256_unpackhi_epi8(bl, zero), _mm256_unpackhi_epi8(br, zero), fxHi), fyHi);
+
+			// unpack and pack both stay inside 128 bit lanes, so pixel order is kept
+			const __m256i out = _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), outside, bad);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), out);
+		}
+		s_remapRowScalar(lut, src, srcPitch, dst, x, width);
+	}
+#endif
+
+#if SIMD_ARM_NEON
+	static inline uint16x8_t s_lerpNEON(uint16x8_t a, uint16x8_t b, uint16x8_t w)
+	{
+		uint16x8_t v = vmlaq_u16(vmulq_u16(a, vsubq_u16(vdupq_n_u16(FRAC_ONE), w)), b, w);
+		return vshrq_n_u16(vaddq_u16(v, vdupq_n_u16(FRAC_ONE / 2)), FRAC_BITS);
+	}
+
+	static void s_remapRowNEON(const unsigned int *lut, const unsigned char *src, int srcPitch, unsigned int *dst, int x, int width)
+	{
+		for (; x + 2 <= width; x += 2)
+		{
+			if (lut[x] == LUT_INVALID || lut[x + 1] == LUT_INVALID)
+			{
+				s_remapRowScalar(lut, src, srcPitch, dst, x, x + 2);
+				continue;
+			}
+
+			// two pixels per iteration: 2 x 4 channels fill one 16 bit vector
+			uint32_t tl[2], tr[2], bl[2], br[2];
+			uint16_t fx[8], fy[8];
+			for (int i = 0; i < 2; i++)
+			{
+				const unsigned e = lut[x + i];
+				const unsigned char *p = src + ((e >> 16) >> FRAC_BITS) * srcPitch + ((e & 0xFFFF) >> FRAC_BITS) * 4;
+				tl[i] = *reinterpret_cast<const uint32_t*>(p);
+				tr[i] = *reinterpret_cast<const uint32_t*>(p + 4);
+				bl[i] = *reinterpret_cast<const uint32_t*>(p + srcPitch);
+				br[i] = *reinterpret_cast<const uint32_t*>(p + srcPitch + 4);
+				for (int c = 0; c < 4; c++)
+				{
+					fx[i * 4 + c] = static_cast<uint16_t>(e & FRAC_MASK);
+					fy[i * 4 + c] = static_cast<uint16_t>((e >> 16) & FRAC_MASK);
+				}
+			}
+
+			const uint16x8_t wx = vld1q_u16(fx), wy = vld1q_u16(fy);
+			#define TEXELS(t) vmovl_u8(vreinterpret_u8_u32(vld1_u32(t)))
+			const uint16x8_t top = s_lerpNEON(TEXELS(tl), TEXELS(tr), wx);
+			const uint16x8_t bot = s_lerpNEON(TEXELS(bl), TEXELS(br), wx);
+			#undef TEXELS
+			vst1_u8(reinterpret_cast<uint8_t*>(dst + x), vmovn_u16(s_lerpNEON(top, bot, wy)));
+		}
+		s_remapRowScalar(lut, src, srcPitch, dst, x, width);
+	}
+#endif
+
+	static RemapRowFn s_pickRow(eSimdLevel level)
+	{
+#if SIMD_X86
+		if (level == SIMD_AVX2)
+			return s_remapRowAVX2;
+		if (level == SIMD_SSE2)
+			return s_remapRowSSE2;
+#elif SIMD_ARM_NEON
+		if (level == SIMD_NEON)
+			return s_remapRowNEON;
+#endif
+		(void)level;
+		return s_remapRowScalar;
+	}
+
+//------------------------------------------------------------------
+
+	void UndistortMap::Apply(int eye, const unsigned char *src, int srcPitch,
+		unsigned char *dst, int dstPitch, ThreadPool *pool) const
+	{
+		const RemapRowFn row = s_pickRow(Simd::Level());
+		const unsigned int *lut = &m_lut[eye][0];
+		const int width = m_width;
+
+		auto rows = [=](int begin, int end)
+		{
+			for (int y = begin; y < end; y++)
+				row(lut + y * width, src, srcPitch, reinterpret_cast<unsigned int*>(dst + y * dstPitch), 0, width);
+		};
+
+		if (pool)
+			pool->ParallelFor(m_height, 16, rows);
+		else
+			rows(0, m_height);
+	}
+
+	void UndistortMap::ApplyReference(int eye, const unsigned char *src, int srcPitch,
+		unsigned char *dst, int dstPitch) const
+	{
+		const unsigned int *lut = &m_lut[eye][0];
+		for (int y = 0; y < m_height; y++)
+			s_remapRowScalar(lut + y * m_width, src, srcPitch, reinterpret_cast<unsigned int*>(dst + y * dstPitch), 0, m_width);
+	}
+
+//------------------------------------------------------------------
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+
+namespace D3D11Framework
+{
+//------------------------------------------------------------------
+
+	class ThreadPool;
+
+	// Pinhole intrinsics and Brown-Conrady distortion of one camera, in pixels
+	struct CameraCalibration
+	{
+		CameraCalibration();
+
+		float fx, fy;		// focal length
+		float cx, cy;		// principal point
+		float k1, k2, k3;	// radial
+		float p1, p2;		// tangential
+	};
+
+	// Removes lens distortion from both camera images.
+	//
+	// For every output pixel a lookup table stores where to sample the
+	// camera image, as 11.5 fixed point x and y packed into 32 bits. The
+	// tables are built once per calibration and cached on disk; after that a
+	// frame costs one bilinear fetch per pixel, spread over the thread pool.
+	class UndistortMap
+	{
+	public:
+		UndistortMap();
+
+		// Builds the tables for width x height images, or loads them from
+		// cacheDir if they were built with the same parameters before.
+		// A null cacheDir always builds and writes nothing.
+		// interocular shifts the eyes apart horizontally (in normalized
+		// image units), scale zooms the rectified image.
+		bool Init(int width, int height, const CameraCalibration calibration[2],
+			float interocular, float scale, const char *cacheDir = ".");
+
+		// Resamples one RGBA eye image into dst (RGBA, same size). Pixels
+		// mapping outside the camera image become opaque black.
+		// pool may be null to run on the calling thread only.
+		void Apply(int eye, const unsigned char *src, int srcPitch,
+			unsigned char *dst, int dstPitch, ThreadPool *pool = nullptr) const;
+
+		// Same as Apply, plain C++ on the calling thread
+		void ApplyReference(int eye, const unsigned char *src, int srcPitch,
+			unsigned char *dst, int dstPitch) const;
+
+		int Width() const { return m_width; }
+		int Height() const { return m_height; }
+		// True if Init found the tables in the cache
+		bool FromCache() const { return m_fromCache; }
+
+	private:
+		void m_build(int eye, const CameraCalibration &calibration, float shift, float scale);
+		bool m_load(const char *path, unsigned long long key);
+		void m_save(const char *path, unsigned long long key) const;
+
+		int m_width;
+		int m_height;
+		bool m_fromCache;
+		std::vector<unsigned int> m_lut[2];
+	};
+
+//------------------------------------------------------------------
+}
@@ -1,5 +1,9 @@
+// Matrices of all draws of a frame, uploaded at once (RenderDevice::MaxDraws),
+// as many float4x4 as a constant buffer holds
+#define MAX_DRAWS 1024
+
 cbuffer Constants {
-	float4x4 mvp;
+	float4x4 mvp[MAX_DRAWS];
 };
 
 Texture2D ObjTexture;
@@ -10,9 +14,11 @@ struct VS_OUTPUT
 	float4 Pos : SV_POSITION; 
 	float4 TexCoord : TEXCOORD;
 };
-VS_OUTPUT VS(float4 Pos : POSITION, float4 TexCoord : TEXCOORD) {
+// DrawIndex comes per instance from a buffer holding 0, 1, 2, ..., every draw starts
+// its single instance at its own matrix.
+VS_OUTPUT VS(float4 Pos : POSITION, float4 TexCoord : TEXCOORD, uint DrawIndex : DRAWINDEX) {
 	VS_OUTPUT output = (VS_OUTPUT)0;
-	output.Pos = mul(mvp, Pos);
+	output.Pos = mul(mvp[DrawIndex], Pos);
 	output.TexCoord = TexCoord;
 	return output;
 };
@@ -20,4 +26,31 @@ VS_OUTPUT VS(float4 Pos : POSITION, float4 TexCoord : TEXCOORD) {
 float4 PS(VS_OUTPUT input) : SV_Target
 {
 	return ObjTexture.Sample(ObjSamplerState, input.TexCoord); 
-};
\ No newline at end of file
+};
+
+// Instanced overlay quads, all of an eye in one draw (OverlayInstance). The
+// matrix comes as the four columns of the mvp, the texture rectangle as
+// u0 v0 u1 v1 and the slice picks the image from the overlay array.
+Texture2DArray OverlayTextures;
+
+struct VS_OUTPUT_INSTANCED
+{
+	float4 Pos : SV_POSITION;
+	float2 TexCoord : TEXCOORD;
+	nointerpolation uint Slice : SLICE;
+};
+
+VS_OUTPUT_INSTANCED VSInstanced(float4 Pos : POSITION, float2 TexCoord : TEXCOORD,
+	float4 Column0 : INSTANCEMVP0, float4 Column1 : INSTANCEMVP1, float4 Column2 : INSTANCEMVP2, float4 Column3 : INSTANCEMVP3,
+	float4 UvRect : UVRECT, uint Slice : SLICE) {
+	VS_OUTPUT_INSTANCED output = (VS_OUTPUT_INSTANCED)0;
+	output.Pos = mul(Pos, float4x4(Column0, Column1, Column2, Column3));
+	output.TexCoord = UvRect.xy + TexCoord * (UvRect.zw - UvRect.xy);
+	output.Slice = Slice;
+	return output;
+};
+
+float4 PSInstanced(VS_OUTPUT_INSTANCED input) : SV_Target
+{
+	return OverlayTextures.Sample(ObjSamplerState, float3(input.TexCoord, input.Slice));
+};